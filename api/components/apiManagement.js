@@ -9,6 +9,7 @@ const dataManagement = require('./dataManagement');
 const deviceManagement = require('./deviceManagement');
 const liveManagement = require('./liveManagement');
 const historyManagement = require('./historyManagement');
+const rulesCompiler = require('./rulesCompiler');
 
 // Init CORS
 app.use(cors({ origin: '*' }));
@@ -25,6 +26,7 @@ app.get('/', function (req, res) {
             '/devices/[MAC_ADDRESS]/status/[SENSOR]',
             '/devices/[MAC_ADDRESS]/history/[SENSOR]',
             '/devices/[MAC_ADDRESS]/control/[SENSOR]/[ON,OFF]',
+            '/devices/[MAC_ADDRESS]/rules (POST)',
         ]
     });
 });
@@ -97,9 +99,9 @@ app.get('/devices/:mac/control/light/on', function (req, res) {
     // Check it client is set
     if (liveManagement.areDeviceListening()) {
         // Send MQTT message
-        liveManagement.publish('unishare/control/' + req.params.mac + '/light', '{"control": "on"}');
+        const id = liveManagement.publishCommand(req.params.mac, 'light', 'on');
         // Send response
-        res.status(200).json({ status: 'ON', success: true });
+        res.status(200).json({ status: 'ON', success: true, id: id });
         // Log
         logger.info('Light of ' + req.params.mac + ' turned ON.');
     } else {
@@ -116,9 +118,9 @@ app.get('/devices/:mac/control/light/off', function (req, res) {
     // Check it client is set
     if (liveManagement.areDeviceListening()) {
         // Send MQTT message
-        liveManagement.publish('unishare/control/' + req.params.mac + '/light', '{"control": "off"}');
+        const id = liveManagement.publishCommand(req.params.mac, 'light', 'off');
         // Send response
-        res.status(200).json({ status: 'OFF', success: true });
+        res.status(200).json({ status: 'OFF', success: true, id: id });
         // Log
         logger.info('Light of ' + req.params.mac + ' turned OFF.');
     } else {
@@ -135,9 +137,9 @@ app.get('/devices/:mac/control/air/on', function (req, res) {
     // Check it client is set
     if (liveManagement.areDeviceListening()) {
         // Send MQTT message
-        liveManagement.publish('unishare/control/' + req.params.mac + '/ac', '{"control": "on"}');
+        const id = liveManagement.publishCommand(req.params.mac, 'ac', 'on');
         // Send response
-        res.status(200).json({ status: 'ON', success: true });
+        res.status(200).json({ status: 'ON', success: true, id: id });
         // Log
         logger.info('Air of ' + req.params.mac + ' turned ON.');
     } else {
@@ -154,9 +156,9 @@ app.get('/devices/:mac/control/air/off', function (req, res) {
     // Check it client is set
     if (liveManagement.areDeviceListening()) {
         // Send MQTT message
-        liveManagement.publish('unishare/control/' + req.params.mac + '/ac', '{"control": "off"}');
+        const id = liveManagement.publishCommand(req.params.mac, 'ac', 'off');
         // Send response
-        res.status(200).json({ status: 'OFF', success: true });
+        res.status(200).json({ status: 'OFF', success: true, id: id });
         // Log
         logger.info('Air of ' + req.params.mac + ' turned OFF.');
     } else {
@@ -167,6 +169,34 @@ app.get('/devices/:mac/control/air/off', function (req, res) {
     }
 });
 
+// RULES
+// -------------------------------------
+// Compile automation rules and push them to the device (an empty list removes them)
+app.post('/devices/:mac/rules', express.json(), function (req, res) {
+    // Compile
+    let program;
+    try {
+        program = (Array.isArray(req.body) && !req.body.length) ? '' : rulesCompiler.compile(req.body).toString('hex');
+    } catch (error) {
+        res.status(400).json({ success: false, error: error.message });
+        return;
+    }
+    // Check it client is set
+    if (liveManagement.areDeviceListening()) {
+        // Send MQTT message
+        liveManagement.publish('unishare/control/' + req.params.mac + '/rules', JSON.stringify({ program: program }));
+        // Send response
+        res.status(200).json({ success: true, size: program.length / 2 });
+        // Log
+        logger.info('Rules of ' + req.params.mac + ' updated (' + program.length / 2 + ' bytes).');
+    } else {
+        // Send response
+        res.status(500).json({ success: false });
+        // Log
+        logger.warning('Rules of ' + req.params.mac + ' not updated.');
+    }
+});
+
 
 // HISTORY (READ-ONLY)
 // -------------------------------------
@@ -43,6 +43,23 @@ module.exports.publish = function(topic, message) {
     });
 };
 
+// Commands waiting for the device acknowledgement (id => sent time)
+const pendingCommands = new Map();
+// Sequence number of the last command, ms since the epoch so that it keeps
+// increasing across restarts (the devices drop commands that are not newer)
+let lastCommandSeq = 0;
+
+module.exports.publishCommand = function(mac, actuator, control) {
+    // Tag the command with a correlation id, echoed back in the device ack
+    const id = Date.now().toString(36) + Math.random().toString(36).substring(2, 6);
+    pendingCommands.set(id, Date.now());
+    // Forget the oldest commands of devices that never answered
+    if (pendingCommands.size > 100) pendingCommands.delete(pendingCommands.keys().next().value);
+    lastCommandSeq = Math.max(Date.now(), lastCommandSeq + 1);
+    module.exports.publish('unishare/control/' + mac + '/' + actuator, JSON.stringify({ control: control, id: id, seq: lastCommandSeq }));
+    return id;
+};
+
 module.exports.areDeviceListening = function() {
     // Return TRUE if client is set up
     return mqttClient ? true : false;
@@ -73,6 +90,11 @@ const on_connected = async function() {
     // Connected to MQTT broker
     logger.debug('Subscribing to all MQTT topics for each devices...');
     
+    // Subscribe to command acknowledgements of all devices
+    subscribe('unishare/acks/+/+');
+    // Subscribe to local interlock overrides of all devices
+    subscribe('unishare/interlock/+');
+
     // Subscribe to all topics for each devices
     for (let i = 0; i < devices.length; i++) {
         const device = devices[i];
@@ -96,7 +118,25 @@ const on_message = async function (topic, message) {
     // Log message
     logger.debug('MQTT message: ' + message.toString() + ' from device ' +  device);
     // Check topic
-    if (topic.includes('flame')) {
+    if (topic.startsWith('unishare/acks/')) {
+        // Get actuator
+        const actuator = topic.split('/')[3];
+        // Get round trip time of the command
+        const sent = data.id ? pendingCommands.get(data.id) : undefined;
+        if (sent) pendingCommands.delete(data.id);
+        const rtt = sent ? (Date.now() - sent) + ' ms' : 'N/A';
+        // Log
+        const outcome = data.applied ? 'applied' : data.dropped ? 'dropped (' + data.dropped + ')' : 'rejected';
+        logger.info('Device ' + device + ' ' + outcome + ' ' + actuator + ' command ' + (data.id || '') +
+            ': state ' + data.state + ', on-device latency ' + data.latency_us + ' us, round trip ' + rtt);
+    }
+    else if (topic.startsWith('unishare/interlock/')) {
+        // Actuators already switched by the device
+        const actions = ['light', 'ac'].filter(a => data[a]).map(a => a + ' ' + data[a]).join(', ');
+        logger.warning('Device ' + device + ' interlock rule ' + data.rule + ' on ' + data.metric + ' (' + data.value + ') ' +
+            (data.active ? 'tripped: ' + actions : 'released'));
+    }
+    else if (topic.includes('flame')) {
         // Get fire data
         const fire = data.value || false;
         // Set fire data
@@ -0,0 +1,140 @@
+// Compiler of the automation rules run on the sensors nodes.
+// Rules are JSON:
+//   [{ "if": <condition>, "then": { "light": "on" }, "else": { "ac": "off" } }, ...]
+// with conditions
+//   { "metric": "temperature", "above": 28, "hysteresis": 1, "for": 60000 }
+//   { "metric": "light", "below": 300 }
+//   { "all": [ ... ] }, { "any": [ ... ] }, { "not": <condition> }
+// and the output is the bytecode of the firmware rules VM (see rules_vm.h).
+
+const MAGIC = 0x52; // 'R'
+const FORMAT = 1;
+const MAX_PROGRAM = 256;
+const MAX_METRICS = 8;
+const REGISTERS = 8;
+const TIMERS = 4;
+
+const OP = {
+    END: 0x00, METRIC: 0x01, CONST: 0x02, LOAD: 0x03, STORE: 0x04,
+    GT: 0x10, LT: 0x11, AND: 0x20, OR: 0x21, NOT: 0x22,
+    HYST: 0x30, HELD: 0x31, JZ: 0x40, WRITE: 0x50,
+};
+const ACTUATORS = { light: 0, ac: 1 };
+
+class Program {
+    constructor() {
+        this.metrics = [];
+        this.code = [];
+        this.registers = 0;
+        this.timers = 0;
+    }
+    emit(...bytes) {
+        this.code.push(...bytes);
+    }
+    constant(value) {
+        const buffer = Buffer.alloc(4);
+        buffer.writeFloatLE(value);
+        this.emit(OP.CONST, ...buffer);
+    }
+    metric(name) {
+        if (typeof name !== 'string' || !name.length || name.length > 31) throw new Error('Invalid metric name');
+        let slot = this.metrics.indexOf(name);
+        if (slot < 0) {
+            if (this.metrics.length === MAX_METRICS) throw new Error('Too many metrics');
+            slot = this.metrics.push(name) - 1;
+        }
+        this.emit(OP.METRIC, slot);
+    }
+    register() {
+        if (this.registers === REGISTERS) throw new Error('Too many rules or hysteresis conditions');
+        return this.registers++;
+    }
+    timer() {
+        if (this.timers === TIMERS) throw new Error('Too many "for" conditions');
+        return this.timers++;
+    }
+    bytes() {
+        const header = [MAGIC, FORMAT, this.metrics.length];
+        for (const name of this.metrics) header.push(name.length, ...Buffer.from(name, 'ascii'));
+        const program = Buffer.from([...header, ...this.code, OP.END]);
+        if (program.length > MAX_PROGRAM) throw new Error('Program too large (' + program.length + ' bytes)');
+        return program;
+    }
+}
+
+const number = function(value, what) {
+    if (typeof value !== 'number' || !isFinite(value)) throw new Error('Invalid ' + what);
+    return value;
+};
+
+const compileCondition = function(program, condition) {
+    if (!condition || typeof condition !== 'object') throw new Error('Invalid condition');
+
+    if (Array.isArray(condition.all) || Array.isArray(condition.any)) {
+        const list = condition.all || condition.any;
+        if (!list.length) throw new Error('Empty condition list');
+        list.forEach((item, i) => {
+            compileCondition(program, item);
+            if (i > 0) program.emit(condition.all ? OP.AND : OP.OR);
+        });
+        return;
+    }
+    if (condition.not !== undefined) {
+        compileCondition(program, condition.not);
+        program.emit(OP.NOT);
+        return;
+    }
+
+    // comparison on a metric
+    const above = condition.above !== undefined;
+    if (above === (condition.below !== undefined)) throw new Error('A condition needs either "above" or "below"');
+    const threshold = number(above ? condition.above : condition.below, 'threshold');
+    program.metric(condition.metric);
+    if (condition.hysteresis !== undefined) {
+        // latched: trips past the threshold, released once back by the hysteresis
+        const hysteresis = number(condition.hysteresis, 'hysteresis');
+        if (hysteresis < 0) throw new Error('Invalid hysteresis');
+        program.constant(above ? threshold - hysteresis : threshold);
+        program.constant(above ? threshold : threshold + hysteresis);
+        program.emit(OP.HYST, program.register());
+        if (!above) program.emit(OP.NOT);
+    } else {
+        program.constant(threshold);
+        program.emit(above ? OP.GT : OP.LT);
+    }
+    if (condition.for !== undefined) {
+        const ms = number(condition.for, '"for" time');
+        if (ms < 0 || ms > 0xFFFFFFFF) throw new Error('Invalid "for" time');
+        const duration = Buffer.alloc(4);
+        duration.writeUInt32LE(Math.round(ms));
+        program.emit(OP.HELD, program.timer(), ...duration);
+    }
+};
+
+const compileActions = function(program, condition_register, negate, actions) {
+    const block = new Program();
+    for (const [actuator, state] of Object.entries(actions)) {
+        if (ACTUATORS[actuator] === undefined) throw new Error('Unknown actuator ' + actuator);
+        if (state !== 'on' && state !== 'off') throw new Error('Invalid state for ' + actuator);
+        block.constant(state === 'on' ? 1 : 0);
+        block.emit(OP.WRITE, ACTUATORS[actuator]);
+    }
+    program.emit(OP.LOAD, condition_register);
+    if (negate) program.emit(OP.NOT);
+    program.emit(OP.JZ, block.code.length);
+    program.emit(...block.code);
+};
+
+module.exports.compile = function(rules) {
+    if (!Array.isArray(rules) || !rules.length) throw new Error('Rules must be a non empty list');
+    const program = new Program();
+    for (const rule of rules) {
+        if (!rule || (!rule.then && !rule.else)) throw new Error('A rule needs "then" or "else"');
+        compileCondition(program, rule.if);
+        const condition_register = program.register();
+        program.emit(OP.STORE, condition_register);
+        if (rule.then) compileActions(program, condition_register, false, rule.then);
+        if (rule.else) compileActions(program, condition_register, true, rule.else);
+    }
+    return program.bytes();
+};
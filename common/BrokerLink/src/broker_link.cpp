@@ -0,0 +1,184 @@
+#include "broker_link.h"
+
+#include <ESP8266WiFi.h>
+#include <WiFiClientSecureBearSSL.h>
+
+#include <crc32.h>
+#include <rtc_layout.h>
+
+#define TLS_RTC_MAGIC 0x544C5331
+#define TLS_FULL_FRAGMENT 16384 // TLS record size without MFL
+#define TLS_XMIT_BUFFER 512     // MQTT publishes fit, larger ones are split in records
+
+// BearSSL::Session only wraps the session parameters, which are copied to
+// and from RTC memory as they are
+static_assert(sizeof(BearSSL::Session) == sizeof(br_ssl_session_parameters), "unexpected BearSSL::Session layout");
+
+// TLS state kept in RTC memory across reconnects, resets and deep sleep
+typedef struct tls_rtc_state
+{
+    uint32_t magic;
+    uint32_t crc;
+    uint32_t peer;     // checksum of host, port and fingerprint the state belongs to
+    uint16_t fragment; // negotiated MFL, 0 if not supported
+    uint8_t probed;    // MFL support already probed
+    uint8_t reserved;
+    br_ssl_session_parameters session; // zeroed until the first full handshake
+} tls_rtc_state_t;
+
+static_assert(sizeof(tls_rtc_state_t) % 4 == 0, "RTC state must be block aligned");
+static_assert(sizeof(tls_rtc_state_t) <= RTC_TLS_BLOCKS * 4, "RTC state exceeds its slot");
+
+// Only ECDHE with ECDSA certificates: much cheaper than RSA on this CPU
+static const uint16_t ec_ciphers[] = {
+    BR_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256,
+    BR_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+    BR_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+};
+
+static WiFiClient plain_client;
+static BearSSL::WiFiClientSecure secure_client;
+static BearSSL::Session tls_session;
+static tls_rtc_state_t rtc_state;
+static bool rtc_loaded = false;
+
+static const char *link_host = "";
+static uint16_t link_port = 0;
+static uint16_t link_fragment = 0;
+static bool link_secure = false;
+static uint32_t handshake_ms = 0;
+static bool resumed = false;
+
+static br_ssl_session_parameters *sessionParameters()
+{
+    return reinterpret_cast<br_ssl_session_parameters *>(&tls_session);
+}
+
+static uint32_t stateCrc()
+{
+    return crc32((const uint8_t *)&rtc_state + 8, sizeof(rtc_state) - 8);
+}
+
+static void saveState()
+{
+    memcpy(&rtc_state.session, sessionParameters(), sizeof(rtc_state.session));
+    rtc_state.magic = TLS_RTC_MAGIC;
+    rtc_state.crc = stateCrc();
+    ESP.rtcUserMemoryWrite(RTC_TLS_OFFSET, (uint32_t *)&rtc_state, sizeof(rtc_state));
+}
+
+static void loadState(uint32_t peer)
+{
+    if (!rtc_loaded)
+    {
+        ESP.rtcUserMemoryRead(RTC_TLS_OFFSET, (uint32_t *)&rtc_state, sizeof(rtc_state));
+        rtc_loaded = true;
+        if (rtc_state.magic != TLS_RTC_MAGIC || rtc_state.crc != stateCrc())
+            memset(&rtc_state, 0, sizeof(rtc_state)); // power on or corrupted state
+    }
+    if (rtc_state.peer != peer)
+    {
+        // another broker or certificate, nothing to resume
+        memset(&rtc_state, 0, sizeof(rtc_state));
+        rtc_state.peer = peer;
+    }
+    memcpy(sessionParameters(), &rtc_state.session, sizeof(rtc_state.session));
+}
+
+Client &brokerLinkSetup(const char *host, uint16_t port, const char *fingerprint, uint16_t fragment)
+{
+    plain_client.stop();
+    secure_client.stop();
+
+    link_host = host;
+    link_port = port;
+    link_fragment = fragment;
+    link_secure = fingerprint != NULL && fingerprint[0] != '\0';
+    if (!link_secure)
+        return plain_client;
+
+    uint32_t peer = crc32(host, strlen(host));
+    peer = crc32(&port, sizeof(port), peer);
+    peer = crc32(fingerprint, strlen(fingerprint), peer);
+    loadState(peer);
+
+    secure_client.setFingerprint(fingerprint);
+    secure_client.setCiphers(ec_ciphers, sizeof(ec_ciphers) / sizeof(ec_ciphers[0]));
+    secure_client.setSession(&tls_session);
+    secure_client.setTimeout(BROKER_LINK_HANDSHAKE_TIMEOUT);
+    return secure_client;
+}
+
+bool brokerLinkOpen()
+{
+    if (!link_secure)
+    {
+        plain_client.stop();
+        uint32_t start = millis();
+        bool ok = plain_client.connect(link_host, link_port) > 0;
+        handshake_ms = millis() - start;
+        resumed = false;
+        return ok;
+    }
+
+    secure_client.stop();
+    if (link_fragment > 0 && !rtc_state.probed)
+    {
+        // one ClientHello/ServerHello round trip, once per power cycle
+        if (BearSSL::WiFiClientSecure::probeMaxFragmentLength(link_host, link_port, link_fragment))
+            rtc_state.fragment = link_fragment;
+        rtc_state.probed = 1;
+        saveState();
+    }
+    if (link_fragment > 0 && rtc_state.fragment == link_fragment)
+        secure_client.setBufferSizes(link_fragment, link_fragment);
+    else
+        secure_client.setBufferSizes(TLS_FULL_FRAGMENT, TLS_XMIT_BUFFER);
+
+    br_ssl_session_parameters previous = *sessionParameters();
+    uint32_t start = millis();
+    bool ok = secure_client.connect(link_host, link_port) > 0;
+    handshake_ms = millis() - start;
+    if (!ok)
+    {
+        resumed = false;
+        return false;
+    }
+
+    // the server echoes the cached session id when it accepts to resume
+    const br_ssl_session_parameters *current = sessionParameters();
+    resumed = previous.session_id_len > 0 &&
+              previous.session_id_len == current->session_id_len &&
+              memcmp(previous.session_id, current->session_id, current->session_id_len) == 0;
+    if (!resumed)
+        saveState(); // new session, keep it for the next connection
+    return true;
+}
+
+void brokerLinkFlush()
+{
+    if (link_secure)
+        secure_client.flush();
+    else
+        plain_client.flush();
+}
+
+bool brokerLinkSecure()
+{
+    return link_secure;
+}
+
+uint32_t brokerLinkHandshakeMs()
+{
+    return handshake_ms;
+}
+
+bool brokerLinkResumed()
+{
+    return resumed;
+}
+
+uint16_t brokerLinkFragment()
+{
+    return link_secure ? rtc_state.fragment : 0;
+}
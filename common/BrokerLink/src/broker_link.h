@@ -0,0 +1,38 @@
+#ifndef BROKER_LINK_H
+#define BROKER_LINK_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+// Network connection to the MQTT broker, plain TCP or TLS.
+// TLS is enabled by a pinned SHA-1 fingerprint of the broker certificate
+// (no chain validation, so no CA store and no wall clock needed) and is
+// tuned to keep the handshake short on the ESP8266:
+//   - only ECDHE-ECDSA suites, the broker needs an EC (P-256) certificate
+//   - the session is cached in RTC memory and resumed on every reconnect,
+//     also after a deep sleep, which skips the key exchange altogether
+//   - Maximum Fragment Length is negotiated (probed once per boot) so that
+//     the TLS buffers shrink from 16 KB to a few hundred bytes.
+// The MQTT session is then started on top of the open connection with
+// mqttClient.connect(id, username, password, true).
+
+#define BROKER_LINK_FINGERPRINT_LEN 60 // "AA:BB:..." 20 bytes as hex, with separators
+#define BROKER_LINK_HANDSHAKE_TIMEOUT 15000 // ms
+
+// Select the transport (TLS if fingerprint is not empty, fragment is the
+// requested MFL in bytes, 0 to keep full size buffers). Call while
+// disconnected, the returned client is the one to give to the MQTT client.
+Client &brokerLinkSetup(const char *host, uint16_t port, const char *fingerprint, uint16_t fragment);
+// Open the connection, false on network or TLS failure
+bool brokerLinkOpen();
+// Push out the data still buffered (TLS records, TCP segments)
+void brokerLinkFlush();
+bool brokerLinkSecure();
+// Duration of the last connection setup (TCP + TLS handshake) in ms
+uint32_t brokerLinkHandshakeMs();
+// The last handshake resumed a cached session
+bool brokerLinkResumed();
+// Negotiated fragment length, 0 if the broker doesn't support MFL
+uint16_t brokerLinkFragment();
+
+#endif
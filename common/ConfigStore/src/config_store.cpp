@@ -0,0 +1,229 @@
+#include "config_store.h"
+
+#include <LittleFS.h>
+
+#include <crc32.h>
+
+#define CONFIG_STORE_MAGIC 0x46434D48 // "HMCF"
+#define CONFIG_STORE_PATCH_MAX 512    // largest struct configStorePatch() can stage
+#define CONFIG_STORE_CHUNK 64         // stack used by configStoreLoad() to check a blob
+
+typedef struct config_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t crc;
+} config_header_t;
+
+static const config_field_t *findField(const config_field_t *fields, size_t n_fields, const char *key)
+{
+    for (size_t i = 0; i < n_fields; i++)
+    {
+        if (strcmp(fields[i].key, key) == 0)
+            return &fields[i];
+    }
+    return NULL;
+}
+
+static uint32_t readNumber(const uint8_t *bytes, const config_field_t *field)
+{
+    if (field->type == CONFIG_U8)
+        return bytes[field->offset];
+    if (field->type == CONFIG_U16)
+    {
+        uint16_t value;
+        memcpy(&value, bytes + field->offset, sizeof(value));
+        return value;
+    }
+    uint32_t value;
+    memcpy(&value, bytes + field->offset, sizeof(value));
+    return value;
+}
+
+static void writeNumber(uint8_t *bytes, const config_field_t *field, uint32_t value)
+{
+    if (field->type == CONFIG_U8)
+    {
+        bytes[field->offset] = value;
+    }
+    else if (field->type == CONFIG_U16)
+    {
+        uint16_t value16 = value;
+        memcpy(bytes + field->offset, &value16, sizeof(value16));
+    }
+    else
+    {
+        memcpy(bytes + field->offset, &value, sizeof(value));
+    }
+}
+
+bool configStoreBegin()
+{
+    return LittleFS.begin();
+}
+
+bool configStoreLoad(const char *path, uint16_t version, void *data, size_t length)
+{
+    File file = LittleFS.open(path, "r");
+    if (!file)
+        return false;
+
+    config_header_t header;
+    bool ok = length <= CONFIG_STORE_LENGTH_MAX &&
+              file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == CONFIG_STORE_MAGIC &&
+              header.version == version &&
+              header.length == length;
+
+    // Check the CRC through a small chunk first so data is untouched when
+    // the blob is corrupted, whatever its length, then read it in place
+    uint8_t chunk[CONFIG_STORE_CHUNK];
+    uint32_t crc = 0;
+    for (size_t done = 0; ok && done < length; done += sizeof(chunk))
+    {
+        size_t n = length - done < sizeof(chunk) ? length - done : sizeof(chunk);
+        ok = file.read(chunk, n) == n;
+        crc = crc32(chunk, n, crc);
+    }
+    ok = ok && crc == header.crc && file.seek(sizeof(header)) &&
+         file.read((uint8_t *)data, length) == length && crc32(data, length) == header.crc;
+    file.close();
+    return ok;
+}
+
+bool configStoreMigrate(const char *path, const config_layout_t *layouts, size_t n_layouts,
+                        void *data, const config_field_t *fields, size_t n_fields)
+{
+    File file = LittleFS.open(path, "r");
+    if (!file)
+        return false;
+
+    config_header_t header;
+    const config_layout_t *layout = NULL;
+    if (file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == CONFIG_STORE_MAGIC)
+    {
+        for (size_t i = 0; i < n_layouts; i++)
+        {
+            if (layouts[i].version == header.version && layouts[i].length == header.length)
+                layout = &layouts[i];
+        }
+    }
+    uint8_t old[CONFIG_STORE_PATCH_MAX];
+    bool ok = layout && header.length <= sizeof(old) &&
+              file.read(old, header.length) == header.length && crc32(old, header.length) == header.crc;
+    file.close();
+    if (!ok)
+        return false;
+
+    uint8_t *bytes = (uint8_t *)data;
+    for (size_t i = 0; i < layout->n_fields; i++)
+    {
+        const config_field_t *from = &layout->fields[i];
+        const config_field_t *to = findField(fields, n_fields, from->key);
+        if (!to || (from->type == CONFIG_STR) != (to->type == CONFIG_STR))
+            continue;
+
+        if (to->type == CONFIG_STR)
+        {
+            const char *value = (const char *)(old + from->offset);
+            size_t length = strnlen(value, from->size);
+            if (length >= to->size)
+                continue; // would not fit, keep the default
+            memset(bytes + to->offset, 0, to->size);
+            memcpy(bytes + to->offset, value, length);
+        }
+        else
+        {
+            uint32_t value = readNumber(old, from);
+            if (value >= to->min && value <= to->max)
+                writeNumber(bytes, to, value);
+        }
+    }
+    return true;
+}
+
+bool configStoreSave(const char *path, uint16_t version, const void *data, size_t length)
+{
+    if (length > CONFIG_STORE_LENGTH_MAX)
+        return false;
+
+    char tmp_path[32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    File file = LittleFS.open(tmp_path, "w");
+    if (!file)
+        return false;
+
+    config_header_t header;
+    header.magic = CONFIG_STORE_MAGIC;
+    header.version = version;
+    header.length = length;
+    header.crc = crc32(data, length);
+
+    bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t *)data, length) == length;
+    file.close();
+
+    if (!ok)
+    {
+        LittleFS.remove(tmp_path);
+        return false;
+    }
+    // rename replaces the old blob in a single metadata commit
+    return LittleFS.rename(tmp_path, path);
+}
+
+bool configStorePatch(void *data, size_t length, const config_field_t *fields, size_t n_fields, JsonObjectConst patch)
+{
+    if (length > CONFIG_STORE_PATCH_MAX)
+        return false;
+
+    uint8_t candidate[CONFIG_STORE_PATCH_MAX];
+    memcpy(candidate, data, length);
+
+    for (JsonPairConst kv : patch)
+    {
+        const config_field_t *field = findField(fields, n_fields, kv.key().c_str());
+        if (!field)
+            return false;
+
+        uint8_t *target = candidate + field->offset;
+        if (field->type == CONFIG_STR)
+        {
+            const char *value = kv.value().as<const char *>();
+            if (!value || strlen(value) >= field->size)
+                return false;
+            memset(target, 0, field->size);
+            memcpy(target, value, strlen(value));
+        }
+        else
+        {
+            if (!kv.value().is<uint32_t>())
+                return false;
+            uint32_t value = kv.value().as<uint32_t>();
+            if (value < field->min || value > field->max)
+                return false;
+            writeNumber(candidate, field, value);
+        }
+    }
+
+    memcpy(data, candidate, length);
+    return true;
+}
+
+void configStoreDump(const void *data, const config_field_t *fields, size_t n_fields, JsonObject out)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < n_fields; i++)
+    {
+        const config_field_t *field = &fields[i];
+        if (field->secret)
+            continue;
+
+        if (field->type == CONFIG_STR)
+            out[field->key] = (const char *)(bytes + field->offset);
+        else
+            out[field->key] = readNumber(bytes, field);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Runtime configuration persisted in flash.
+// A firmware keeps its settings in a packed struct loaded once at boot (plain
+// field access afterwards) and describes the fields in a table, so partial
+// JSON updates can be validated and applied without per-field code.
+// Blobs are stored in LittleFS with a header (magic, layout version, length,
+// CRC-32) and written to a temporary file first, then renamed over the old
+// one, so an update is either fully stored or not at all.
+// A firmware that changes its struct bumps the layout version and keeps a
+// field table of every older layout, so the values stored by the previous
+// firmware (credentials above all) survive the update.
+
+typedef enum config_type
+{
+    CONFIG_U8,
+    CONFIG_U16,
+    CONFIG_U32,
+    CONFIG_STR,
+} config_type_t;
+
+typedef struct config_field
+{
+    const char *key;
+    config_type_t type;
+    uint16_t offset; // offsetof() in the config struct
+    uint16_t size;   // for CONFIG_STR, including the terminator
+    uint32_t min;    // valid range for numbers
+    uint32_t max;
+    bool secret; // never reported back
+} config_field_t;
+
+#define CONFIG_NUMBER(type, key, ctype, member, min, max) \
+    {key, type, (uint16_t)offsetof(ctype, member), (uint16_t)sizeof(((ctype *)0)->member), min, max, false}
+#define CONFIG_STRING(key, ctype, member, secret) \
+    {key, CONFIG_STR, (uint16_t)offsetof(ctype, member), (uint16_t)sizeof(((ctype *)0)->member), 0, 0, secret}
+
+// A layout stored by an older firmware
+typedef struct config_layout
+{
+    uint16_t version;
+    uint16_t length;
+    const config_field_t *fields;
+    size_t n_fields;
+} config_layout_t;
+
+#define CONFIG_LAYOUT(version, ctype, fields) \
+    {version, (uint16_t)sizeof(ctype), fields, sizeof(fields) / sizeof(fields[0])}
+
+#define CONFIG_STORE_LENGTH_MAX 0xFFFF // largest blob, the header keeps a 16-bit length
+
+// Mount the filesystem (formatted on first use)
+bool configStoreBegin();
+// Read a blob, false if missing, corrupted, stored with another layout version
+// or longer than CONFIG_STORE_LENGTH_MAX. data is left untouched then, unless
+// the flash read fails between the CRC check and the copy
+bool configStoreLoad(const char *path, uint16_t version, void *data, size_t length);
+// Read a blob stored with one of the older layouts into data (holding the
+// defaults): every field with the same key in both tables is copied over when
+// its value is valid, the others keep their default. False if there is no
+// such blob, nothing is changed then
+bool configStoreMigrate(const char *path, const config_layout_t *layouts, size_t n_layouts,
+                        void *data, const config_field_t *fields, size_t n_fields);
+// Write a blob atomically, at most CONFIG_STORE_LENGTH_MAX bytes
+bool configStoreSave(const char *path, uint16_t version, const void *data, size_t length);
+// Apply a partial update; on any unknown key or invalid value data is left untouched
+bool configStorePatch(void *data, size_t length, const config_field_t *fields, size_t n_fields, JsonObjectConst patch);
+// Report the non secret fields
+void configStoreDump(const void *data, const config_field_t *fields, size_t n_fields, JsonObject out);
+
+#endif
@@ -0,0 +1,48 @@
+#include "json_arena.h"
+
+static char arena[JSON_ARENA_SIZE] __attribute__((aligned(sizeof(void *))));
+static size_t top = 0;  // first free byte
+static uint8_t held = 0; // scopes holding a block
+static json_arena_stats_t stats = {JSON_ARENA_SIZE, 0, 0, 0, 0};
+
+char *jsonArenaAcquire(size_t capacity)
+{
+    if (capacity > JSON_ARENA_SIZE - top)
+    {
+        stats.failed++;
+        return nullptr;
+    }
+    char *block = arena + top;
+    top += capacity;
+    held++;
+    if (top > stats.peak)
+        stats.peak = top;
+    if (held > stats.depth)
+        stats.depth = held;
+    return block;
+}
+
+void jsonArenaRelease(char *block, size_t used)
+{
+    if (block == nullptr)
+        return;
+    // scopes end in reverse order, the block is always the last one
+    top = block - arena;
+    held--;
+    if (used > stats.largest)
+        stats.largest = used;
+}
+
+void jsonArenaStats(json_arena_stats_t &out)
+{
+    out = stats;
+}
+
+void jsonArenaReport(JsonObject out)
+{
+    out["size"] = stats.size;
+    out["peak"] = stats.peak;
+    out["largest"] = stats.largest;
+    out["depth"] = stats.depth;
+    out["failed"] = stats.failed;
+}
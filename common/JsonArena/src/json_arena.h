@@ -0,0 +1,67 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// Static memory for the JSON documents of the firmwares.
+// Documents are JsonScope<capacity> objects: they take their pool from a
+// single statically allocated arena when they are declared and give it back
+// when they go out of scope, last in first out like the stack they used to
+// live on. No heap, and the stack only holds the document header.
+//
+// Scopes nest: a document of loop() is still held while mqttClient.publish()
+// waits for the PUBACK, and the MQTT callback can run meanwhile with its own
+// documents. The arena is sized for JSON_ARENA_DEPTH documents of the largest
+// capacity, which is checked at compile time for every scope. A scope that
+// doesn't fit at run time (deeper nesting) gets an empty pool, so parsing
+// fails with NoMemory and nothing is written; it is counted in the stats.
+
+#ifndef JSON_ARENA_SIZE
+#define JSON_ARENA_SIZE 2048 // bytes, set per firmware in build_flags
+#endif
+#ifndef JSON_ARENA_DEPTH
+#define JSON_ARENA_DEPTH 2 // a document of loop() and one of the MQTT callback
+#endif
+
+#define JSON_ARENA_ALIGN(n) (((n) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+typedef struct json_arena_stats
+{
+    uint16_t size;
+    uint16_t peak;    // highest reserved bytes, nested scopes together
+    uint16_t largest; // most bytes used by a single document
+    uint8_t depth;    // most scopes held at once
+    uint16_t failed;  // scopes that did not fit
+} json_arena_stats_t;
+
+// Used by JsonScope
+char *jsonArenaAcquire(size_t capacity);
+void jsonArenaRelease(char *block, size_t used);
+
+void jsonArenaStats(json_arena_stats_t &stats);
+// Stats as JSON, for the status messages of the firmwares
+void jsonArenaReport(JsonObject out);
+
+template <size_t CAPACITY>
+class JsonScope : public JsonDocument
+{
+    static_assert(JSON_ARENA_ALIGN(CAPACITY) * JSON_ARENA_DEPTH <= JSON_ARENA_SIZE,
+                  "JSON document too large for the arena, raise JSON_ARENA_SIZE");
+
+public:
+    JsonScope() : JsonScope(jsonArenaAcquire(JSON_ARENA_ALIGN(CAPACITY))) {}
+    ~JsonScope() { jsonArenaRelease(block, memoryUsage()); }
+
+    JsonScope(const JsonScope &) = delete;
+    JsonScope &operator=(const JsonScope &) = delete;
+
+private:
+    explicit JsonScope(char *block) : JsonDocument(block, block ? JSON_ARENA_ALIGN(CAPACITY) : 0), block(block) {}
+
+    char *block;
+};
+
+#endif
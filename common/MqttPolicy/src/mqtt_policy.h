@@ -0,0 +1,69 @@
+#ifndef MQTT_POLICY_H
+#define MQTT_POLICY_H
+
+#include <stdint.h>
+
+// Delivery policy (QoS and retain flag) per class of message.
+// Defaults can be overridden at build time with -D flags and at runtime
+// through the node configuration.
+
+typedef enum message_class
+{
+    MSG_TELEMETRY, // periodic readings
+    MSG_SNAPSHOT,  // periodic readings kept as "last value" on the broker
+    MSG_ALARM,     // flame and other safety events
+    MSG_STATUS,    // connection status, will, OTA and config reports
+    MSG_ACK,       // actuator command acknowledgements
+    MSG_CLASS_N,
+} message_class_t;
+
+typedef struct __attribute__((packed)) delivery_policy
+{
+    uint8_t qos;
+    uint8_t retained;
+} delivery_policy_t;
+
+#ifndef MQTT_TELEMETRY_QOS
+#define MQTT_TELEMETRY_QOS 0
+#endif
+#ifndef MQTT_TELEMETRY_RETAINED
+#define MQTT_TELEMETRY_RETAINED 0
+#endif
+#ifndef MQTT_SNAPSHOT_QOS
+#define MQTT_SNAPSHOT_QOS 1
+#endif
+#ifndef MQTT_SNAPSHOT_RETAINED
+#define MQTT_SNAPSHOT_RETAINED 1
+#endif
+#ifndef MQTT_ALARM_QOS
+#define MQTT_ALARM_QOS 1
+#endif
+#ifndef MQTT_ALARM_RETAINED
+#define MQTT_ALARM_RETAINED 1
+#endif
+#ifndef MQTT_STATUS_QOS
+#define MQTT_STATUS_QOS 1
+#endif
+#ifndef MQTT_STATUS_RETAINED
+#define MQTT_STATUS_RETAINED 1
+#endif
+#ifndef MQTT_ACK_QOS
+#define MQTT_ACK_QOS 1 // 2 for exactly-once acknowledgements
+#endif
+#ifndef MQTT_ACK_RETAINED
+#define MQTT_ACK_RETAINED 0
+#endif
+#ifndef MQTT_SNAPSHOT_EVERY
+#define MQTT_SNAPSHOT_EVERY 10 // every N telemetry cycles readings are sent as a snapshot
+#endif
+
+inline void mqttPolicyDefaults(delivery_policy_t *policy)
+{
+    policy[MSG_TELEMETRY] = {MQTT_TELEMETRY_QOS, MQTT_TELEMETRY_RETAINED};
+    policy[MSG_SNAPSHOT] = {MQTT_SNAPSHOT_QOS, MQTT_SNAPSHOT_RETAINED};
+    policy[MSG_ALARM] = {MQTT_ALARM_QOS, MQTT_ALARM_RETAINED};
+    policy[MSG_STATUS] = {MQTT_STATUS_QOS, MQTT_STATUS_RETAINED};
+    policy[MSG_ACK] = {MQTT_ACK_QOS, MQTT_ACK_RETAINED};
+}
+
+#endif
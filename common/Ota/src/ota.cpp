@@ -0,0 +1,277 @@
+#include "ota.h"
+
+#include <ArduinoJson.h>
+#include <ESP8266HTTPClient.h>
+#include <ESP8266WiFi.h>
+#include <Updater.h>
+
+#include <crc32.h>
+#include <json_arena.h>
+#include <rtc_layout.h>
+
+#define OTA_RTC_MAGIC 0x4F544131
+#define OTA_STREAM_TIMEOUT 10000 // abort if the server stalls for this long (ms)
+#define OTA_CHUNK_SIZE 512
+#define OTA_ROLLBACK_RETRY 30000 // wait before downloading a failed rollback again (ms)
+
+// Update state kept in RTC memory across the reboots of a trial image
+typedef struct ota_rtc_state
+{
+    uint32_t magic;
+    uint32_t crc;
+    uint8_t trial;         // running image not confirmed yet
+    uint8_t boot_attempts; // boots of the trial image so far
+    uint8_t reserved[2];
+    char trial_version[OTA_VERSION_LEN];
+    char failed_version[OTA_VERSION_LEN]; // never install this version again
+    char rollback_url[OTA_URL_LEN];
+    char rollback_md5[OTA_MD5_LEN + 3];
+} ota_rtc_state_t;
+
+static_assert(sizeof(ota_rtc_state_t) % 4 == 0, "RTC state must be block aligned");
+static_assert(sizeof(ota_rtc_state_t) <= RTC_OTA_BLOCKS * 4, "RTC state exceeds its slot");
+
+static ota_rtc_state_t rtc_state;
+static const char *running_version = "";
+static ota_report_t ota_report = NULL;
+
+// Pending image
+static bool pending = false;
+static bool pending_rollback = false;
+static bool rollback_failed = false;
+static unsigned long rollback_failed_at = 0;
+static char pending_version[OTA_VERSION_LEN];
+static char pending_url[OTA_URL_LEN];
+static char pending_md5[OTA_MD5_LEN];
+static char announced_rollback_url[OTA_URL_LEN];
+static char announced_rollback_md5[OTA_MD5_LEN];
+
+static uint32_t stateCrc()
+{
+    return crc32((const uint8_t *)&rtc_state + 8, sizeof(rtc_state) - 8);
+}
+
+static void saveState()
+{
+    rtc_state.magic = OTA_RTC_MAGIC;
+    rtc_state.crc = stateCrc();
+    ESP.rtcUserMemoryWrite(RTC_OTA_OFFSET, (uint32_t *)&rtc_state, sizeof(rtc_state));
+}
+
+static void report(const char *state, int progress)
+{
+    if (ota_report)
+        ota_report(state, progress);
+}
+
+static void copyString(char *dest, const char *src, size_t size)
+{
+    strncpy(dest, src ? src : "", size - 1);
+    dest[size - 1] = '\0';
+}
+
+static bool validMd5(const char *md5)
+{
+    if (strlen(md5) != OTA_MD5_LEN - 1)
+        return false;
+    for (const char *c = md5; *c; c++)
+    {
+        if (!isxdigit((unsigned char)*c))
+            return false;
+    }
+    return true;
+}
+
+void otaBegin(const char *current_version, uint8_t max_boot_attempts, ota_report_t report_callback)
+{
+    running_version = current_version;
+    ota_report = report_callback;
+
+    ESP.rtcUserMemoryRead(RTC_OTA_OFFSET, (uint32_t *)&rtc_state, sizeof(rtc_state));
+    if (rtc_state.magic != OTA_RTC_MAGIC || rtc_state.crc != stateCrc())
+    { // cold boot or corrupted state
+        memset(&rtc_state, 0, sizeof(rtc_state));
+        saveState();
+        return;
+    }
+
+    if (!rtc_state.trial)
+        return;
+
+    rtc_state.boot_attempts++;
+    if (rtc_state.boot_attempts > max_boot_attempts)
+    {
+        // the new image never completed its setup, go back to the previous one.
+        // The trial stays open until the rollback image is written, so a
+        // failed download is tried again (and again at the next boot).
+        copyString(rtc_state.failed_version, rtc_state.trial_version, sizeof(rtc_state.failed_version));
+
+        copyString(pending_version, "", sizeof(pending_version));
+        copyString(pending_url, rtc_state.rollback_url, sizeof(pending_url));
+        copyString(pending_md5, rtc_state.rollback_md5, sizeof(pending_md5));
+        pending = true;
+        pending_rollback = true;
+    }
+    saveState();
+}
+
+bool otaAnnounce(const char *payload, const char *mac_address)
+{
+    JsonScope<384> doc;
+    if (deserializeJson(doc, payload))
+        return false;
+
+    const char *version = doc["version"] | "";
+    const char *url = doc["url"] | "";
+    const char *md5 = doc["md5"] | "";
+    const char *rollback_url = doc["rollback_url"] | "";
+    const char *rollback_md5 = doc["rollback_md5"] | "";
+    int rollout = doc["rollout"] | 100;
+
+    if (version[0] == '\0' || url[0] == '\0' || !validMd5(md5))
+        return false;
+    // every image boots on trial, it must have a way back
+    if (rollback_url[0] == '\0' || !validMd5(rollback_md5))
+        return false;
+    // already running it, or it was rolled back on this node
+    if (strcmp(version, running_version) == 0 || strcmp(version, rtc_state.failed_version) == 0)
+        return false;
+    // staged rollout: stable bucket per node
+    if (crc32(mac_address, strlen(mac_address)) % 100 >= (uint32_t)rollout)
+        return false;
+    if (pending_rollback)
+        return false;
+
+    copyString(pending_version, version, sizeof(pending_version));
+    copyString(pending_url, url, sizeof(pending_url));
+    copyString(pending_md5, md5, sizeof(pending_md5));
+    copyString(announced_rollback_url, rollback_url, sizeof(announced_rollback_url));
+    copyString(announced_rollback_md5, rollback_md5, sizeof(announced_rollback_md5));
+    pending = true;
+    return true;
+}
+
+bool otaPending()
+{
+    if (rollback_failed && millis() - rollback_failed_at < OTA_ROLLBACK_RETRY)
+        return false;
+    return pending;
+}
+
+static bool download(const char *url, const char *md5)
+{
+    WiFiClient client;
+    HTTPClient http;
+
+    if (!http.begin(client, url))
+        return false;
+    if (http.GET() != HTTP_CODE_OK)
+    {
+        http.end();
+        return false;
+    }
+
+    int size = http.getSize();
+    if (size <= 0 || !Update.begin(size))
+    {
+        http.end();
+        return false;
+    }
+    if (!validMd5(md5) || !Update.setMD5(md5))
+    {
+        Update.end();
+        http.end();
+        return false;
+    }
+
+    WiFiClient *stream = http.getStreamPtr();
+    uint8_t buffer[OTA_CHUNK_SIZE];
+    int written = 0;
+    int last_progress = -1;
+    unsigned long last_data = millis();
+    while (written < size)
+    {
+        size_t available = stream->available();
+        if (available)
+        {
+            size_t n = stream->readBytes(buffer, available < sizeof(buffer) ? available : sizeof(buffer));
+            if (Update.write(buffer, n) != n)
+                break;
+            written += n;
+            last_data = millis();
+
+            int progress = (int)((int64_t)written * 100 / size);
+            if (progress / 10 != last_progress / 10)
+            {
+                report("downloading", progress);
+                last_progress = progress;
+            }
+        }
+        else if (!stream->connected() || millis() - last_data > OTA_STREAM_TIMEOUT)
+        {
+            break;
+        }
+        else
+        {
+            delay(1);
+        }
+    }
+    http.end();
+
+    // end() checks the size and the MD5 before marking the image bootable
+    return written == size && Update.end();
+}
+
+bool otaRun()
+{
+    if (!pending)
+        return false;
+    pending = false;
+
+    report(pending_rollback ? "rollback" : "downloading", 0);
+
+    if (!download(pending_url, pending_md5))
+    {
+        report("failed", -1);
+        if (pending_rollback)
+        { // still running the failed image, keep trying
+            pending = true;
+            rollback_failed = true;
+            rollback_failed_at = millis();
+        }
+        return false;
+    }
+
+    if (pending_rollback)
+    {
+        // the previous image is written, the trial is over
+        rtc_state.trial = 0;
+        rtc_state.boot_attempts = 0;
+        saveState();
+    }
+    else
+    {
+        // boot the new image on trial
+        copyString(rtc_state.trial_version, pending_version, sizeof(rtc_state.trial_version));
+        copyString(rtc_state.rollback_url, announced_rollback_url, sizeof(rtc_state.rollback_url));
+        copyString(rtc_state.rollback_md5, announced_rollback_md5, sizeof(rtc_state.rollback_md5));
+        rtc_state.trial = 1;
+        rtc_state.boot_attempts = 0;
+        saveState();
+    }
+
+    report("rebooting", 100);
+    delay(100);
+    ESP.restart();
+    return true;
+}
+
+void otaConfirm()
+{
+    if (!rtc_state.trial || pending_rollback)
+        return;
+    rtc_state.trial = 0;
+    rtc_state.boot_attempts = 0;
+    saveState();
+    report("confirmed", 100);
+}
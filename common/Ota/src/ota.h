@@ -0,0 +1,38 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <Arduino.h>
+
+// Over-the-air firmware updates.
+// Images are announced as JSON on an MQTT topic:
+//   {"version": "1.2.0", "url": "http://host/fw.bin.gz", "md5": "...",
+//    "rollback_url": "http://host/fw-1.1.0.bin.gz", "rollback_md5": "...",
+//    "rollout": 25}
+// and pulled over HTTP. Gzip-compressed images are accepted as they are
+// inflated by eboot while copying, which cuts transfer time and flash writes.
+// "rollout" (0-100, default 100) stages a fleet-wide announcement: each
+// node takes part only if its MAC falls in the first rollout% buckets.
+// "md5", "rollback_url" and "rollback_md5" are required: every image boots
+// on trial and is replaced by the rollback one if it never confirms.
+
+#define OTA_VERSION_LEN 16
+#define OTA_URL_LEN 96
+#define OTA_MD5_LEN 33
+
+// Progress callback, state is one of "downloading", "failed", "rebooting",
+// "rollback", "confirmed" and progress is a percentage (-1 if unknown)
+typedef void (*ota_report_t)(const char *state, int progress);
+
+// Call once in setup(): counts boots of an unconfirmed image and schedules a
+// rollback when it did not reach the confirmation within max_boot_attempts
+void otaBegin(const char *current_version, uint8_t max_boot_attempts, ota_report_t report);
+// Parse an announcement (call from the MQTT callback, it does not download)
+bool otaAnnounce(const char *payload, const char *mac_address);
+// True if an update (or a rollback) is waiting to be installed
+bool otaPending();
+// Download, verify and install the pending image, reboots on success
+bool otaRun();
+// The running image is healthy (call once the node completed its setup)
+void otaConfirm();
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef RTC_LAYOUT_H
+#define RTC_LAYOUT_H
+
+// RTC user memory map, shared by all the firmwares.
+// 128 blocks of 4 bytes that survive resets and deep sleep (not power loss).
+// Offsets are in blocks, as expected by ESP.rtcUserMemoryRead/Write.
+#define RTC_USER_BLOCKS 128
+
+// Blocks 0-31 hold the flash copy command of eboot: written by
+// Update.end() for the next boot and cleared by eboot on every boot
+#define RTC_EBOOT_OFFSET 0
+#define RTC_EBOOT_BLOCKS 32
+
+#define RTC_OTA_OFFSET 32 // ota_rtc_state_t
+#define RTC_OTA_BLOCKS 48
+
+#define RTC_STALL_OFFSET 80 // stall_rtc_state_t (watchdog diagnostics)
+#define RTC_STALL_BLOCKS 8
+
+#define RTC_TLS_OFFSET 96 // tls_rtc_state_t (MQTT session resumption)
+#define RTC_TLS_BLOCKS 32
+
+static_assert(RTC_EBOOT_OFFSET + RTC_EBOOT_BLOCKS <= RTC_OTA_OFFSET, "OTA state overlaps the eboot command");
+static_assert(RTC_OTA_OFFSET + RTC_OTA_BLOCKS <= RTC_STALL_OFFSET, "OTA and stall states overlap");
+static_assert(RTC_STALL_OFFSET + RTC_STALL_BLOCKS <= RTC_TLS_OFFSET, "stall and TLS states overlap");
+static_assert(RTC_TLS_OFFSET + RTC_TLS_BLOCKS <= RTC_USER_BLOCKS, "TLS state past the RTC user memory");
+
+// Memory mapped address of user block 0, for writes from interrupt handlers
+// (ESP.rtcUserMemoryWrite runs from flash)
+#define RTC_USER_MEMORY ((volatile uint32_t *)0x60001200)
+
+#endif
@@ -0,0 +1,152 @@
+#include "stall_watch.h"
+
+#include <rtc_layout.h>
+
+#define STALL_RTC_MAGIC 0x53544C31
+#define TIMER1_TICKS_PER_MS (80000 / 256) // APB clock, TIM_DIV256
+
+// Kept in RTC memory, written from the timer interrupt: 32 bit fields only
+// (RTC memory takes word accesses) and no checksum, the magic tells a cold
+// boot apart
+typedef struct stall_rtc_state
+{
+    uint32_t magic;
+    uint32_t section;
+    uint32_t entered_ms;
+    uint32_t section_ms;
+    uint32_t longest_section;
+    uint32_t longest_ms;
+    uint32_t stalls;
+} stall_rtc_state_t;
+
+static_assert(sizeof(stall_rtc_state_t) <= RTC_STALL_BLOCKS * 4, "RTC state exceeds its slot");
+
+static volatile stall_rtc_state_t *const rtc_state = (volatile stall_rtc_state_t *)(RTC_USER_MEMORY + RTC_STALL_OFFSET);
+
+static const char *const section_names[STALL_SECTIONS] = {
+    "idle", "wifi_connect", "broker_connect", "mqtt_poll", "publish", "sensors", "ota", "display", "button_isr"};
+
+// Current section, mirrored in RAM for the timer
+static volatile uint8_t current = STALL_IDLE;
+static volatile uint32_t entered = 0;
+static volatile bool counted = false; // this section is already in stalls
+static uint32_t threshold = 0;
+static uint32_t longest = 0;
+static uint32_t stalls = 0;
+
+static stall_report_t last_report;
+
+static void IRAM_ATTR stallTick()
+{
+    if (current == STALL_IDLE)
+        return;
+    uint32_t elapsed = millis() - entered;
+    if (elapsed < threshold)
+        return;
+
+    rtc_state->section_ms = elapsed;
+    if (!counted)
+    {
+        counted = true;
+        rtc_state->stalls = ++stalls;
+    }
+    if (elapsed > longest)
+    {
+        longest = elapsed;
+        rtc_state->longest_section = current;
+        rtc_state->longest_ms = elapsed;
+    }
+}
+
+static void IRAM_ATTR enter(uint8_t section, uint32_t since)
+{
+    current = section;
+    entered = since;
+    rtc_state->section = section;
+    rtc_state->entered_ms = since;
+    rtc_state->section_ms = 0;
+}
+
+void stallBegin(uint32_t threshold_ms)
+{
+    const rst_info *info = ESP.getResetInfoPtr();
+    memset(&last_report, 0, sizeof(last_report));
+    last_report.reason = info->reason;
+    last_report.crashed = info->reason == REASON_WDT_RST || info->reason == REASON_EXCEPTION_RST ||
+                          info->reason == REASON_SOFT_WDT_RST;
+    if (info->reason == REASON_EXCEPTION_RST)
+    {
+        last_report.exccause = info->exccause;
+        last_report.epc1 = info->epc1;
+        last_report.excvaddr = info->excvaddr;
+    }
+
+    if (rtc_state->magic == STALL_RTC_MAGIC && rtc_state->section < STALL_SECTIONS &&
+        rtc_state->longest_section < STALL_SECTIONS)
+    {
+        last_report.section = rtc_state->section;
+        last_report.section_ms = rtc_state->section_ms;
+        last_report.entered_ms = rtc_state->entered_ms;
+        last_report.longest_section = rtc_state->longest_section;
+        last_report.longest_ms = rtc_state->longest_ms;
+        last_report.stalls = rtc_state->stalls > 0xFFFF ? 0xFFFF : rtc_state->stalls;
+    }
+
+    // fresh state for this boot
+    rtc_state->longest_section = STALL_IDLE;
+    rtc_state->longest_ms = 0;
+    rtc_state->stalls = 0;
+    enter(STALL_IDLE, millis());
+    rtc_state->magic = STALL_RTC_MAGIC;
+
+    threshold = threshold_ms;
+    timer1_attachInterrupt(stallTick);
+    timer1_enable(TIM_DIV256, TIM_EDGE, TIM_LOOP);
+    timer1_write(STALL_TICK_MS * TIMER1_TICKS_PER_MS);
+}
+
+bool stallReport(stall_report_t &report)
+{
+    report = last_report;
+    return report.crashed || report.stalls > 0;
+}
+
+const char *stallSectionName(uint8_t section)
+{
+    return section < STALL_SECTIONS ? section_names[section] : "unknown";
+}
+
+void stallReportJson(const stall_report_t &report, JsonObject out)
+{
+    out["reset"] = ESP.getResetReason();
+    out["crashed"] = report.crashed;
+    if (report.reason == REASON_EXCEPTION_RST)
+    {
+        out["exccause"] = report.exccause;
+        out["epc1"] = report.epc1;
+        out["excvaddr"] = report.excvaddr;
+    }
+    out["section"] = stallSectionName(report.section);
+    out["section_ms"] = report.section_ms;
+    out["entered_ms"] = report.entered_ms;
+    out["stalls"] = report.stalls;
+    if (report.stalls > 0)
+    {
+        out["longest"] = stallSectionName(report.longest_section);
+        out["longest_ms"] = report.longest_ms;
+    }
+}
+
+IRAM_ATTR StallSection::StallSection(stall_section_t section)
+    : previous(current), previous_entered(entered)
+{
+    counted = false;
+    enter(section, millis());
+}
+
+IRAM_ATTR StallSection::~StallSection()
+{
+    // an enclosing section already over the threshold was counted with this one
+    counted = millis() - previous_entered >= threshold;
+    enter(previous, previous_entered);
+}
@@ -0,0 +1,71 @@
+#ifndef STALL_WATCH_H
+#define STALL_WATCH_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Stall diagnostics: where the node was when the watchdog reset it.
+// Blocking paths are wrapped in sections (StallSection). Entering a section
+// writes its id and entry time to RTC memory; a timer1 interrupt then keeps
+// the time spent in it up to date there once it exceeds the threshold, and
+// records the longest section of the boot. RTC memory survives the reset,
+// so the next boot can report the section that blocked, for how long, and
+// the reset reason. Sections entered from an interrupt handler or with
+// interrupts disabled are still recorded, but the timer can't measure them:
+// a duration of 0 after a hardware watchdog reset points at them.
+
+#define STALL_TICK_MS 100 // timer period
+
+typedef enum stall_section
+{
+    STALL_IDLE,
+    STALL_WIFI_CONNECT,
+    STALL_BROKER_CONNECT,
+    STALL_MQTT_POLL,
+    STALL_PUBLISH,
+    STALL_SENSORS,
+    STALL_OTA,
+    STALL_DISPLAY,
+    STALL_BUTTON_ISR,
+    STALL_SECTIONS,
+} stall_section_t;
+
+// What happened during the previous boot
+typedef struct stall_report
+{
+    uint32_t reason;   // rst_info reason (REASON_SOFT_WDT_RST, ...)
+    uint32_t exccause; // exception resets only
+    uint32_t epc1;
+    uint32_t excvaddr;
+    bool crashed;            // watchdog or exception reset
+    uint8_t section;         // innermost section at the reset, STALL_IDLE if none
+    uint32_t section_ms;     // time spent in it, as last seen by the timer
+    uint32_t entered_ms;     // uptime when it was entered
+    uint8_t longest_section; // longest section over the threshold
+    uint32_t longest_ms;
+    uint16_t stalls; // sections over the threshold
+} stall_report_t;
+
+// Call first in setup(): takes the report of the previous boot, then starts
+// watching sections longer than threshold_ms (keep it well below the 3.2 s
+// of the software watchdog). Uses timer1, which rules out analogWrite/tone.
+void stallBegin(uint32_t threshold_ms);
+// Report of the previous boot, false if it ended cleanly without stalls
+bool stallReport(stall_report_t &report);
+const char *stallSectionName(uint8_t section);
+// Report as JSON, for the crash report of the firmwares
+void stallReportJson(const stall_report_t &report, JsonObject out);
+
+// Scope of a section, can be nested and used in interrupt handlers
+class StallSection
+{
+public:
+    explicit StallSection(stall_section_t section);
+    ~StallSection();
+
+private:
+    uint8_t previous;
+    uint32_t previous_entered;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "time_sync.h"
+
+#include <coredecls.h>
+#include <sys/time.h>
+#include <time.h>
+
+static time_source_t source = TIME_NONE;
+static bool source_changed = false;
+static uint64_t base_epoch_ms = 0; // wall clock at base_millis
+static uint32_t base_millis = 0;
+
+static void setBase(uint64_t epoch_ms, time_source_t new_source)
+{
+    base_epoch_ms = epoch_ms;
+    base_millis = millis();
+    if (new_source != source)
+        source_changed = true;
+    source = new_source;
+}
+
+static void onSntpSync()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    setBase((uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000, TIME_SNTP);
+}
+
+void timeSyncBegin(const char *ntp_server)
+{
+    settimeofday_cb(onSntpSync);
+    configTime(0, 0, ntp_server); // UTC, readings are converted by the consumers
+}
+
+void timeSyncBroker(uint64_t epoch_ms)
+{
+    if (source == TIME_SNTP && millis() - base_millis < TIME_SNTP_STALE_MS)
+        return;
+    setBase(epoch_ms, TIME_BROKER);
+}
+
+uint64_t timeNowMs()
+{
+    if (source == TIME_NONE)
+        return 0;
+    return base_epoch_ms + (uint32_t)(millis() - base_millis);
+}
+
+time_source_t timeSource()
+{
+    return source;
+}
+
+uint32_t timeSyncAge()
+{
+    return (millis() - base_millis) / 1000;
+}
+
+const char *timeSourceName(time_source_t time_source)
+{
+    switch (time_source)
+    {
+    case TIME_SNTP:
+        return "sntp";
+    case TIME_BROKER:
+        return "broker";
+    default:
+        return "none";
+    }
+}
+
+bool timeSourceChanged()
+{
+    bool changed = source_changed;
+    source_changed = false;
+    return changed;
+}
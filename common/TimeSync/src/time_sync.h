@@ -0,0 +1,33 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+
+// Wall clock for timestamping readings.
+// SNTP is the primary source; when it is not reachable the time published
+// by the backend on the broker is used instead (its accuracy is bounded by
+// the delivery latency). The clock runs on millis() between two syncs.
+
+#define TIME_SNTP_STALE_MS 7200000UL // SNTP syncs hourly, after 2 h the broker takes over
+
+typedef enum time_source
+{
+    TIME_NONE,   // no sync yet, readings carry no timestamp
+    TIME_BROKER, // from the broker time topic
+    TIME_SNTP,
+} time_source_t;
+
+// Start SNTP (call once, it syncs in the background when WiFi is up)
+void timeSyncBegin(const char *ntp_server);
+// Broker time in ms since the epoch, ignored while SNTP is fresh
+void timeSyncBroker(uint64_t epoch_ms);
+// Current time in ms since the epoch, 0 if never synced
+uint64_t timeNowMs();
+time_source_t timeSource();
+// Seconds since the last sync
+uint32_t timeSyncAge();
+const char *timeSourceName(time_source_t source);
+// True once after every change of source
+bool timeSourceChanged();
+
+#endif
@@ -0,0 +1,105 @@
+#ifdef ESP8266
+
+#include "espnow_transport.h"
+
+#include <string.h>
+
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+
+static uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Filled by the receive callback (WiFi task), drained by poll() (loop)
+static uint8_t rx_frames[ESPNOW_QUEUE][TRANSPORT_FRAME_MAX];
+static uint8_t rx_sizes[ESPNOW_QUEUE];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_count = 0;
+static volatile uint32_t rx_lost = 0;
+
+static void received(uint8_t *mac, uint8_t *data, uint8_t len)
+{
+    (void)mac; // the sender is part of the topic
+    if (len < TRANSPORT_FRAME_HEADER || len > TRANSPORT_FRAME_MAX)
+        return;
+    if (rx_count == ESPNOW_QUEUE)
+    {
+        rx_lost++;
+        return;
+    }
+    uint8_t slot = (rx_head + rx_count) % ESPNOW_QUEUE;
+    memcpy(rx_frames[slot], data, len);
+    rx_sizes[slot] = len;
+    rx_count++;
+}
+
+EspNowTransport::EspNowTransport() : started(false), sequence(0)
+{
+}
+
+bool EspNowTransport::begin(uint8_t channel)
+{
+    if (started)
+        return true;
+    if (channel != 0 && WiFi.status() != WL_CONNECTED)
+        wifi_set_channel(channel);
+    if (esp_now_init() != 0)
+        return false;
+    esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+    esp_now_add_peer(broadcast, ESP_NOW_ROLE_COMBO, channel, NULL, 0);
+    esp_now_register_recv_cb(received);
+    started = true;
+    return true;
+}
+
+void EspNowTransport::end()
+{
+    if (!started)
+        return;
+    esp_now_unregister_recv_cb();
+    esp_now_deinit();
+    started = false;
+}
+
+bool EspNowTransport::publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos)
+{
+    (void)qos; // broadcasts are never acknowledged
+    if (!started)
+        return false;
+    uint8_t frame[TRANSPORT_FRAME_MAX];
+    size_t size = transportFrameEncode(frame, topic, payload, length, retained ? TRANSPORT_FRAME_RETAINED : 0, sequence);
+    if (size == 0)
+        return false;
+    sequence++;
+    return esp_now_send(broadcast, frame, size) == 0;
+}
+
+bool EspNowTransport::poll()
+{
+    while (rx_count > 0)
+    {
+        // copy out, the callback may reuse the slot as soon as it's released
+        uint8_t frame[TRANSPORT_FRAME_MAX];
+        size_t size = rx_sizes[rx_head];
+        memcpy(frame, rx_frames[rx_head], size);
+        noInterrupts();
+        rx_head = (rx_head + 1) % ESPNOW_QUEUE;
+        rx_count--;
+        interrupts();
+
+        transport_message_t message;
+        if (!transportFrameDecode(frame, size, message))
+            continue;
+        char topic[TRANSPORT_FRAME_MAX];
+        memcpy(topic, message.topic, message.topic_length);
+        topic[message.topic_length] = '\0';
+        deliver(topic, message.payload, message.length);
+    }
+    return started;
+}
+
+uint32_t EspNowTransport::dropped() const
+{
+    return rx_lost;
+}
+
+#endif
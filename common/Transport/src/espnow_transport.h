@@ -0,0 +1,43 @@
+#ifndef ESPNOW_TRANSPORT_H
+#define ESPNOW_TRANSPORT_H
+
+#ifdef ESP8266
+
+#include "transport.h"
+#include "transport_frame.h"
+
+#define ESPNOW_QUEUE 6 // frames received between two polls
+
+// ESP-NOW broadcast link: messages are sent as single vendor action frames
+// to every node listening on the same WiFi channel, without association,
+// broker or acknowledgement (latency is a few ms, delivery best effort).
+// A node associated to the access point transmits on the AP channel, so
+// a receiver that doesn't associate must be set to that channel.
+// Broadcasts are not authenticated: receivers should only accept data
+// that is harmless to spoof (readings), never commands or configuration.
+class EspNowTransport : public Transport
+{
+public:
+    EspNowTransport();
+
+    // channel 0 keeps the current one (the AP's when associated).
+    // WiFi must be in station mode.
+    bool begin(uint8_t channel);
+    // Before turning the radio off
+    void end();
+
+    bool publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos) override;
+    bool poll() override;
+    bool ready() override { return started; }
+
+    // Received frames lost to a full queue
+    uint32_t dropped() const;
+
+private:
+    bool started;
+    uint8_t sequence;
+};
+
+#endif
+
+#endif
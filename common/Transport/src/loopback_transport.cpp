@@ -0,0 +1,60 @@
+#include "loopback_transport.h"
+
+#include <string.h>
+
+LoopbackTransport::LoopbackTransport() : peer(nullptr), head(0), count(0), sequence(0), lost(0)
+{
+}
+
+void LoopbackTransport::link(LoopbackTransport &other)
+{
+    peer = &other;
+    other.peer = this;
+}
+
+bool LoopbackTransport::publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos)
+{
+    (void)qos; // best effort, like a broadcast
+    uint8_t frame[TRANSPORT_FRAME_MAX];
+    size_t size = transportFrameEncode(frame, topic, payload, length, retained ? TRANSPORT_FRAME_RETAINED : 0, sequence);
+    if (size == 0 || peer == nullptr)
+        return false;
+    sequence++;
+    return peer->push(frame, size);
+}
+
+bool LoopbackTransport::push(const uint8_t *frame, size_t size)
+{
+    if (count == LOOPBACK_QUEUE)
+    {
+        lost++;
+        return false;
+    }
+    uint8_t slot = (head + count) % LOOPBACK_QUEUE;
+    memcpy(frames[slot], frame, size);
+    sizes[slot] = size;
+    count++;
+    return true;
+}
+
+bool LoopbackTransport::poll()
+{
+    while (count > 0)
+    {
+        // handlers may publish back, free the slot first
+        uint8_t frame[TRANSPORT_FRAME_MAX];
+        size_t size = sizes[head];
+        memcpy(frame, frames[head], size);
+        head = (head + 1) % LOOPBACK_QUEUE;
+        count--;
+
+        transport_message_t message;
+        if (!transportFrameDecode(frame, size, message))
+            continue;
+        char topic[TRANSPORT_FRAME_MAX];
+        memcpy(topic, message.topic, message.topic_length);
+        topic[message.topic_length] = '\0';
+        deliver(topic, message.payload, message.length);
+    }
+    return peer != nullptr;
+}
@@ -0,0 +1,39 @@
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include "transport.h"
+#include "transport_frame.h"
+
+#define LOOPBACK_QUEUE 8 // frames in flight towards a peer
+
+// In-memory link between two endpoints of the same process. Messages are
+// carried as ESP-NOW frames, so a native build sees the same size limit
+// and encoding as the radio, and are delivered by the peer's poll() in
+// publish order. A full queue drops the message, like a lost broadcast.
+class LoopbackTransport : public Transport
+{
+public:
+    LoopbackTransport();
+
+    // Messages published on either end are received by the other one
+    void link(LoopbackTransport &other);
+
+    bool publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos) override;
+    bool poll() override;
+    bool ready() override { return peer != nullptr; }
+
+    uint32_t dropped() const { return lost; }
+
+private:
+    bool push(const uint8_t *frame, size_t size);
+
+    LoopbackTransport *peer;
+    uint8_t frames[LOOPBACK_QUEUE][TRANSPORT_FRAME_MAX];
+    uint8_t sizes[LOOPBACK_QUEUE];
+    uint8_t head;
+    uint8_t count;
+    uint8_t sequence;
+    uint32_t lost;
+};
+
+#endif
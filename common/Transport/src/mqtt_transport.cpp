@@ -0,0 +1,25 @@
+#ifdef ARDUINO
+
+#include "mqtt_transport.h"
+
+MqttTransport *MqttTransport::receiving = nullptr;
+
+void MqttTransport::begin()
+{
+    receiving = this;
+    client.onMessageAdvanced(received);
+}
+
+bool MqttTransport::publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos)
+{
+    return client.publish(topic, payload, (int)length, retained, qos);
+}
+
+void MqttTransport::received(MQTTClient *client, char topic[], char bytes[], int length)
+{
+    (void)client;
+    if (receiving)
+        receiving->deliver(topic, bytes, length);
+}
+
+#endif
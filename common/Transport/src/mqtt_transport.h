@@ -0,0 +1,34 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#ifdef ARDUINO
+
+#include <MQTT.h>
+
+#include "transport.h"
+
+// Broker session of the 256dpi MQTT client. The connection itself (WiFi,
+// broker_link, connect and subscriptions) stays with the firmware, this
+// only publishes and dispatches what MQTTClient::loop() receives.
+class MqttTransport : public Transport
+{
+public:
+    explicit MqttTransport(MQTTClient &mqtt_client) : client(mqtt_client) {}
+
+    // Route the received messages to onMessage() (replaces the client callback)
+    void begin();
+
+    bool publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos) override;
+    bool poll() override { return client.loop(); }
+    bool ready() override { return client.connected(); }
+
+private:
+    static void received(MQTTClient *client, char topic[], char bytes[], int length);
+    static MqttTransport *receiving; // the client callback has no context
+
+    MQTTClient &client;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Link carrying the node messages (topic + payload), under the publish
+// helpers and the message handlers of the firmwares:
+//   - MqttTransport: the broker session (mqtt_transport.h)
+//   - EspNowTransport: ESP-NOW broadcasts between nearby nodes, no access
+//     point or broker involved (espnow_transport.h)
+//   - LoopbackTransport: in-memory pair, for native builds (loopback_transport.h)
+// Received messages are handed to the handler from poll(), i.e. from the
+// loop() of the firmware, never from a network callback.
+
+typedef void (*transport_handler_t)(const char *topic, const char *payload, size_t length);
+
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    // QoS and retain flag are honoured by the backends that support them
+    virtual bool publish(const char *topic, const char *payload, size_t length, bool retained, uint8_t qos) = 0;
+    // Deliver the messages received so far, false if the link failed
+    virtual bool poll() = 0;
+    virtual bool ready() = 0;
+
+    void onMessage(transport_handler_t message_handler) { handler = message_handler; }
+
+protected:
+    Transport() : handler(nullptr) {}
+
+    void deliver(const char *topic, const char *payload, size_t length)
+    {
+        if (handler)
+            handler(topic, payload, length);
+    }
+
+private:
+    transport_handler_t handler;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "transport_frame.h"
+
+#include <string.h>
+
+#define FRAME_MAGIC_0 'U'
+#define FRAME_MAGIC_1 'S'
+
+size_t transportFrameEncode(uint8_t *frame, const char *topic, const char *payload, size_t length,
+                            uint8_t flags, uint8_t sequence)
+{
+    size_t topic_length = strlen(topic);
+    if (topic_length == 0 || topic_length > 255)
+        return 0;
+    size_t size = TRANSPORT_FRAME_HEADER + topic_length + length;
+    if (size > TRANSPORT_FRAME_MAX)
+        return 0;
+
+    frame[0] = FRAME_MAGIC_0;
+    frame[1] = FRAME_MAGIC_1;
+    frame[2] = TRANSPORT_FRAME_FORMAT;
+    frame[3] = flags;
+    frame[4] = sequence;
+    frame[5] = topic_length;
+    memcpy(frame + TRANSPORT_FRAME_HEADER, topic, topic_length);
+    memcpy(frame + TRANSPORT_FRAME_HEADER + topic_length, payload, length);
+    return size;
+}
+
+bool transportFrameDecode(const uint8_t *frame, size_t size, transport_message_t &message)
+{
+    if (size < TRANSPORT_FRAME_HEADER || size > TRANSPORT_FRAME_MAX)
+        return false;
+    if (frame[0] != FRAME_MAGIC_0 || frame[1] != FRAME_MAGIC_1 || frame[2] != TRANSPORT_FRAME_FORMAT)
+        return false;
+    uint8_t topic_length = frame[5];
+    if (topic_length == 0 || (size_t)TRANSPORT_FRAME_HEADER + topic_length > size)
+        return false;
+
+    message.flags = frame[3];
+    message.sequence = frame[4];
+    message.topic = (const char *)frame + TRANSPORT_FRAME_HEADER;
+    message.topic_length = topic_length;
+    message.payload = message.topic + topic_length;
+    message.length = size - TRANSPORT_FRAME_HEADER - topic_length;
+    return true;
+}
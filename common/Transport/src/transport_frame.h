@@ -0,0 +1,39 @@
+#ifndef TRANSPORT_FRAME_H
+#define TRANSPORT_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Datagram encoding of a message for the links without a broker (ESP-NOW,
+// loopback): a whole message per frame, no fragmentation.
+//   0  magic 'U' 'S'
+//   2  format
+//   3  flags (bit 0: retained)
+//   4  sequence number, per sender
+//   5  topic length
+//   6  topic, then the payload up to the end of the frame
+// Frames of other applications sharing the channel are recognised by the
+// magic and dropped.
+
+#define TRANSPORT_FRAME_MAX 250 // ESP-NOW payload limit
+#define TRANSPORT_FRAME_HEADER 6
+#define TRANSPORT_FRAME_FORMAT 1
+#define TRANSPORT_FRAME_RETAINED 0x01
+
+typedef struct transport_message
+{
+    const char *topic; // not terminated, points into the frame
+    uint8_t topic_length;
+    const char *payload;
+    size_t length;
+    uint8_t flags;
+    uint8_t sequence;
+} transport_message_t;
+
+// Frame size, 0 if the message doesn't fit in TRANSPORT_FRAME_MAX
+size_t transportFrameEncode(uint8_t *frame, const char *topic, const char *payload, size_t length,
+                            uint8_t flags, uint8_t sequence);
+// False if the frame is not a message of ours
+bool transportFrameDecode(const uint8_t *frame, size_t size, transport_message_t &message);
+
+#endif
@@ -0,0 +1,75 @@
+import struct
+
+# Reading log segments of the sensors nodes (sensors/Sensors/lib/ReadingLog
+# and LogCodec): a header, then one record per log window with varints for
+# the metric mask, the delta-of-delta timestamp and the zigzag value deltas.
+
+LOG_MAGIC = 0x31474C55
+SEGMENT_HEADER = struct.Struct("<IIIIB3x")  # magic, seq, first_ts, layout, metrics
+CHUNK_HEADER = struct.Struct("<IHH")  # seq, offset, segment length
+
+
+def _varint(data, pos):
+    value, shift = 0, 0
+    while pos < len(data) and shift < 35:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+        shift += 7
+    raise ValueError("truncated record")
+
+
+def _unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_segment(data, metric_names, layout, scale):
+    """Yield (epoch seconds, {metric: value}) for every complete record."""
+    magic, seq, first_ts, seg_layout, metrics = SEGMENT_HEADER.unpack_from(data)
+    if magic != LOG_MAGIC or seg_layout != layout or metrics != len(metric_names):
+        return
+    ts, period = first_ts, 0
+    last = [0] * metrics
+    pos = SEGMENT_HEADER.size
+    while pos < len(data):
+        try:
+            mask, pos = _varint(data, pos)
+            dod, pos = _varint(data, pos)
+            if mask >> metrics:
+                return
+            values = {}
+            for m in range(metrics):
+                if mask & (1 << m):
+                    delta, pos = _varint(data, pos)
+                    last[m] += _unzigzag(delta)
+                    values[metric_names[m]] = last[m] / scale
+        except ValueError:
+            return  # torn write at the end of the segment
+        period += _unzigzag(dod)
+        ts += period
+        yield ts, values
+
+
+class Reassembly:
+    """Chunks of one history query, until its done message."""
+
+    def __init__(self):
+        self.segments = {}  # seq -> [bytearray, received bytes]
+
+    def add(self, payload):
+        seq, offset, length = CHUNK_HEADER.unpack_from(payload)
+        body = payload[CHUNK_HEADER.size:]
+        segment = self.segments.setdefault(seq, [bytearray(length), 0])
+        if len(segment[0]) != length or offset + len(body) > length:
+            return
+        segment[0][offset:offset + len(body)] = body
+        segment[1] += len(body)
+
+    def complete(self):
+        # segments overwritten on the node while streaming stay incomplete
+        for seq in sorted(self.segments):
+            data, received = self.segments[seq]
+            if received == len(data):
+                yield bytes(data)
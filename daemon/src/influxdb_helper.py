@@ -1,5 +1,7 @@
-from influxdb_client import InfluxDBClient, Point
-from influxdb_client.client.write_api import SYNCHRONOUS
+import time
+
+from influxdb_client import InfluxDBClient, Point, WritePrecision
+from influxdb_client.client.write_api import WriteOptions
 
 
 def getInfluxClient():
@@ -13,7 +15,42 @@ def createBucketInflux(influxClient, bucket_name):
         buckets_api.create_bucket(bucket_name=bucket_name)
     return
 
-def writeDataToInflux(influxClient, bucket_name, mac, type, value):
-    write_api = influxClient.write_api(write_options=SYNCHRONOUS)
-    p = Point(mac).field(type, value)
+def getWriteApi(influxClient):
+    # readings carry their own timestamp, so points can be batched
+    # and flushed in the background without shifting the time axis
+    return influxClient.write_api(write_options=WriteOptions(batch_size=500, flush_interval=1000))
+
+
+def writeDataToInflux(write_api, bucket_name, mac, type, value, window=None, ts=None):
+    if ts is None:
+        # node clock not synced yet: stamp at ingest
+        ts = int(time.time() * 1000)
+    p = Point(mac).field(type, value).time(ts, WritePrecision.MS)
+    if window:
+        for stat, stat_value in window.items():
+            p = p.field(type + "_" + stat, stat_value)
+    write_api.write(bucket=bucket_name, record=p)
+
+
+def lastReadingTime(influxClient, bucket_name, mac, days=30):
+    # newest point of a node in ms since the epoch, None if there is none
+    query = ('from(bucket: "%s") |> range(start: -%dd) '
+             '|> filter(fn: (r) => r._measurement == "%s") |> last() '
+             '|> keep(columns: ["_time"])') % (bucket_name, days, mac)
+    newest = None
+    for table in influxClient.query_api().query(query):
+        for record in table.records:
+            t = int(record.get_time().timestamp() * 1000)
+            newest = t if newest is None else max(newest, t)
+    return newest
+
+
+def writeBackfillToInflux(write_api, bucket_name, mac, ts, values):
+    # window means from the node's flash log; light and flame keep their
+    # live field boolean, so only the mean is written for them
+    p = Point(mac).time(ts, WritePrecision.MS)
+    for type, value in values.items():
+        p = p.field(type + "_mean", value)
+        if type.split("/")[0] not in ("light", "flame"):
+            p = p.field(type, value)
     write_api.write(bucket=bucket_name, record=p)
@@ -1,15 +1,33 @@
 import json
 import secrets
+import time
 
 import paho.mqtt.client as mqtt
 
+import history_log
 import influxdb_helper
 import mysql_helper
 
 mqttClient = mqtt.Client()
 influxdbClient = influxdb_helper.getInfluxClient()
+influxWriteApi = influxdb_helper.getWriteApi(influxdbClient)
 bucketName = "home-monitor-logs"
 
+# Device registry: a full snapshot for bootstrap/resync plus one retained
+# delta per change, both carrying a monotonically increasing version
+TOPIC_DEVICES = "unishare/devices/all_sensors"
+TOPIC_DEVICES_DELTA = "unishare/devices/all_sensors/delta"
+TOPIC_DEVICES_RESYNC = "unishare/devices/all_sensors/resync"
+# Wall clock for the nodes that can't reach an SNTP server
+TOPIC_TIME = "unishare/time"
+TIME_PERIOD = 60  # seconds
+registryVersion = int(time.time())  # keeps growing across daemon restarts
+# Readings missed during an outage are asked back to the node's flash log
+TOPIC_HISTORY = "unishare/history/"
+BACKFILL_GAP = 300  # seconds without readings before a backfill
+BACKFILL_RETRY = 600  # seconds before asking again for an unanswered query
+backfills = {}  # mac -> since (ms), requested at (s), chunks
+
 
 def json_all_sensors():
     devices = mysql_helper.get_all_sensors()
@@ -22,46 +40,137 @@ def json_all_sensors():
         device_dict["TYPE"] = device[2]
         jsondata.append(device_dict)
 
-    jsondata = json.dumps(jsondata)
+    jsondata = json.dumps({"version": registryVersion, "devices": jsondata})
     return jsondata
 
 
+def publish_registry_snapshot(client):
+    json_sensors = json_all_sensors()
+    print(json_sensors)
+    client.publish(TOPIC_DEVICES, payload=json_sensors, qos=1, retain=True)
+
+
+def publish_registry_delta(client, op, mac_address, name, dev_type):
+    global registryVersion
+    registryVersion += 1
+    delta = {"version": registryVersion, "op": op,
+             "MAC_ADDRESS": mac_address, "NAME": name, "TYPE": dev_type}
+    print(delta)
+    client.publish(TOPIC_DEVICES_DELTA, payload=json.dumps(delta), qos=1, retain=True)
+
+
+def publish_time(client):
+    # not retained: a stale time must never be delivered
+    payload = json.dumps({"epoch_ms": int(time.time() * 1000)})
+    client.publish(TOPIC_TIME, payload=payload, qos=0, retain=False)
+
+
+def request_backfill(client, mac):
+    since = influxdb_helper.lastReadingTime(influxdbClient, bucketName, mac)
+    now = int(time.time() * 1000)
+    if since is None or now - since < BACKFILL_GAP * 1000:
+        return  # unknown or no gap
+    pending = backfills.get(mac)
+    if pending is not None and time.time() - pending["requested"] < BACKFILL_RETRY:
+        return
+    backfills[mac] = {"since": since, "requested": time.time(),
+                      "chunks": history_log.Reassembly()}
+    query = {"from": since, "to": now, "id": "backfill-%d" % now}
+    print("Backfill %s from %d" % (mac, since))
+    client.publish("unishare/control/" + mac + "/history",
+                   payload=json.dumps(query), qos=1, retain=False)
+
+
+def on_history(topic, payload):
+    # binary chunks on unishare/history/<mac>, then unishare/history/<mac>/done
+    split_topic = topic.split("/")
+    mac = split_topic[2]
+    if len(split_topic) == 3:
+        if mac in backfills:
+            backfills[mac]["chunks"].add(payload)
+        return
+    backfill = backfills.pop(mac, None)
+    if backfill is None:
+        return
+    done = json.loads(payload.decode("utf-8"))
+    points = 0
+    for segment in backfill["chunks"].complete():
+        for ts, values in history_log.decode_segment(
+                segment, done["metrics"], done["layout"], done["scale"]):
+            ts_ms = ts * 1000
+            if ts_ms <= backfill["since"] or not values:
+                continue  # already stored live
+            influxdb_helper.writeBackfillToInflux(
+                influxWriteApi, bucketName, mac, ts_ms, values)
+            points += 1
+    print("Backfill %s: %d points from %d bytes" % (mac, points, done["bytes"]))
+
+
 def on_connect(client, userdata, flags, rc):
     print("Connected with result code "+str(rc))
     client.subscribe("unishare/devices/setup", qos=1)
     client.subscribe("unishare/sensors/#", qos=1)
     client.subscribe("unishare/devices/status/#", qos=1)
+    client.subscribe("unishare/devices/remove", qos=1)
+    client.subscribe(TOPIC_DEVICES_RESYNC, qos=1)
+    client.subscribe(TOPIC_HISTORY + "#", qos=1)
 
 
 
 def on_message(client, userdata, msg):
     print(msg.topic)
+    if msg.topic.startswith(TOPIC_HISTORY):
+        on_history(msg.topic, msg.payload)
+        return
     print(json.loads(msg.payload.decode("utf-8")))
     if msg.topic == "unishare/devices/setup":
         x = json.loads(msg.payload.decode("utf-8"))
-        add_status = mysql_helper.add_device_to_db(
+        op = mysql_helper.add_device_to_db(
             x["mac_address"], x["name"], x["type"])
-        if add_status == True:
-            json_sensors = json_all_sensors()
-            print(json_sensors)
-            client.publish("unishare/devices/all_sensors",
-                           payload=json_sensors, qos=1, retain=True)
+        # only sensors are listed in the registry
+        if op is not None and x["type"].lower() == "sensors":
+            publish_registry_delta(
+                client, op, x["mac_address"], x["name"], x["type"])
+        return
+    if msg.topic == "unishare/devices/remove":
+        x = json.loads(msg.payload.decode("utf-8"))
+        if mysql_helper.remove_device_from_db(x["mac_address"]):
+            publish_registry_delta(
+                client, "remove", x["mac_address"], "", "")
+        return
+    if msg.topic == TOPIC_DEVICES_RESYNC:
+        # a subscriber found a gap in the deltas
+        publish_registry_snapshot(client)
         return
     if msg.topic.startswith('unishare/sensors'):
         split_topic = msg.topic.split("/")
         mac = split_topic[2]
-        data_type = split_topic[3]
+        # <metric> or <metric>/<channel> for the other probes of a node
+        data_type = "/".join(split_topic[3:])
+        kind = split_topic[3]
         data_json = json.loads(msg.payload.decode("utf-8"))
 
-        if (data_type == "temperature" or data_type == "apparent_temperature" or data_type == "humidity"):
-            value = float(data_json["value"])
-        elif (data_type == "rssi"):
+        if (kind == "rssi"):
             value = int(data_json["value"])
-        elif (data_type == "light" or data_type == "flame"):
+        elif (kind == "light" or kind == "flame"):
             value = bool(data_json["value"])
+        else:
+            # temperature, humidity, pressure, ... (any driver metric)
+            value = float(data_json["value"])
+
+        # window statistics aggregated on the node (if any)
+        window = {}
+        for stat in ("min", "max", "mean", "stddev"):
+            if stat in data_json and data_json[stat] is not None:
+                window[stat] = float(data_json[stat])
+        if "count" in data_json:
+            window["count"] = int(data_json["count"])
+
+        # device-side timestamp in ms since the epoch (if its clock is synced)
+        ts = int(data_json["ts"]) if "ts" in data_json else None
 
         influxdb_helper.writeDataToInflux(
-            influxdbClient, bucketName, mac, data_type, value)
+            influxWriteApi, bucketName, mac, data_type, value, window, ts)
         print(mac)
         print(data_type)
         print(value)
@@ -72,6 +181,8 @@ def on_message(client, userdata, msg):
         data_json = json.loads(msg.payload.decode("utf-8"))
         status = bool(data_json["connected"])
         mysql_helper.update_device_status_db(mac, status)
+        if status:
+            request_backfill(client, mac)
         return
 
 def main():
@@ -80,10 +191,15 @@ def main():
     mqttClient.on_connect = on_connect
     mqttClient.on_message = on_message
     mqttClient.connect(secrets.MQTT_BROKERIP, 1883, 60)
-    json_sensors = json_all_sensors()
-    mqttClient.publish("unishare/devices/all_sensors",
-                       payload=json_sensors, qos=1, retain=True)
-    mqttClient.loop_forever()
+    publish_registry_snapshot(mqttClient)
+    mqttClient.loop_start()
+    try:
+        while True:
+            publish_time(mqttClient)
+            time.sleep(TIME_PERIOD)
+    finally:
+        # flush the points still in the batch
+        influxWriteApi.close()
     
 if __name__ == "__main__":
     main()
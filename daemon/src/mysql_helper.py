@@ -50,22 +50,44 @@ def exist_device_in_db(mac_address):
         result = cursor.fetchall()
         return bool(len(result) == 1)
 
+def get_device_name(mac_address):
+    conn = connect_db()
+    with conn.cursor() as cursor:
+        sql = "SELECT NAME FROM `home_monitor_devices` WHERE MAC_ADDRESS=%s"
+        cursor.execute(sql, (mac_address,))
+        result = cursor.fetchone()
+        return result['NAME'] if result else None
+
+# Returns the registry change: "add", "rename" or None if nothing changed
 def add_device_to_db(mac_address, name, dev_type):
     conn = connect_db()
     if exist_device_in_db(mac_address):
+        if get_device_name(mac_address) == name:
+            return None
         print("Device ", mac_address, " already in db, with updating name ", name)
         with conn.cursor() as cursor:
             sql = "UPDATE `home_monitor_devices` SET `NAME` = %s WHERE `home_monitor_devices`.`MAC_ADDRESS` = %s;"
             cursor.execute(sql, (name, mac_address))
             conn.commit()
-            return True
+            return "rename"
     else:
         print("Adding device ", mac_address, " with name ", name, " type ", dev_type)      
         with conn.cursor() as cursor:
             sql = "INSERT INTO `home_monitor_devices` VALUES(%s, %s, %s, TRUE)"
             cursor.execute(sql, (mac_address, name, dev_type,))
             conn.commit()
-            return True
+            return "add"
+
+def remove_device_from_db(mac_address):
+    conn = connect_db()
+    if not exist_device_in_db(mac_address):
+        return False
+    print("Removing device ", mac_address)
+    with conn.cursor() as cursor:
+        sql = "DELETE FROM `home_monitor_devices` WHERE `home_monitor_devices`.`MAC_ADDRESS` = %s;"
+        cursor.execute(sql, (mac_address,))
+        conn.commit()
+        return True
 
 def update_device_status_db(mac_address, status):
     conn = connect_db()
@@ -0,0 +1,52 @@
+#ifndef NODE_CONFIG_H
+#define NODE_CONFIG_H
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+#include <broker_link.h>
+
+// Defaults of the runtime tunables (see unishare/config/<mac>)
+#define DISPLAY_REFRESH_RATE 5000
+#define USER_DELAY 30000
+#define HISTORY_SLOT 900000 // time covered by a point of the trends (16 points: 4 h)
+#define CONNECTION_TIMEOUT_CUSTOM 15000
+#define DEVICE_NAME "schermo1"
+#define TLS_FRAGMENT 512 // requested TLS max fragment length, 0 = full 16 KB records
+#define LOCAL_CHANNEL 0   // WiFi channel of the ESP-NOW readings (the AP's), 0 = not listening
+#define LOCAL_ONLY 0      // 1 to show the ESP-NOW readings only, without WiFi and broker
+
+#define CONFIG_PATH "/config.bin"
+#define CONFIG_VERSION 4 // bump when node_config_t changes, and add the old layout to node_config.cpp
+
+// Integers first so that the packed layout stays naturally aligned
+typedef struct __attribute__((packed)) node_config
+{
+    uint32_t revision; // incremented by every applied update
+    uint32_t display_refresh_rate;
+    uint32_t user_delay;
+    uint32_t connection_timeout;
+    uint32_t history_slot; // ms per trend point
+    uint16_t mqtt_port;
+    uint16_t tls_fragment;
+    uint8_t local_channel; // ESP-NOW readings from the sensors nodes, 0 = off
+    uint8_t local_only;    // no WiFi association nor broker session
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char mqtt_fingerprint[BROKER_LINK_FINGERPRINT_LEN]; // broker certificate SHA-1, empty for plain MQTT
+} node_config_t;
+
+extern node_config_t config;
+
+// Load the configuration from flash (defaults on first boot)
+void configBegin();
+// Apply a partial JSON update, stored before it becomes effective
+bool configUpdate(const char *payload, size_t length);
+// Report the current configuration (secrets excluded)
+void configReport(JsonObject out);
+
+#endif
@@ -0,0 +1,194 @@
+#include "device_list_parser.h"
+
+#include <string.h>
+
+void DeviceListParser::begin(device_list_entry_t entry_callback, void *entry_context)
+{
+    callback = entry_callback;
+    context = entry_context;
+    depth = 0;
+    array_depth = 0;
+    started = false;
+    done = false;
+    failed = false;
+    in_string = false;
+    escape = false;
+    expect_key = false;
+    field = FIELD_OTHER;
+    key_length = 0;
+    value_length = 0;
+    mac[0] = '\0';
+    name[0] = '\0';
+    entries = 0;
+    snapshot_version = 0;
+}
+
+bool DeviceListParser::feed(const char *data, size_t length)
+{
+    for (size_t i = 0; i < length && !failed; i++)
+        failed = !feedChar(data[i]);
+    return !failed;
+}
+
+bool DeviceListParser::end()
+{
+    return !failed && done && array_depth != 0;
+}
+
+size_t DeviceListParser::count() const
+{
+    return entries;
+}
+
+unsigned long DeviceListParser::version() const
+{
+    return snapshot_version;
+}
+
+void DeviceListParser::keyChar(char c)
+{
+    if (key_length < sizeof(key) - 1)
+        key[key_length++] = c;
+    else
+        key_length = sizeof(key); // too long, can't be a known key
+}
+
+void DeviceListParser::valueChar(char c)
+{
+    if (field == FIELD_MAC && value_length < sizeof(mac) - 1)
+    {
+        mac[value_length++] = c;
+        mac[value_length] = '\0';
+    }
+    else if (field == FIELD_NAME && value_length < sizeof(name) - 1)
+    {
+        name[value_length++] = c;
+        name[value_length] = '\0';
+    }
+}
+
+DeviceListParser::Field DeviceListParser::keyField() const
+{
+    bool in_entry = array_depth != 0 && depth == array_depth + 1;
+    if (in_entry && key_length == 11 && memcmp(key, "MAC_ADDRESS", 11) == 0)
+        return FIELD_MAC;
+    if (in_entry && key_length == 4 && memcmp(key, "NAME", 4) == 0)
+        return FIELD_NAME;
+    if (depth == 1 && key_length == 7 && memcmp(key, "version", 7) == 0)
+        return FIELD_VERSION;
+    if (depth == 1 && key_length == 7 && memcmp(key, "devices", 7) == 0)
+        return FIELD_DEVICES;
+    return FIELD_OTHER;
+}
+
+bool DeviceListParser::feedChar(char c)
+{
+    // objects whose keys are tracked: the wrapper and the entries
+    bool tracked = (depth == 1 && array_depth != 1) || (array_depth != 0 && depth == array_depth + 1);
+
+    if (in_string)
+    {
+        if (escape)
+        {
+            escape = false;
+            // control escapes become spaces, the others are kept literally (\uXXXX is not decoded)
+            c = (c == 'n' || c == 't' || c == 'r' || c == 'b' || c == 'f') ? ' ' : c;
+        }
+        else if (c == '\\')
+        {
+            escape = true;
+            return true;
+        }
+        else if (c == '"')
+        {
+            in_string = false;
+            if (tracked && expect_key)
+                field = keyField();
+            return true;
+        }
+
+        if (tracked)
+        {
+            if (expect_key)
+                keyChar(c);
+            else
+                valueChar(c);
+        }
+        return true;
+    }
+
+    if (done)
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\0';
+
+    switch (c)
+    {
+    case '"':
+        in_string = true;
+        if (tracked)
+        {
+            if (expect_key)
+                key_length = 0;
+            else
+                value_length = 0;
+        }
+        return true;
+    case '[':
+    case '{':
+        if (!started)
+        {
+            started = true;
+            if (c == '[')
+                array_depth = 1; // bare array
+            else
+                expect_key = true;
+        }
+        else if (array_depth == 0 && depth == 1 && field == FIELD_DEVICES && c == '[')
+        {
+            array_depth = 2;
+        }
+        else if (array_depth != 0 && depth == array_depth)
+        {
+            if (c != '{')
+                return false;
+            mac[0] = '\0';
+            name[0] = '\0';
+            expect_key = true;
+            field = FIELD_OTHER;
+        }
+        depth++;
+        return depth != 0; // overflow on absurd nesting
+    case ']':
+    case '}':
+        if (depth == 0)
+            return false;
+        if (array_depth != 0 && depth == array_depth + 1 && c == '}')
+        {
+            if (mac[0] != '\0')
+            {
+                entries++;
+                if (callback)
+                    callback(mac, name, context);
+            }
+        }
+        depth--;
+        if (depth == 0)
+            done = true;
+        return true;
+    case ':':
+        if (tracked)
+            expect_key = false;
+        return true;
+    case ',':
+        if (tracked)
+        {
+            expect_key = true;
+            field = FIELD_OTHER;
+        }
+        return true;
+    default:
+        if (tracked && field == FIELD_VERSION && c >= '0' && c <= '9')
+            snapshot_version = snapshot_version * 10 + (c - '0');
+        // other numbers, literals and whitespace are skipped
+        return true;
+    }
+}
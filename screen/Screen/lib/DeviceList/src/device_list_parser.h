@@ -0,0 +1,68 @@
+#ifndef DEVICE_LIST_PARSER_H
+#define DEVICE_LIST_PARSER_H
+
+#include <stddef.h>
+
+#define DEVICE_LIST_MAC_LEN 18  // including the terminator
+#define DEVICE_LIST_NAME_LEN 24 // longer names are truncated
+
+// Called for every complete entry of the array
+typedef void (*device_list_entry_t)(const char *mac, const char *name, void *context);
+
+// Incremental parser of the device registry snapshot published on
+// unishare/devices/all_sensors:
+//   {"version": 12, "devices": [{"MAC_ADDRESS": "...", "NAME": "...", "TYPE": "sensors"}, ...]}
+// (a bare array of entries is accepted too, with version 0).
+// Bytes can be fed in any number of chunks; each entry is reported as soon as
+// its object is closed, so memory use does not depend on the list length.
+// Other keys, nested values and escapes are skipped.
+class DeviceListParser
+{
+public:
+    void begin(device_list_entry_t callback, void *context);
+    // False once the input is not a valid device list
+    bool feed(const char *data, size_t length);
+    // True if a complete snapshot was parsed
+    bool end();
+    // Entries reported so far
+    size_t count() const;
+    // Registry version of the snapshot
+    unsigned long version() const;
+
+private:
+    enum Field
+    {
+        FIELD_OTHER,
+        FIELD_MAC,
+        FIELD_NAME,
+        FIELD_VERSION,
+        FIELD_DEVICES,
+    };
+
+    bool feedChar(char c);
+    void keyChar(char c);
+    void valueChar(char c);
+    Field keyField() const;
+
+    device_list_entry_t callback;
+    void *context;
+
+    unsigned char depth;
+    unsigned char array_depth; // depth of the entries array, 0 until found
+    bool started;
+    bool done;
+    bool failed;
+    bool in_string;
+    bool escape;
+    bool expect_key; // next string of the current object is a key
+    Field field;     // key being read, or field of the value being read
+    char key[12];
+    unsigned char key_length;
+    unsigned char value_length;
+    char mac[DEVICE_LIST_MAC_LEN];
+    char name[DEVICE_LIST_NAME_LEN];
+    size_t entries;
+    unsigned long snapshot_version;
+};
+
+#endif
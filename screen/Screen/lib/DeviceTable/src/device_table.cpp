@@ -0,0 +1,250 @@
+#include "device_table.h"
+
+#include <string.h>
+
+#include <json_arena.h>
+
+const history_range_t history_ranges[HISTORY_METRICS] = {{-20, 60}, {0, 100}, {-20, 60}};
+const char *const history_labels[HISTORY_METRICS] = {"Temp", "Hum", "App"};
+
+// Topic level that ends at end (a '/' or the terminator), a MAC
+static bool topicLevel(const char *topic, const char *end, char *mac)
+{
+    const char *begin = end;
+    while (begin > topic && *(begin - 1) != '/')
+        begin--;
+    size_t length = end - begin;
+    if (length == 0 || length >= DEVICE_LIST_MAC_LEN)
+        return false;
+    memcpy(mac, begin, length);
+    mac[length] = '\0';
+    return true;
+}
+
+// unishare/sensors/<mac>/<metric>[/<ID>]: the MAC, and the metric with the
+// channel ID if any; NULL for another topic
+static const char *readingTopic(const char *topic, char *mac)
+{
+    size_t prefix = strlen(MQTT_TOPIC_SENSORS);
+    if (strncmp(topic, MQTT_TOPIC_SENSORS, prefix) != 0)
+        return NULL;
+    const char *end = strchr(topic + prefix, '/');
+    if (end == NULL || end[1] == '\0' || !topicLevel(topic, end, mac))
+        return NULL;
+    return end + 1;
+}
+
+// First level of a metric: "temperature" matches "temperature" and the
+// channels "temperature/<ID>"
+static bool isMetric(const char *metric, const char *name)
+{
+    size_t length = strlen(name);
+    return strncmp(metric, name, length) == 0 && (metric[length] == '\0' || metric[length] == '/');
+}
+
+static void copyName(char *out, const char *in, size_t size)
+{
+    strncpy(out, in, size - 1);
+    out[size - 1] = '\0';
+}
+
+DeviceTable::DeviceTable() : count(0), entries(0), registry_version(-1), resync_pending(false), history_changed(false)
+{
+    for (int i = 0; i < MAX_DEVICES; i++)
+        devices[i] = sensors_t();
+    // Only the value and the device timestamp of the window statistics are kept
+    reading_filter["value"] = true;
+    reading_filter["ts"] = true;
+}
+
+bool DeviceTable::snapshot(const char *payload, size_t length)
+{
+    entries = 0;
+    list_parser.begin(listEntry, this);
+    bool ok = list_parser.feed(payload, length) && list_parser.end();
+    count = entries < MAX_DEVICES ? entries : MAX_DEVICES;
+    registry_version = ok ? (long)list_parser.version() : -1;
+    return ok;
+}
+
+void DeviceTable::listEntry(const char *mac, const char *name, void *context)
+{
+    // Insert the i-th entry of the list in the i-th slot, keeping known devices' data
+    DeviceTable *table = (DeviceTable *)context;
+    int slot = table->entries++;
+    if (slot >= MAX_DEVICES)
+        return;
+
+    int found = -1;
+    for (int i = slot; i < MAX_DEVICES; i++)
+    {
+        if (strcmp(table->devices[i].mac, mac) == 0)
+        {
+            found = i;
+            break;
+        }
+    }
+
+    sensors_t &device = table->devices[slot];
+    if (found > slot)
+    {
+        sensors_t known = table->devices[found];
+        table->devices[found] = device;
+        device = known;
+    }
+    else if (found < 0)
+    {
+        device = sensors_t();
+        copyName(device.mac, mac, sizeof(device.mac));
+    }
+    copyName(device.name, name, sizeof(device.name));
+}
+
+void DeviceTable::delta(const char *payload, size_t length)
+{
+    JsonScope<192> doc;
+    if (deserializeJson(doc, payload, length))
+        return;
+
+    long version = doc["version"] | -1L;
+    if (registry_version < 0)
+    {
+        resync_pending = true; // no snapshot yet
+        return;
+    }
+    if (version <= registry_version)
+        return; // already part of our table (retained delta replayed on subscribe)
+    if (version != registry_version + 1)
+    {
+        resync_pending = true;
+        return;
+    }
+
+    const char *op = doc["op"] | "";
+    const char *mac = doc["MAC_ADDRESS"] | "";
+    const char *name = doc["NAME"] | "";
+    int index = find(mac);
+
+    if (strcmp(op, "add") == 0 || strcmp(op, "rename") == 0)
+    {
+        if (index < 0 && count < MAX_DEVICES)
+        {
+            index = count++;
+            devices[index] = sensors_t();
+            copyName(devices[index].mac, mac, sizeof(devices[index].mac));
+        }
+        if (index >= 0)
+            copyName(devices[index].name, name, sizeof(devices[index].name));
+    }
+    else if (strcmp(op, "remove") == 0 && index >= 0)
+    {
+        // keep the table dense, the last device takes the free slot
+        count--;
+        devices[index] = devices[count];
+    }
+    registry_version = version;
+}
+
+int DeviceTable::reading(const char *topic, const char *payload, size_t length, uint32_t history_slot)
+{
+    char mac[DEVICE_LIST_MAC_LEN];
+    const char *metric = readingTopic(topic, mac);
+    if (metric == NULL)
+        return -1;
+    int index = find(mac);
+    if (index < 0)
+        return -1;
+
+    JsonScope<64> doc;
+    deserializeJson(doc, payload, length, DeserializationOption::Filter(reading_filter));
+
+    sensors_t &device = devices[index];
+    if (isMetric(metric, "humidity"))
+    {
+        device.humidity = doc["value"].as<double>();
+        recordHistory(device, HISTORY_HUMIDITY, device.humidity, doc, history_slot);
+    }
+    else if (isMetric(metric, "temperature"))
+    {
+        device.temperature = doc["value"].as<double>();
+        recordHistory(device, HISTORY_TEMPERATURE, device.temperature, doc, history_slot);
+    }
+    else if (isMetric(metric, "apparent_temperature"))
+    {
+        device.apparent_temperature = doc["value"].as<double>();
+        recordHistory(device, HISTORY_APPARENT_TEMPERATURE, device.apparent_temperature, doc, history_slot);
+    }
+    else if (isMetric(metric, "flame"))
+        device.flame = doc["value"].as<bool>();
+    else if (isMetric(metric, "light"))
+        device.light = doc["value"].as<bool>();
+    else if (isMetric(metric, "rssi"))
+        device.rssi = doc["value"].as<long>();
+    return index;
+}
+
+void DeviceTable::recordHistory(sensors_t &device, uint8_t metric, float value, JsonDocument &reading,
+                                uint32_t history_slot)
+{
+    // Slots come from the device clock, so retained and late readings land
+    // where they belong; readings without a timestamp are not recorded
+    uint64_t ts = reading["ts"] | (uint64_t)0;
+    if (ts == 0)
+        return;
+    historyAdd(device.history[metric], historyQuantize(value, history_ranges[metric]), ts / history_slot);
+    history_changed = true;
+}
+
+int DeviceTable::status(const char *topic, const char *payload, size_t length)
+{
+    char mac[DEVICE_LIST_MAC_LEN];
+    if (!topicLevel(topic, topic + strlen(topic), mac))
+        return -1;
+    int index = find(mac);
+    if (index < 0)
+        return -1;
+
+    JsonScope<32> doc;
+    deserializeJson(doc, payload, length);
+    devices[index].status = doc["connected"].as<bool>();
+    return index;
+}
+
+void DeviceTable::heard(const char *topic)
+{
+    char mac[DEVICE_LIST_MAC_LEN];
+    if (registry_version >= 0 || count >= MAX_DEVICES || readingTopic(topic, mac) == NULL || find(mac) >= 0)
+        return;
+    sensors_t &device = devices[count++];
+    device = sensors_t();
+    copyName(device.mac, mac, sizeof(device.mac));
+    copyName(device.name, mac, sizeof(device.name));
+}
+
+int DeviceTable::find(const char *mac) const
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(devices[i].mac, mac) == 0)
+            return i;
+    }
+    return -1;
+}
+
+sensors_t *DeviceTable::storage()
+{
+    for (int i = count; i < MAX_DEVICES; i++)
+        devices[i] = sensors_t();
+    history_changed = false;
+    return devices;
+}
+
+void DeviceTable::restore()
+{
+    count = 0;
+    while (count < MAX_DEVICES && devices[count].mac[0] != '\0')
+    {
+        devices[count].status = false; // until its status arrives
+        count++;
+    }
+}
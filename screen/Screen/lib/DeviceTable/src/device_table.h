@@ -0,0 +1,109 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+#include <device_list_parser.h>
+#include <metric_history.h>
+
+// Devices shown by the screen, with their latest readings and trends, and
+// the handlers of the messages that update them: registry snapshots and
+// deltas, readings and statuses. The MQTT callback of the firmware calls
+// them with the topic and payload as received; the trace replay of the
+// simulator calls the same ones. The table is dense, devices are in the
+// order of the registry.
+
+#define MAX_DEVICES 32 // capacity of the device table
+#define MQTT_TOPIC_SENSORS "unishare/sensors/"
+
+// Metrics with a trend on the screen
+typedef enum history_metric
+{
+    HISTORY_TEMPERATURE,
+    HISTORY_HUMIDITY,
+    HISTORY_APPARENT_TEMPERATURE,
+    HISTORY_METRICS,
+} history_metric_t;
+
+#define HISTORY_RAM_BUDGET 2560 // bytes for the trends of the whole device table
+
+typedef struct sensors
+{
+    float humidity;
+    float temperature;
+    float apparent_temperature;
+    bool flame;
+    bool light;
+    long rssi;
+    char mac[DEVICE_LIST_MAC_LEN];
+    char name[DEVICE_LIST_NAME_LEN];
+    bool status;
+    metric_history_t history[HISTORY_METRICS];
+} sensors_t;
+
+static_assert(sizeof(metric_history_t) * HISTORY_METRICS * MAX_DEVICES <= HISTORY_RAM_BUDGET, "trends exceed their RAM budget");
+
+// Quantization range and label of the trends
+extern const history_range_t history_ranges[HISTORY_METRICS];
+extern const char *const history_labels[HISTORY_METRICS];
+
+class DeviceTable
+{
+public:
+    DeviceTable();
+
+    // unishare/devices/all_sensors, parsed in place entry by entry: the i-th
+    // entry goes in the i-th slot, known devices keep their data. Entries
+    // past MAX_DEVICES are counted but dropped. False if malformed, the
+    // version is unknown then.
+    bool snapshot(const char *payload, size_t length);
+    // unishare/devices/all_sensors/delta, a single change in place. A delta
+    // without a snapshot or after a gap asks for a resync instead.
+    void delta(const char *payload, size_t length);
+    // unishare/sensors/<mac>/<metric>: index of the device, -1 if unknown.
+    // The readings of a channel, <metric>/<ID>, update that metric too.
+    // Readings with a timestamp are added to the trend, in slots of
+    // history_slot ms of the device clock.
+    int reading(const char *topic, const char *payload, size_t length, uint32_t history_slot);
+    // unishare/devices/status/<mac>: index of the device, -1 if unknown
+    int status(const char *topic, const char *payload, size_t length);
+    // Reading heard on the local link: without a snapshot (local only, broker
+    // not reached yet) its device is added, named after its MAC
+    void heard(const char *topic);
+    int find(const char *mac) const;
+
+    int size() const { return count; }
+    sensors_t &at(int index) { return devices[index]; }
+    const sensors_t &at(int index) const { return devices[index]; }
+    // Entries of the last snapshot, including those that did not fit
+    int listed() const { return entries; }
+    // Registry version of the table, -1 until a snapshot arrives
+    long version() const { return registry_version; }
+    bool resyncPending() const { return resync_pending; }
+    void resyncRequested() { resync_pending = false; }
+
+    // Whole table, as stored across deep sleep. Free slots are cleared
+    // before storing so that restore() finds the end of the table.
+    sensors_t *storage();
+    // After the storage was loaded: devices offline until their status arrives
+    void restore();
+    // Trends changed since storage() was last called
+    bool historyChanged() const { return history_changed; }
+
+private:
+    static void listEntry(const char *mac, const char *name, void *context);
+    void recordHistory(sensors_t &device, uint8_t metric, float value, JsonDocument &reading, uint32_t history_slot);
+
+    sensors_t devices[MAX_DEVICES];
+    int count;
+    int entries;
+    long registry_version;
+    bool resync_pending;
+    bool history_changed;
+    DeviceListParser list_parser;
+    StaticJsonDocument<32> reading_filter; // built once, not in the callback
+};
+
+#endif
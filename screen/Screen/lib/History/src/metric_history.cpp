@@ -0,0 +1,112 @@
+#include "metric_history.h"
+
+#include <string.h>
+
+uint8_t historyQuantize(float value, history_range_t range)
+{
+    if (value <= range.min)
+        return 1;
+    if (value >= range.max)
+        return 255;
+    return 1 + (uint8_t)((value - range.min) * 254 / (range.max - range.min) + 0.5f);
+}
+
+float historyValue(uint8_t point, history_range_t range)
+{
+    return range.min + (point - 1) * (range.max - range.min) / 254;
+}
+
+void historyClear(metric_history_t &history)
+{
+    memset(&history, 0, sizeof(history));
+}
+
+void historyAdd(metric_history_t &history, uint8_t point, uint32_t slot)
+{
+    if (point == HISTORY_EMPTY)
+        return;
+
+    if (history.slot != 0 && slot == history.slot)
+    {
+        // same slot: running mean
+        if (history.samples == 255)
+            return;
+        history.sum += point;
+        history.samples++;
+        history.points[history.head] = (history.sum + history.samples / 2) / history.samples;
+        return;
+    }
+    if (history.slot != 0 && slot < history.slot)
+        return;
+
+    if (history.slot == 0 || slot - history.slot >= HISTORY_POINTS)
+    {
+        // nothing left of the previous points
+        historyClear(history);
+    }
+    else
+    {
+        for (uint32_t skipped = history.slot + 1; skipped < slot; skipped++)
+        {
+            history.head = (history.head + 1) % HISTORY_POINTS;
+            history.points[history.head] = HISTORY_EMPTY;
+        }
+        history.head = (history.head + 1) % HISTORY_POINTS;
+    }
+    history.slot = slot;
+    history.points[history.head] = point;
+    history.sum = point;
+    history.samples = 1;
+}
+
+bool historyPoints(const metric_history_t &history, uint8_t *out)
+{
+    bool any = false;
+    for (uint8_t i = 0; i < HISTORY_POINTS; i++)
+    {
+        out[i] = history.points[(history.head + 1 + i) % HISTORY_POINTS];
+        any = any || out[i] != HISTORY_EMPTY;
+    }
+    return any;
+}
+
+bool historyBounds(const uint8_t *points, uint8_t &lowest, uint8_t &highest)
+{
+    lowest = 255;
+    highest = 0;
+    for (uint8_t i = 0; i < HISTORY_POINTS; i++)
+    {
+        if (points[i] == HISTORY_EMPTY)
+            continue;
+        lowest = points[i] < lowest ? points[i] : lowest;
+        highest = points[i] > highest ? points[i] : highest;
+    }
+    return highest != 0;
+}
+
+// Bar height in pixels (1..8), 0 for an empty point
+static uint8_t barHeight(uint8_t point, uint8_t lowest, uint8_t highest)
+{
+    if (point == HISTORY_EMPTY)
+        return 0;
+    if (highest == lowest)
+        return 4; // flat
+    return 1 + (point - lowest) * 7 / (highest - lowest);
+}
+
+void historySparkline(const uint8_t *points, uint8_t glyphs[HISTORY_GLYPHS][8])
+{
+    uint8_t lowest, highest;
+    historyBounds(points, lowest, highest);
+    for (uint8_t g = 0; g < HISTORY_GLYPHS; g++)
+    {
+        // two bars of 2 columns with a blank column between them
+        uint8_t left = barHeight(points[2 * g], lowest, highest);
+        uint8_t right = barHeight(points[2 * g + 1], lowest, highest);
+        for (uint8_t row = 0; row < 8; row++)
+        {
+            uint8_t level = 8 - row; // row 0 is the top
+            glyphs[g][row] = (left >= level ? 0x18 : 0) | (right >= level ? 0x03 : 0);
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef METRIC_HISTORY_H
+#define METRIC_HISTORY_H
+
+#include <stdint.h>
+
+// Rolling history of a metric, downsampled to one point per time slot and
+// quantized to a byte, for trends on the screen without asking the backend.
+// Readings of the same slot are averaged into the newest point; a reading
+// of a later slot starts a new point, leaving slots without readings empty.
+// Insertion is O(1) (at most HISTORY_POINTS empty points are skipped) and
+// memory is fixed: sizeof(metric_history_t) per metric and device.
+
+#define HISTORY_POINTS 16 // 8 LCD characters, 2 points each
+#define HISTORY_EMPTY 0   // point of a slot without readings
+#define HISTORY_GLYPHS (HISTORY_POINTS / 2)
+
+typedef struct metric_history
+{
+    uint32_t slot;                  // slot of the newest point, 0 while empty
+    uint8_t points[HISTORY_POINTS]; // ring, 1..255
+    uint8_t head;                   // newest point
+    uint8_t samples;                // readings averaged in the newest point
+    uint16_t sum;                   // of their quantized values
+} metric_history_t;
+
+// Quantization of a metric to 1..255 over [min, max], clamped
+typedef struct history_range
+{
+    float min;
+    float max;
+} history_range_t;
+
+uint8_t historyQuantize(float value, history_range_t range);
+float historyValue(uint8_t point, history_range_t range);
+
+void historyClear(metric_history_t &history);
+// Readings older than the newest point (late deliveries) are dropped
+void historyAdd(metric_history_t &history, uint8_t point, uint32_t slot);
+// Points from the oldest to the newest, false if there are none
+bool historyPoints(const metric_history_t &history, uint8_t *out);
+// Lowest and highest non empty points
+bool historyBounds(const uint8_t *points, uint8_t &lowest, uint8_t &highest);
+// HD44780 custom characters (5x8, one byte per row) drawing the points as
+// bars scaled between the lowest and the highest one
+void historySparkline(const uint8_t *points, uint8_t glyphs[HISTORY_GLYPHS][8]);
+
+#endif
@@ -3,38 +3,58 @@
 #include <LiquidCrystal_I2C.h> // display library
 #include <Wire.h>              // I2C library
 #include <ArduinoJson.h>
+#include <json_arena.h>
 #include <MQTT.h>
+#include <ota.h>
+#include <config_store.h>
+#include <broker_link.h>
+#include <device_table.h>
+#include <mqtt_transport.h>
+#include <espnow_transport.h>
+#include <stall_watch.h>
 
 #include <ESP8266WiFi.h>
 #include "secrets.h"
-#include "sensors_t.h"
+#include "node_config.h"
 
 #define DISPLAY_CHARS 16  // number of characters on a line
 #define DISPLAY_LINES 2   // number of display lines
 #define DISPLAY_ADDR 0x27 // display address on I2C bus
-#define DISPLAY_MODE_N 6
-#define DISPLAY_REFRESH_RATE 5000
+#define DISPLAY_MODE_TREND 6 // first trend mode, one per history metric
+#define DISPLAY_MODE_N (DISPLAY_MODE_TREND + HISTORY_METRICS)
 
 #define INC_PIN D3
 #define DEVICE_BUTTON D6
 #define BUTTON_DEBOUNCE_DELAY 200 // button debounce time in ms
-#define USER_DELAY 30000
-#define CONNECTION_TIMEOUT_CUSTOM 15000
 
-#define MQTT_BUFFER_SIZE 2048            // the maximum size for packets being published and received
-MQTTClient mqttClient(MQTT_BUFFER_SIZE); // handles the MQTT communication protocol
-WiFiClient networkClient;                // handles the network connection to the MQTT broker
+#define HISTORY_PATH "/history.bin" // device table with the trends, kept across deep sleep
+#define HISTORY_VERSION 1
+static_assert(sizeof(sensors_t) * MAX_DEVICES <= CONFIG_STORE_LENGTH_MAX, "device table too large for the config store");
+
+#define FIRMWARE_VERSION "1.1.0"
+#define OTA_MAX_BOOT_ATTEMPTS 3 // roll back if the new image can't complete the setup
+#define STALL_THRESHOLD 1000    // ms in a section before it counts as a stall (soft WDT after ~3.2 s)
+
+#define MQTT_READ_BUFFER_SIZE 4096 // the maximum size for packets being received (device list)
+#define MQTT_WRITE_BUFFER_SIZE 512 // the maximum size for packets being published
+MQTTClient mqttClient(MQTT_READ_BUFFER_SIZE, MQTT_WRITE_BUFFER_SIZE); // handles the MQTT communication protocol (network in broker_link)
+MqttTransport mqtt_transport(mqttClient);
+EspNowTransport local_transport; // readings broadcast by the sensors nodes (config.local_channel)
+bool local_only = false;         // showing local readings only, WiFi and broker left off
 #define MQTT_TOPIC_DEVICES "unishare/devices/all_sensors"
-#define MQTT_TOPIC_SENSORS "unishare/sensors/"
+#define MQTT_TOPIC_DEVICES_DELTA "unishare/devices/all_sensors/delta"
+#define MQTT_TOPIC_DEVICES_RESYNC "unishare/devices/all_sensors/resync"
 #define MQTT_TOPIC_SETUP "unishare/devices/setup"
+#define MQTT_TOPIC_OTA "unishare/ota/announce"
 
 String mqtt_topic_status = "unishare/devices/status/";
 String mac_address;
 String mqtt_topic_my_status;
+String mqtt_topic_my_ota;
+String mqtt_topic_my_config;
+String mqtt_topic_my_stall;
 
-// WiFi cfg
-char ssid[] = SECRET_SSID; // your network SSID (name)
-char pass[] = SECRET_PASS; // your network password
+// WiFi cfg (SSID and password are in the runtime config)
 #ifdef IP
 IPAddress ip(IP);
 IPAddress subnet(SUBNET);
@@ -52,23 +72,39 @@ volatile unsigned long last_interrupt_devices_display = 0;
 volatile unsigned long last_user_interaction = 0;
 
 unsigned long last_refresh = 0;
+volatile bool display_stale = false; // new reading of the device on display, or a new display mode
+
+bool config_state_pending = false;
+bool config_state_ok = false;
 
-sensors_t all_sensors[10];
-int number_of_devices = 0;
+DeviceTable devices; // registry, latest readings and trends of the sensors nodes
 
 bool connectToWiFi();
 void IRAM_ATTR deviceDisplayInterrupt();
 void IRAM_ATTR isrInc();
 void printDisplayInfo();
+void printTrend(uint8_t metric);
+void loadHistory();
+void saveHistory();
 bool connectToMQTTBroker();
+void messageReceived(const char *topic, const char *payload, size_t length);
+void localMessageReceived(const char *topic, const char *payload, size_t length);
 void mqttMessageReceived(String &topic, String &payload);
+void refreshDisplay();
+void requestRegistryResync();
 String clearMacAddress(String mac_address);
+void otaReport(const char *state, int progress);
+void sendConfigState(bool ok);
+void sendStallReport();
 
 void setup()
 {
 
   Serial.begin(115200);
 
+  // Take the stall report of the previous boot, then watch this one
+  stallBegin(STALL_THRESHOLD);
+
   Wire.begin();
   Wire.beginTransmission(DISPLAY_ADDR);
   byte error = Wire.endTransmission();
@@ -99,8 +135,25 @@ void setup()
       delay(1);
   }
 
+  // Load runtime configuration
+  configBegin();
+  loadHistory();
+
   WiFi.mode(WIFI_STA);
 
+  // Readings broadcast by the sensors nodes. Holding the device button at
+  // boot ignores local_only, to get the broker (and config updates) back.
+  if (config.local_channel != 0)
+  {
+    local_only = config.local_only && digitalRead(DEVICE_BUTTON) == HIGH;
+    if (local_only)
+    {
+      WiFi.disconnect(); // no association (and no channel change) from the stored credentials
+    }
+    local_transport.onMessage(localMessageReceived);
+    local_transport.begin(config.local_channel);
+  }
+
   lcd.setBacklight(255);
   lcd.home();
   lcd.clear();
@@ -108,37 +161,55 @@ void setup()
   lcd.setCursor(0, 1);
   lcd.print("Monitor");
 
-  // setup MQTT
-  mqttClient.begin(MQTT_BROKERIP, 1883, networkClient); // setup communication with MQTT broker
-  mqttClient.onMessage(mqttMessageReceived);            // callback on message received from MQTT broker
+  // setup MQTT (the connection is set up by connectToMQTTBroker)
+  mqtt_transport.onMessage(messageReceived); // callback on message received from MQTT broker
+  mqtt_transport.begin();
 
   String to_replace = String(':');
   String replaced = "";
   mac_address = clearMacAddress(String(WiFi.macAddress()));
   mqtt_topic_my_status = mqtt_topic_status + mac_address;
+  mqtt_topic_my_ota = "unishare/control/" + mac_address + "/ota";
+  mqtt_topic_my_config = "unishare/config/" + mac_address;
+  mqtt_topic_my_stall = "unishare/metrics/" + mac_address + "/stall";
   mac_address.replace(to_replace, replaced);
 
-  DynamicJsonDocument doc_will(128);
+  JsonScope<128> doc_will;
   doc_will["connected"] = false;
   char buffer_will[128];
   serializeJson(doc_will, buffer_will);
   const char *topic_status = mqtt_topic_my_status.c_str();
   mqttClient.setWill(topic_status, buffer_will, true, 1);
+
+  // Check if the running image is on trial after an update
+  otaBegin(FIRMWARE_VERSION, OTA_MAX_BOOT_ATTEMPTS, otaReport);
 }
 
 bool sent_setup = false;
 void loop()
 {
-  if (!sent_setup)
+  // Local readings arrive whether WiFi and the broker are up or not
+  local_transport.poll();
+
+  if (local_only)
+  {
+    refreshDisplay();
+  }
+  else if (!sent_setup)
   {
     if (connectToWiFi())
     {
       if (connectToMQTTBroker())
       {
-        DynamicJsonDocument doc(256);
+        if (otaPending())
+        {
+          StallSection section(STALL_OTA);
+          otaRun(); // rollback scheduled at boot
+        }
+        JsonScope<256> doc;
         doc["mac_address"] = mac_address;
         doc["type"] = "screen";
-        doc["name"] = "schermo1";
+        doc["name"] = config.device_name;
         char buffer[256];
         size_t n = serializeJson(doc, buffer);
 
@@ -150,6 +221,8 @@ void loop()
         if (mqttClient.publish(MQTT_TOPIC_SETUP, buffer, n, false, 1))
         {
           sent_setup = true;
+          otaConfirm(); // the image works, keep it
+          sendStallReport();
         }
       }
     }
@@ -160,7 +233,12 @@ void loop()
     {
       if (connectToMQTTBroker())
       {
-        if (!mqttClient.loop())
+        bool polled;
+        {
+          StallSection section(STALL_MQTT_POLL);
+          polled = mqtt_transport.poll();
+        }
+        if (!polled)
         {
 #ifdef DEBUG
           Serial.println(mqttClient.lastError());
@@ -168,22 +246,39 @@ void loop()
           mqttClient.disconnect();
         }
 
-        unsigned long now = millis();
-        if (now - last_refresh > DISPLAY_REFRESH_RATE)
+        if (devices.resyncPending())
         {
-          printDisplayInfo();
-          last_refresh = now;
+          requestRegistryResync();
         }
+
+        if (config_state_pending)
+        {
+          config_state_pending = false;
+          sendConfigState(config_state_ok);
+        }
+
+        // Install announced firmware
+        if (otaPending())
+        {
+          lcd.home();
+          lcd.clear();
+          lcd.print("Updating...");
+          StallSection section(STALL_OTA);
+          otaRun();
+        }
+
+        refreshDisplay();
       }
     }
   }
   unsigned long now = millis();
-  if (now - last_user_interaction > USER_DELAY)
+  if (now - last_user_interaction > config.user_delay)
   {
 #ifdef DEBUG
     Serial.println("Going to sleep");
 #endif
     mqttClient.disconnect();
+    saveHistory();
     lcd.clear();
     lcd.noBacklight();
     ESP.deepSleep(0);
@@ -193,6 +288,7 @@ void loop()
 // Helpers
 void isrInc()
 {
+  StallSection section(STALL_BUTTON_ISR);
   unsigned long now = millis();
   last_user_interaction = now;
   if (now - last_interrupt_inc > BUTTON_DEBOUNCE_DELAY)
@@ -205,15 +301,16 @@ void isrInc()
 #endif
 
     last_interrupt_inc = now;
-    printDisplayInfo();
+    display_stale = true; // drawn by refreshDisplay() from loop(), not over I2C from here
   }
 }
 
 void IRAM_ATTR deviceDisplayInterrupt()
 {
+  StallSection section(STALL_BUTTON_ISR);
   unsigned long now = millis();
   last_user_interaction = now;
-  if (number_of_devices == 0)
+  if (devices.size() == 0)
   {
     lcd.home();
     lcd.clear();
@@ -224,23 +321,32 @@ void IRAM_ATTR deviceDisplayInterrupt()
   {
     last_interrupt_devices_display = now;
     device_index++;
-    device_index = device_index % number_of_devices;
+    device_index = device_index % devices.size();
     lcd.home();
     lcd.clear();
-    String mac_string = all_sensors[device_index].mac;
-    char buffer[mac_string.length() + 1];
-    mac_string.toCharArray(buffer, mac_string.length() + 1);
-    lcd.printf("%s", buffer);
+    lcd.printf("%s", devices.at(device_index).mac);
     lcd.setCursor(0, 1);
-    lcd.printf("Status %s", all_sensors[device_index].status ? "ON" : "OFF");
+    lcd.printf("Status %s", devices.at(device_index).status ? "ON" : "OFF");
 #ifdef DEBUG
     Serial.print(F("Device to display: "));
-    Serial.println(mac_string);
+    Serial.println(devices.at(device_index).mac);
 #endif
     last_refresh = now;
   }
 }
 
+void refreshDisplay()
+{
+  unsigned long now = millis();
+  if (display_stale || now - last_refresh > config.display_refresh_rate)
+  {
+    StallSection section(STALL_DISPLAY);
+    printDisplayInfo();
+    display_stale = false;
+    last_refresh = now;
+  }
+}
+
 void printDisplayInfo()
 {
   lcd.home();
@@ -250,38 +356,76 @@ void printDisplayInfo()
   {
     lcd.printf("Humidity:");
     lcd.setCursor(0, 1);
-    lcd.printf("%2.2f %%", all_sensors[device_index].humidity);
+    lcd.printf("%2.2f %%", devices.at(device_index).humidity);
   }
   else if (displayMode == 1)
   {
     lcd.printf("Temp:");
     lcd.setCursor(0, 1);
-    lcd.printf("%2.2f C", all_sensors[device_index].temperature);
+    lcd.printf("%2.2f C", devices.at(device_index).temperature);
   }
   else if (displayMode == 2)
   {
     lcd.printf("Apparent temp:");
     lcd.setCursor(0, 1);
-    lcd.printf("%2.2f C", all_sensors[device_index].apparent_temperature);
+    lcd.printf("%2.2f C", devices.at(device_index).apparent_temperature);
   }
   else if (displayMode == 3)
   {
     lcd.printf("Light:");
     lcd.setCursor(0, 1);
-    lcd.printf("%s", all_sensors[device_index].light ? "ON" : "OFF");
+    lcd.printf("%s", devices.at(device_index).light ? "ON" : "OFF");
   }
   else if (displayMode == 4)
   {
     lcd.printf("Fire:");
     lcd.setCursor(0, 1);
-    lcd.printf("%s", all_sensors[device_index].flame ? "YES" : "NO");
+    lcd.printf("%s", devices.at(device_index).flame ? "YES" : "NO");
   }
   else if (displayMode == 5)
   {
     lcd.printf("WiFi Signal:");
     lcd.setCursor(0, 1);
-    lcd.printf("%ld dB", all_sensors[device_index].rssi);
+    lcd.printf("%ld dB", devices.at(device_index).rssi);
+  }
+  else
+  {
+    printTrend(displayMode - DISPLAY_MODE_TREND);
+  }
+}
+
+void printTrend(uint8_t metric)
+{
+  // Range on the first line, sparkline of the last HISTORY_POINTS slots on the second
+  uint8_t points[HISTORY_POINTS];
+  if (!historyPoints(devices.at(device_index).history[metric], points))
+  {
+    lcd.printf("%s trend:", history_labels[metric]);
+    lcd.setCursor(0, 1);
+    lcd.printf("No history");
+    return;
+  }
+  uint8_t lowest, highest;
+  historyBounds(points, lowest, highest);
+  lcd.printf("%s %.1f-%.1f", history_labels[metric],
+             historyValue(lowest, history_ranges[metric]), historyValue(highest, history_ranges[metric]));
+
+  uint8_t glyphs[HISTORY_GLYPHS][8];
+  historySparkline(points, glyphs);
+  for (uint8_t g = 0; g < HISTORY_GLYPHS; g++)
+  {
+    lcd.createChar(g, glyphs[g]);
   }
+  lcd.setCursor(0, 1);
+  for (uint8_t g = 0; g < HISTORY_GLYPHS; g++)
+  {
+    lcd.write(g);
+  }
+  unsigned long span_min = HISTORY_POINTS * (config.history_slot / 60000);
+  if (span_min >= 120)
+    lcd.printf(" %luh", span_min / 60);
+  else
+    lcd.printf(" %lumin", span_min);
 }
 
 bool connectToWiFi()
@@ -291,17 +435,18 @@ bool connectToWiFi()
   {
 #ifdef DEBUG
     Serial.print(F("Connecting to SSID: "));
-    Serial.println(ssid);
+    Serial.println(config.wifi_ssid);
 #endif
 
 #ifdef IP
     WiFi.config(ip, dns, gateway, subnet); // by default network is configured using DHCP
 #endif
 
-    WiFi.begin(ssid, pass);
+    StallSection section(STALL_WIFI_CONNECT);
+    WiFi.begin(config.wifi_ssid, config.wifi_pass);
     unsigned long wifi_now = millis();
     unsigned long wifi_start_time = millis();
-    while (WiFi.status() != WL_CONNECTED && (wifi_now - wifi_start_time < CONNECTION_TIMEOUT_CUSTOM))
+    while (WiFi.status() != WL_CONNECTED && (wifi_now - wifi_start_time < config.connection_timeout))
     {
 #ifdef DEBUG
       Serial.print(F("."));
@@ -331,15 +476,21 @@ bool connectToMQTTBroker()
 #ifdef DEBUG
     Serial.print(F("\nConnecting to MQTT broker..."));
 #endif
+    // broker settings may have changed since the last connection
+    mqttClient.begin(config.mqtt_broker_ip, config.mqtt_port,
+                     brokerLinkSetup(config.mqtt_broker_ip, config.mqtt_port, config.mqtt_fingerprint, config.tls_fragment));
     unsigned long mqtt_now = millis();
     unsigned long mqtt_start_time = millis();
-    while (!mqttClient.connect(MQTT_CLIENTID, MQTT_USERNAME, MQTT_PASSWORD) && (mqtt_now - mqtt_start_time < CONNECTION_TIMEOUT_CUSTOM))
     {
+      StallSection section(STALL_BROKER_CONNECT);
+      while (!(brokerLinkOpen() && mqttClient.connect(config.mqtt_client_id, config.mqtt_username, config.mqtt_password, true)) && (mqtt_now - mqtt_start_time < config.connection_timeout))
+      {
 #ifdef DEBUG
-      Serial.print(F("."));
+        Serial.print(F("."));
 #endif
-      delay(200);
-      mqtt_now = millis();
+        delay(200);
+        mqtt_now = millis();
+      }
     }
     if (!mqttClient.connected())
     {
@@ -351,21 +502,39 @@ bool connectToMQTTBroker()
 
 #ifdef DEBUG
     Serial.println(F("\nConnected!"));
+    if (brokerLinkSecure())
+    {
+      Serial.printf("TLS handshake %u ms (%s, fragment %u)\n", brokerLinkHandshakeMs(),
+                    brokerLinkResumed() ? "resumed" : "full", brokerLinkFragment());
+    }
 #endif
     // connected to broker, subscribe topics
     mqttClient.subscribe(MQTT_TOPIC_DEVICES, 1);
+    mqttClient.subscribe(MQTT_TOPIC_DEVICES_DELTA, 1); // after the snapshot, so retained messages arrive in order
     String topic_sensors = String(MQTT_TOPIC_SENSORS) + "#";
     mqttClient.subscribe(topic_sensors, 1);
     String topic_status_all = mqtt_topic_status + "#";
     mqttClient.subscribe(topic_status_all);
+    mqttClient.subscribe(mqtt_topic_my_ota, 1);
+    mqttClient.subscribe(MQTT_TOPIC_OTA, 1);
+    mqttClient.subscribe(mqtt_topic_my_config, 1);
 #ifdef DEBUG
     Serial.printf("Subscribed to %s topic! \n", MQTT_TOPIC_DEVICES);
     Serial.printf("Subscribed to %s topic! \n", MQTT_TOPIC_SENSORS);
 #endif
 
-    DynamicJsonDocument doc_stat(128);
+    JsonScope<256> doc_stat;
     doc_stat["connected"] = true;
-    char buffer_stat[128];
+    doc_stat["version"] = FIRMWARE_VERSION;
+    doc_stat["tls"] = brokerLinkSecure();
+    doc_stat["connect_ms"] = brokerLinkHandshakeMs(); // TCP + TLS handshake
+    if (brokerLinkSecure())
+    {
+      doc_stat["tls_resumed"] = brokerLinkResumed();
+      doc_stat["tls_fragment"] = brokerLinkFragment();
+    }
+    jsonArenaReport(doc_stat.createNestedObject("json_arena"));
+    char buffer_stat[256];
     size_t n = serializeJson(doc_stat, buffer_stat);
     const char *topic_status = mqtt_topic_my_status.c_str();
     mqttClient.publish(topic_status, buffer_stat, n, true, 1);
@@ -374,129 +543,117 @@ bool connectToMQTTBroker()
   return true;
 }
 
-void mqttMessageReceived(String &topic, String &payload)
+void messageReceived(const char *topic, const char *payload, size_t length)
 {
-// this function handles a message from the MQTT broker
+  // The device table is updated from the MQTT buffer, without String copies
+  if (strcmp(topic, MQTT_TOPIC_DEVICES) == 0)
+  {
+    // parsed in place, entry by entry
+    bool ok = devices.snapshot(payload, length);
+    if (device_index >= devices.size())
+      device_index = 0;
 #ifdef DEBUG
-  Serial.println("Incoming MQTT message: " + topic + " - " + payload);
+    Serial.printf("Device list v%ld: %d devices%s\n", devices.version(), devices.listed(), ok ? "" : " (malformed)");
+    if (devices.listed() > MAX_DEVICES)
+      Serial.printf("Device table full, %d devices ignored\n", devices.listed() - MAX_DEVICES);
 #endif
+    return;
+  }
 
-  if (topic == MQTT_TOPIC_DEVICES)
+  if (strcmp(topic, MQTT_TOPIC_DEVICES_DELTA) == 0)
   {
-    StaticJsonDocument<2048> devices_doc;
-    deserializeJson(devices_doc, payload);
-    // extract the values
-    JsonArray array = devices_doc.as<JsonArray>();
-    number_of_devices = 0;
-    bool device_found;
-    for (JsonVariant v : array)
-    {
-      String mac_to_find = v["MAC_ADDRESS"].as<String>();
-      device_found = false;
-      for (int i = 0; i < 10; i++)
-      {
-        if (all_sensors[i].mac == mac_to_find)
-        {
-          device_found = true;
-          break;
-        }
-      }
-      if (!device_found)
-      {
-        all_sensors[number_of_devices].mac = mac_to_find;
-      }
-      number_of_devices++;
-    }
+    devices.delta(payload, length);
+    if (device_index >= devices.size())
+      device_index = 0;
     return;
   }
 
-  if (topic.startsWith(MQTT_TOPIC_SENSORS))
+  if (strncmp(topic, MQTT_TOPIC_SENSORS, strlen(MQTT_TOPIC_SENSORS)) == 0)
   {
-    int s_index = topic.lastIndexOf('/');
-    int length = topic.length();
-    String data_type = topic.substring(s_index + 1, length);
-    String sub_s = topic.substring(0, s_index);
-    s_index = sub_s.lastIndexOf('/');
-    length = sub_s.length();
-    String mac_to_find = sub_s.substring(s_index + 1, length);
+    int index = devices.reading(topic, payload, length, config.history_slot);
+    if (index >= 0 && index == device_index)
+      display_stale = true;
+    return;
+  }
+
+  if (strncmp(topic, mqtt_topic_status.c_str(), mqtt_topic_status.length()) == 0)
+  {
+    devices.status(topic, payload, length);
+    return;
+  }
+
+  String str_topic = String(topic);
+  String str_payload;
+  str_payload.concat(payload, length);
+  mqttMessageReceived(str_topic, str_payload);
+}
+
+void localMessageReceived(const char *topic, const char *payload, size_t length)
+{
+  // Broadcasts are not authenticated, only readings are taken from them
+  if (strncmp(topic, MQTT_TOPIC_SENSORS, strlen(MQTT_TOPIC_SENSORS)) != 0)
+    return;
+
+  devices.heard(topic);
+  messageReceived(topic, payload, length);
+}
 
+void requestRegistryResync()
+{
+  // Ask the daemon to publish the full snapshot again
+  JsonScope<64> doc;
+  doc["version"] = devices.version();
+  char buffer[64];
+  size_t n = serializeJson(doc, buffer);
+  mqttClient.publish(MQTT_TOPIC_DEVICES_RESYNC, buffer, n, false, 1);
+  devices.resyncRequested();
+}
+
+void mqttMessageReceived(String &topic, String &payload)
+{
+// this function handles a message from the MQTT broker
 #ifdef DEBUG
-    Serial.println("Data type: " + data_type);
-    Serial.println("MAC: " + mac_to_find);
+  Serial.println("Incoming MQTT message: " + topic + " - " + payload);
 #endif
 
-    StaticJsonDocument<32> sensor_doc;
-    deserializeJson(sensor_doc, payload);
-    int index = 0;
-    int i = 0;
-    for (i = 0; i < 10; i++)
-    {
-      if (all_sensors[i].mac == mac_to_find)
-      {
-        index = i;
-        break;
-      }
-    }
+  if (topic == mqtt_topic_my_config)
+  {
+    // stored first, then applied to the running config in one step
+    bool ok = configUpdate(payload.c_str(), payload.length());
+#ifdef DEBUG
+    Serial.println(ok ? "Config updated" : "Invalid config update");
+#endif
+    config_state_pending = true; // the MQTT client must not publish from its own callback
+    config_state_ok = ok;
+    return;
+  }
 
-    if (i == 10)
-      return;
+  if (topic == mqtt_topic_my_ota || topic == MQTT_TOPIC_OTA)
+  {
+    // installed later from loop(), never inside the callback
+    otaAnnounce(payload.c_str(), mac_address.c_str());
+    return;
+  }
+  return;
+}
 
-    if (data_type == "humidity")
-    {
-      all_sensors[index].humidity = sensor_doc["value"].as<double>();
-      return;
-    }
-    if (data_type == "temperature")
-    {
-      all_sensors[index].temperature = sensor_doc["value"].as<double>();
-      return;
-    }
-    if (data_type == "apparent_temperature")
-    {
-      all_sensors[index].apparent_temperature = sensor_doc["value"].as<double>();
-      return;
-    }
-    if (data_type == "flame")
-    {
-      all_sensors[index].flame = sensor_doc["value"].as<bool>();
-      return;
-    }
-    if (data_type == "light")
-    {
-      all_sensors[index].light = sensor_doc["value"].as<bool>();
-      return;
-    }
-    if (data_type == "rssi")
-    {
-      all_sensors[index].rssi = sensor_doc["value"].as<long>();
-      return;
-    }
+void loadHistory()
+{
+  // Last known devices, values and trends until the broker (or the local link) updates them
+  if (!configStoreLoad(HISTORY_PATH, HISTORY_VERSION, devices.storage(), sizeof(sensors_t) * MAX_DEVICES))
+  {
+    return;
   }
+  devices.restore();
+}
 
-  if (topic.startsWith(mqtt_topic_status))
+void saveHistory()
+{
+  if (!devices.historyChanged())
   {
-    int s_index = topic.lastIndexOf('/');
-    int length = topic.length();
-    String mac_to_find = topic.substring(s_index + 1, length);
-
-    StaticJsonDocument<32> stat_doc;
-    deserializeJson(stat_doc, payload);
-    int index = 0;
-    int i = 0;
-    for (i = 0; i < 10; i++)
-    {
-      if (all_sensors[i].mac == mac_to_find)
-      {
-        index = i;
-        break;
-      }
-    }
-    if (i == 10)
-      return;
-    all_sensors[index].status = stat_doc["connected"].as<bool>();
     return;
   }
-  return;
+  configStoreSave(HISTORY_PATH, HISTORY_VERSION, devices.storage(), sizeof(sensors_t) * MAX_DEVICES);
 }
 
 String clearMacAddress(String mac_address)
@@ -508,4 +665,51 @@ String clearMacAddress(String mac_address)
   mac_address.replace(to_replace, replaced);
   // Return
   return mac_address;
-}
\ No newline at end of file
+}
+
+void otaReport(const char *state, int progress)
+{
+  // Report update progress on the status topic
+  JsonScope<128> doc;
+  doc["connected"] = true;
+  doc["version"] = FIRMWARE_VERSION;
+  doc["ota"] = state;
+  doc["progress"] = progress;
+  char buffer[128];
+  size_t n = serializeJson(doc, buffer);
+  const char *topic_status = mqtt_topic_my_status.c_str();
+  mqttClient.publish(topic_status, buffer, n, true, 1);
+#ifdef DEBUG
+  Serial.printf("OTA %s %d%%\n", state, progress);
+#endif
+}
+
+void sendConfigState(bool ok)
+{
+  // Report the running configuration
+  JsonScope<512> doc;
+  doc["ok"] = ok;
+  configReport(doc.createNestedObject("config"));
+  char buffer[512];
+  size_t n = serializeJson(doc, buffer);
+  String topic = mqtt_topic_my_config + "/state";
+  mqttClient.publish(topic.c_str(), buffer, n, true, 1);
+}
+
+void sendStallReport()
+{
+  // Where the previous boot hung or crashed, sent once per boot
+  stall_report_t report;
+  if (!stallReport(report))
+    return;
+  JsonScope<384> doc;
+  doc["version"] = FIRMWARE_VERSION;
+  stallReportJson(report, doc.as<JsonObject>());
+  char buffer[384];
+  size_t n = serializeJson(doc, buffer);
+  mqttClient.publish(mqtt_topic_my_stall.c_str(), buffer, n, true, 1);
+#ifdef DEBUG
+  Serial.print(F("Stall report: "));
+  Serial.println(buffer);
+#endif
+}
@@ -0,0 +1,187 @@
+#include "node_config.h"
+
+#include <config_store.h>
+#include <json_arena.h>
+
+#include "secrets.h"
+
+// Older secrets.h files predate TLS
+#ifndef MQTT_BROKERPORT
+#define MQTT_BROKERPORT 1883
+#endif
+#ifndef MQTT_FINGERPRINT
+#define MQTT_FINGERPRINT ""
+#endif
+
+node_config_t config;
+
+// Field groups shared by the current and the older layouts
+#define CONFIG_TIMING_FIELDS(ctype)                                                                \
+    CONFIG_NUMBER(CONFIG_U32, "display_refresh_rate", ctype, display_refresh_rate, 500, 60000),    \
+    CONFIG_NUMBER(CONFIG_U32, "user_delay", ctype, user_delay, 5000, 3600000),                     \
+    CONFIG_NUMBER(CONFIG_U32, "connection_timeout", ctype, connection_timeout, 1000, 120000)
+#define CONFIG_TLS_FIELDS(ctype)                                           \
+    CONFIG_NUMBER(CONFIG_U16, "mqtt_port", ctype, mqtt_port, 1, 65535),    \
+    CONFIG_NUMBER(CONFIG_U16, "tls_fragment", ctype, tls_fragment, 0, 4096)
+#define CONFIG_LOCAL_FIELDS(ctype)                                               \
+    CONFIG_NUMBER(CONFIG_U8, "local_channel", ctype, local_channel, 0, 14),      \
+    CONFIG_NUMBER(CONFIG_U8, "local_only", ctype, local_only, 0, 1)
+#define CONFIG_CREDENTIAL_FIELDS(ctype)                           \
+    CONFIG_STRING("device_name", ctype, device_name, false),       \
+    CONFIG_STRING("wifi_ssid", ctype, wifi_ssid, false),           \
+    CONFIG_STRING("wifi_pass", ctype, wifi_pass, true),            \
+    CONFIG_STRING("mqtt_broker_ip", ctype, mqtt_broker_ip, false), \
+    CONFIG_STRING("mqtt_client_id", ctype, mqtt_client_id, false), \
+    CONFIG_STRING("mqtt_username", ctype, mqtt_username, false),   \
+    CONFIG_STRING("mqtt_password", ctype, mqtt_password, true)
+
+static const config_field_t config_fields[] = {
+    CONFIG_TIMING_FIELDS(node_config_t),
+    CONFIG_NUMBER(CONFIG_U32, "history_slot", node_config_t, history_slot, 60000, 86400000),
+    CONFIG_TLS_FIELDS(node_config_t),
+    CONFIG_LOCAL_FIELDS(node_config_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_t),
+    CONFIG_STRING("mqtt_fingerprint", node_config_t, mqtt_fingerprint, false),
+};
+#define CONFIG_FIELDS_N (sizeof(config_fields) / sizeof(config_fields[0]))
+
+// Layouts stored by the older firmwares, migrated at boot
+typedef struct __attribute__((packed)) node_config_v1
+{
+    uint32_t revision;
+    uint32_t display_refresh_rate;
+    uint32_t user_delay;
+    uint32_t connection_timeout;
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+} node_config_v1_t;
+
+typedef struct __attribute__((packed)) node_config_v2
+{
+    uint32_t revision;
+    uint32_t display_refresh_rate;
+    uint32_t user_delay;
+    uint32_t connection_timeout;
+    uint16_t mqtt_port;
+    uint16_t tls_fragment;
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char mqtt_fingerprint[BROKER_LINK_FINGERPRINT_LEN];
+} node_config_v2_t;
+
+typedef struct __attribute__((packed)) node_config_v3
+{
+    uint32_t revision;
+    uint32_t display_refresh_rate;
+    uint32_t user_delay;
+    uint32_t connection_timeout;
+    uint16_t mqtt_port;
+    uint16_t tls_fragment;
+    uint8_t local_channel;
+    uint8_t local_only;
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char mqtt_fingerprint[BROKER_LINK_FINGERPRINT_LEN];
+} node_config_v3_t;
+
+static const config_field_t config_fields_v1[] = {
+    CONFIG_TIMING_FIELDS(node_config_v1_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v1_t),
+};
+static const config_field_t config_fields_v2[] = {
+    CONFIG_TIMING_FIELDS(node_config_v2_t),
+    CONFIG_TLS_FIELDS(node_config_v2_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v2_t),
+    CONFIG_STRING("mqtt_fingerprint", node_config_v2_t, mqtt_fingerprint, false),
+};
+static const config_field_t config_fields_v3[] = {
+    CONFIG_TIMING_FIELDS(node_config_v3_t),
+    CONFIG_TLS_FIELDS(node_config_v3_t),
+    CONFIG_LOCAL_FIELDS(node_config_v3_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v3_t),
+    CONFIG_STRING("mqtt_fingerprint", node_config_v3_t, mqtt_fingerprint, false),
+};
+
+static const config_layout_t config_layouts[] = {
+    CONFIG_LAYOUT(1, node_config_v1_t, config_fields_v1),
+    CONFIG_LAYOUT(2, node_config_v2_t, config_fields_v2),
+    CONFIG_LAYOUT(3, node_config_v3_t, config_fields_v3),
+};
+#define CONFIG_LAYOUTS_N (sizeof(config_layouts) / sizeof(config_layouts[0]))
+
+static void configDefaults(node_config_t &c)
+{
+    memset(&c, 0, sizeof(c));
+    c.display_refresh_rate = DISPLAY_REFRESH_RATE;
+    c.user_delay = USER_DELAY;
+    c.connection_timeout = CONNECTION_TIMEOUT_CUSTOM;
+    c.history_slot = HISTORY_SLOT;
+    c.mqtt_port = MQTT_BROKERPORT;
+    c.tls_fragment = TLS_FRAGMENT;
+    c.local_channel = LOCAL_CHANNEL;
+    c.local_only = LOCAL_ONLY;
+    strlcpy(c.device_name, DEVICE_NAME, sizeof(c.device_name));
+    strlcpy(c.wifi_ssid, SECRET_SSID, sizeof(c.wifi_ssid));
+    strlcpy(c.wifi_pass, SECRET_PASS, sizeof(c.wifi_pass));
+    strlcpy(c.mqtt_broker_ip, MQTT_BROKERIP, sizeof(c.mqtt_broker_ip));
+    strlcpy(c.mqtt_client_id, MQTT_CLIENTID, sizeof(c.mqtt_client_id));
+    strlcpy(c.mqtt_username, MQTT_USERNAME, sizeof(c.mqtt_username));
+    strlcpy(c.mqtt_password, MQTT_PASSWORD, sizeof(c.mqtt_password));
+    strlcpy(c.mqtt_fingerprint, MQTT_FINGERPRINT, sizeof(c.mqtt_fingerprint));
+}
+
+void configBegin()
+{
+    bool mounted = configStoreBegin();
+    if (mounted && configStoreLoad(CONFIG_PATH, CONFIG_VERSION, &config, sizeof(config)))
+        return;
+
+    configDefaults(config);
+    // stored by an older firmware: keep its values, the new fields get their defaults
+    if (mounted && configStoreMigrate(CONFIG_PATH, config_layouts, CONFIG_LAYOUTS_N, &config, config_fields, CONFIG_FIELDS_N))
+        configStoreSave(CONFIG_PATH, CONFIG_VERSION, &config, sizeof(config));
+}
+
+bool configUpdate(const char *payload, size_t length)
+{
+    JsonScope<512> doc;
+    if (deserializeJson(doc, payload, length) || !doc.is<JsonObject>())
+        return false;
+
+    node_config_t candidate = config;
+    if (!configStorePatch(&candidate, sizeof(candidate), config_fields, CONFIG_FIELDS_N, doc.as<JsonObjectConst>()))
+        return false;
+
+    // retained updates are delivered again on every reconnect, don't wear the flash
+    if (memcmp((uint8_t *)&candidate + sizeof(candidate.revision),
+               (uint8_t *)&config + sizeof(config.revision),
+               sizeof(config) - sizeof(config.revision)) == 0)
+        return true;
+
+    candidate.revision = config.revision + 1;
+    if (!configStoreSave(CONFIG_PATH, CONFIG_VERSION, &candidate, sizeof(candidate)))
+        return false;
+    config = candidate;
+    return true;
+}
+
+void configReport(JsonObject out)
+{
+    out["revision"] = config.revision;
+    configStoreDump(&config, config_fields, CONFIG_FIELDS_N, out);
+}
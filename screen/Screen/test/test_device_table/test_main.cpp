@@ -0,0 +1,146 @@
+// Message handlers of the device table, fed with the topics and payloads of
+// the broker and the local link:  pio test -e native -f test_device_table
+
+#include <string.h>
+#include <unity.h>
+
+#include <device_table.h>
+
+#define SLOT 900000 // ms, default trend slot
+
+static const char *snapshot_payload =
+    "{\"version\": 3, \"devices\": [{\"MAC_ADDRESS\": \"AA:AA:AA:AA:AA:AA\", \"NAME\": \"Kitchen\"}, "
+    "{\"MAC_ADDRESS\": \"BB:BB:BB:BB:BB:BB\", \"NAME\": \"Office\"}]}";
+
+static DeviceTable table;
+
+static int reading(const char *topic, const char *payload)
+{
+    return table.reading(topic, payload, strlen(payload), SLOT);
+}
+
+static void delta(const char *payload)
+{
+    table.delta(payload, strlen(payload));
+}
+
+void setUp(void)
+{
+    table = DeviceTable();
+}
+
+void tearDown(void) {}
+
+void test_snapshot_fills_the_table(void)
+{
+    TEST_ASSERT_TRUE(table.snapshot(snapshot_payload, strlen(snapshot_payload)));
+    TEST_ASSERT_EQUAL_INT(2, table.size());
+    TEST_ASSERT_EQUAL_INT(3, table.version());
+    TEST_ASSERT_EQUAL_STRING("BB:BB:BB:BB:BB:BB", table.at(1).mac);
+    TEST_ASSERT_EQUAL_STRING("Office", table.at(1).name);
+}
+
+void test_reading_updates_its_device(void)
+{
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+
+    TEST_ASSERT_EQUAL_INT(1, reading("unishare/sensors/BB:BB:BB:BB:BB:BB/temperature", "{\"value\": 21.5, \"ts\": 1000000}"));
+    TEST_ASSERT_EQUAL_FLOAT(21.5f, table.at(1).temperature);
+    TEST_ASSERT_TRUE(table.historyChanged());
+
+    TEST_ASSERT_EQUAL_INT(0, reading("unishare/sensors/AA:AA:AA:AA:AA:AA/light", "{\"value\": true}"));
+    TEST_ASSERT_TRUE(table.at(0).light);
+}
+
+void test_channel_reading_updates_its_metric(void)
+{
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+
+    TEST_ASSERT_EQUAL_INT(0, reading("unishare/sensors/AA:AA:AA:AA:AA:AA/temperature/28FF4A1B", "{\"value\": -4.25}"));
+    TEST_ASSERT_EQUAL_FLOAT(-4.25f, table.at(0).temperature);
+    TEST_ASSERT_EQUAL_INT(0, reading("unishare/sensors/AA:AA:AA:AA:AA:AA/humidity/2", "{\"value\": 55}"));
+    TEST_ASSERT_EQUAL_FLOAT(55.0f, table.at(0).humidity);
+
+    // a metric that only starts like a known one
+    TEST_ASSERT_EQUAL_INT(0, reading("unishare/sensors/AA:AA:AA:AA:AA:AA/temperature_raw", "{\"value\": 99}"));
+    TEST_ASSERT_EQUAL_FLOAT(-4.25f, table.at(0).temperature);
+}
+
+void test_reading_of_unknown_device_or_topic(void)
+{
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+
+    TEST_ASSERT_EQUAL_INT(-1, reading("unishare/sensors/CC:CC:CC:CC:CC:CC/temperature", "{\"value\": 1}"));
+    TEST_ASSERT_EQUAL_INT(-1, reading("unishare/sensors/AA:AA:AA:AA:AA:AA", "{\"value\": 1}"));
+    TEST_ASSERT_EQUAL_INT(-1, reading("unishare/sensors/AA:AA:AA:AA:AA:AA/", "{\"value\": 1}"));
+    TEST_ASSERT_EQUAL_INT(-1, reading("unishare/devices/AA:AA:AA:AA:AA:AA/temperature", "{\"value\": 1}"));
+    TEST_ASSERT_EQUAL_INT(-1, reading("temperature", "{\"value\": 1}"));
+}
+
+void test_heard_registers_the_device_once(void)
+{
+    table.heard("unishare/sensors/CC:CC:CC:CC:CC:CC/temperature");
+    table.heard("unishare/sensors/CC:CC:CC:CC:CC:CC/temperature/28FF4A1B");
+    table.heard("unishare/sensors/CC:CC:CC:CC:CC:CC/humidity/2");
+
+    TEST_ASSERT_EQUAL_INT(1, table.size());
+    TEST_ASSERT_EQUAL_STRING("CC:CC:CC:CC:CC:CC", table.at(0).mac);
+    TEST_ASSERT_EQUAL_STRING("CC:CC:CC:CC:CC:CC", table.at(0).name);
+    TEST_ASSERT_EQUAL_INT(0, table.find("CC:CC:CC:CC:CC:CC"));
+}
+
+void test_heard_after_snapshot_is_ignored(void)
+{
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+    table.heard("unishare/sensors/CC:CC:CC:CC:CC:CC/temperature");
+    TEST_ASSERT_EQUAL_INT(2, table.size());
+}
+
+void test_delta_in_order_and_after_a_gap(void)
+{
+    delta("{\"version\": 1, \"op\": \"add\"}");
+    TEST_ASSERT_TRUE(table.resyncPending()); // no snapshot yet
+    table.resyncRequested();
+
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+    delta("{\"version\": 4, \"op\": \"add\", \"MAC_ADDRESS\": \"CC:CC:CC:CC:CC:CC\", \"NAME\": \"Hall\"}");
+    TEST_ASSERT_EQUAL_INT(3, table.size());
+    TEST_ASSERT_EQUAL_INT(4, table.version());
+
+    delta("{\"version\": 5, \"op\": \"remove\", \"MAC_ADDRESS\": \"AA:AA:AA:AA:AA:AA\"}");
+    TEST_ASSERT_EQUAL_INT(2, table.size());
+    TEST_ASSERT_EQUAL_STRING("CC:CC:CC:CC:CC:CC", table.at(0).mac);
+
+    delta("{\"version\": 7, \"op\": \"remove\", \"MAC_ADDRESS\": \"CC:CC:CC:CC:CC:CC\"}");
+    TEST_ASSERT_EQUAL_INT(2, table.size());
+    TEST_ASSERT_TRUE(table.resyncPending());
+}
+
+void test_storage_and_restore(void)
+{
+    table.snapshot(snapshot_payload, strlen(snapshot_payload));
+    const char *status = "{\"connected\": true}";
+    TEST_ASSERT_EQUAL_INT(1, table.status("unishare/devices/status/BB:BB:BB:BB:BB:BB", status, strlen(status)));
+    TEST_ASSERT_TRUE(table.at(1).status);
+
+    static DeviceTable restored;
+    memcpy(restored.storage(), table.storage(), sizeof(sensors_t) * MAX_DEVICES);
+    restored.restore();
+    TEST_ASSERT_EQUAL_INT(2, restored.size());
+    TEST_ASSERT_EQUAL_STRING("Office", restored.at(1).name);
+    TEST_ASSERT_FALSE(restored.at(1).status); // until its status arrives
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_snapshot_fills_the_table);
+    RUN_TEST(test_reading_updates_its_device);
+    RUN_TEST(test_channel_reading_updates_its_metric);
+    RUN_TEST(test_reading_of_unknown_device_or_topic);
+    RUN_TEST(test_heard_registers_the_device_once);
+    RUN_TEST(test_heard_after_snapshot_is_ignored);
+    RUN_TEST(test_delta_in_order_and_after_a_gap);
+    RUN_TEST(test_storage_and_restore);
+    return UNITY_END();
+}
@@ -0,0 +1,59 @@
+#ifndef NODE_CONFIG_H
+#define NODE_CONFIG_H
+
+#include "Arduino.h"
+#include <ArduinoJson.h>
+#include <mqtt_policy.h>
+#include <energy_profiler.h>
+#include <broker_link.h>
+
+// Defaults of the runtime tunables (see unishare/config/<mac>)
+#define LOG_DELAY 60000
+#define SAMPLE_DELAY 5000 // sampling period inside a log window (Warning! DHT min = 2000)
+#define MQTT_CONTROL_DELAY 0
+#define AC_CONTROL_DELAY 30000
+#define PHOTORESISTOR_THRESHOLD 900 // turn led on for light values lesser than this
+#define DEVICE_NAME "sensors1"
+#define NTP_SERVER "pool.ntp.org"
+#define TLS_FRAGMENT 512 // requested TLS max fragment length, 0 = full 16 KB records
+#define LOCAL_LINK 0      // 1 to also broadcast readings to nearby screens over ESP-NOW
+
+#define CONFIG_PATH "/config.bin"
+#define CONFIG_VERSION 6 // bump when node_config_t changes, and add the old layout to node_config.cpp
+
+// Integers first so that the packed layout stays naturally aligned
+typedef struct __attribute__((packed)) node_config
+{
+    uint32_t revision; // incremented by every applied update
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    uint16_t snapshot_every; // telemetry cycles between retained snapshots
+    uint16_t mqtt_port;
+    uint16_t tls_fragment;
+    energy_model_t energy; // current of every CPU/radio state, in uA
+    delivery_policy_t delivery[MSG_CLASS_N];
+    uint8_t local_link; // readings also broadcast over ESP-NOW
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char mqtt_fingerprint[BROKER_LINK_FINGERPRINT_LEN]; // broker certificate SHA-1, empty for plain MQTT
+    char ntp_server[40];
+} node_config_t;
+
+extern node_config_t config;
+
+// Load the configuration from flash (defaults on first boot)
+void configBegin();
+// Apply a partial JSON update, stored before it becomes effective
+bool configUpdate(const char *payload, size_t length);
+// Report the current configuration (secrets excluded)
+void configReport(JsonObject out);
+
+#endif
@@ -0,0 +1,106 @@
+#include "actuators.h"
+
+#include <string.h>
+
+static const char *const actuator_names[INTERLOCK_ACTUATORS] = {"light", "ac"};
+
+Actuators::Actuators()
+    : interlock(NULL), write(NULL), clock(NULL), ac_temp(0), ac_output(-1), n_acks(0), applied_count(0)
+{
+    control[INTERLOCK_LIGHT] = COMMAND_OFF;
+    control[INTERLOCK_AC] = COMMAND_OFF;
+}
+
+void Actuators::begin(const Interlock &interlock, actuator_write_t write, actuator_clock_t clock)
+{
+    this->interlock = &interlock;
+    this->write = write;
+    this->clock = clock;
+}
+
+void Actuators::offer(interlock_actuator_t actuator, const char *payload, size_t length, unsigned long received_at)
+{
+    // Only parsed here, the pins are written at the next control tick
+    command_t command;
+    if (!commandParse(payload, length, command) || command.control == COMMAND_UNKNOWN ||
+        (actuator == INTERLOCK_LIGHT && command.control == COMMAND_AUTO))
+    {
+        queueAck(actuator, command.id, false, NULL, received_at);
+        return;
+    }
+    command.received_at = received_at;
+
+    command_t replaced;
+    switch (commands[actuator].offer(command, replaced))
+    {
+    case COMMAND_STALE:
+        queueAck(actuator, command.id, false, "stale", received_at);
+        break;
+    case COMMAND_SUPERSEDED:
+        queueAck(actuator, replaced.id, false, "superseded", replaced.received_at);
+        break;
+    default:
+        break;
+    }
+}
+
+void Actuators::apply()
+{
+    command_t command;
+    for (uint8_t a = 0; a < INTERLOCK_ACTUATORS; a++)
+    {
+        interlock_actuator_t actuator = (interlock_actuator_t)a;
+        if (!commands[actuator].take(command))
+            continue;
+        bool applied = !interlock->locked(actuator);
+        if (applied && command.control == COMMAND_AUTO)
+        {
+            control[actuator] = COMMAND_AUTO;
+            ac_temp = command.temp;
+            ac_output = -1; // apply the new target at the next control tick
+        }
+        else if (applied)
+        {
+            set(actuator, command.control == COMMAND_ON);
+        }
+        applied_count += applied;
+        queueAck(actuator, command.id, applied, NULL, command.received_at);
+    }
+}
+
+void Actuators::set(interlock_actuator_t actuator, bool on)
+{
+    control[actuator] = on ? COMMAND_ON : COMMAND_OFF;
+    write(actuator, on);
+}
+
+const char *Actuators::acOutput() const
+{
+    return ac_output < 0 ? "" : commandControlName(ac_output ? COMMAND_ON : COMMAND_OFF);
+}
+
+bool Actuators::setAcOutput(bool on)
+{
+    if (ac_output == (int8_t)on)
+        return false;
+    ac_output = on;
+    return true;
+}
+
+void Actuators::queueAck(interlock_actuator_t actuator, const char *id, bool applied, const char *dropped,
+                         unsigned long received_at)
+{
+    unsigned long latency_us = clock() - received_at;
+    if (n_acks >= ACK_QUEUE_SIZE - (dropped ? ACK_QUEUE_RESERVED : 0))
+        return; // not drained yet, the state digest still reports the outcome
+
+    command_ack_t &ack = ack_queue[n_acks++];
+    ack.actuator = actuator_names[actuator];
+    strncpy(ack.id, id, sizeof(ack.id) - 1);
+    ack.id[sizeof(ack.id) - 1] = '\0';
+    strncpy(ack.state, state(actuator), sizeof(ack.state) - 1);
+    ack.state[sizeof(ack.state) - 1] = '\0';
+    ack.applied = applied;
+    ack.dropped = dropped;
+    ack.latency_us = latency_us;
+}
@@ -0,0 +1,82 @@
+#ifndef ACTUATORS_H
+#define ACTUATORS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <command_slot.h>
+#include <interlock.h>
+
+// Light and AC of a node and the path of their remote commands. The MQTT
+// callback offers a command to the slot of its actuator; the control tick
+// applies the newest one, unless the interlock locks the actuator. Every
+// command is acknowledged, applied or dropped: the acknowledgements wait in
+// a small queue until loop() publishes them (the MQTT client must not
+// publish from inside its own callback).
+
+#define ACK_QUEUE_SIZE 4
+#define ACK_QUEUE_RESERVED 2 // kept for the applied commands, not filled by dropped ones
+
+typedef struct command_ack
+{
+    const char *actuator;
+    char id[COMMAND_ID_LEN];
+    char state[8];
+    bool applied;
+    const char *dropped;      // "superseded" or "stale", NULL otherwise
+    unsigned long latency_us; // from message received to pins written
+} command_ack_t;
+
+typedef void (*actuator_write_t)(interlock_actuator_t actuator, bool on); // writes the pins
+typedef unsigned long (*actuator_clock_t)();                            // micros()
+
+class Actuators
+{
+public:
+    Actuators();
+
+    void begin(const Interlock &interlock, actuator_write_t write, actuator_clock_t clock);
+
+    // From the MQTT callback, the command is only parsed here
+    void offer(interlock_actuator_t actuator, const char *payload, size_t length, unsigned long received_at);
+    bool pending() const { return commands[INTERLOCK_LIGHT].pending() || commands[INTERLOCK_AC].pending(); }
+    // From the control tick, the newest command of every actuator, once
+    void apply();
+    // Interlock, rules: switch an actuator right away (the AC leaves the automatic mode)
+    void set(interlock_actuator_t actuator, bool on);
+
+    // "on", "off", or "auto" for the AC
+    const char *state(interlock_actuator_t actuator) const { return commandControlName(control[actuator]); }
+    bool acAuto() const { return control[INTERLOCK_AC] == COMMAND_AUTO; }
+    double acTemp() const { return ac_temp; }
+    // Output of the automatic AC control: "on", "off", "" until its first
+    // tick with the current target
+    const char *acOutput() const;
+    // True if the output changed, the pins are up to the caller
+    bool setAcOutput(bool on);
+
+    uint8_t acks() const { return n_acks; }
+    const command_ack_t &ack(uint8_t index) const { return ack_queue[index]; }
+    void clearAcks() { n_acks = 0; }
+
+    uint32_t applied() const { return applied_count; }
+    uint32_t superseded() const { return commands[INTERLOCK_LIGHT].superseded() + commands[INTERLOCK_AC].superseded(); }
+    uint32_t stale() const { return commands[INTERLOCK_LIGHT].stale() + commands[INTERLOCK_AC].stale(); }
+
+private:
+    void queueAck(interlock_actuator_t actuator, const char *id, bool applied, const char *dropped,
+                  unsigned long received_at);
+
+    const Interlock *interlock;
+    actuator_write_t write;
+    actuator_clock_t clock;
+    CommandSlot commands[INTERLOCK_ACTUATORS];
+    command_control_t control[INTERLOCK_ACTUATORS];
+    double ac_temp;   // target of the automatic mode
+    int8_t ac_output; // -1 until the automatic control ran
+    command_ack_t ack_queue[ACK_QUEUE_SIZE];
+    uint8_t n_acks;
+    uint32_t applied_count;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "aggregator.h"
+
+#include <math.h>
+
+Aggregator::Aggregator()
+{
+    reset();
+}
+
+void Aggregator::reset()
+{
+    n = 0;
+    running_mean = 0.0;
+    m2 = 0.0;
+    lowest = 0.0;
+    highest = 0.0;
+}
+
+void Aggregator::add(double value)
+{
+    if (isnan(value))
+        return;
+
+    n++;
+    if (n == 1)
+    {
+        lowest = value;
+        highest = value;
+    }
+    else
+    {
+        if (value < lowest)
+            lowest = value;
+        if (value > highest)
+            highest = value;
+    }
+
+    // Welford update
+    double delta = value - running_mean;
+    running_mean += delta / n;
+    m2 += delta * (value - running_mean);
+}
+
+uint32_t Aggregator::count() const
+{
+    return n;
+}
+
+double Aggregator::min() const
+{
+    return n > 0 ? lowest : NAN;
+}
+
+double Aggregator::max() const
+{
+    return n > 0 ? highest : NAN;
+}
+
+double Aggregator::mean() const
+{
+    return n > 0 ? running_mean : NAN;
+}
+
+double Aggregator::variance() const
+{
+    // population variance of the window
+    return n > 0 ? m2 / n : NAN;
+}
+
+double Aggregator::stddev() const
+{
+    return n > 0 ? sqrt(variance()) : NAN;
+}
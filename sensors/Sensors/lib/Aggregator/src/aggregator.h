@@ -0,0 +1,32 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <stdint.h>
+
+// Streaming statistics over a publish window.
+// Uses Welford's running mean/variance so memory stays constant and
+// the variance does not suffer from catastrophic cancellation.
+class Aggregator
+{
+public:
+    Aggregator();
+
+    void reset();
+    void add(double value);
+
+    uint32_t count() const;
+    double min() const;
+    double max() const;
+    double mean() const;
+    double variance() const;
+    double stddev() const;
+
+private:
+    uint32_t n;
+    double running_mean;
+    double m2; // sum of squared distances from the mean
+    double lowest;
+    double highest;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "comfort.h"
+
+#ifdef ARDUINO
+#include <pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_dword(address) (*(address))
+#endif
+
+// Saturation vapour pressure over water in 0.01 Pa, every 1 °C from -40 to
+// 60 °C: 6.1094 hPa * exp(17.625 T / (T + 243.04)).
+// The curve is exponential with a ~6 %/°C slope, so linear interpolation
+// within 1 °C stays below 0.05 % of the value.
+static const uint32_t SATURATION[] PROGMEM = {
+    1897, 2103, 2330, 2579, 2851, 3149, 3475, 3832,
+    4220, 4644, 5106, 5609, 6156, 6751, 7397, 8098,
+    8857, 9681, 10572, 11536, 12578, 13704, 14919, 16230,
+    17643, 19165, 20803, 22565, 24459, 26493, 28677, 31020,
+    33533, 36224, 39106, 42191, 45490, 49016, 52782, 56803,
+    61094, 65670, 70546, 75741, 81271, 87156, 93414, 100066,
+    107134, 114638, 122602, 131050, 140007, 149500, 159554, 170198,
+    181462, 193377, 205973, 219284, 233344, 248189, 263855, 280381,
+    297807, 316174, 335523, 355901, 377352, 399924, 423665, 448627,
+    474862, 502424, 531370, 561757, 593645, 627096, 662173, 698942,
+    737472, 777831, 820093, 864331, 910622, 959045, 1009680, 1062612,
+    1117926, 1175711, 1236058, 1299059, 1364812, 1433415, 1504969, 1579579,
+    1657350, 1738394, 1822823, 1910752, 2002300};
+#define SATURATION_N (sizeof(SATURATION) / sizeof(SATURATION[0]))
+
+// Heat index coefficients in Q32 (°F and %RH, see apparentTemperature())
+#define Q32(x) ((int64_t)((x) * 4294967296.0 + ((x) < 0 ? -0.5 : 0.5)))
+static const int64_t HI_C1 = Q32(-42.379);
+static const int64_t HI_C2 = Q32(2.04901523);
+static const int64_t HI_C3 = Q32(10.14333127);
+static const int64_t HI_C4 = Q32(-0.22475541);
+static const int64_t HI_C5 = Q32(-0.00683783);
+static const int64_t HI_C6 = Q32(-0.05481717);
+static const int64_t HI_C7 = Q32(0.00122874);
+static const int64_t HI_C8 = Q32(0.00085282);
+static const int64_t HI_C9 = Q32(-0.00000199);
+
+static int32_t divRound(int32_t value, int32_t divisor)
+{
+    return (value >= 0 ? value + divisor / 2 : value - divisor / 2) / divisor;
+}
+
+static uint32_t isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > value)
+        bit >>= 2;
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static int16_t clampTemperature(int16_t t_dc)
+{
+    return t_dc < COMFORT_T_MIN ? COMFORT_T_MIN : t_dc > COMFORT_T_MAX ? COMFORT_T_MAX : t_dc;
+}
+
+// Actual vapour pressure in 0.01 Pa
+static uint32_t vapourPressure(uint32_t saturation, uint16_t rh_dp)
+{
+    if (rh_dp > 1000)
+        rh_dp = 1000;
+    return (saturation * rh_dp + 500) / 1000;
+}
+
+static int16_t dewPoint(uint32_t vapour)
+{
+    // last entry not above the pressure, then interpolate within the degree
+    uint8_t lo = 0, hi = SATURATION_N - 1;
+    if (vapour <= pgm_read_dword(&SATURATION[lo]))
+        return COMFORT_T_MIN;
+    if (vapour >= pgm_read_dword(&SATURATION[hi]))
+        return COMFORT_T_MAX;
+    while (hi - lo > 1)
+    {
+        uint8_t mid = (lo + hi) / 2;
+        if (pgm_read_dword(&SATURATION[mid]) <= vapour)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    uint32_t base = pgm_read_dword(&SATURATION[lo]);
+    uint32_t step = pgm_read_dword(&SATURATION[hi]) - base;
+    return COMFORT_T_MIN + lo * 10 + (10 * (vapour - base) + step / 2) / step;
+}
+
+static uint16_t absoluteHumidity(int16_t t_dc, uint32_t vapour)
+{
+    // 216.68 g K / kJ * e / T, with e in 0.01 Pa and T in 0.01 K
+    uint32_t kelvin = 10 * (int32_t)t_dc + 27315;
+    return (21668ULL * vapour + 50 * kelvin) / (100 * kelvin);
+}
+
+static int16_t humidex(int16_t t_dc, uint32_t vapour)
+{
+    // T + 5/9 (e - 10 hPa)
+    return t_dc + divRound((int32_t)vapour - 100000, 1800);
+}
+
+uint32_t comfortSaturationPressure(int16_t t_dc)
+{
+    t_dc = clampTemperature(t_dc);
+    uint16_t index = (t_dc - COMFORT_T_MIN) / 10;
+    uint8_t fraction = (t_dc - COMFORT_T_MIN) % 10;
+    uint32_t base = pgm_read_dword(&SATURATION[index]);
+    if (fraction == 0)
+        return base;
+    uint32_t next = pgm_read_dword(&SATURATION[index + 1]);
+    return base + ((next - base) * fraction + 5) / 10;
+}
+
+int16_t comfortHeatIndex(int16_t t_dc, uint16_t rh_dp)
+{
+    // The simple formula 0.5 (T + 61 + 1.2 (T - 68) + 0.094 RH) is exact in
+    // tenths: 1.1 T - 10.3 + 0.047 RH = (1980 t_dc + 47 rh_dp) / 10000 + 24.9
+    int32_t simple = 1980 * (int32_t)t_dc + 47 * (int32_t)rh_dp;
+    if (simple <= 541000)
+        return divRound(simple - 71000, 1800);
+
+    // Q8 °F and %RH
+    int64_t t = divRound((int32_t)t_dc * 4608, 100) + 32 * 256;
+    int64_t r = ((int32_t)rh_dp * 128 + 2) / 5;
+
+    // Rothfusz regression, Horner on the humidity
+    int64_t t2 = t * t;
+    int64_t a = HI_C1 + ((HI_C2 * t) >> 8) + ((HI_C5 * t2) >> 16);
+    int64_t b = HI_C3 + ((HI_C4 * t) >> 8) + ((HI_C7 * t2) >> 16);
+    int64_t c = HI_C6 + ((HI_C8 * t) >> 8) + ((HI_C9 * t2) >> 16);
+    int64_t hi = a + ((b * r) >> 8) + ((c * (r * r)) >> 16);
+
+    if (r < 13 * 256 && t >= 80 * 256 && t <= 112 * 256)
+    {
+        // dry air: - (13 - RH) / 4 * sqrt((17 - |T - 95|) / 17)
+        int64_t distance = t > 95 * 256 ? t - 95 * 256 : 95 * 256 - t;
+        uint32_t root = isqrt((uint32_t)(((17 * 256 - distance) << 8) / 17)); // Q8
+        hi -= (((13 * 256 - r) / 4) * root) << 16;
+    }
+    else if (r > 85 * 256 && t >= 80 * 256 && t <= 87 * 256)
+    {
+        // humid air: + (RH - 85) / 10 * (87 - T) / 5
+        hi += (((r - 85 * 256) * (87 * 256 - t)) / 50) << 16;
+    }
+
+    // back to 0.1 °C: (HI - 32) * 50 / 9
+    int64_t celsius = ((hi - (32LL << 32)) >> 16) * 50;
+    int64_t divisor = 9LL << 16;
+    return (celsius >= 0 ? celsius + divisor / 2 : celsius - divisor / 2) / divisor;
+}
+
+int16_t comfortDewPoint(int16_t t_dc, uint16_t rh_dp)
+{
+    return dewPoint(vapourPressure(comfortSaturationPressure(t_dc), rh_dp));
+}
+
+uint16_t comfortAbsoluteHumidity(int16_t t_dc, uint16_t rh_dp)
+{
+    t_dc = clampTemperature(t_dc);
+    return absoluteHumidity(t_dc, vapourPressure(comfortSaturationPressure(t_dc), rh_dp));
+}
+
+int16_t comfortHumidex(int16_t t_dc, uint16_t rh_dp)
+{
+    t_dc = clampTemperature(t_dc);
+    return humidex(t_dc, vapourPressure(comfortSaturationPressure(t_dc), rh_dp));
+}
+
+void comfortCompute(int16_t t_dc, uint16_t rh_dp, comfort_t &out)
+{
+    t_dc = clampTemperature(t_dc);
+    uint32_t vapour = vapourPressure(comfortSaturationPressure(t_dc), rh_dp);
+    out.heat_index = comfortHeatIndex(t_dc, rh_dp);
+    out.dew_point = dewPoint(vapour);
+    out.humidex = humidex(t_dc, vapour);
+    out.absolute_humidity = absoluteHumidity(t_dc, vapour);
+}
@@ -0,0 +1,42 @@
+#ifndef COMFORT_H
+#define COMFORT_H
+
+#include <stdint.h>
+
+// Comfort metrics derived from temperature and relative humidity, in
+// integer arithmetic only (the ESP8266 has no FPU, so every float operation
+// and libm call is emulated in software).
+// Inputs are in tenths (0.1 °C, 0.1 %RH), the resolution of the humidity
+// sensors; temperatures outside -40..60 °C are clamped.
+//   - saturation vapour pressure: Magnus formula (Alduchov & Eskridge
+//     constants) tabulated every 1 °C and interpolated linearly
+//   - dew point: the same table searched backwards
+//   - absolute humidity: ideal gas law on the vapour pressure
+//   - humidex: Environment Canada formula on the vapour pressure
+//   - heat index: NOAA (Rothfusz regression and its adjustments, as in
+//     apparentTemperature()) evaluated in 64-bit fixed point
+// Maximum errors against the float formulas over the whole input range are
+// checked by the comfort tool of simulator/Simulator.
+
+#define COMFORT_T_MIN -400 // 0.1 °C
+#define COMFORT_T_MAX 600
+
+typedef struct comfort
+{
+    int16_t heat_index;         // 0.1 °C
+    int16_t dew_point;          // 0.1 °C
+    int16_t humidex;            // 0.1 °C
+    uint16_t absolute_humidity; // 0.01 g/m3
+} comfort_t;
+
+// All the metrics of a reading, sharing the vapour pressure
+void comfortCompute(int16_t t_dc, uint16_t rh_dp, comfort_t &out);
+
+// Saturation vapour pressure in 0.01 Pa
+uint32_t comfortSaturationPressure(int16_t t_dc);
+int16_t comfortHeatIndex(int16_t t_dc, uint16_t rh_dp);
+int16_t comfortDewPoint(int16_t t_dc, uint16_t rh_dp);
+uint16_t comfortAbsoluteHumidity(int16_t t_dc, uint16_t rh_dp);
+int16_t comfortHumidex(int16_t t_dc, uint16_t rh_dp);
+
+#endif
@@ -0,0 +1,77 @@
+#include "command_slot.h"
+
+#include <string.h>
+
+#include <ArduinoJson.h>
+#include <json_arena.h>
+
+static const char *const control_names[] = {"off", "on", "auto"};
+
+bool commandParse(const char *payload, size_t length, command_t &out)
+{
+    memset(&out, 0, sizeof(out));
+    out.control = COMMAND_UNKNOWN;
+    JsonScope<192> doc;
+    if (deserializeJson(doc, payload, length) || !doc.is<JsonObject>())
+        return false;
+
+    const char *control = doc["control"] | "";
+    for (uint8_t c = 0; c < COMMAND_UNKNOWN; c++)
+    {
+        if (!strcmp(control, control_names[c]))
+            out.control = (command_control_t)c;
+    }
+    out.temp = doc["temp"] | 0.0;
+    out.seq = doc["seq"] | (uint64_t)0;
+    // ids are strings from the API, anything else is kept as its JSON text
+    JsonVariantConst id = doc["id"];
+    if (id.is<const char *>())
+        strncpy(out.id, id.as<const char *>(), sizeof(out.id) - 1);
+    else if (!id.isNull())
+        serializeJson(id, out.id, sizeof(out.id));
+    out.id[sizeof(out.id) - 1] = '\0';
+    return true;
+}
+
+const char *commandControlName(command_control_t control)
+{
+    return control < COMMAND_UNKNOWN ? control_names[control] : "?";
+}
+
+CommandSlot::CommandSlot() : slot_pending(false), last_seq(0), superseded_count(0), stale_count(0)
+{
+    memset(&slot, 0, sizeof(slot));
+}
+
+command_offer_t CommandSlot::offer(const command_t &command, command_t &replaced)
+{
+    if (command.seq != 0)
+    {
+        if (command.seq <= last_seq)
+        {
+            stale_count++;
+            return COMMAND_STALE;
+        }
+        last_seq = command.seq;
+    }
+
+    command_offer_t result = COMMAND_ACCEPTED;
+    if (slot_pending)
+    {
+        replaced = slot;
+        superseded_count++;
+        result = COMMAND_SUPERSEDED;
+    }
+    slot = command;
+    slot_pending = true;
+    return result;
+}
+
+bool CommandSlot::take(command_t &out)
+{
+    if (!slot_pending)
+        return false;
+    out = slot;
+    slot_pending = false;
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef COMMAND_SLOT_H
+#define COMMAND_SLOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Latest-value-wins command slot of an actuator. The MQTT callback only
+// parses a command and leaves it in the slot of its actuator; the control
+// tick takes whatever is there and writes the pins once. A burst of queued
+// commands replayed after a reconnection then ends in the newest state
+// instead of walking the actuator through every one in between.
+//
+// Commands carry a sequence number ("seq", increasing for every command of
+// the sender). A command that is not newer than the last accepted one is a
+// duplicate or arrived out of order, and is dropped as stale. Commands
+// without a sequence number are taken in arrival order.
+
+#define COMMAND_ID_LEN 24
+
+typedef enum command_control
+{
+    COMMAND_OFF,
+    COMMAND_ON,
+    COMMAND_AUTO,
+    COMMAND_UNKNOWN,
+} command_control_t;
+
+typedef struct command
+{
+    uint64_t seq; // 0 when the sender gave none
+    command_control_t control;
+    double temp; // target of COMMAND_AUTO
+    char id[COMMAND_ID_LEN];
+    unsigned long received_at; // micros(), for the ack latency
+} command_t;
+
+typedef enum command_offer
+{
+    COMMAND_ACCEPTED,
+    COMMAND_SUPERSEDED, // accepted, the command it replaced was never applied
+    COMMAND_STALE,      // dropped
+} command_offer_t;
+
+// {"control": "on"|"off"|"auto", "temp": ..., "id": "...", "seq": n},
+// false when the payload is not a JSON object
+bool commandParse(const char *payload, size_t length, command_t &out);
+const char *commandControlName(command_control_t control);
+
+class CommandSlot
+{
+public:
+    CommandSlot();
+
+    // From the MQTT callback. On COMMAND_SUPERSEDED the replaced command is
+    // copied to replaced, so it can still be acknowledged.
+    command_offer_t offer(const command_t &command, command_t &replaced);
+    // From the control tick, the newest command not applied yet
+    bool take(command_t &out);
+    bool pending() const { return slot_pending; }
+
+    uint32_t superseded() const { return superseded_count; }
+    uint32_t stale() const { return stale_count; }
+
+private:
+    command_t slot;
+    bool slot_pending;
+    uint64_t last_seq; // of the newest accepted command
+    uint32_t superseded_count;
+    uint32_t stale_count;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "energy_profiler.h"
+
+#include <string.h>
+
+EnergyProfiler::EnergyProfiler()
+    : cpu_state(CPU_ACTIVE), radio_state(RADIO_OFF), subsystem(SUB_IDLE), last_us(0), window_us(0)
+{
+    energyModelDefaults(model);
+    memset(charge, 0, sizeof(charge));
+    memset(cpu_us, 0, sizeof(cpu_us));
+    memset(radio_us, 0, sizeof(radio_us));
+}
+
+void EnergyProfiler::begin(uint32_t now_us)
+{
+    last_us = now_us;
+}
+
+void EnergyProfiler::account(uint32_t now_us)
+{
+    uint32_t dt = now_us - last_us; // wraps fine between two transitions
+    last_us = now_us;
+    uint32_t current = model.cpu_ua[cpu_state] + model.radio_ua[radio_state];
+    charge[subsystem] += (uint64_t)current * dt;
+    cpu_us[cpu_state] += dt;
+    radio_us[radio_state] += dt;
+    window_us += dt;
+}
+
+void EnergyProfiler::cpu(energy_cpu_t state, uint32_t now_us)
+{
+    account(now_us);
+    cpu_state = state;
+}
+
+void EnergyProfiler::radio(energy_radio_t state, uint32_t now_us)
+{
+    account(now_us);
+    radio_state = state;
+}
+
+energy_subsystem_t EnergyProfiler::enter(energy_subsystem_t next, uint32_t now_us)
+{
+    account(now_us);
+    energy_subsystem_t previous = subsystem;
+    subsystem = next;
+    return previous;
+}
+
+void EnergyProfiler::report(uint32_t now_us, energy_report_t &out)
+{
+    account(now_us);
+    double elapsed = window_us > 0 ? (double)window_us : 1.0;
+
+    out.elapsed_ms = window_us / 1000;
+    out.total_ma = 0;
+    for (uint8_t i = 0; i < SUBSYSTEMS; i++)
+    {
+        out.subsystem_ma[i] = charge[i] / elapsed / 1000.0;
+        out.total_ma += out.subsystem_ma[i];
+    }
+    for (uint8_t i = 0; i < RADIO_STATES; i++)
+        out.radio_share[i] = radio_us[i] / elapsed;
+    for (uint8_t i = 0; i < CPU_STATES; i++)
+        out.cpu_share[i] = cpu_us[i] / elapsed;
+
+    window_us = 0;
+    memset(charge, 0, sizeof(charge));
+    memset(cpu_us, 0, sizeof(cpu_us));
+    memset(radio_us, 0, sizeof(radio_us));
+}
+
+void energyModelDefaults(energy_model_t &model)
+{
+    model.cpu_ua[CPU_ACTIVE] = ENERGY_CPU_ACTIVE_UA;
+    model.cpu_ua[CPU_LIGHT_SLEEP] = ENERGY_CPU_LIGHT_SLEEP_UA;
+    model.cpu_ua[CPU_DEEP_SLEEP] = ENERGY_CPU_DEEP_SLEEP_UA;
+    model.radio_ua[RADIO_OFF] = 0;
+    model.radio_ua[RADIO_MODEM_SLEEP] = ENERGY_RADIO_MODEM_SLEEP_UA;
+    model.radio_ua[RADIO_ASSOCIATED] = ENERGY_RADIO_ASSOCIATED_UA;
+    model.radio_ua[RADIO_RX] = ENERGY_RADIO_RX_UA;
+    model.radio_ua[RADIO_TX] = ENERGY_RADIO_TX_UA;
+}
+
+const char *energySubsystemName(uint8_t subsystem)
+{
+    static const char *const names[SUBSYSTEMS] = {"idle", "wifi", "mqtt", "sensors", "publish", "ota"};
+    return subsystem < SUBSYSTEMS ? names[subsystem] : "";
+}
+
+const char *energyRadioName(uint8_t state)
+{
+    static const char *const names[RADIO_STATES] = {"off", "modem_sleep", "associated", "rx", "tx"};
+    return state < RADIO_STATES ? names[state] : "";
+}
+
+const char *energyCpuName(uint8_t state)
+{
+    static const char *const names[CPU_STATES] = {"active", "light_sleep", "deep_sleep"};
+    return state < CPU_STATES ? names[state] : "";
+}
@@ -0,0 +1,122 @@
+#ifndef ENERGY_PROFILER_H
+#define ENERGY_PROFILER_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// Energy accounting of the node.
+// The firmware marks the transitions of the CPU and radio states and the
+// subsystem it is working for; the time spent in every combination is
+// weighted with a per-state current model (uA, radio currents are on top
+// of the CPU one) and charged to the active subsystem. All the accounting
+// is integer (uA x us), so it is cheap enough to stay enabled.
+
+typedef enum energy_cpu
+{
+    CPU_ACTIVE,
+    CPU_LIGHT_SLEEP,
+    CPU_DEEP_SLEEP,
+    CPU_STATES,
+} energy_cpu_t;
+
+typedef enum energy_radio
+{
+    RADIO_OFF,         // forced sleep
+    RADIO_MODEM_SLEEP, // associated, radio on only for the DTIM beacons
+    RADIO_ASSOCIATED,  // associated and always listening (no sleep)
+    RADIO_RX,          // receiving, scanning, connecting
+    RADIO_TX,
+    RADIO_STATES,
+} energy_radio_t;
+
+typedef enum energy_subsystem
+{
+    SUB_IDLE,
+    SUB_WIFI,
+    SUB_MQTT,
+    SUB_SENSORS,
+    SUB_PUBLISH,
+    SUB_OTA,
+    SUBSYSTEMS,
+} energy_subsystem_t;
+
+typedef struct energy_model
+{
+    uint32_t cpu_ua[CPU_STATES];
+    uint32_t radio_ua[RADIO_STATES];
+} energy_model_t;
+
+// ESP8266 datasheet figures (radio currents without the CPU share)
+#define ENERGY_CPU_ACTIVE_UA 15000
+#define ENERGY_CPU_LIGHT_SLEEP_UA 900
+#define ENERGY_CPU_DEEP_SLEEP_UA 20
+#define ENERGY_RADIO_MODEM_SLEEP_UA 1000 // beacon wake-ups averaged
+#define ENERGY_RADIO_ASSOCIATED_UA 41000
+#define ENERGY_RADIO_RX_UA 41000
+#define ENERGY_RADIO_TX_UA 155000
+
+typedef struct energy_report
+{
+    uint32_t elapsed_ms;
+    float subsystem_ma[SUBSYSTEMS]; // average current, i.e. mAh per hour
+    float total_ma;
+    float radio_share[RADIO_STATES]; // fraction of the time in each radio state
+    float cpu_share[CPU_STATES];
+} energy_report_t;
+
+class EnergyProfiler
+{
+public:
+    EnergyProfiler();
+
+    void setModel(const energy_model_t &current_model) { model = current_model; }
+    void begin(uint32_t now_us);
+
+    void cpu(energy_cpu_t state, uint32_t now_us);
+    void radio(energy_radio_t state, uint32_t now_us);
+    // Charge the following time to a subsystem, returns the previous one
+    energy_subsystem_t enter(energy_subsystem_t subsystem, uint32_t now_us);
+
+    energy_radio_t radioState() const { return radio_state; }
+
+    // Averages since the last report, then start a new window
+    void report(uint32_t now_us, energy_report_t &out);
+
+private:
+    void account(uint32_t now_us);
+
+    energy_model_t model;
+    energy_cpu_t cpu_state;
+    energy_radio_t radio_state;
+    energy_subsystem_t subsystem;
+    uint32_t last_us;
+    uint64_t window_us;
+    uint64_t charge[SUBSYSTEMS]; // uA x us
+    uint64_t cpu_us[CPU_STATES];
+    uint64_t radio_us[RADIO_STATES];
+};
+
+void energyModelDefaults(energy_model_t &model);
+const char *energySubsystemName(uint8_t subsystem);
+const char *energyRadioName(uint8_t state);
+const char *energyCpuName(uint8_t state);
+
+#ifdef ARDUINO
+// Charges a block of code to a subsystem
+class EnergyScope
+{
+public:
+    EnergyScope(EnergyProfiler &energy_profiler, energy_subsystem_t subsystem)
+        : profiler(energy_profiler), previous(energy_profiler.enter(subsystem, micros())) {}
+    ~EnergyScope() { profiler.enter(previous, micros()); }
+
+private:
+    EnergyProfiler &profiler;
+    energy_subsystem_t previous;
+};
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+#include "interlock.h"
+
+#include <string.h>
+
+static const char *const ACTUATOR_KEYS[INTERLOCK_ACTUATORS] = {"light", "ac"};
+
+Interlock::Interlock() : apply(nullptr), resolve(nullptr), n_events(0)
+{
+    rules.n_rules = 0;
+}
+
+void Interlock::begin(interlock_apply_t apply_action, interlock_resolve_t resolve_metric)
+{
+    apply = apply_action;
+    resolve = resolve_metric;
+}
+
+bool Interlock::load(const interlock_table_t &table)
+{
+    if (table.n_rules > INTERLOCK_MAX_RULES)
+        return false;
+
+    int8_t indexes[INTERLOCK_MAX_RULES];
+    for (uint8_t i = 0; i < table.n_rules; i++)
+    {
+        indexes[i] = resolve(table.rules[i].metric);
+        if (indexes[i] < 0)
+            return false;
+    }
+
+    rules = table;
+    for (uint8_t i = 0; i < table.n_rules; i++)
+    {
+        metric_index[i] = indexes[i];
+        tripped[i] = false;
+    }
+    return true;
+}
+
+void Interlock::update(uint8_t metric, float value)
+{
+    for (uint8_t i = 0; i < rules.n_rules; i++)
+    {
+        if (metric_index[i] != metric)
+            continue;
+
+        const interlock_rule_t &rule = rules.rules[i];
+        bool trip;
+        if (tripped[i]) // stay tripped until past the hysteresis band
+            trip = rule.above ? value > rule.threshold - rule.hysteresis : value < rule.threshold + rule.hysteresis;
+        else
+            trip = rule.above ? value > rule.threshold : value < rule.threshold;
+        if (trip == tripped[i])
+            continue;
+
+        tripped[i] = trip;
+        if (trip)
+        {
+            for (uint8_t a = 0; a < INTERLOCK_ACTUATORS; a++)
+            {
+                if (rule.action[a] != INTERLOCK_KEEP)
+                    apply((interlock_actuator_t)a, rule.action[a] == INTERLOCK_ON);
+            }
+        }
+
+        // the actuators are already switched, the report can be dropped
+        if (n_events < INTERLOCK_EVENT_QUEUE)
+            events[n_events++] = {i, trip, value};
+    }
+}
+
+bool Interlock::locked(interlock_actuator_t actuator) const
+{
+    for (uint8_t i = 0; i < rules.n_rules; i++)
+    {
+        if (tripped[i] && rules.rules[i].action[actuator] != INTERLOCK_KEEP)
+            return true;
+    }
+    return false;
+}
+
+bool Interlock::pollEvent(interlock_event_t &event)
+{
+    if (n_events == 0)
+        return false;
+    event = events[0];
+    n_events--;
+    memmove(events, events + 1, n_events * sizeof(events[0]));
+    return true;
+}
+
+void interlockDefaults(interlock_table_t &table)
+{
+    memset(&table, 0, sizeof(table));
+    table.n_rules = 1;
+    interlock_rule_t &flame = table.rules[0];
+    strcpy(flame.metric, "flame");
+    flame.above = 1;
+    flame.threshold = 0.5f;
+    flame.action[INTERLOCK_LIGHT] = INTERLOCK_ON;
+    flame.action[INTERLOCK_AC] = INTERLOCK_OFF;
+}
+
+bool interlockParse(JsonObjectConst doc, interlock_resolve_t resolve, interlock_table_t &table)
+{
+    JsonArrayConst list = doc["rules"];
+    if (list.isNull() || list.size() > INTERLOCK_MAX_RULES)
+        return false;
+
+    interlock_table_t candidate;
+    memset(&candidate, 0, sizeof(candidate));
+    for (JsonObjectConst item : list)
+    {
+        interlock_rule_t &rule = candidate.rules[candidate.n_rules++];
+
+        const char *metric = item["metric"];
+        if (!metric || strlen(metric) >= INTERLOCK_METRIC_LEN || resolve(metric) < 0)
+            return false;
+        strcpy(rule.metric, metric);
+
+        // exactly one of above/below
+        bool above = item["above"].is<float>();
+        if (above == item["below"].is<float>())
+            return false;
+        rule.above = above;
+        rule.threshold = above ? item["above"].as<float>() : item["below"].as<float>();
+        rule.hysteresis = item["hysteresis"] | 0.0f;
+        if (rule.hysteresis < 0)
+            return false;
+
+        bool any = false;
+        for (uint8_t a = 0; a < INTERLOCK_ACTUATORS; a++)
+        {
+            JsonVariantConst action = item[ACTUATOR_KEYS[a]];
+            if (action.isNull())
+                continue;
+            if (action == "on")
+                rule.action[a] = INTERLOCK_ON;
+            else if (action == "off")
+                rule.action[a] = INTERLOCK_OFF;
+            else
+                return false;
+            any = true;
+        }
+        if (!any)
+            return false;
+    }
+
+    table = candidate;
+    return true;
+}
+
+void interlockReport(const interlock_table_t &table, JsonArray out)
+{
+    for (uint8_t i = 0; i < table.n_rules; i++)
+    {
+        const interlock_rule_t &rule = table.rules[i];
+        JsonObject item = out.createNestedObject();
+        item["metric"] = rule.metric;
+        item[rule.above ? "above" : "below"] = (float)rule.threshold;
+        if (rule.hysteresis > 0)
+            item["hysteresis"] = (float)rule.hysteresis;
+        for (uint8_t a = 0; a < INTERLOCK_ACTUATORS; a++)
+        {
+            if (rule.action[a] != INTERLOCK_KEEP)
+                item[ACTUATOR_KEYS[a]] = interlockActionName(rule.action[a]);
+        }
+    }
+}
+
+const char *interlockActionName(uint8_t action)
+{
+    return action == INTERLOCK_ON ? "on" : action == INTERLOCK_OFF ? "off" : "keep";
+}
@@ -0,0 +1,93 @@
+#ifndef INTERLOCK_H
+#define INTERLOCK_H
+
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// Local safety interlock: rules map a sensor metric crossing a threshold
+// (flame edge, temperature over a limit, ...) to actuator actions that are
+// applied right away from the sampling path, without waiting for the broker.
+// While a rule is tripped its actuators are locked against remote commands;
+// releasing a rule unlocks them but leaves their state as it is.
+
+#define INTERLOCK_MAX_RULES 6
+#define INTERLOCK_METRIC_LEN 24
+#define INTERLOCK_EVENT_QUEUE 4
+
+typedef enum interlock_actuator
+{
+    INTERLOCK_LIGHT,
+    INTERLOCK_AC,
+    INTERLOCK_ACTUATORS,
+} interlock_actuator_t;
+
+typedef enum interlock_action
+{
+    INTERLOCK_KEEP,
+    INTERLOCK_OFF,
+    INTERLOCK_ON,
+} interlock_action_t;
+
+typedef struct __attribute__((packed)) interlock_rule
+{
+    char metric[INTERLOCK_METRIC_LEN]; // metric name in the sensor set
+    uint8_t above;                     // trips when value > threshold (1) or value < threshold (0)
+    float threshold;
+    float hysteresis; // released once back past threshold by this much
+    uint8_t action[INTERLOCK_ACTUATORS];
+} interlock_rule_t;
+
+typedef struct __attribute__((packed)) interlock_table
+{
+    uint8_t n_rules;
+    interlock_rule_t rules[INTERLOCK_MAX_RULES];
+} interlock_table_t;
+
+// A rule tripping or releasing, reported upstream after the fact
+typedef struct interlock_event
+{
+    uint8_t rule;
+    bool active;
+    float value;
+} interlock_event_t;
+
+typedef void (*interlock_apply_t)(interlock_actuator_t actuator, bool on);
+typedef int (*interlock_resolve_t)(const char *metric); // metric index, -1 if unknown
+
+class Interlock
+{
+public:
+    Interlock();
+
+    void begin(interlock_apply_t apply, interlock_resolve_t resolve);
+    // Replace the rules (all released), false if a metric is unknown
+    bool load(const interlock_table_t &table);
+    const interlock_table_t &table() const { return rules; }
+
+    // Evaluate the rules of a metric on a new sample
+    void update(uint8_t metric, float value);
+
+    bool locked(interlock_actuator_t actuator) const;
+    bool pending() const { return n_events > 0; }
+    bool pollEvent(interlock_event_t &event);
+
+private:
+    interlock_apply_t apply;
+    interlock_resolve_t resolve;
+    interlock_table_t rules;
+    int8_t metric_index[INTERLOCK_MAX_RULES];
+    bool tripped[INTERLOCK_MAX_RULES];
+    interlock_event_t events[INTERLOCK_EVENT_QUEUE];
+    uint8_t n_events;
+};
+
+// Default table: on flame turn the light on and the AC fan off
+void interlockDefaults(interlock_table_t &table);
+// Parse {"rules": [{"metric", "above"|"below", "hysteresis", "light", "ac"}, ...]},
+// table is untouched on any invalid rule
+bool interlockParse(JsonObjectConst doc, interlock_resolve_t resolve, interlock_table_t &table);
+void interlockReport(const interlock_table_t &table, JsonArray out);
+const char *interlockActionName(uint8_t action);
+
+#endif
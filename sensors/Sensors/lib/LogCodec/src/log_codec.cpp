@@ -0,0 +1,118 @@
+#include "log_codec.h"
+
+#include <math.h>
+
+#define LOG_FIXED_MAX 1000000000L // clamp, keeps the deltas within int32
+
+static size_t putVarint(uint8_t *out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static size_t getVarint(const uint8_t *in, size_t length, uint32_t &value)
+{
+    value = 0;
+    for (size_t n = 0; n < length && n < 5; n++)
+    {
+        value |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80))
+            return n + 1;
+    }
+    return 0;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t toFixed(float value)
+{
+    float fixed = roundf(value * LOG_SCALE);
+    if (!(fixed > -LOG_FIXED_MAX)) // NaN included
+        return -LOG_FIXED_MAX;
+    if (fixed > LOG_FIXED_MAX)
+        return LOG_FIXED_MAX;
+    return (int32_t)fixed;
+}
+
+void logCodecReset(log_codec_state_t &state, uint32_t first_ts)
+{
+    state.ts = first_ts;
+    state.period = 0;
+    for (uint8_t m = 0; m < LOG_MAX_METRICS; m++)
+        state.last[m] = 0;
+}
+
+size_t logEncode(log_codec_state_t &state, uint32_t ts, uint32_t mask, const float *values, uint8_t *out)
+{
+    mask &= (1UL << LOG_MAX_METRICS) - 1;
+    size_t n = putVarint(out, mask);
+
+    int32_t period = (int32_t)(ts - state.ts);
+    n += putVarint(out + n, zigzag(period - state.period));
+    state.ts = ts;
+    state.period = period;
+
+    for (uint8_t m = 0; m < LOG_MAX_METRICS; m++)
+    {
+        if (!(mask & (1UL << m)))
+            continue;
+        int32_t fixed = toFixed(values[m]);
+        n += putVarint(out + n, zigzag(fixed - state.last[m]));
+        state.last[m] = fixed;
+    }
+    return n;
+}
+
+size_t logDecode(log_codec_state_t &state, const uint8_t *in, size_t length, uint8_t metrics,
+                 uint32_t &ts, uint32_t &mask, float *values)
+{
+    size_t n = getVarint(in, length, mask);
+    if (n == 0 || metrics > LOG_MAX_METRICS || (mask >> metrics) != 0)
+        return 0;
+
+    uint32_t field;
+    size_t used = getVarint(in + n, length - n, field);
+    if (used == 0)
+        return 0;
+    n += used;
+    int32_t period = state.period + unzigzag(field);
+
+    // values go to a scratch copy, the state only moves on a complete record
+    int32_t last[LOG_MAX_METRICS];
+    for (uint8_t m = 0; m < metrics; m++)
+    {
+        last[m] = state.last[m];
+        if (!(mask & (1UL << m)))
+            continue;
+        used = getVarint(in + n, length - n, field);
+        if (used == 0)
+            return 0;
+        n += used;
+        last[m] += unzigzag(field);
+    }
+
+    state.ts += period;
+    state.period = period;
+    ts = state.ts;
+    for (uint8_t m = 0; m < metrics; m++)
+    {
+        state.last[m] = last[m];
+        if (mask & (1UL << m))
+            values[m] = (float)last[m] / LOG_SCALE;
+    }
+    return n;
+}
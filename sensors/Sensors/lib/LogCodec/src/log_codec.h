@@ -0,0 +1,37 @@
+#ifndef LOG_CODEC_H
+#define LOG_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compression of the reading log (one record per log window).
+// A record is a presence mask of the metrics, the timestamp and the value of
+// every present metric, all as LEB128 varints:
+//   mask        bit m set when metric m has a value in this window
+//   timestamp   delta-of-delta in seconds, zigzag: 0 (one byte) as long as
+//               the windows keep the same period
+//   values      fixed point (LOG_SCALE), zigzag delta from the previous
+//               value of the same metric: one or two bytes for slow signals
+// The state starts again at every segment, so each one decodes on its own.
+
+#define LOG_MAX_METRICS 16
+#define LOG_SCALE 100 // values kept to 0.01
+#define LOG_RECORD_MAX (3 + 5 + LOG_MAX_METRICS * 5)
+
+typedef struct log_codec_state
+{
+    uint32_t ts;    // previous timestamp, epoch seconds
+    int32_t period; // previous interval
+    int32_t last[LOG_MAX_METRICS];
+} log_codec_state_t;
+
+// Start of a segment, first_ts is stored in its header
+void logCodecReset(log_codec_state_t &state, uint32_t first_ts);
+// Record into out (LOG_RECORD_MAX bytes), returns its length
+size_t logEncode(log_codec_state_t &state, uint32_t ts, uint32_t mask, const float *values, uint8_t *out);
+// Record from in, returns the bytes used, 0 if truncated or invalid.
+// values[m] is written for every bit m of mask, metrics bounds the mask.
+size_t logDecode(log_codec_state_t &state, const uint8_t *in, size_t length, uint8_t metrics,
+                 uint32_t &ts, uint32_t &mask, float *values);
+
+#endif
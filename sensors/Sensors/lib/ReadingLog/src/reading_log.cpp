@@ -0,0 +1,260 @@
+#include "reading_log.h"
+
+#include <LittleFS.h>
+
+ReadingLog::ReadingLog()
+    : log_metrics(0), log_layout(0), next_seq(1), head(-1), head_open(false), head_length(0), pending_length(0),
+      query_active(false), query_from(0), query_to(0), stream_seq(0), stream_slot(-1), stream_offset(0),
+      stream_length(0)
+{
+    log_dir[0] = '\0';
+    memset(index, 0, sizeof(index));
+}
+
+bool ReadingLog::begin(const char *dir, uint8_t metrics, uint32_t layout)
+{
+    if (metrics > LOG_MAX_METRICS)
+        return false;
+    strlcpy(log_dir, dir, sizeof(log_dir));
+    log_metrics = metrics;
+    log_layout = layout;
+    if (!LittleFS.exists(dir) && !LittleFS.mkdir(dir))
+    {
+        log_dir[0] = '\0';
+        return false;
+    }
+
+    head = -1;
+    for (uint8_t s = 0; s < LOG_SEGMENTS; s++)
+    {
+        index[s].seq = 0;
+        char name[LOG_PATH_MAX];
+        path(s, name);
+        File file = LittleFS.open(name, "r");
+        if (!file)
+            continue;
+        log_segment_header_t header;
+        if (file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) && header.magic == LOG_MAGIC &&
+            header.seq != 0 && header.layout == layout && header.metrics == metrics)
+        {
+            index[s].seq = header.seq;
+            index[s].first_ts = header.first_ts;
+            if (head < 0 || header.seq > index[head].seq)
+                head = s;
+        }
+        file.close();
+    }
+    next_seq = head < 0 ? 1 : index[head].seq + 1;
+    head_open = head >= 0 && restore(head);
+    return true;
+}
+
+bool ReadingLog::restore(uint8_t slot)
+{
+    // replay the records of the segment to get the codec state back
+    char name[LOG_PATH_MAX];
+    path(slot, name);
+    File file = LittleFS.open(name, "r");
+    if (!file)
+        return false;
+    size_t size = file.size();
+    size_t offset = sizeof(log_segment_header_t);
+    file.seek(offset);
+    logCodecReset(codec, index[slot].first_ts);
+
+    uint8_t buffer[256];
+    size_t buffered = 0;
+    while (offset < size)
+    {
+        buffered += file.read(buffer + buffered, sizeof(buffer) - buffered);
+        uint32_t ts, mask;
+        float values[LOG_MAX_METRICS];
+        size_t used = logDecode(codec, buffer, buffered, log_metrics, ts, mask, values);
+        if (used == 0)
+            break; // torn write, left as is for the reader
+        offset += used;
+        buffered -= used;
+        memmove(buffer, buffer + used, buffered);
+    }
+    file.close();
+    head_length = offset;
+    return offset == size && size + LOG_RECORD_MAX <= LOG_SEGMENT_SIZE;
+}
+
+bool ReadingLog::append(uint32_t ts, uint32_t mask, const float *values)
+{
+    if (log_dir[0] == '\0')
+        return false;
+    // new segment when full, after a failed write or when the clock went back
+    if (!head_open || ts < codec.ts || head_length + pending_length + LOG_RECORD_MAX > LOG_SEGMENT_SIZE)
+    {
+        flush();
+        if (!openSegment(ts))
+            return false;
+    }
+    mask &= (1UL << log_metrics) - 1;
+    pending_length += logEncode(codec, ts, mask, values, pending + pending_length);
+    if (pending_length >= LOG_FLUSH_BYTES)
+        flush();
+    return true;
+}
+
+void ReadingLog::flush()
+{
+    if (pending_length == 0)
+        return;
+    if (head_open)
+    {
+        char name[LOG_PATH_MAX];
+        path(head, name);
+        File file = LittleFS.open(name, "a");
+        size_t written = 0;
+        if (file)
+        {
+            written = file.write(pending, pending_length);
+            file.close();
+        }
+        if (written == pending_length)
+            head_length += written;
+        else
+            head_open = false; // never append after a partial record
+    }
+    pending_length = 0;
+}
+
+bool ReadingLog::openSegment(uint32_t ts)
+{
+    // the slot after the newest one holds the oldest segment
+    uint8_t slot = head < 0 ? 0 : (head + 1) % LOG_SEGMENTS;
+    head = slot;
+    head_open = false;
+    index[slot].seq = 0;
+
+    char name[LOG_PATH_MAX];
+    path(slot, name);
+    File file = LittleFS.open(name, "w");
+    if (!file)
+        return false;
+    log_segment_header_t header = {LOG_MAGIC, next_seq, ts, log_layout, log_metrics, {0, 0, 0}};
+    bool ok = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+    file.close();
+    if (!ok)
+        return false;
+
+    index[slot].seq = next_seq++;
+    index[slot].first_ts = ts;
+    logCodecReset(codec, ts);
+    head_length = sizeof(header);
+    head_open = true;
+    return true;
+}
+
+void ReadingLog::query(uint32_t from, uint32_t to)
+{
+    flush(); // up to the latest record
+    query_active = true;
+    query_from = from;
+    query_to = to;
+    stream_seq = 0;
+    stream_slot = -1;
+}
+
+size_t ReadingLog::nextChunk(uint8_t *out)
+{
+    while (query_active)
+    {
+        if (stream_slot < 0 || index[stream_slot].seq != stream_seq)
+        {
+            // next overlapping segment in order (an overwritten one is left incomplete)
+            int next = -1;
+            for (uint8_t s = 0; s < LOG_SEGMENTS; s++)
+            {
+                if (index[s].seq > stream_seq && overlaps(s) && (next < 0 || index[s].seq < index[next].seq))
+                    next = s;
+            }
+            if (next < 0)
+            {
+                query_active = false;
+                return 0;
+            }
+            stream_slot = next;
+            stream_seq = index[next].seq;
+            stream_offset = 0;
+        }
+
+        char name[LOG_PATH_MAX];
+        path(stream_slot, name);
+        File file = LittleFS.open(name, "r");
+        size_t n = 0;
+        if (file)
+        {
+            if (stream_offset == 0)
+                stream_length = file.size(); // records appended meanwhile go with the next query
+            size_t want = stream_length - stream_offset;
+            if (want > LOG_CHUNK_SIZE)
+                want = LOG_CHUNK_SIZE;
+            if (file.seek(stream_offset))
+                n = file.read(out + sizeof(log_chunk_header_t), want);
+            file.close();
+        }
+        if (n == 0)
+        {
+            stream_slot = -1;
+            continue;
+        }
+
+        log_chunk_header_t header = {stream_seq, stream_offset, stream_length};
+        memcpy(out, &header, sizeof(header));
+        stream_offset += n;
+        if (stream_offset >= stream_length)
+            stream_slot = -1;
+        return sizeof(header) + n;
+    }
+    return 0;
+}
+
+bool ReadingLog::overlaps(uint8_t slot) const
+{
+    // a segment runs until the first record of the next one
+    if (index[slot].seq == 0 || index[slot].first_ts > query_to)
+        return false;
+    int next = findSlot(index[slot].seq + 1);
+    return next < 0 || index[next].first_ts >= query_from;
+}
+
+int ReadingLog::findSlot(uint32_t seq) const
+{
+    for (uint8_t s = 0; s < LOG_SEGMENTS; s++)
+    {
+        if (index[s].seq == seq)
+            return s;
+    }
+    return -1;
+}
+
+uint16_t ReadingLog::segments() const
+{
+    uint16_t n = 0;
+    for (uint8_t s = 0; s < LOG_SEGMENTS; s++)
+    {
+        if (index[s].seq != 0)
+            n++;
+    }
+    return n;
+}
+
+uint32_t ReadingLog::oldest() const
+{
+    int oldest = -1;
+    for (uint8_t s = 0; s < LOG_SEGMENTS; s++)
+    {
+        if (index[s].seq != 0 && (oldest < 0 || index[s].seq < index[oldest].seq))
+            oldest = s;
+    }
+    return oldest < 0 ? 0 : index[oldest].first_ts;
+}
+
+void ReadingLog::path(uint8_t slot, char *out) const
+{
+    snprintf(out, LOG_PATH_MAX, "%s/%u.log", log_dir, slot);
+}
@@ -0,0 +1,105 @@
+#ifndef READING_LOG_H
+#define READING_LOG_H
+
+#include <Arduino.h>
+
+#include <log_codec.h>
+
+// Local history of the readings, kept in flash for backfilling the backend
+// after an outage. One compressed record per log window (log_codec.h) is
+// appended to a ring of fixed size segment files in LittleFS; the oldest
+// segment is overwritten when the ring is full, so writes move over the
+// whole ring instead of hitting the same blocks. Records are buffered in RAM
+// and written LOG_FLUSH_BYTES at a time (lost on a reset).
+//
+// A segment is a header and the records, decodable on its own. Range queries
+// return the segments that overlap the range, as is, in chunks small enough
+// for an MQTT message; the receiver reassembles and decodes them.
+
+#define LOG_SEGMENT_SIZE 4096 // bytes per segment, one flash block
+#define LOG_SEGMENTS 64       // 256 KB of flash
+#define LOG_FLUSH_BYTES 128
+#define LOG_CHUNK_SIZE 768 // segment bytes per chunk
+#define LOG_MAGIC 0x31474C55 // "ULG1"
+#define LOG_PATH_MAX 32
+
+typedef struct __attribute__((packed)) log_segment_header
+{
+    uint32_t magic;
+    uint32_t seq;      // segment number, increases by one per segment
+    uint32_t first_ts; // epoch seconds, base of the first record
+    uint32_t layout;   // identifies the metrics of the mask bits
+    uint8_t metrics;
+    uint8_t reserved[3];
+} log_segment_header_t;
+
+// Starts every chunk (little endian, like the rest of the segment)
+typedef struct __attribute__((packed)) log_chunk_header
+{
+    uint32_t seq;
+    uint16_t offset; // of the chunk in the segment
+    uint16_t length; // of the whole segment
+} log_chunk_header_t;
+
+#define LOG_CHUNK_MAX (sizeof(log_chunk_header_t) + LOG_CHUNK_SIZE)
+
+class ReadingLog
+{
+public:
+    ReadingLog();
+
+    // Index the segments in dir (filesystem already mounted). Segments of
+    // another layout are dropped, layout changes with the metric set.
+    bool begin(const char *dir, uint8_t metrics, uint32_t layout);
+    // Record of a log window: values[m] for every bit m of mask
+    bool append(uint32_t ts, uint32_t mask, const float *values);
+    void flush();
+
+    // Start streaming the segments overlapping [from, to] (epoch seconds)
+    void query(uint32_t from, uint32_t to);
+    bool querying() const { return query_active; }
+    // Next chunk of the query into out (LOG_CHUNK_MAX bytes), 0 once done
+    size_t nextChunk(uint8_t *out);
+
+    uint16_t segments() const;
+    uint32_t oldest() const; // first timestamp kept, 0 if empty
+    uint32_t layout() const { return log_layout; }
+
+private:
+    typedef struct slot
+    {
+        uint32_t seq; // 0 for a free slot
+        uint32_t first_ts;
+    } slot_t;
+
+    void path(uint8_t slot, char *out) const;
+    bool openSegment(uint32_t ts);
+    bool restore(uint8_t slot);
+    int findSlot(uint32_t seq) const;
+    bool overlaps(uint8_t slot) const;
+
+    char log_dir[16];
+    uint8_t log_metrics;
+    uint32_t log_layout;
+    slot_t index[LOG_SEGMENTS];
+    uint32_t next_seq;
+
+    // newest segment, records are appended to it while it is open
+    int head; // slot, -1 for none
+    bool head_open;
+    uint16_t head_length;
+    log_codec_state_t codec;
+    uint8_t pending[LOG_FLUSH_BYTES + LOG_RECORD_MAX];
+    uint16_t pending_length;
+
+    // query being streamed
+    bool query_active;
+    uint32_t query_from;
+    uint32_t query_to;
+    uint32_t stream_seq;
+    int stream_slot; // -1 between segments
+    uint16_t stream_offset;
+    uint16_t stream_length;
+};
+
+#endif
@@ -0,0 +1,372 @@
+#include "rules_vm.h"
+
+#include <math.h>
+#include <string.h>
+
+// Operand bytes of each opcode, -1 if unknown
+static int8_t operandSize(uint8_t op)
+{
+    switch (op)
+    {
+    case RULES_END:
+    case RULES_GT:
+    case RULES_LT:
+    case RULES_GE:
+    case RULES_LE:
+    case RULES_EQ:
+    case RULES_NE:
+    case RULES_AND:
+    case RULES_OR:
+    case RULES_NOT:
+    case RULES_ADD:
+    case RULES_SUB:
+        return 0;
+    case RULES_METRIC:
+    case RULES_LOAD:
+    case RULES_STORE:
+    case RULES_HYST:
+    case RULES_JZ:
+    case RULES_WRITE:
+        return 1;
+    case RULES_CONST:
+        return 4;
+    case RULES_HELD:
+        return 5;
+    default:
+        return -1;
+    }
+}
+
+// Stack effect: values popped and pushed
+static void stackEffect(uint8_t op, uint8_t &pop, uint8_t &push)
+{
+    switch (op)
+    {
+    case RULES_METRIC:
+    case RULES_CONST:
+    case RULES_LOAD:
+        pop = 0, push = 1;
+        break;
+    case RULES_STORE:
+    case RULES_JZ:
+    case RULES_WRITE:
+        pop = 1, push = 0;
+        break;
+    case RULES_NOT:
+    case RULES_HELD:
+        pop = 1, push = 1;
+        break;
+    case RULES_HYST:
+        pop = 3, push = 1;
+        break;
+    case RULES_END:
+        pop = 0, push = 0;
+        break;
+    default: // binary operators
+        pop = 2, push = 1;
+        break;
+    }
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static float readF32(const uint8_t *p)
+{
+    uint32_t bits = readU32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+RulesVm::RulesVm()
+{
+    clear();
+}
+
+void RulesVm::clear()
+{
+    // an empty program: no names, END
+    code[0] = RULES_MAGIC;
+    code[1] = RULES_FORMAT;
+    code[2] = 0;
+    code[3] = RULES_END;
+    length = 4;
+    entry = 3;
+    memset(registers, 0, sizeof(registers));
+    memset(timer_running, 0, sizeof(timer_running));
+    memset(outputs, -1, sizeof(outputs));
+}
+
+bool RulesVm::load(const uint8_t *program, size_t program_length, rules_resolve_t resolve)
+{
+    if (program_length < 4 || program_length > RULES_MAX_PROGRAM)
+        return false;
+    if (program[0] != RULES_MAGIC || program[1] != RULES_FORMAT || program[2] > RULES_MAX_METRICS)
+        return false;
+
+    // metric names
+    int8_t indexes[RULES_MAX_METRICS];
+    uint8_t n_metrics = program[2];
+    size_t pc = 3;
+    for (uint8_t i = 0; i < n_metrics; i++)
+    {
+        if (pc >= program_length)
+            return false;
+        uint8_t name_length = program[pc++];
+        char name[32];
+        if (name_length == 0 || name_length >= sizeof(name) || pc + name_length > program_length)
+            return false;
+        memcpy(name, program + pc, name_length);
+        name[name_length] = '\0';
+        pc += name_length;
+        int index = resolve(name);
+        if (index < 0)
+            return false;
+        indexes[i] = index;
+    }
+    size_t code_entry = pc;
+
+    // code: walk it once, tracking the stack depth at every jump target
+    int8_t depth_at[RULES_MAX_PROGRAM];
+    memset(depth_at, -1, sizeof(depth_at));
+    int depth = 0;
+    bool ended = false;
+    while (pc < program_length && !ended)
+    {
+        if (depth_at[pc] >= 0 && depth_at[pc] != depth)
+            return false; // paths merge with different stacks
+        uint8_t op = program[pc];
+        int8_t operands = operandSize(op);
+        if (operands < 0 || pc + 1 + operands > program_length)
+            return false;
+        const uint8_t *arg = program + pc + 1;
+
+        switch (op)
+        {
+        case RULES_METRIC:
+            if (arg[0] >= n_metrics)
+                return false;
+            break;
+        case RULES_LOAD:
+        case RULES_STORE:
+        case RULES_HYST:
+            if (arg[0] >= RULES_REGISTERS)
+                return false;
+            break;
+        case RULES_HELD:
+            if (arg[0] >= RULES_TIMERS)
+                return false;
+            break;
+        case RULES_WRITE:
+            if (arg[0] >= RULES_ACTUATORS)
+                return false;
+            break;
+        case RULES_END:
+            ended = true;
+            break;
+        }
+
+        uint8_t pop, push;
+        stackEffect(op, pop, push);
+        if (depth < pop)
+            return false;
+        depth += push - pop;
+        if (depth > RULES_STACK)
+            return false;
+
+        size_t next = pc + 1 + operands;
+        if (op == RULES_JZ)
+        {
+            size_t target = next + arg[0];
+            if (target >= program_length)
+                return false;
+            if (depth_at[target] >= 0 && depth_at[target] != depth)
+                return false;
+            depth_at[target] = depth;
+        }
+        pc = next;
+    }
+    // must end with END, nothing after it, and every jump must land on an instruction
+    if (!ended || pc != program_length)
+        return false;
+    for (size_t i = code_entry; i < program_length; i++)
+    {
+        if (depth_at[i] < 0)
+            continue;
+        size_t at = code_entry;
+        while (at < i)
+            at += 1 + operandSize(program[at]);
+        if (at != i)
+            return false;
+    }
+
+    memcpy(code, program, program_length);
+    length = program_length;
+    entry = code_entry;
+    memcpy(metric_index, indexes, sizeof(indexes));
+    memset(registers, 0, sizeof(registers));
+    memset(timer_running, 0, sizeof(timer_running));
+    memset(outputs, -1, sizeof(outputs));
+    return true;
+}
+
+uint16_t RulesVm::run(const float *metrics, uint32_t now, rules_write_t write)
+{
+    float stack[RULES_STACK];
+    uint8_t sp = 0;
+    uint16_t executed = 0;
+    uint16_t pc = entry;
+
+    for (;;)
+    {
+        uint8_t op = code[pc];
+        const uint8_t *arg = code + pc + 1;
+        pc += 1 + operandSize(op);
+        executed++;
+
+        float b;
+        switch (op)
+        {
+        case RULES_END:
+            return executed;
+        case RULES_METRIC:
+            stack[sp++] = metrics[metric_index[arg[0]]];
+            break;
+        case RULES_CONST:
+            stack[sp++] = readF32(arg);
+            break;
+        case RULES_LOAD:
+            stack[sp++] = registers[arg[0]];
+            break;
+        case RULES_STORE:
+            registers[arg[0]] = stack[--sp];
+            break;
+        case RULES_NOT:
+            stack[sp - 1] = stack[sp - 1] == 0 ? 1 : 0;
+            break;
+        case RULES_HYST:
+        {
+            float hi = stack[--sp];
+            float lo = stack[--sp];
+            float value = stack[sp - 1];
+            float &state = registers[arg[0]];
+            if (value > hi)
+                state = 1;
+            else if (value < lo)
+                state = 0;
+            stack[sp - 1] = state;
+            break;
+        }
+        case RULES_HELD:
+        {
+            uint8_t t = arg[0];
+            if (stack[sp - 1] == 0 || isnan(stack[sp - 1]))
+            {
+                timer_running[t] = false;
+                stack[sp - 1] = 0;
+                break;
+            }
+            if (!timer_running[t])
+            {
+                timer_running[t] = true;
+                timer_start[t] = now;
+            }
+            stack[sp - 1] = now - timer_start[t] >= readU32(arg + 1) ? 1 : 0;
+            break;
+        }
+        case RULES_JZ:
+            if (stack[--sp] == 0)
+                pc += arg[0];
+            break;
+        case RULES_WRITE:
+        {
+            int8_t on = stack[--sp] != 0 ? 1 : 0;
+            if (outputs[arg[0]] != on)
+            {
+                outputs[arg[0]] = on;
+                write(arg[0], on);
+            }
+            break;
+        }
+        default: // binary operators
+            b = stack[--sp];
+            float &a = stack[sp - 1];
+            switch (op)
+            {
+            case RULES_GT:
+                a = a > b;
+                break;
+            case RULES_LT:
+                a = a < b;
+                break;
+            case RULES_GE:
+                a = a >= b;
+                break;
+            case RULES_LE:
+                a = a <= b;
+                break;
+            case RULES_EQ:
+                a = a == b;
+                break;
+            case RULES_NE:
+                a = a != b;
+                break;
+            case RULES_AND:
+                a = a != 0 && b != 0;
+                break;
+            case RULES_OR:
+                a = a != 0 || b != 0;
+                break;
+            case RULES_ADD:
+                a = a + b;
+                break;
+            case RULES_SUB:
+                a = a - b;
+                break;
+            }
+            break;
+        }
+    }
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+size_t rulesFromHex(const char *hex, uint8_t *out, size_t max)
+{
+    size_t n = 0;
+    while (hex[0] && hex[1])
+    {
+        int hi = hexDigit(hex[0]);
+        int lo = hexDigit(hex[1]);
+        if (hi < 0 || lo < 0 || n == max)
+            return 0;
+        out[n++] = (hi << 4) | lo;
+        hex += 2;
+    }
+    return hex[0] ? 0 : n; // odd length
+}
+
+bool rulesUpdate(const char *hex, rules_resolve_t resolve, RulesVm &candidate, rules_blob_t &blob)
+{
+    candidate.clear();
+    if (hex[0] == '\0')
+    {
+        memcpy(blob.code, candidate.program(), candidate.size());
+        blob.length = candidate.size();
+        return true;
+    }
+    blob.length = rulesFromHex(hex, blob.code, sizeof(blob.code));
+    return blob.length > 0 && candidate.load(blob.code, blob.length, resolve);
+}
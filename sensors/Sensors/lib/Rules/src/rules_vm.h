@@ -0,0 +1,102 @@
+#ifndef RULES_VM_H
+#define RULES_VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interpreter of the automation rules compiled by the backend.
+// A program is validated once when it is loaded (opcodes, operands, jump
+// targets, stack depth, metric names), so run() does no checks, allocates
+// nothing and executes each instruction at most once: there are only
+// forward jumps, so a run costs at most one pass over the code.
+//
+// Layout: 'R', format, n_metrics, n_metrics x (length, name), code.
+// Stack machine on floats, booleans are 0/1:
+//   METRIC m         push latest value of metric slot m (NaN until sampled)
+//   CONST f32        push constant (little endian)
+//   LOAD r, STORE r  registers kept across runs
+//   GT LT GE LE EQ NE AND OR NOT ADD SUB
+//   HYST r           pop hi, lo, value; r = value > hi ? 1 : value < lo ? 0 : r; push r
+//   HELD t u32       pop condition; push 1 once it has been true for u32 ms (timer t)
+//   JZ u8            pop; skip u8 bytes forward if zero
+//   WRITE a          pop; switch actuator a on if non zero (only when it changes)
+//   END
+
+#define RULES_MAGIC 'R'
+#define RULES_FORMAT 1
+#define RULES_MAX_PROGRAM 256
+#define RULES_MAX_METRICS 8
+#define RULES_STACK 8
+#define RULES_REGISTERS 8
+#define RULES_TIMERS 4
+#define RULES_ACTUATORS 2 // light, ac
+
+typedef enum rules_opcode
+{
+    RULES_END = 0x00,
+    RULES_METRIC = 0x01,
+    RULES_CONST = 0x02,
+    RULES_LOAD = 0x03,
+    RULES_STORE = 0x04,
+    RULES_GT = 0x10,
+    RULES_LT = 0x11,
+    RULES_GE = 0x12,
+    RULES_LE = 0x13,
+    RULES_EQ = 0x14,
+    RULES_NE = 0x15,
+    RULES_AND = 0x20,
+    RULES_OR = 0x21,
+    RULES_NOT = 0x22,
+    RULES_ADD = 0x28,
+    RULES_SUB = 0x29,
+    RULES_HYST = 0x30,
+    RULES_HELD = 0x31,
+    RULES_JZ = 0x40,
+    RULES_WRITE = 0x50,
+} rules_opcode_t;
+
+// Program as stored in flash
+typedef struct rules_blob
+{
+    uint16_t length;
+    uint8_t code[RULES_MAX_PROGRAM];
+} rules_blob_t;
+
+typedef int (*rules_resolve_t)(const char *metric); // metric index, -1 if unknown
+typedef void (*rules_write_t)(uint8_t actuator, bool on);
+
+class RulesVm
+{
+public:
+    RulesVm();
+
+    // Validate and install a program, the running one is kept on failure
+    bool load(const uint8_t *program, size_t length, rules_resolve_t resolve);
+    void clear();
+
+    const uint8_t *program() const { return code; }
+    uint16_t size() const { return length; }
+
+    // Evaluate the program on the latest metric values (indexed like the
+    // sensor set), returns the number of executed instructions
+    uint16_t run(const float *metrics, uint32_t now, rules_write_t write);
+
+private:
+    uint8_t code[RULES_MAX_PROGRAM];
+    uint16_t length;
+    uint16_t entry; // first instruction after the metric names
+    int8_t metric_index[RULES_MAX_METRICS];
+    float registers[RULES_REGISTERS];
+    uint32_t timer_start[RULES_TIMERS];
+    bool timer_running[RULES_TIMERS];
+    int8_t outputs[RULES_ACTUATORS]; // last written by the program, -1 never
+};
+
+// Decode a hex string, returns the number of bytes or 0 if invalid
+size_t rulesFromHex(const char *hex, uint8_t *out, size_t max);
+// Program of a rules update ("program" of the control message, an empty
+// one removes the rules) validated into candidate, with the blob to store.
+// The running program is not touched, it is swapped once the blob is stored.
+bool rulesUpdate(const char *hex, rules_resolve_t resolve, RulesVm &candidate, rules_blob_t &blob);
+
+#endif
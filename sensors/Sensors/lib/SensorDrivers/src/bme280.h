@@ -0,0 +1,171 @@
+#ifndef BME280_H
+#define BME280_H
+
+#include "sensor_driver.h"
+
+// Bosch BME280 temperature, humidity & pressure sensor on I2C, sampled in
+// forced mode (x1 oversampling, no filter) with the datasheet integer
+// compensation.
+template <typename Bus>
+class Bme280 : public SensorDriver<Bme280<Bus>>
+{
+public:
+    static const uint8_t METRICS = 3 + COMFORT_METRICS;
+    static const uint32_t MIN_INTERVAL_MS = 100;
+    static const uint32_t CONVERSION_MS = 10;
+    static const uint32_t SAMPLE_COST_US = 1000;
+    static const bool CONTINUOUS = false;
+
+    static metric_info_t metric(uint8_t i)
+    {
+        switch (i)
+        {
+        case 0:
+            return {"temperature", METRIC_VALUE};
+        case 1:
+            return {"humidity", METRIC_VALUE};
+        case 2:
+            return {"pressure", METRIC_VALUE};
+        default:
+            return comfortMetric(i - 3);
+        }
+    }
+
+    explicit Bme280(Bus &i2c, uint8_t i2c_address = 0x76) : bus(i2c), address(i2c_address) {}
+
+    bool begin()
+    {
+        uint8_t id;
+        uint8_t calib[26];
+        uint8_t hum_calib[7];
+
+        if (!readRegisters(0xD0, &id, 1) || id != 0x60)
+            return false;
+        if (!readRegisters(0x88, calib, 26) || !readRegisters(0xE1, hum_calib, 7))
+            return false;
+
+        dig_T1 = u16(calib + 0);
+        dig_T2 = (int16_t)u16(calib + 2);
+        dig_T3 = (int16_t)u16(calib + 4);
+        dig_P1 = u16(calib + 6);
+        for (uint8_t i = 0; i < 8; i++)
+            dig_P[i] = (int16_t)u16(calib + 8 + 2 * i);
+        dig_H1 = calib[25];
+        dig_H2 = (int16_t)u16(hum_calib + 0);
+        dig_H3 = hum_calib[2];
+        dig_H4 = (int16_t)((int8_t)hum_calib[3] * 16 | (hum_calib[4] & 0x0F));
+        dig_H5 = (int16_t)((int8_t)hum_calib[5] * 16 | (hum_calib[4] >> 4));
+        dig_H6 = (int8_t)hum_calib[6];
+
+        // humidity oversampling only takes effect after a ctrl_meas write
+        return writeRegister(0xF2, 0x01);
+    }
+
+    bool startConversion()
+    {
+        // temperature x1, pressure x1, forced mode
+        return writeRegister(0xF4, 0x25);
+    }
+
+    bool collect(float *values)
+    {
+        uint8_t data[8];
+        if (!readRegisters(0xF7, data, 8))
+            return false;
+
+        int32_t adc_P = ((int32_t)data[0] << 12) | ((int32_t)data[1] << 4) | (data[2] >> 4);
+        int32_t adc_T = ((int32_t)data[3] << 12) | ((int32_t)data[4] << 4) | (data[5] >> 4);
+        int32_t adc_H = ((int32_t)data[6] << 8) | data[7];
+        if (adc_T == 0x80000) // measurement skipped
+            return false;
+
+        int32_t t_fine = fineTemperature(adc_T);
+        int32_t t_cc = (t_fine * 5 + 128) >> 8; // 0.01 °C
+        uint32_t rh_q10 = compensateHumidity(adc_H, t_fine);
+
+        values[0] = t_cc / 100.0f;
+        values[1] = rh_q10 / 1024.0f;
+        values[2] = compensatePressure(adc_P, t_fine) / 25600.0f; // hPa
+        comfortValues((t_cc + (t_cc < 0 ? -5 : 5)) / 10, (rh_q10 * 10 + 512) >> 10, values + 3);
+        return true;
+    }
+
+private:
+    static uint16_t u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+    bool writeRegister(uint8_t reg, uint8_t value)
+    {
+        bus.beginTransmission(address);
+        bus.write(reg);
+        bus.write(value);
+        return bus.endTransmission() == 0;
+    }
+
+    bool readRegisters(uint8_t reg, uint8_t *out, uint8_t len)
+    {
+        bus.beginTransmission(address);
+        bus.write(reg);
+        if (bus.endTransmission() != 0 || bus.requestFrom(address, len) != len)
+            return false;
+        for (uint8_t i = 0; i < len; i++)
+            out[i] = bus.read();
+        return true;
+    }
+
+    int32_t fineTemperature(int32_t adc_T) const
+    {
+        int32_t var1 = ((((adc_T >> 3) - ((int32_t)dig_T1 << 1))) * ((int32_t)dig_T2)) >> 11;
+        int32_t var2 = (((((adc_T >> 4) - ((int32_t)dig_T1)) * ((adc_T >> 4) - ((int32_t)dig_T1))) >> 12) *
+                        ((int32_t)dig_T3)) >>
+                       14;
+        return var1 + var2;
+    }
+
+    // Pressure in Pa as Q24.8
+    uint32_t compensatePressure(int32_t adc_P, int32_t t_fine) const
+    {
+        int64_t var1 = ((int64_t)t_fine) - 128000;
+        int64_t var2 = var1 * var1 * (int64_t)dig_P[4];
+        var2 = var2 + ((var1 * (int64_t)dig_P[3]) << 17);
+        var2 = var2 + (((int64_t)dig_P[2]) << 35);
+        var1 = ((var1 * var1 * (int64_t)dig_P[1]) >> 8) + ((var1 * (int64_t)dig_P[0]) << 12);
+        var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)dig_P1) >> 33;
+        if (var1 == 0)
+            return 0;
+        int64_t p = 1048576 - adc_P;
+        p = (((p << 31) - var2) * 3125) / var1;
+        var1 = (((int64_t)dig_P[7]) * (p >> 13) * (p >> 13)) >> 25;
+        var2 = (((int64_t)dig_P[6]) * p) >> 19;
+        p = ((p + var1 + var2) >> 8) + (((int64_t)dig_P[5]) << 4);
+        return (uint32_t)p;
+    }
+
+    // Relative humidity in % as Q22.10
+    uint32_t compensateHumidity(int32_t adc_H, int32_t t_fine) const
+    {
+        int32_t v = t_fine - ((int32_t)76800);
+        v = (((((adc_H << 14) - (((int32_t)dig_H4) << 20) - (((int32_t)dig_H5) * v)) + ((int32_t)16384)) >> 15) *
+             (((((((v * ((int32_t)dig_H6)) >> 10) * (((v * ((int32_t)dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+                ((int32_t)2097152)) *
+                   ((int32_t)dig_H2) +
+               8192) >>
+              14));
+        v = (v - (((((v >> 15) * (v >> 15)) >> 7) * ((int32_t)dig_H1)) >> 4));
+        v = v < 0 ? 0 : v;
+        v = v > 419430400 ? 419430400 : v;
+        return (uint32_t)(v >> 12);
+    }
+
+    Bus &bus;
+    uint8_t address;
+
+    uint16_t dig_T1;
+    int16_t dig_T2, dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P[8]; // dig_P2 .. dig_P9
+    uint8_t dig_H1, dig_H3;
+    int16_t dig_H2, dig_H4, dig_H5;
+    int8_t dig_H6;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdio.h>
+
+#include "sensor_driver.h"
+
+#define CHANNEL_NAME_MAX 32
+
+// One more probe of a kind the node already has. The metrics of Driver are
+// named <metric>/<ID>, so they are published on
+// unishare/sensors/<mac>/<metric>/<ID> and are referred to by that name in
+// the interlock and rules, while the first probe keeps the plain names.
+// The channel table of a node is its SensorSet typedef, e.g. a second and
+// third DHT11 on D3 and D6:
+//
+//   typedef SensorSet<Dht11<ArduinoGpio>, Channel<Dht11<ArduinoGpio>, 2>, Channel<Dht11<ArduinoGpio>, 3>> NodeSensors;
+//   NodeSensors sensors(Dht11<ArduinoGpio>(D2), Channel<Dht11<ArduinoGpio>, 2>(D3), Channel<Dht11<ArduinoGpio>, 3>(D6));
+template <typename Driver, uint8_t ID>
+class Channel : public Driver
+{
+public:
+    template <typename... Args>
+    explicit Channel(Args... args) : Driver(args...)
+    {
+    }
+
+    static metric_info_t metric(uint8_t i)
+    {
+        static char names[Driver::METRICS][CHANNEL_NAME_MAX];
+        metric_info_t info = Driver::metric(i);
+        if (names[i][0] == '\0')
+            snprintf(names[i], sizeof(names[i]), "%s/%u", info.name, ID);
+        info.name = names[i];
+        return info;
+    }
+};
+
+#endif
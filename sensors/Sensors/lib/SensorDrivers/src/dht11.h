@@ -0,0 +1,100 @@
+#ifndef DHT11_H
+#define DHT11_H
+
+#include "sensor_driver.h"
+
+// DHT11 temperature & humidity sensor on a single bit-banged line.
+// The 18 ms start signal is the conversion phase, so only the ~4 ms bit
+// transfer (with interrupts disabled) blocks the CPU.
+template <typename Gpio>
+class Dht11 : public SensorDriver<Dht11<Gpio>>
+{
+public:
+    static const uint8_t METRICS = 2 + COMFORT_METRICS;
+    static const uint32_t MIN_INTERVAL_MS = 2000;
+    static const uint32_t CONVERSION_MS = 20;
+    static const uint32_t SAMPLE_COST_US = 4500;
+    static const bool CONTINUOUS = false;
+
+    static metric_info_t metric(uint8_t i)
+    {
+        switch (i)
+        {
+        case 0:
+            return {"temperature", METRIC_VALUE};
+        case 1:
+            return {"humidity", METRIC_VALUE};
+        default:
+            return comfortMetric(i - 2);
+        }
+    }
+
+    explicit Dht11(uint8_t data_pin) : pin(data_pin) {}
+
+    bool begin()
+    {
+        Gpio::input(pin, true);
+        return true;
+    }
+
+    bool startConversion()
+    {
+        // start signal: hold the line low for at least 18 ms
+        Gpio::output(pin);
+        Gpio::write(pin, false);
+        return true;
+    }
+
+    bool collect(float *values)
+    {
+        uint8_t data[5] = {0, 0, 0, 0, 0};
+        bool ok = true;
+
+        Gpio::lock();
+        Gpio::input(pin, true); // release the line, the sensor answers within 40 us
+        Gpio::wait_us(55);
+        // response: 80 us low, 80 us high
+        ok = pulse(false) >= 0 && pulse(true) >= 0;
+        // 40 bits: 50 us low, then 26-28 us (0) or 70 us (1) high
+        for (uint8_t bit = 0; ok && bit < 40; bit++)
+        {
+            int32_t low = pulse(false);
+            int32_t high = pulse(true);
+            ok = low >= 0 && high >= 0;
+            data[bit / 8] = (data[bit / 8] << 1) | (high > low ? 1 : 0);
+        }
+        Gpio::unlock();
+
+        if (!ok || data[4] != (uint8_t)(data[0] + data[1] + data[2] + data[3]))
+            return false;
+
+        // integral and decimal bytes, in tenths
+        uint16_t humidity = data[0] * 10 + data[1];
+        int16_t temperature = data[2] * 10;
+        if (data[3] & 0x80)
+            temperature = -10 - temperature;
+        temperature += data[3] & 0x0f;
+
+        values[0] = temperature * 0.1f;
+        values[1] = humidity * 0.1f;
+        comfortValues(temperature, humidity, values + 2);
+        return true;
+    }
+
+private:
+    // Duration of the current level in us, -1 on timeout
+    int32_t pulse(bool level)
+    {
+        uint32_t start = Gpio::now_us();
+        while (Gpio::read(pin) == level)
+        {
+            if (Gpio::now_us() - start > 1000)
+                return -1;
+        }
+        return Gpio::now_us() - start;
+    }
+
+    uint8_t pin;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef FLAME_H
+#define FLAME_H
+
+#include "sensor_driver.h"
+
+// Digital flame detector, HIGH when a flame is seen
+template <typename Gpio>
+class FlameDetector : public SensorDriver<FlameDetector<Gpio>>
+{
+public:
+    static const uint8_t METRICS = 1;
+    static const uint32_t MIN_INTERVAL_MS = 0;
+    static const uint32_t CONVERSION_MS = 0;
+    static const uint32_t SAMPLE_COST_US = 1;
+    static const bool CONTINUOUS = true;
+
+    static metric_info_t metric(uint8_t)
+    {
+        return {"flame", METRIC_EVENT};
+    }
+
+    explicit FlameDetector(uint8_t input_pin) : pin(input_pin) {}
+
+    bool begin()
+    {
+        Gpio::input(pin, false);
+        return true;
+    }
+
+    bool startConversion() { return true; }
+
+    bool collect(float *values)
+    {
+        values[0] = Gpio::read(pin) ? 1.0f : 0.0f;
+        return true;
+    }
+
+private:
+    uint8_t pin;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PHOTORESISTOR_H
+#define PHOTORESISTOR_H
+
+#include "sensor_driver.h"
+
+// Photoresistor on the ADC (range 0-1023), published as light on/off
+template <typename Gpio>
+class Photoresistor : public SensorDriver<Photoresistor<Gpio>>
+{
+public:
+    static const uint8_t METRICS = 1;
+    static const uint32_t MIN_INTERVAL_MS = 10; // reading the ADC too often disturbs WiFi
+    static const uint32_t CONVERSION_MS = 0;
+    static const uint32_t SAMPLE_COST_US = 100;
+    static const bool CONTINUOUS = false;
+
+    static metric_info_t metric(uint8_t)
+    {
+        return {"light", METRIC_LEVEL};
+    }
+
+    explicit Photoresistor(uint8_t analog_pin) : pin(analog_pin) {}
+
+    bool begin() { return true; }
+    bool startConversion() { return true; }
+
+    bool collect(float *values)
+    {
+        values[0] = Gpio::analog(pin);
+        return true;
+    }
+
+private:
+    uint8_t pin;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SENSOR_DRIVER_H
+#define SENSOR_DRIVER_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include <comfort.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// How a metric is published
+typedef enum metric_kind
+{
+    METRIC_VALUE, // aggregated over the log window, published as the mean
+    METRIC_LEVEL, // aggregated raw value, published as a boolean against a threshold
+    METRIC_EVENT, // published as soon as it changes
+} metric_kind_t;
+
+typedef struct metric_info
+{
+    const char *name; // last level of the MQTT topic
+    metric_kind_t kind;
+} metric_info_t;
+
+#ifdef ARDUINO
+// Pin access of the drivers, a native build passes its own mock instead
+struct ArduinoGpio
+{
+    static void output(uint8_t pin) { pinMode(pin, OUTPUT); }
+    static void input(uint8_t pin, bool pullup) { pinMode(pin, pullup ? INPUT_PULLUP : INPUT); }
+    static void write(uint8_t pin, bool high) { digitalWrite(pin, high ? HIGH : LOW); }
+    static bool read(uint8_t pin) { return digitalRead(pin) == HIGH; }
+    static int analog(uint8_t pin) { return analogRead(pin); }
+    static uint32_t now_us() { return micros(); }
+    static void wait_us(uint32_t us) { delayMicroseconds(us); }
+    static void lock() { noInterrupts(); }
+    static void unlock() { interrupts(); }
+};
+#endif
+
+// Base of the sensor drivers (CRTP, no virtual calls).
+// A driver Derived provides:
+//   static const uint8_t METRICS;           number of values per sample
+//   static metric_info_t metric(uint8_t i); name and kind of the i-th value
+//   static const uint32_t MIN_INTERVAL_MS;  minimum time between two samples
+//   static const uint32_t CONVERSION_MS;    time between start and collect
+//   static const uint32_t SAMPLE_COST_US;   CPU time blocked by one sample
+//   static const bool CONTINUOUS;           sampled at every poll (events)
+//   bool begin();
+//   bool startConversion();                 kick off a sample, must not block
+//   bool collect(float *values);            read the result, false if invalid
+// and the base schedules the two phases so that the conversion time is
+// spent doing something else.
+template <typename Derived>
+class SensorDriver
+{
+public:
+    // Requested sampling period, never below the driver minimum
+    void setInterval(uint32_t interval_ms)
+    {
+        interval = interval_ms > Derived::MIN_INTERVAL_MS ? interval_ms : Derived::MIN_INTERVAL_MS;
+    }
+
+    bool due(uint32_t now) const
+    {
+        if (busy)
+            return false;
+        if (Derived::CONTINUOUS || !started_once)
+            return true;
+        return now - last_start >= interval;
+    }
+
+    bool start(uint32_t now)
+    {
+        busy = derived().startConversion();
+        started_once = true;
+        last_start = now;
+        return busy;
+    }
+
+    bool ready(uint32_t now) const
+    {
+        return busy && now - last_start >= Derived::CONVERSION_MS;
+    }
+
+    uint32_t started() const { return last_start; }
+
+    bool finish(float *values)
+    {
+        busy = false;
+        return derived().collect(values);
+    }
+
+protected:
+    SensorDriver() : interval(Derived::MIN_INTERVAL_MS), last_start(0), busy(false), started_once(false) {}
+
+private:
+    Derived &derived() { return static_cast<Derived &>(*this); }
+
+    uint32_t interval;
+    uint32_t last_start;
+    bool busy;
+    bool started_once;
+};
+
+// Metrics derived from a temperature & humidity reading, published after
+// the two raw values by the drivers that measure both
+#define COMFORT_METRICS 4
+
+inline metric_info_t comfortMetric(uint8_t i)
+{
+    switch (i)
+    {
+    case 0:
+        return {"apparent_temperature", METRIC_VALUE};
+    case 1:
+        return {"dew_point", METRIC_VALUE};
+    case 2:
+        return {"absolute_humidity", METRIC_VALUE};
+    default:
+        return {"humidex", METRIC_VALUE};
+    }
+}
+
+// Fills the COMFORT_METRICS values from 0.1 °C and 0.1 %RH, in fixed point
+inline void comfortValues(int16_t t_dc, uint16_t rh_dp, float *values)
+{
+    comfort_t comfort;
+    comfortCompute(t_dc, rh_dp, comfort);
+    values[0] = comfort.heat_index * 0.1f;
+    values[1] = comfort.dew_point * 0.1f;
+    values[2] = comfort.absolute_humidity * 0.01f; // g/m3
+    values[3] = comfort.humidex * 0.1f;
+}
+
+// Apparent temperature (NOAA heat index, Rothfusz regression) in Celsius.
+// Float reference of comfortHeatIndex(), kept for the comfort tool.
+inline float apparentTemperature(float celsius, float humidity)
+{
+    float t = celsius * 1.8f + 32.0f;
+    float hi = 0.5f * (t + 61.0f + ((t - 68.0f) * 1.2f) + (humidity * 0.094f));
+    if (hi > 79.0f)
+    {
+        hi = -42.379f + 2.04901523f * t + 10.14333127f * humidity +
+             -0.22475541f * t * humidity +
+             -0.00683783f * t * t +
+             -0.05481717f * humidity * humidity +
+             0.00122874f * t * t * humidity +
+             0.00085282f * t * humidity * humidity +
+             -0.00000199f * t * t * humidity * humidity;
+
+        if ((humidity < 13.0f) && (t >= 80.0f) && (t <= 112.0f))
+            hi -= ((13.0f - humidity) * 0.25f) * sqrtf((17.0f - fabsf(t - 95.0f)) * 0.05882f);
+        else if ((humidity > 85.0f) && (t >= 80.0f) && (t <= 87.0f))
+            hi += ((humidity - 85.0f) * 0.1f) * ((87.0f - t) * 0.2f);
+    }
+    return (hi - 32.0f) * 0.55555f;
+}
+
+#endif
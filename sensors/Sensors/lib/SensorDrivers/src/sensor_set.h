@@ -0,0 +1,234 @@
+#ifndef SENSOR_SET_H
+#define SENSOR_SET_H
+
+#include <stddef.h>
+#include <string.h>
+#include <tuple>
+#include <utility>
+
+#include "sensor_driver.h"
+
+// Compile-time set of sensor drivers. Metrics of all the drivers are
+// numbered in declaration order, so a node describes its hardware with a
+// single typedef and everything else (windows, topics, publish loop) is
+// derived from it:
+//
+//   typedef SensorSet<Dht11<ArduinoGpio>, Photoresistor<ArduinoGpio>> NodeSensors;
+//
+// poll() hands every value to a sink providing
+//   void sample(uint8_t metric, float value);
+//   void failed(uint8_t first_metric);        a driver returned an invalid sample
+//
+// A node with several probes (see channel.h) starts all their conversions
+// in the same poll, and the collects (the DHT11 bit transfer, an I2C read)
+// would then run back to back. With a budget, a poll only collects as many
+// as fit in it by SAMPLE_COST_US; the others stay ready and are collected
+// by the next polls, after the loop had its turn. CONTINUOUS drivers (event
+// metrics such as flame) are never deferred, wherever they are declared:
+// their cost still counts against the budget of the drivers after them.
+
+// Acquisition of one driver since the last resetStats()
+typedef struct acquisition_stats
+{
+    uint32_t samples;
+    uint32_t failures;
+    uint32_t deferred;       // polls a ready conversion waited for the budget
+    uint32_t max_latency_ms; // from start to collect
+    uint32_t max_collect_us; // measured, 0 without a clock
+    uint32_t total_collect_us;
+} acquisition_stats_t;
+
+template <typename... Drivers>
+class SensorSet
+{
+    typedef std::tuple<Drivers...> drivers_t;
+    static const size_t COUNT = sizeof...(Drivers);
+
+    template <size_t I>
+    using index = std::integral_constant<size_t, I>;
+
+    template <typename... Ds>
+    struct MetricCount
+    {
+        static const uint8_t value = 0;
+    };
+    template <typename D, typename... Ds>
+    struct MetricCount<D, Ds...>
+    {
+        static const uint8_t value = D::METRICS + MetricCount<Ds...>::value;
+    };
+
+public:
+    static const uint8_t METRICS = MetricCount<Drivers...>::value;
+    static const uint8_t DRIVERS = COUNT;
+
+    explicit SensorSet(const Drivers &...sensors) : drivers(sensors...), budget_us(0), clock_us(NULL)
+    {
+        resetStats();
+    }
+
+    static metric_info_t metric(uint8_t i)
+    {
+        return metricAt(i, index<0>());
+    }
+
+    // Index of a metric by name, -1 if no driver provides it
+    static int metricIndex(const char *name)
+    {
+        for (uint8_t i = 0; i < METRICS; i++)
+        {
+            if (strcmp(metric(i).name, name) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    // Worst case CPU time of sampling every driver once
+    static uint32_t sampleCostUs()
+    {
+        return costAt(index<0>());
+    }
+
+    // First metric of a driver, names it in the reports
+    static uint8_t firstMetric(uint8_t driver)
+    {
+        return firstMetricAt(driver, index<0>());
+    }
+
+    // Number of drivers that failed to start
+    uint8_t begin()
+    {
+        return beginAt(index<0>());
+    }
+
+    void setInterval(uint32_t interval_ms)
+    {
+        intervalAt(interval_ms, index<0>());
+    }
+
+    // Collect cost allowed per poll (0 for no limit, the first ready driver
+    // is always collected), and the clock that times the collects
+    void setBudget(uint32_t collect_budget_us, uint32_t (*now_us)() = NULL)
+    {
+        budget_us = collect_budget_us;
+        clock_us = now_us;
+    }
+
+    const acquisition_stats_t &stats(uint8_t driver) const { return acquisition[driver]; }
+    void resetStats() { memset(acquisition, 0, sizeof(acquisition)); }
+
+    // Start the drivers that are due and collect the conversions that are
+    // complete; never waits for a conversion.
+    template <typename Sink>
+    void poll(uint32_t now, Sink &sink)
+    {
+        pollAt(now, sink, 0, index<0>());
+    }
+
+private:
+    static constexpr uint8_t offset(index<0>) { return 0; }
+    template <size_t I>
+    static constexpr uint8_t offset(index<I>)
+    {
+        return offset(index<I - 1>()) + std::tuple_element<I - 1, drivers_t>::type::METRICS;
+    }
+
+    static metric_info_t metricAt(uint8_t, index<COUNT>) { return {"", METRIC_VALUE}; }
+    template <size_t I>
+    static metric_info_t metricAt(uint8_t i, index<I>)
+    {
+        typedef typename std::tuple_element<I, drivers_t>::type driver_t;
+        if (i < driver_t::METRICS)
+            return driver_t::metric(i);
+        return metricAt(i - driver_t::METRICS, index<I + 1>());
+    }
+
+    static uint32_t costAt(index<COUNT>) { return 0; }
+    template <size_t I>
+    static uint32_t costAt(index<I>)
+    {
+        return std::tuple_element<I, drivers_t>::type::SAMPLE_COST_US + costAt(index<I + 1>());
+    }
+
+    static uint8_t firstMetricAt(uint8_t, index<COUNT>) { return METRICS; }
+    template <size_t I>
+    static uint8_t firstMetricAt(uint8_t driver, index<I>)
+    {
+        return driver == I ? offset(index<I>()) : firstMetricAt(driver, index<I + 1>());
+    }
+
+    uint8_t beginAt(index<COUNT>) { return 0; }
+    template <size_t I>
+    uint8_t beginAt(index<I>)
+    {
+        uint8_t failed = std::get<I>(drivers).begin() ? 0 : 1;
+        return failed + beginAt(index<I + 1>());
+    }
+
+    void intervalAt(uint32_t, index<COUNT>) {}
+    template <size_t I>
+    void intervalAt(uint32_t interval_ms, index<I>)
+    {
+        std::get<I>(drivers).setInterval(interval_ms);
+        intervalAt(interval_ms, index<I + 1>());
+    }
+
+    template <typename Sink>
+    void pollAt(uint32_t, Sink &, uint32_t, index<COUNT>) {}
+    template <typename Sink, size_t I>
+    void pollAt(uint32_t now, Sink &sink, uint32_t spent_us, index<I>)
+    {
+        typedef typename std::tuple_element<I, drivers_t>::type driver_t;
+        driver_t &driver = std::get<I>(drivers);
+        acquisition_stats_t &stats = acquisition[I];
+
+        if (driver.due(now))
+            driver.start(now);
+        // drivers without conversion time are collected in the same poll
+        bool collect = driver.ready(now);
+        if (collect && !driver_t::CONTINUOUS && budget_us > 0 && spent_us > 0 &&
+            spent_us + driver_t::SAMPLE_COST_US > budget_us)
+        {
+            stats.deferred++; // left ready for one of the next polls
+            collect = false;
+        }
+        if (collect)
+        {
+            spent_us += driver_t::SAMPLE_COST_US;
+
+            uint32_t latency_ms = now - driver.started();
+            if (latency_ms > stats.max_latency_ms)
+                stats.max_latency_ms = latency_ms;
+            uint32_t begin_us = clock_us ? clock_us() : 0;
+            float values[driver_t::METRICS];
+            bool ok = driver.finish(values);
+            if (clock_us)
+            {
+                uint32_t collect_us = clock_us() - begin_us;
+                stats.total_collect_us += collect_us;
+                if (collect_us > stats.max_collect_us)
+                    stats.max_collect_us = collect_us;
+            }
+
+            if (ok)
+            {
+                stats.samples++;
+                for (uint8_t m = 0; m < driver_t::METRICS; m++)
+                    sink.sample(offset(index<I>()) + m, values[m]);
+            }
+            else
+            {
+                stats.failures++;
+                sink.failed(offset(index<I>()));
+            }
+        }
+        pollAt(now, sink, spent_us, index<I + 1>());
+    }
+
+    drivers_t drivers;
+    uint32_t budget_us;
+    uint32_t (*clock_us)();
+    acquisition_stats_t acquisition[COUNT];
+};
+
+#endif
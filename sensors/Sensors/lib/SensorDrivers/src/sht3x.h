@@ -0,0 +1,89 @@
+#ifndef SHT3X_H
+#define SHT3X_H
+
+#include "sensor_driver.h"
+
+// Sensirion SHT3x temperature & humidity sensor on I2C (single shot,
+// high repeatability, no clock stretching)
+template <typename Bus>
+class Sht3x : public SensorDriver<Sht3x<Bus>>
+{
+public:
+    static const uint8_t METRICS = 2 + COMFORT_METRICS;
+    static const uint32_t MIN_INTERVAL_MS = 100;
+    static const uint32_t CONVERSION_MS = 16;
+    static const uint32_t SAMPLE_COST_US = 800;
+    static const bool CONTINUOUS = false;
+
+    static metric_info_t metric(uint8_t i)
+    {
+        switch (i)
+        {
+        case 0:
+            return {"temperature", METRIC_VALUE};
+        case 1:
+            return {"humidity", METRIC_VALUE};
+        default:
+            return comfortMetric(i - 2);
+        }
+    }
+
+    explicit Sht3x(Bus &i2c, uint8_t i2c_address = 0x44) : bus(i2c), address(i2c_address) {}
+
+    bool begin()
+    {
+        bus.beginTransmission(address);
+        return bus.endTransmission() == 0;
+    }
+
+    bool startConversion()
+    {
+        bus.beginTransmission(address);
+        bus.write((uint8_t)0x24);
+        bus.write((uint8_t)0x00);
+        return bus.endTransmission() == 0;
+    }
+
+    bool collect(float *values)
+    {
+        uint8_t data[6];
+        if (bus.requestFrom(address, (uint8_t)6) != 6)
+            return false;
+        for (uint8_t i = 0; i < 6; i++)
+            data[i] = bus.read();
+        if (crc8(data) != data[2] || crc8(data + 3) != data[5])
+            return false;
+
+        uint16_t raw_temperature = (data[0] << 8) | data[1];
+        uint16_t raw_humidity = (data[3] << 8) | data[4];
+        float temperature = -45.0f + 175.0f * raw_temperature / 65535.0f;
+        float humidity = 100.0f * raw_humidity / 65535.0f;
+
+        values[0] = temperature;
+        values[1] = humidity;
+        // 0.1 °C and 0.1 %RH: -450 + 1750 * raw / 65535, 1000 * raw / 65535
+        int16_t t_dc = -450 + (int16_t)((1750UL * raw_temperature + 32767) / 65535);
+        uint16_t rh_dp = (1000UL * raw_humidity + 32767) / 65535;
+        comfortValues(t_dc, rh_dp, values + 2);
+        return true;
+    }
+
+private:
+    // CRC-8 of a 16 bit word, polynomial 0x31, init 0xff
+    static uint8_t crc8(const uint8_t *word)
+    {
+        uint8_t crc = 0xff;
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            crc ^= word[i];
+            for (uint8_t bit = 0; bit < 8; bit++)
+                crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+        }
+        return crc;
+    }
+
+    Bus &bus;
+    uint8_t address;
+};
+
+#endif
@@ -2,23 +2,59 @@
 
 // Include sensors libraries
 // --------------
-// Include DHT 11 library
-#include <Adafruit_Sensor.h>
-#include <DHT.h>
+// Sensor drivers
+#include <sensor_set.h>
+#include <channel.h>
+#include <dht11.h>
+#include <photoresistor.h>
+#include <flame.h>
 // Include WIFi Library
 #include <ESP8266WiFi.h>
 // Include JSON Library
 #include <ArduinoJson.h>
+#include <json_arena.h>
 // Include MQTT Library
 #include <MQTT.h>
+// Include window statistics
+#include <aggregator.h>
+// Include OTA updates
+#include <ota.h>
+// Include local safety interlock
+#include <interlock.h>
+// Include the actuators and the coalescing of their commands
+#include <actuators.h>
+#include <config_store.h>
+// Include automation rules
+#include <rules_vm.h>
+// Include wall clock
+#include <time_sync.h>
+// Include energy accounting
+#include <energy_profiler.h>
+// Include broker connection (plain or TLS)
+#include <broker_link.h>
+// Include message transports (broker, ESP-NOW to the screens)
+#include <mqtt_transport.h>
+#include <espnow_transport.h>
+// Include watchdog diagnostics
+#include <stall_watch.h>
+// Include local history log
+#include <reading_log.h>
+#include <crc32.h>
 
 // Include SECRETs
 #include "secrets.h"
+// Include runtime configuration
+#include "node_config.h"
 
 // Init Mode
 #define DEBUG
 //#define FORCE_MODEM_SLEEP
 
+#define FIRMWARE_VERSION "1.1.0"
+#define OTA_MAX_BOOT_ATTEMPTS 3 // roll back if the new image can't complete the setup
+#define STALL_THRESHOLD 1000    // ms in a section before it counts as a stall (soft WDT after ~3.2 s)
+#define SAMPLE_BUDGET_US 5000   // collect cost per loop pass (one DHT11), more probes wait for the next passes
+
 // Sensors
 // --------------
 // Buildi-In LEDs
@@ -28,18 +64,20 @@
 #define FLAME D1
 // DHT11 - Temperature & Humidity Sensor
 #define DHT_PIN D2
-#define DHT_TYPE DHT11 // Sensor type: DHT 11
 // Photoresistor
-#define PHOTORESISTOR A0            // photoresistor pin
-#define PHOTORESISTOR_THRESHOLD 900 // turn led on for light values lesser than this
+#define PHOTORESISTOR A0 // photoresistor pin
 // WiFi signal
 #define RSSI_THRESHOLD -60 // WiFi signal strength threshold
 
-#define LOG_DELAY 60000
-#define MQTT_CONTROL_DELAY 0
-#define AC_CONTROL_DELAY 30000
-
 #define MQTT_TOPIC_SETUP "unishare/devices/setup"
+#define MQTT_TOPIC_OTA "unishare/ota/announce"
+#define MQTT_TOPIC_TIME "unishare/time" // broker time, fallback when SNTP is unreachable
+
+#define INTERLOCK_PATH "/interlock.bin"
+#define INTERLOCK_VERSION 1
+#define RULES_PATH "/rules.bin"
+#define LOG_DIR "/log"
+#define HISTORY_CHUNKS_PER_TICK 4 // history query chunks sent per control tick
 
 // Actuators
 //-----
@@ -54,26 +92,28 @@
 unsigned long currentTime;
 // Initialize setup time
 unsigned long lastSetupTime = 0;
-// Initialize temperature & humidity time
-unsigned long lastTempTime = 0;
-// Initialize photoresistor log time
-unsigned long lastLightLogTime = 0;
-// Initialize flame log time
-unsigned long lastFlameLogTime = 0;
 // Initialize rssi log time
 unsigned long lastRssiLog = 0;
 // Initialize ac control time
 unsigned long lastAcControl = 0;
 bool temp_read = false;
 
-// Initialize DHT sensor
-DHT dht = DHT(DHT_PIN, DHT_TYPE);
+// Initialize sensors (metrics are numbered in declaration order). More
+// probes of the same kind are added as channels, see channel.h
+typedef SensorSet<Dht11<ArduinoGpio>, Photoresistor<ArduinoGpio>, FlameDetector<ArduinoGpio>> NodeSensors;
+NodeSensors sensors(Dht11<ArduinoGpio>(DHT_PIN), Photoresistor<ArduinoGpio>(PHOTORESISTOR), FlameDetector<ArduinoGpio>(FLAME));
+const int metric_temperature = NodeSensors::metricIndex("temperature");
+
+// Receives the samples of the sensor drivers
+struct SampleSink
+{
+  void sample(uint8_t metric, float value);
+  void failed(uint8_t first_metric);
+} sample_sink;
 
 // Configs
 // --------------
-// WiFi config
-char ssid[] = SECRET_SSID; // your network SSID (name)
-char pass[] = SECRET_PASS; // your network password
+// WiFi config (SSID and password are in the runtime config)
 #ifdef IP
 IPAddress ip(IP);
 IPAddress subnet(SUBNET);
@@ -83,29 +123,81 @@ IPAddress gateway(GATEWAY);
 // MQTT cfg
 #define MQTT_BUFFER_SIZE 1024            // the maximum size for packets being published and received
 MQTTClient mqttClient(MQTT_BUFFER_SIZE); // handles the MQTT communication protocol
-WiFiClient networkClient;                // handles the network connection to the MQTT broker
+                                         // (network connection in broker_link, plain or TLS)
+MqttTransport mqtt_transport(mqttClient); // every message goes to the broker
+EspNowTransport local_transport;          // readings also go to nearby screens (config.local_link)
 
 String clean_mac_address;
 String sensors_topic = "unishare/sensors/";
 String control_topic = "unishare/control/";
 String light_control_topic;
 String ac_control_topic;
+String ota_control_topic;
+String interlock_control_topic;
+String interlock_topic = "unishare/interlock/";
+String interlock_state_topic;
+String rules_control_topic;
+String rules_state_topic = "unishare/rules/";
+String history_control_topic;
+String history_topic = "unishare/history/";
+String energy_topic = "unishare/metrics/";
+String stall_topic = "unishare/metrics/";
+String acquisition_topic = "unishare/metrics/";
+String config_topic = "unishare/config/";
+String config_state_topic;
+String ack_topic = "unishare/acks/";
+String state_topic = "unishare/state/";
 String mqtt_topic_status = "unishare/devices/status/";
 
 // Globals
 // --------------
 // Sensors data values
-bool data_light;
-bool data_flame;
-double data_temperature;
-double data_apparent_temperature;
-double data_humidity;
+double data_temperature; // latest sample, used by the automatic AC control
+bool data_events[NodeSensors::METRICS]; // last state of the event metrics
+bool events_pending = false;           // an event metric changed, published from loop()
+bool event_pending[NodeSensors::METRICS];
 long rssi;
 
-// actuators values;
-double ac_temp;
-String ac_mode;
-String ac_previous_state;
+// Sensors data windows (reset at every log)
+Aggregator windows[NodeSensors::METRICS];
+
+// The largest reports (acquisition, interlock rules) are serialized here
+// instead of on the loop stack; both are sent from loop() only
+#define REPORT_BUFFER_SIZE 768
+char report_buffer[REPORT_BUFFER_SIZE];
+
+// Light and AC, with the newest command of each left by the MQTT callback
+// and applied at the control tick
+Actuators actuators;
+
+// Local interlock, overrides the actuators as soon as a rule trips
+Interlock interlock;
+bool interlock_state_pending = false;
+bool interlock_state_ok = false;
+
+// Automation rules pushed by the backend, run on the latest samples
+RulesVm rules;
+float metric_values[NodeSensors::METRICS];
+bool rules_tick = false;     // new samples since the last run
+bool rules_changed = false;  // actuators switched by the rules, not reported yet
+bool rules_state_pending = false;
+bool rules_state_ok = false;
+
+// Estimated energy use, reported at every log
+EnergyProfiler energy;
+energy_radio_t radio_idle = RADIO_OFF; // radio state between transfers
+
+// Log windows kept in flash, streamed back on request for backfill
+ReadingLog reading_log;
+bool history_query_pending = false; // set by the MQTT callback, started from loop()
+uint32_t history_from;
+uint32_t history_to;
+char history_id[24];
+uint32_t history_chunks;
+uint32_t history_bytes;
+uint8_t history_chunk[LOG_CHUNK_MAX];
+bool config_state_pending = false;
+bool config_state_ok = false;
 
 // Functions
 // -------------------------------
@@ -115,10 +207,37 @@ long connectToWiFi();
 void connectToMQTTBroker();
 void mqttMessageReceived(String &topic, String &payload);
 String clearMacAddress(String mac_address);
-void sendMqttDouble(String attribute, double value);
-void sendMqttLong(String attribute, long value);
-void sendMqttBool(String attribute, bool value);
+bool mqttPublish(const char *topic, const char *payload, size_t length, message_class_t message_class);
+void sendMqttDouble(String attribute, double value, message_class_t message_class);
+void sendMqttLong(String attribute, long value, message_class_t message_class);
+void sendMqttBool(String attribute, bool value, message_class_t message_class);
+void sendMqttWindow(String attribute, Aggregator &window, message_class_t message_class);
+void sendMqttBoolWindow(String attribute, bool value, Aggregator &window, message_class_t message_class);
+void publishWindow(String attribute, JsonDocument &doc, Aggregator &window, message_class_t message_class);
 void acAutoControl();
+void otaReport(const char *state, int progress);
+void sendConfigState(bool ok);
+void sendCommandAcks();
+void sendStateDigest();
+void writeActuator(interlock_actuator_t actuator, bool on);
+void interlockApply(interlock_actuator_t actuator, bool on);
+void sendInterlockEvents();
+void sendEventAlarms();
+void sendInterlockState(bool ok);
+void rulesWrite(uint8_t actuator, bool on);
+void sendRulesState(bool ok);
+void sendStatus();
+void addTimestamp(JsonDocument &doc);
+void radioBusy(energy_radio_t state);
+void sendEnergyReport();
+void sendAcquisitionReport();
+uint32_t sampleClockUs();
+void sendStallReport();
+uint32_t readingLogLayout();
+void sendHistoryChunks();
+#ifdef COMFORT_BENCHMARK
+void comfortBenchmark();
+#endif
 
 // CODE
 void setup()
@@ -126,10 +245,12 @@ void setup()
   // Sync Serial logs
   Serial.begin(115200);
 
+  // Take the stall report of the previous boot, then watch this one
+  stallBegin(STALL_THRESHOLD);
+
   // Init PINs
   pinMode(LED1, OUTPUT); // Define LED 1 output pin
   pinMode(LED2, OUTPUT); // Define LED 2 output pin
-  pinMode(FLAME, INPUT); // Define FLAME input pin
 
   // Init actuators
   pinMode(LIGHT, OUTPUT);
@@ -147,26 +268,79 @@ void setup()
   digitalWrite(LED1, HIGH);
   digitalWrite(LED2, HIGH);
 
-  // Start DHT
-  dht.begin();
+  // Load runtime configuration
+  configBegin();
+  energy.setModel(config.energy);
+  energy.begin(micros());
+
+  // Start sensors
+  if (sensors.begin() > 0)
+  {
+    Serial.println(F("Some sensors failed to start!"));
+  }
+  sensors.setInterval(config.sample_delay);
+  sensors.setBudget(SAMPLE_BUDGET_US, sampleClockUs);
+#ifdef COMFORT_BENCHMARK
+  comfortBenchmark();
+#endif
+
+  // Start local interlock (stored rules, flame defaults otherwise)
+  actuators.begin(interlock, writeActuator, micros);
+  interlock.begin(interlockApply, NodeSensors::metricIndex);
+  interlock_table_t interlock_table;
+  if (!configStoreLoad(INTERLOCK_PATH, INTERLOCK_VERSION, &interlock_table, sizeof(interlock_table)) || !interlock.load(interlock_table))
+  {
+    interlockDefaults(interlock_table);
+    interlock.load(interlock_table);
+  }
+
+  // Sync the clock (in the background once connected)
+  timeSyncBegin(config.ntp_server);
+
+  // Open the local history (segments of another metric set are dropped)
+  reading_log.begin(LOG_DIR, NodeSensors::METRICS, readingLogLayout());
+
+  // Load automation rules
+  for (uint8_t m = 0; m < NodeSensors::METRICS; m++)
+  {
+    metric_values[m] = NAN; // not sampled yet
+  }
+  rules_blob_t rules_blob;
+  if (configStoreLoad(RULES_PATH, RULES_FORMAT, &rules_blob, sizeof(rules_blob)))
+  {
+    rules.load(rules_blob.code, rules_blob.length, NodeSensors::metricIndex);
+  }
+
+  // Check if the running image is on trial after an update
+  otaBegin(FIRMWARE_VERSION, OTA_MAX_BOOT_ATTEMPTS, otaReport);
 
-  // Start MQTT
-  mqttClient.begin(MQTT_BROKERIP, 1883, networkClient); // setup communication with MQTT broker
-  mqttClient.onMessage(mqttMessageReceived);            // callback on message received from MQTT broker
+  // Start MQTT (the connection is set up by connectToMQTTBroker)
+  mqttClient.onMessage(mqttMessageReceived); // callback on message received from MQTT broker
 
   // Start WiFi
   WiFi.mode(WIFI_STA);
 
   clean_mac_address = clearMacAddress(String(WiFi.macAddress()));
   mqtt_topic_status = mqtt_topic_status + clean_mac_address;
-
-  DynamicJsonDocument doc_will(128);
+  config_topic = config_topic + clean_mac_address;
+  config_state_topic = config_topic + "/state";
+  ack_topic = ack_topic + clean_mac_address;
+  state_topic = state_topic + clean_mac_address;
+  interlock_topic = interlock_topic + clean_mac_address;
+  interlock_state_topic = interlock_topic + "/state";
+  rules_state_topic = rules_state_topic + clean_mac_address + "/state";
+  energy_topic = energy_topic + clean_mac_address + "/energy";
+  stall_topic = stall_topic + clean_mac_address + "/stall";
+  acquisition_topic = acquisition_topic + clean_mac_address + "/acquisition";
+  history_topic = history_topic + clean_mac_address;
+
+  JsonScope<128> doc_will;
   doc_will["connected"] = false;
   char buffer_will[128];
   serializeJson(doc_will, buffer_will);
   const char *topic_status = mqtt_topic_status.c_str();
-  mqttClient.setWill(topic_status, buffer_will, true, 1);
-  mqttClient.setKeepAlive(LOG_DELAY / 1000 + 2);
+  mqttClient.setWill(topic_status, buffer_will, config.delivery[MSG_STATUS].retained, config.delivery[MSG_STATUS].qos);
+  mqttClient.setKeepAlive(config.log_delay / 1000 + 2);
   mqttClient.setCleanSession(false);
 
 #ifdef DEBUG
@@ -186,6 +360,7 @@ void setup()
 bool sent_setup = false;
 unsigned long last_log_time = 0;
 unsigned long last_control_time = 0;
+unsigned int log_cycles = 0;
 bool wifi_awake = false;
 
 void loop()
@@ -195,11 +370,20 @@ void loop()
     connectToWiFi(); // connect to WiFi (if not already connected)
     light_control_topic = control_topic + clean_mac_address + "/light";
     ac_control_topic = control_topic + clean_mac_address + "/ac";
+    ota_control_topic = control_topic + clean_mac_address + "/ota";
+    interlock_control_topic = control_topic + clean_mac_address + "/interlock";
+    rules_control_topic = control_topic + clean_mac_address + "/rules";
+    history_control_topic = control_topic + clean_mac_address + "/history";
     connectToMQTTBroker(); // connect to MQTT broker (if not already connected)
-    DynamicJsonDocument doc(256);
+    if (otaPending())
+    {
+      StallSection section(STALL_OTA);
+      otaRun(); // rollback scheduled at boot
+    }
+    JsonScope<256> doc;
     doc["mac_address"] = clean_mac_address;
     doc["type"] = "sensors";
-    doc["name"] = "sensors1";
+    doc["name"] = config.device_name;
     char buffer[256];
     size_t n = serializeJson(doc, buffer);
 
@@ -208,48 +392,61 @@ void loop()
     Serial.println(buffer);
 #endif
     if (mqttClient.publish(MQTT_TOPIC_SETUP, buffer, n, false, 1))
+    {
       sent_setup = true;
+      otaConfirm(); // the image works, keep it
+      sendStallReport();
+    }
   }
   else
   {
-    // Send flame data if status changed
-    int fire = digitalRead(FLAME);
-    if (fire == HIGH && !data_flame)
+    currentTime = millis();
+
+    // Start due conversions and collect finished ones (flame is checked at every loop)
     {
+      EnergyScope scope(energy, SUB_SENSORS);
+      StallSection section(STALL_SENSORS);
+      sensors.poll(currentTime, sample_sink);
+    }
 
-#ifdef DEBUG
-      Serial.println("Fire! Fire!");
-#endif
-      data_flame = true;
-      String attribute = "flame";
+    // Report event metrics (flame) that changed during the poll
+    if (events_pending)
+    {
+      if (!wifi_awake)
+      {
+        awakeConnection();
+      }
+      sendEventAlarms();
+    }
 
+    // Report interlock overrides (the actuators are already switched)
+    if (interlock.pending())
+    {
       if (!wifi_awake)
       {
         awakeConnection();
       }
+      sendInterlockEvents();
+    }
 
-      sendMqttBool(attribute, data_flame);
+    // Run the automation rules on the new samples
+    if (rules_tick)
+    {
+      rules_tick = false;
+      rules.run(metric_values, currentTime, rulesWrite);
     }
-    else if (fire == LOW && data_flame)
+    if (rules_changed)
     {
-
-#ifdef DEBUG
-      Serial.println("No more fire!");
-#endif
-      data_flame = false;
-
-      String attribute = "flame";
+      rules_changed = false;
       if (!wifi_awake)
       {
         awakeConnection();
       }
-      sendMqttBool(attribute, data_flame);
+      sendStateDigest();
     }
 
-    currentTime = millis();
-
     // Check incoming mqtt controls
-    if (currentTime - last_control_time > MQTT_CONTROL_DELAY)
+    if (currentTime - last_control_time > config.mqtt_control_delay)
     {
 #ifdef DEBUG
       Serial.println("MQTT CONTROL LOOP");
@@ -259,36 +456,80 @@ void loop()
         awakeConnection();
       }
 
-      if (!mqttClient.loop())
       {
+        EnergyScope scope(energy, SUB_MQTT);
+        StallSection section(STALL_MQTT_POLL);
+        radioBusy(RADIO_RX);
+        if (!mqtt_transport.poll())
+        {
 #ifdef DEBUG
-        Serial.println(mqttClient.lastError());
+          Serial.println(mqttClient.lastError());
 #endif
-        mqttClient.disconnect();
+          mqttClient.disconnect();
+        }
+        radioBusy(radio_idle);
       }
       last_control_time = currentTime;
+
+      // Apply the newest actuator commands, then report what the callback did
+      actuators.apply();
+      sendCommandAcks();
+      if (config_state_pending)
+      {
+        config_state_pending = false;
+        sendConfigState(config_state_ok);
+      }
+      if (interlock_state_pending)
+      {
+        interlock_state_pending = false;
+        sendInterlockState(interlock_state_ok);
+      }
+      if (rules_state_pending)
+      {
+        rules_state_pending = false;
+        sendRulesState(rules_state_ok);
+      }
+      if (history_query_pending)
+      {
+        history_query_pending = false;
+        reading_log.query(history_from, history_to);
+        history_chunks = 0;
+        history_bytes = 0;
+      }
+      if (reading_log.querying())
+      {
+        sendHistoryChunks(); // a few per tick, the control loop keeps running
+      }
+      if (timeSourceChanged())
+      {
+        sendStatus(); // clock quality
+      }
     }
 
-    // automatic AC control
-    if (ac_mode == "auto" && (currentTime - lastAcControl > AC_CONTROL_DELAY))
+    // Install announced firmware
+    if (otaPending())
     {
-      if (!temp_read)
+      if (!wifi_awake)
       {
-        double t = dht.readTemperature(); // temperature Celsius, range 0-50°C (±2°C accuracy)
-
-        if (isnan(t))
-        { // readings failed, skip
-          Serial.println(F("Failed to read from DHT sensor!"));
-          return;
-        }
-        data_temperature = t;
+        awakeConnection();
       }
+      EnergyScope scope(energy, SUB_OTA);
+      StallSection section(STALL_OTA);
+      reading_log.flush(); // the update reboots
+      radioBusy(RADIO_RX);
+      otaRun();
+      radioBusy(radio_idle);
+    }
+
+    // automatic AC control (once a temperature sample is available)
+    if (actuators.acAuto() && temp_read && !interlock.locked(INTERLOCK_AC) && (currentTime - lastAcControl > config.ac_control_delay))
+    {
       lastAcControl = currentTime;
       acAutoControl();
     }
 
     // Send data periodically
-    if (currentTime - last_log_time > LOG_DELAY)
+    if (currentTime - last_log_time > config.log_delay)
     {
 #ifdef DEBUG
       Serial.println("LOG LOOP");
@@ -301,67 +542,72 @@ void loop()
 
       String attribute = "";
 
+      // plain telemetry, except for a periodic retained snapshot
+      message_class_t telemetry = (log_cycles % config.snapshot_every == 0) ? MSG_SNAPSHOT : MSG_TELEMETRY;
+      log_cycles++;
+
       // log RSSI
       attribute = "rssi";
-      sendMqttLong(attribute, rssi);
+      sendMqttLong(attribute, rssi, telemetry);
 
-      // log LIGHT
-      unsigned int lightSensorValue;
-      lastLightLogTime = currentTime;
-      lightSensorValue = analogRead(PHOTORESISTOR); // read analog value (range 0-1023)
-      if (lightSensorValue >= PHOTORESISTOR_THRESHOLD)
-      {
-        data_light = true;
-      }
-      else
-      {
-        data_light = false;
-      }
-      attribute = "light";
-      sendMqttBool(attribute, data_light);
+      // log estimated energy use of the last window
+      sendEnergyReport();
 
-      // log TEMP/HUM
+      // log acquisition timing of every sensor channel
+      sendAcquisitionReport();
 
-      double h = dht.readHumidity();
-      double t = dht.readTemperature();
+      // log window of every aggregated metric
+      float log_values[NodeSensors::METRICS];
+      uint32_t log_mask = 0;
+      for (uint8_t m = 0; m < NodeSensors::METRICS; m++)
+      {
+        metric_info_t info = NodeSensors::metric(m);
+        if (info.kind == METRIC_EVENT)
+        {
+          continue; // sent on change
+        }
+        if (windows[m].count() == 0)
+        { // no valid reading in this window, skip
+          Serial.printf("No %s samples in this window!\n", info.name);
+          continue;
+        }
 
-      if (isnan(h) || isnan(t))
-      { // readings failed, skip
-        Serial.println(F("Failed to read from DHT sensor!"));
-        return;
-      }
+        attribute = info.name;
+        if (info.kind == METRIC_LEVEL)
+        {
+          // photoresistor, range 0-1023
+          sendMqttBoolWindow(attribute, windows[m].mean() >= config.photoresistor_threshold, windows[m], telemetry);
+        }
+        else
+        {
+          sendMqttWindow(attribute, windows[m], telemetry);
+        }
 
-      temp_read = true;
-      double hic = dht.computeHeatIndex(t, h, false);
+        log_values[m] = windows[m].mean();
+        log_mask |= 1UL << m;
 
-      data_humidity = h;
-      data_temperature = t;
-      data_apparent_temperature = hic;
+        // start a new window
+        windows[m].reset();
+      }
 
-#ifdef DEBUG
-      Serial.print(F("Humidity: "));
-      Serial.print(h);
-      Serial.print(F("%  Temperature: "));
-      Serial.print(t);
-      Serial.print(F("°C  Apparent temperature: ")); // the temperature perceived by humans (takes into account humidity)
-      Serial.print(hic);
-      Serial.println(F("°C"));
-#endif
-
-      attribute = "humidity";
-      sendMqttDouble(attribute, data_humidity);
-      attribute = "temperature";
-      sendMqttDouble(attribute, data_temperature);
-      attribute = "apparent_temperature";
-      sendMqttDouble(attribute, data_apparent_temperature);
+      // keep the window means in flash too, for backfill after an outage
+      uint64_t now_ms = timeNowMs();
+      if (log_mask != 0 && now_ms != 0)
+      {
+        reading_log.append(now_ms / 1000, log_mask, log_values);
+      }
     }
 
     // send modem to sleep if awake
     if (wifi_awake)
     {
 #ifdef FORCE_MODEM_SLEEP
+      brokerLinkFlush(); // QoS 0 publishes are not acknowledged, let TCP deliver them first
+      local_transport.end();
       WiFi.mode(WIFI_OFF);
       WiFi.forceSleepBegin();
+      radio_idle = RADIO_OFF;
+      energy.radio(RADIO_OFF, micros());
 #else 
       delay(1); //needed for auto modem sleep
 #endif
@@ -421,8 +667,11 @@ long connectToWiFi()
   // connect to WiFi (if not already connected)
   if (WiFi.status() != WL_CONNECTED)
   {
+    EnergyScope scope(energy, SUB_WIFI);
+    StallSection section(STALL_WIFI_CONNECT);
+    radioBusy(RADIO_RX); // scan, authentication, DHCP
     Serial.print(F("Connecting to SSID: "));
-    Serial.println(ssid);
+    Serial.println(config.wifi_ssid);
 
 #ifdef IP
     WiFi.config(ip, dns, gateway, subnet); // by default network is configured using DHCP
@@ -431,7 +680,7 @@ long connectToWiFi()
 #ifdef DEBUG
     Serial.print(F("Connecting"));
 #endif
-    WiFi.begin(ssid, pass);
+    WiFi.begin(config.wifi_ssid, config.wifi_pass);
     while (WiFi.status() != WL_CONNECTED)
     {
 #ifdef DEBUG
@@ -442,6 +691,8 @@ long connectToWiFi()
 #ifdef DEBUG
     Serial.println(F("\nConnected!"));
 #endif
+    radio_idle = RADIO_MODEM_SLEEP; // auto modem sleep between beacons
+    radioBusy(radio_idle);
 
     rssi_strength = WiFi.RSSI(); // get wifi signal strength
 
@@ -454,6 +705,16 @@ long connectToWiFi()
     rssi_strength = WiFi.RSSI(); // get wifi signal strength
   }
 
+  // ESP-NOW on the AP channel, where the screens listen
+  if (config.local_link)
+  {
+    local_transport.begin(0);
+  }
+  else
+  {
+    local_transport.end();
+  }
+
   return rssi_strength;
 }
 
@@ -461,34 +722,54 @@ void connectToMQTTBroker()
 {
   if (!mqttClient.connected())
   { // not connected
+    EnergyScope scope(energy, SUB_MQTT);
+    radioBusy(RADIO_RX);
 
 #ifdef DEBUG
     Serial.print(F("\nConnecting to MQTT broker..."));
 #endif
 
-    while (!mqttClient.connect(MQTT_CLIENTID, MQTT_USERNAME, MQTT_PASSWORD))
+    // broker settings may have changed since the last connection
+    mqttClient.begin(config.mqtt_broker_ip, config.mqtt_port,
+                     brokerLinkSetup(config.mqtt_broker_ip, config.mqtt_port, config.mqtt_fingerprint, config.tls_fragment));
     {
-      Serial.print(F("."));
-      delay(150);
+      StallSection section(STALL_BROKER_CONNECT);
+      while (!brokerLinkOpen() || !mqttClient.connect(config.mqtt_client_id, config.mqtt_username, config.mqtt_password, true))
+      {
+        Serial.print(F("."));
+        delay(150);
+      }
     }
 
 #ifdef DEBUG
     Serial.println(F("\nConnected!"));
+    if (brokerLinkSecure())
+    {
+      Serial.printf("TLS handshake %u ms (%s, fragment %u)\n", brokerLinkHandshakeMs(),
+                    brokerLinkResumed() ? "resumed" : "full", brokerLinkFragment());
+    }
 #endif
 
     mqttClient.subscribe(light_control_topic, 1);
     mqttClient.subscribe(ac_control_topic, 1);
+    mqttClient.subscribe(ota_control_topic, 1);
+    mqttClient.subscribe(MQTT_TOPIC_OTA, 1);
+    mqttClient.subscribe(config_topic, 1);
+    mqttClient.subscribe(interlock_control_topic, 1);
+    mqttClient.subscribe(rules_control_topic, 1);
+    mqttClient.subscribe(history_control_topic, 1);
+    mqttClient.subscribe(MQTT_TOPIC_TIME, 0);
 #ifdef DEBUG
     Serial.println("Subscribed to " + light_control_topic + "topic");
     Serial.println("Subscribed to " + ac_control_topic + "topic");
+    Serial.println("Subscribed to " + ota_control_topic + "topic");
 #endif
 
-    DynamicJsonDocument doc_stat(128);
-    doc_stat["connected"] = true;
-    char buffer_stat[128];
-    size_t n = serializeJson(doc_stat, buffer_stat);
-    const char *topic_status = mqtt_topic_status.c_str();
-    mqttClient.publish(topic_status, buffer_stat, n, true, 1);
+    sendStatus();
+
+    // Actuators state after (re)connection
+    sendStateDigest();
+    radioBusy(radio_idle);
   }
 }
 
@@ -498,80 +779,100 @@ void mqttMessageReceived(String &topic, String &payload)
 #ifdef DEBUG
   Serial.println("Incoming MQTT message: " + topic + " - " + payload);
 #endif
+  unsigned long received_at = micros();
   if (topic == light_control_topic)
   {
-
-    StaticJsonDocument<128> doc;
-    deserializeJson(doc, payload);
-    String light_control = doc["control"];
-
-    if (light_control == "on")
-    {
-      digitalWrite(LIGHT, HIGH);
-#ifdef DEBUG
-      Serial.println("Light on");
-#endif
-      return;
-    }
-    else if (light_control == "off")
-    {
-      digitalWrite(LIGHT, LOW);
+    actuators.offer(INTERLOCK_LIGHT, payload.c_str(), payload.length(), received_at);
+    return;
+  }
+  if (topic == ac_control_topic)
+  {
+    actuators.offer(INTERLOCK_AC, payload.c_str(), payload.length(), received_at);
+    return;
+  }
+  if (topic == config_topic)
+  {
+    // stored first, then applied to the running config in one step
+    bool ok = configUpdate(payload.c_str(), payload.length());
 #ifdef DEBUG
-      Serial.println("Light off");
+    Serial.println(ok ? "Config updated" : "Invalid config update");
 #endif
-      return;
-    }
-    else
-    {
+    mqttClient.setKeepAlive(config.log_delay / 1000 + 2); // effective at next connection
+    sensors.setInterval(config.sample_delay);
+    energy.setModel(config.energy);
+    config_state_pending = true;
+    config_state_ok = ok;
+    return;
+  }
+  if (topic == interlock_control_topic)
+  {
+    // validated as a whole, stored, then swapped in
+    JsonScope<1024> doc;
+    interlock_table_t table;
+    bool ok = !deserializeJson(doc, payload) &&
+              interlockParse(doc.as<JsonObjectConst>(), NodeSensors::metricIndex, table) &&
+              configStoreSave(INTERLOCK_PATH, INTERLOCK_VERSION, &table, sizeof(table)) &&
+              interlock.load(table);
 #ifdef DEBUG
-      Serial.println("Unrecognized light command!");
+    Serial.println(ok ? "Interlock updated" : "Invalid interlock update");
 #endif
-      return;
-    }
+    interlock_state_pending = true;
+    interlock_state_ok = ok;
+    return;
   }
-  if (topic == ac_control_topic)
+  if (topic == rules_control_topic)
   {
-    StaticJsonDocument<256> doc;
-    deserializeJson(doc, payload);
-    ac_mode = doc["control"].as<String>();
-    ;
-    if (ac_mode == "on")
+    // {"program": "<hex bytecode>"}, an empty program removes the rules.
+    // Validated into a candidate, stored, then swapped in
+    JsonScope<1024> doc;
+    rules_blob_t blob;
+    RulesVm candidate;
+    bool ok = !deserializeJson(doc, payload) && doc["program"].is<const char *>() &&
+              rulesUpdate(doc["program"].as<const char *>(), NodeSensors::metricIndex, candidate, blob) &&
+              configStoreSave(RULES_PATH, RULES_FORMAT, &blob, sizeof(blob));
+    if (ok)
     {
-      digitalWrite(AC_R, LOW);
-      digitalWrite(AC_G, HIGH);
-      digitalWrite(AC_B, LOW);
-#ifdef DEBUG
-      Serial.println("AC on");
-#endif
-      return;
+      rules = candidate;
     }
-    else if (ac_mode == "off")
-    {
-      digitalWrite(AC_R, HIGH);
-      digitalWrite(AC_G, LOW);
-      digitalWrite(AC_B, LOW);
 #ifdef DEBUG
-      Serial.println("AC off");
+    Serial.println(ok ? "Rules updated" : "Invalid rules");
 #endif
-      return;
+    rules_state_pending = true;
+    rules_state_ok = ok;
+    return;
+  }
+  if (topic == history_control_topic)
+  {
+    // {"from": ms, "to": ms, "id": "..."}, streamed from loop()
+    JsonScope<128> doc;
+    if (!deserializeJson(doc, payload))
+    {
+      history_from = (doc["from"] | (uint64_t)0) / 1000;
+      history_to = doc["to"].is<uint64_t>() ? doc["to"].as<uint64_t>() / 1000 : UINT32_MAX;
+      strlcpy(history_id, doc["id"] | "", sizeof(history_id));
+      history_query_pending = true;
     }
-    else if (ac_mode == "auto")
+    return;
+  }
+  if (topic == MQTT_TOPIC_TIME)
+  {
+    JsonScope<64> doc;
+    if (!deserializeJson(doc, payload) && doc["epoch_ms"].is<uint64_t>())
     {
-      ac_temp = doc["temp"];
-#ifdef DEBUG
-      Serial.println("AC auto");
-      Serial.printf("Actual temperature: %f \n", data_temperature);
-      Serial.printf("Desired temperature: %f \n", ac_temp);
-#endif
-      return;
+      timeSyncBroker(doc["epoch_ms"].as<uint64_t>());
     }
-    else
+    return;
+  }
+  if (topic == ota_control_topic || topic == MQTT_TOPIC_OTA)
+  {
+    // installed later from loop(), never inside the callback
+    if (otaAnnounce(payload.c_str(), clean_mac_address.c_str()))
     {
 #ifdef DEBUG
-      Serial.println("Unrecognized AC command");
+      Serial.println("OTA update scheduled");
 #endif
-      return;
     }
+    return;
   }
   return;
 }
@@ -587,17 +888,37 @@ String clearMacAddress(String mac_address)
   return mac_address;
 }
 
-void sendMqttDouble(String attribute, double value)
+bool mqttPublish(const char *topic, const char *payload, size_t length, message_class_t message_class)
+{
+  // Publish with the delivery policy of the message class
+  const delivery_policy_t &policy = config.delivery[message_class];
+  EnergyScope scope(energy, SUB_PUBLISH);
+  StallSection section(STALL_PUBLISH);
+  energy_radio_t previous = energy.radioState();
+  radioBusy(RADIO_TX);
+  bool sent = mqtt_transport.publish(topic, payload, length, policy.retained, policy.qos);
+  // readings (not acks, reports, ...) for the screens, whether the broker took them or not
+  bool reading = message_class == MSG_TELEMETRY || message_class == MSG_SNAPSHOT || message_class == MSG_ALARM;
+  if (reading && local_transport.ready() && strncmp(topic, sensors_topic.c_str(), sensors_topic.length()) == 0)
+  {
+    local_transport.publish(topic, payload, length, policy.retained, policy.qos);
+  }
+  radioBusy(previous);
+  return sent;
+}
+
+void sendMqttDouble(String attribute, double value, message_class_t message_class)
 {
   // Send data to MQTT
-  DynamicJsonDocument doc(128);
+  JsonScope<128> doc;
   doc["value"] = value;
+  addTimestamp(doc);
   char buffer[128];
   size_t n = serializeJson(doc, buffer);
   String topic = sensors_topic + clean_mac_address + "/" + attribute;
   const char *topic_c = topic.c_str();
   bool sent = false;
-  if (mqttClient.publish(topic_c, buffer, n, true, 1))
+  if (mqttPublish(topic_c, buffer, n, message_class))
     sent = true;
 #ifdef DEBUG
   Serial.println(topic);
@@ -610,17 +931,18 @@ void sendMqttDouble(String attribute, double value)
 #endif
 }
 
-void sendMqttLong(String attribute, long value)
+void sendMqttLong(String attribute, long value, message_class_t message_class)
 {
   // Send data to MQTT
-  DynamicJsonDocument doc(128);
+  JsonScope<128> doc;
   doc["value"] = value;
+  addTimestamp(doc);
   char buffer[128];
   size_t n = serializeJson(doc, buffer);
   String topic = sensors_topic + clean_mac_address + "/" + attribute;
   const char *topic_c = topic.c_str();
   bool sent = false;
-  if (mqttClient.publish(topic_c, buffer, n, true, 1))
+  if (mqttPublish(topic_c, buffer, n, message_class))
     sent = true;
 #ifdef DEBUG
   Serial.println(topic);
@@ -633,17 +955,18 @@ void sendMqttLong(String attribute, long value)
 #endif
 }
 
-void sendMqttBool(String attribute, bool value)
+void sendMqttBool(String attribute, bool value, message_class_t message_class)
 {
   // Send data to MQTT
-  DynamicJsonDocument doc(128);
+  JsonScope<128> doc;
   doc["value"] = value;
+  addTimestamp(doc);
   char buffer[128];
   size_t n = serializeJson(doc, buffer);
   String topic = sensors_topic + clean_mac_address + "/" + attribute;
   const char *topic_c = topic.c_str();
   bool sent = false;
-  if (mqttClient.publish(topic_c, buffer, n, true, 1))
+  if (mqttPublish(topic_c, buffer, n, message_class))
     sent = true;
 #ifdef DEBUG
   Serial.println(topic);
@@ -656,23 +979,428 @@ void sendMqttBool(String attribute, bool value)
 #endif
 }
 
-void acAutoControl()
+void sendMqttWindow(String attribute, Aggregator &window, message_class_t message_class)
+{
+  // Send window statistics to MQTT ("value" keeps the plain reading for consumers)
+  JsonScope<256> doc;
+  doc["value"] = window.mean();
+  publishWindow(attribute, doc, window, message_class);
+}
+
+void sendMqttBoolWindow(String attribute, bool value, Aggregator &window, message_class_t message_class)
+{
+  // Send boolean state together with the raw window statistics
+  JsonScope<256> doc;
+  doc["value"] = value;
+  publishWindow(attribute, doc, window, message_class);
+}
+
+void publishWindow(String attribute, JsonDocument &doc, Aggregator &window, message_class_t message_class)
 {
-  String ac_current_state;
-  if (data_temperature >= ac_temp)
+  doc["min"] = window.min();
+  doc["max"] = window.max();
+  doc["mean"] = window.mean();
+  doc["stddev"] = window.stddev();
+  doc["count"] = window.count();
+  addTimestamp(doc);
+  char buffer[256];
+  size_t n = serializeJson(doc, buffer);
+  String topic = sensors_topic + clean_mac_address + "/" + attribute;
+  const char *topic_c = topic.c_str();
+  bool sent = false;
+  if (mqttPublish(topic_c, buffer, n, message_class))
+    sent = true;
+#ifdef DEBUG
+  Serial.println(topic);
+  Serial.print(F("JSON message: "));
+  Serial.println(buffer);
+  if (sent)
+    Serial.println("Send OK");
+  else
+    Serial.println("Send NOT OK");
+#endif
+}
+
+void SampleSink::sample(uint8_t metric, float value)
+{
+  // Local reaction first, reports go out afterwards
+  interlock.update(metric, value);
+  metric_values[metric] = value;
+  rules_tick = true;
+
+  metric_info_t info = NodeSensors::metric(metric);
+  if (metric == metric_temperature)
   {
-    ac_current_state = "on";
+    temp_read = true;
+    data_temperature = value;
   }
-  else
+
+  if (info.kind != METRIC_EVENT)
+  {
+    windows[metric].add(value);
+    return;
+  }
+
+  // Queue event metrics (flame) if status changed, sent after the poll
+  bool active = value != 0;
+  if (active == data_events[metric])
+  {
+    return;
+  }
+  data_events[metric] = active;
+  event_pending[metric] = true;
+  events_pending = true;
+
+#ifdef DEBUG
+  Serial.printf("%s: %s\n", info.name, active ? "on" : "off");
+#endif
+}
+
+void SampleSink::failed(uint8_t first_metric)
+{
+  // readings failed, skip this sample
+  Serial.printf("Failed to read %s!\n", NodeSensors::metric(first_metric).name);
+}
+
+void radioBusy(energy_radio_t state)
+{
+  energy.radio(state, micros());
+}
+
+void sendEnergyReport()
+{
+  // Average current of every subsystem since the last report (mAh per hour)
+  energy_report_t report;
+  energy.report(micros(), report);
+
+  JsonScope<512> doc;
+  doc["elapsed_ms"] = report.elapsed_ms;
+  doc["total_ma"] = report.total_ma;
+  JsonObject subsystems = doc.createNestedObject("subsystems_ma");
+  for (uint8_t i = 0; i < SUBSYSTEMS; i++)
+    subsystems[energySubsystemName(i)] = report.subsystem_ma[i];
+  JsonObject radio = doc.createNestedObject("radio_share");
+  for (uint8_t i = 0; i < RADIO_STATES; i++)
+    radio[energyRadioName(i)] = report.radio_share[i];
+  addTimestamp(doc);
+  char buffer[512];
+  size_t n = serializeJson(doc, buffer);
+  mqttPublish(energy_topic.c_str(), buffer, n, MSG_TELEMETRY);
+
+  Serial.printf("Energy: %.2f mA average over %u ms (", report.total_ma, report.elapsed_ms);
+  for (uint8_t i = 0; i < SUBSYSTEMS; i++)
+    Serial.printf("%s %.2f%s", energySubsystemName(i), report.subsystem_ma[i], i + 1 < SUBSYSTEMS ? ", " : ")\n");
+}
+
+void sendAcquisitionReport()
+{
+  // Samples and collect timing of every sensor channel since the last report
+  JsonScope<768> doc;
+  doc["budget_us"] = SAMPLE_BUDGET_US;
+  JsonArray channels = doc.createNestedArray("channels");
+  for (uint8_t d = 0; d < NodeSensors::DRIVERS; d++)
+  {
+    const acquisition_stats_t &stats = sensors.stats(d);
+    uint32_t collects = stats.samples + stats.failures;
+    JsonObject channel = channels.createNestedObject();
+    channel["metric"] = NodeSensors::metric(NodeSensors::firstMetric(d)).name;
+    channel["samples"] = stats.samples;
+    channel["failures"] = stats.failures;
+    channel["deferred"] = stats.deferred;
+    channel["latency_ms"] = stats.max_latency_ms;
+    channel["collect_us"] = collects ? stats.total_collect_us / collects : 0;
+    channel["collect_max_us"] = stats.max_collect_us;
+  }
+  sensors.resetStats();
+  addTimestamp(doc);
+  size_t n = serializeJson(doc, report_buffer);
+  mqttPublish(acquisition_topic.c_str(), report_buffer, n, MSG_TELEMETRY);
+#ifdef DEBUG
+  Serial.print(F("Acquisition: "));
+  Serial.println(report_buffer);
+#endif
+}
+
+uint32_t sampleClockUs()
+{
+  return micros();
+}
+
+void sendStallReport()
+{
+  // Where the previous boot hung or crashed, sent once per boot
+  stall_report_t report;
+  if (!stallReport(report))
+    return;
+  JsonScope<384> doc;
+  doc["version"] = FIRMWARE_VERSION;
+  stallReportJson(report, doc.as<JsonObject>());
+  addTimestamp(doc);
+  char buffer[384];
+  size_t n = serializeJson(doc, buffer);
+  mqttPublish(stall_topic.c_str(), buffer, n, MSG_STATUS);
+#ifdef DEBUG
+  Serial.print(F("Stall report: "));
+  Serial.println(buffer);
+#endif
+}
+
+uint32_t readingLogLayout()
+{
+  // The mask bits of the log records are metric numbers, identified by their names
+  uint32_t layout = 0;
+  for (uint8_t m = 0; m < NodeSensors::METRICS; m++)
+  {
+    const char *name = NodeSensors::metric(m).name;
+    layout = crc32(name, strlen(name) + 1, layout);
+  }
+  return layout;
+}
+
+void sendHistoryChunks()
+{
+  // Segments of the history query as binary chunks (log_chunk_header_t + segment bytes)
+  for (uint8_t i = 0; i < HISTORY_CHUNKS_PER_TICK; i++)
+  {
+    size_t n = reading_log.nextChunk(history_chunk);
+    if (n == 0)
+    {
+      break;
+    }
+    mqttPublish(history_topic.c_str(), (const char *)history_chunk, n, MSG_ACK);
+    history_chunks++;
+    history_bytes += n;
+  }
+  if (reading_log.querying())
+  {
+    return;
+  }
+
+  // then what the receiver needs to decode them
+  JsonScope<512> doc;
+  doc["id"] = (const char *)history_id;
+  doc["from"] = (uint64_t)history_from * 1000;
+  doc["to"] = (uint64_t)history_to * 1000;
+  doc["chunks"] = history_chunks;
+  doc["bytes"] = history_bytes;
+  doc["oldest"] = (uint64_t)reading_log.oldest() * 1000;
+  doc["layout"] = reading_log.layout();
+  doc["scale"] = LOG_SCALE;
+  JsonArray metrics = doc.createNestedArray("metrics");
+  for (uint8_t m = 0; m < NodeSensors::METRICS; m++)
+    metrics.add(NodeSensors::metric(m).name);
+  char buffer[512];
+  size_t n = serializeJson(doc, buffer);
+  String topic = history_topic + "/done";
+  mqttPublish(topic.c_str(), buffer, n, MSG_ACK);
+#ifdef DEBUG
+  Serial.printf("History query: %u chunks, %u bytes\n", history_chunks, history_bytes);
+#endif
+}
+
+void addTimestamp(JsonDocument &doc)
+{
+  // Time of the reading in ms since the epoch, omitted until the clock is synced
+  uint64_t ts = timeNowMs();
+  if (ts != 0)
+    doc["ts"] = ts;
+}
+
+void sendStatus()
+{
+  // Connection status, firmware version, clock quality, connection setup cost and JSON memory
+  JsonScope<256> doc;
+  doc["connected"] = true;
+  doc["version"] = FIRMWARE_VERSION;
+  doc["clock"] = timeSourceName(timeSource());
+  if (timeSource() != TIME_NONE)
+    doc["clock_age"] = timeSyncAge(); // seconds since the last sync
+  doc["tls"] = brokerLinkSecure();
+  doc["connect_ms"] = brokerLinkHandshakeMs();
+  if (brokerLinkSecure())
+  {
+    doc["tls_resumed"] = brokerLinkResumed();
+    doc["tls_fragment"] = brokerLinkFragment();
+  }
+  jsonArenaReport(doc.createNestedObject("json_arena"));
+  char buffer[256];
+  size_t n = serializeJson(doc, buffer);
+  const char *topic_status = mqtt_topic_status.c_str();
+  mqttPublish(topic_status, buffer, n, MSG_STATUS);
+}
+
+void otaReport(const char *state, int progress)
+{
+  // Report update progress on the status topic
+  JsonScope<128> doc;
+  doc["connected"] = true;
+  doc["version"] = FIRMWARE_VERSION;
+  doc["ota"] = state;
+  doc["progress"] = progress;
+  char buffer[128];
+  size_t n = serializeJson(doc, buffer);
+  const char *topic_status = mqtt_topic_status.c_str();
+  mqttPublish(topic_status, buffer, n, MSG_STATUS);
+#ifdef DEBUG
+  Serial.printf("OTA %s %d%%\n", state, progress);
+#endif
+}
+
+void sendConfigState(bool ok)
+{
+  // Report the running configuration
+  JsonScope<512> doc;
+  doc["ok"] = ok;
+  configReport(doc.createNestedObject("config"));
+  char buffer[512];
+  size_t n = serializeJson(doc, buffer);
+  mqttPublish(config_state_topic.c_str(), buffer, n, MSG_STATUS);
+}
+
+void sendCommandAcks()
+{
+  // Send the acknowledgements queued by the MQTT callback
+  for (uint8_t i = 0; i < actuators.acks(); i++)
+  {
+    const command_ack_t &ack = actuators.ack(i);
+    JsonScope<128> doc;
+    if (ack.id[0] != '\0')
+      doc["id"] = ack.id;
+    doc["state"] = ack.state;
+    doc["applied"] = ack.applied;
+    if (ack.dropped)
+      doc["dropped"] = ack.dropped;
+    doc["latency_us"] = ack.latency_us;
+    char buffer[128];
+    size_t n = serializeJson(doc, buffer);
+    String topic = ack_topic + "/" + ack.actuator;
+    mqttPublish(topic.c_str(), buffer, n, MSG_ACK);
+#ifdef DEBUG
+    Serial.println(topic);
+    Serial.print(F("JSON message: "));
+    Serial.println(buffer);
+#endif
+  }
+  actuators.clearAcks();
+}
+
+void sendStateDigest()
+{
+  // Report the state of all the actuators
+  JsonScope<256> doc;
+  doc["light"] = actuators.state(INTERLOCK_LIGHT);
+  doc["ac"] = actuators.state(INTERLOCK_AC);
+  if (actuators.acAuto())
   {
-    ac_current_state = "off";
+    doc["ac_temp"] = actuators.acTemp();
+    doc["ac_state"] = actuators.acOutput();
   }
+  doc["light_locked"] = interlock.locked(INTERLOCK_LIGHT);
+  doc["ac_locked"] = interlock.locked(INTERLOCK_AC);
+  JsonObject commands = doc.createNestedObject("commands"); // dropped since boot
+  commands["superseded"] = actuators.superseded();
+  commands["stale"] = actuators.stale();
+  char buffer[224];
+  size_t n = serializeJson(doc, buffer);
+  mqttPublish(state_topic.c_str(), buffer, n, MSG_STATUS);
+}
 
-  if (ac_current_state != ac_previous_state)
+void writeActuator(interlock_actuator_t actuator, bool on)
+{
+  // Pins of an actuator switched by a command, the interlock or the rules
+  if (actuator == INTERLOCK_LIGHT)
   {
-    ac_previous_state = ac_current_state;
+    digitalWrite(LIGHT, on ? HIGH : LOW);
+    return;
+  }
+  digitalWrite(AC_R, on ? LOW : HIGH);
+  digitalWrite(AC_G, on ? HIGH : LOW);
+  digitalWrite(AC_B, LOW);
+}
 
-    if (ac_current_state == "on")
+void interlockApply(interlock_actuator_t actuator, bool on)
+{
+  // Called from the sampling path when a rule trips (the AC also leaves the automatic mode)
+  actuators.set(actuator, on);
+}
+
+void sendEventAlarms()
+{
+  // Latest state of every event metric that changed since the last call
+  events_pending = false;
+  for (uint8_t metric = 0; metric < NodeSensors::METRICS; metric++)
+  {
+    if (!event_pending[metric])
+      continue;
+    event_pending[metric] = false;
+    sendMqttBool(NodeSensors::metric(metric).name, data_events[metric], MSG_ALARM);
+  }
+}
+
+void sendInterlockEvents()
+{
+  // Report the rules that tripped or released, then the resulting actuators state
+  interlock_event_t event;
+  while (interlock.pollEvent(event))
+  {
+    const interlock_rule_t &rule = interlock.table().rules[event.rule];
+    JsonScope<256> doc;
+    doc["rule"] = event.rule;
+    doc["metric"] = rule.metric;
+    doc["value"] = event.value;
+    doc["active"] = event.active;
+    if (rule.action[INTERLOCK_LIGHT] != INTERLOCK_KEEP)
+      doc["light"] = interlockActionName(rule.action[INTERLOCK_LIGHT]);
+    if (rule.action[INTERLOCK_AC] != INTERLOCK_KEEP)
+      doc["ac"] = interlockActionName(rule.action[INTERLOCK_AC]);
+    addTimestamp(doc);
+    char buffer[256];
+    size_t n = serializeJson(doc, buffer);
+    mqttPublish(interlock_topic.c_str(), buffer, n, MSG_ALARM);
+#ifdef DEBUG
+    Serial.println(interlock_topic);
+    Serial.print(F("JSON message: "));
+    Serial.println(buffer);
+#endif
+  }
+  sendStateDigest();
+}
+
+void rulesWrite(uint8_t actuator, bool on)
+{
+  // Called by the rules VM when a rule output changes
+  if (actuator < INTERLOCK_ACTUATORS && !interlock.locked((interlock_actuator_t)actuator))
+    actuators.set((interlock_actuator_t)actuator, on);
+  rules_changed = true;
+}
+
+void sendRulesState(bool ok)
+{
+  // Report the size of the running rules program
+  JsonScope<64> doc;
+  doc["ok"] = ok;
+  doc["size"] = rules.size();
+  char buffer[64];
+  size_t n = serializeJson(doc, buffer);
+  mqttPublish(rules_state_topic.c_str(), buffer, n, MSG_STATUS);
+}
+
+void sendInterlockState(bool ok)
+{
+  // Report the running interlock rules
+  JsonScope<768> doc;
+  doc["ok"] = ok;
+  interlockReport(interlock.table(), doc.createNestedArray("rules"));
+  size_t n = serializeJson(doc, report_buffer);
+  mqttPublish(interlock_state_topic.c_str(), report_buffer, n, MSG_STATUS);
+}
+
+void acAutoControl()
+{
+  bool on = data_temperature >= actuators.acTemp();
+  if (actuators.setAcOutput(on))
+  {
+    if (on)
     {
       digitalWrite(AC_R, LOW);
       digitalWrite(AC_G, LOW);
@@ -691,4 +1419,33 @@ void acAutoControl()
 #endif
     }
   }
-}
\ No newline at end of file
+}
+
+#ifdef COMFORT_BENCHMARK
+// CPU cycles per reading of the derived metrics, fixed point against the
+// float heat index it replaced (floats are emulated in software here)
+void comfortBenchmark()
+{
+  const uint16_t calls = 1000;
+  volatile float sink = 0;
+  float values[COMFORT_METRICS];
+
+  uint32_t start = ESP.getCycleCount();
+  for (uint16_t i = 0; i < calls; i++)
+  {
+    comfortValues(150 + i % 250, 300 + i % 700, values);
+    sink = sink + values[0];
+  }
+  uint32_t fixed = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint16_t i = 0; i < calls; i++)
+  {
+    sink = sink + apparentTemperature(15.0f + (i % 250) * 0.1f, 30.0f + (i % 700) * 0.1f);
+  }
+  uint32_t floating = ESP.getCycleCount() - start;
+
+  Serial.printf("Comfort metrics: %u cycles/reading (4 metrics, fixed point), float heat index alone %u cycles\n",
+                fixed / calls, floating / calls);
+}
+#endif
@@ -0,0 +1,281 @@
+#include "node_config.h"
+
+#include <config_store.h>
+#include <json_arena.h>
+
+#include "secrets.h"
+
+// Older secrets.h files predate TLS
+#ifndef MQTT_BROKERPORT
+#define MQTT_BROKERPORT 1883
+#endif
+#ifndef MQTT_FINGERPRINT
+#define MQTT_FINGERPRINT ""
+#endif
+
+node_config_t config;
+
+// Field groups shared by the current and the older layouts
+#define CONFIG_TIMING_FIELDS(ctype)                                                                   \
+    CONFIG_NUMBER(CONFIG_U32, "log_delay", ctype, log_delay, 1000, 3600000),                          \
+    CONFIG_NUMBER(CONFIG_U32, "sample_delay", ctype, sample_delay, 2000, 3600000),                    \
+    CONFIG_NUMBER(CONFIG_U32, "mqtt_control_delay", ctype, mqtt_control_delay, 0, 60000),             \
+    CONFIG_NUMBER(CONFIG_U32, "ac_control_delay", ctype, ac_control_delay, 1000, 3600000),            \
+    CONFIG_NUMBER(CONFIG_U16, "photoresistor_threshold", ctype, photoresistor_threshold, 0, 1023)
+#define CONFIG_ENERGY_FIELDS(ctype)                                                                               \
+    CONFIG_NUMBER(CONFIG_U32, "energy_cpu_active_ua", ctype, energy.cpu_ua[CPU_ACTIVE], 0, 1000000),              \
+    CONFIG_NUMBER(CONFIG_U32, "energy_cpu_light_sleep_ua", ctype, energy.cpu_ua[CPU_LIGHT_SLEEP], 0, 1000000),    \
+    CONFIG_NUMBER(CONFIG_U32, "energy_cpu_deep_sleep_ua", ctype, energy.cpu_ua[CPU_DEEP_SLEEP], 0, 1000000),      \
+    CONFIG_NUMBER(CONFIG_U32, "energy_radio_modem_sleep_ua", ctype, energy.radio_ua[RADIO_MODEM_SLEEP], 0, 1000000), \
+    CONFIG_NUMBER(CONFIG_U32, "energy_radio_associated_ua", ctype, energy.radio_ua[RADIO_ASSOCIATED], 0, 1000000), \
+    CONFIG_NUMBER(CONFIG_U32, "energy_radio_rx_ua", ctype, energy.radio_ua[RADIO_RX], 0, 1000000),               \
+    CONFIG_NUMBER(CONFIG_U32, "energy_radio_tx_ua", ctype, energy.radio_ua[RADIO_TX], 0, 1000000)
+#define CONFIG_DELIVERY_FIELDS(ctype)                                                              \
+    CONFIG_NUMBER(CONFIG_U8, "telemetry_qos", ctype, delivery[MSG_TELEMETRY].qos, 0, 2),           \
+    CONFIG_NUMBER(CONFIG_U8, "telemetry_retained", ctype, delivery[MSG_TELEMETRY].retained, 0, 1), \
+    CONFIG_NUMBER(CONFIG_U8, "snapshot_qos", ctype, delivery[MSG_SNAPSHOT].qos, 0, 2),             \
+    CONFIG_NUMBER(CONFIG_U8, "snapshot_retained", ctype, delivery[MSG_SNAPSHOT].retained, 0, 1),   \
+    CONFIG_NUMBER(CONFIG_U8, "alarm_qos", ctype, delivery[MSG_ALARM].qos, 0, 2),                   \
+    CONFIG_NUMBER(CONFIG_U8, "alarm_retained", ctype, delivery[MSG_ALARM].retained, 0, 1),         \
+    CONFIG_NUMBER(CONFIG_U8, "status_qos", ctype, delivery[MSG_STATUS].qos, 0, 2),                 \
+    CONFIG_NUMBER(CONFIG_U8, "status_retained", ctype, delivery[MSG_STATUS].retained, 0, 1),       \
+    CONFIG_NUMBER(CONFIG_U8, "ack_qos", ctype, delivery[MSG_ACK].qos, 0, 2),                       \
+    CONFIG_NUMBER(CONFIG_U8, "ack_retained", ctype, delivery[MSG_ACK].retained, 0, 1)
+#define CONFIG_CREDENTIAL_FIELDS(ctype)                                   \
+    CONFIG_STRING("device_name", ctype, device_name, false),               \
+    CONFIG_STRING("wifi_ssid", ctype, wifi_ssid, false),                   \
+    CONFIG_STRING("wifi_pass", ctype, wifi_pass, true),                    \
+    CONFIG_STRING("mqtt_broker_ip", ctype, mqtt_broker_ip, false),         \
+    CONFIG_STRING("mqtt_client_id", ctype, mqtt_client_id, false),         \
+    CONFIG_STRING("mqtt_username", ctype, mqtt_username, false),           \
+    CONFIG_STRING("mqtt_password", ctype, mqtt_password, true)
+
+static const config_field_t config_fields[] = {
+    CONFIG_TIMING_FIELDS(node_config_t),
+    CONFIG_NUMBER(CONFIG_U16, "snapshot_every", node_config_t, snapshot_every, 1, 1000),
+    CONFIG_NUMBER(CONFIG_U16, "mqtt_port", node_config_t, mqtt_port, 1, 65535),
+    CONFIG_NUMBER(CONFIG_U16, "tls_fragment", node_config_t, tls_fragment, 0, 4096),
+    CONFIG_ENERGY_FIELDS(node_config_t),
+    CONFIG_DELIVERY_FIELDS(node_config_t),
+    CONFIG_NUMBER(CONFIG_U8, "local_link", node_config_t, local_link, 0, 1),
+    CONFIG_CREDENTIAL_FIELDS(node_config_t),
+    CONFIG_STRING("mqtt_fingerprint", node_config_t, mqtt_fingerprint, false),
+    CONFIG_STRING("ntp_server", node_config_t, ntp_server, false),
+};
+#define CONFIG_FIELDS_N (sizeof(config_fields) / sizeof(config_fields[0]))
+
+// Layouts stored by the older firmwares, migrated at boot
+typedef struct __attribute__((packed)) node_config_v1
+{
+    uint32_t revision;
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+} node_config_v1_t;
+
+typedef struct __attribute__((packed)) node_config_v2
+{
+    uint32_t revision;
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    uint16_t snapshot_every;
+    delivery_policy_t delivery[MSG_CLASS_N];
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+} node_config_v2_t;
+
+typedef struct __attribute__((packed)) node_config_v3
+{
+    uint32_t revision;
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    uint16_t snapshot_every;
+    delivery_policy_t delivery[MSG_CLASS_N];
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char ntp_server[40];
+} node_config_v3_t;
+
+typedef struct __attribute__((packed)) node_config_v4
+{
+    uint32_t revision;
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    uint16_t snapshot_every;
+    energy_model_t energy;
+    delivery_policy_t delivery[MSG_CLASS_N];
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char ntp_server[40];
+} node_config_v4_t;
+
+typedef struct __attribute__((packed)) node_config_v5
+{
+    uint32_t revision;
+    uint32_t log_delay;
+    uint32_t sample_delay;
+    uint32_t mqtt_control_delay;
+    uint32_t ac_control_delay;
+    uint16_t photoresistor_threshold;
+    uint16_t snapshot_every;
+    uint16_t mqtt_port;
+    uint16_t tls_fragment;
+    energy_model_t energy;
+    delivery_policy_t delivery[MSG_CLASS_N];
+    char device_name[24];
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    char mqtt_broker_ip[40];
+    char mqtt_client_id[24];
+    char mqtt_username[32];
+    char mqtt_password[64];
+    char mqtt_fingerprint[BROKER_LINK_FINGERPRINT_LEN];
+    char ntp_server[40];
+} node_config_v5_t;
+
+static const config_field_t config_fields_v1[] = {
+    CONFIG_TIMING_FIELDS(node_config_v1_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v1_t),
+};
+static const config_field_t config_fields_v2[] = {
+    CONFIG_TIMING_FIELDS(node_config_v2_t),
+    CONFIG_NUMBER(CONFIG_U16, "snapshot_every", node_config_v2_t, snapshot_every, 1, 1000),
+    CONFIG_DELIVERY_FIELDS(node_config_v2_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v2_t),
+};
+static const config_field_t config_fields_v3[] = {
+    CONFIG_TIMING_FIELDS(node_config_v3_t),
+    CONFIG_NUMBER(CONFIG_U16, "snapshot_every", node_config_v3_t, snapshot_every, 1, 1000),
+    CONFIG_DELIVERY_FIELDS(node_config_v3_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v3_t),
+    CONFIG_STRING("ntp_server", node_config_v3_t, ntp_server, false),
+};
+static const config_field_t config_fields_v4[] = {
+    CONFIG_TIMING_FIELDS(node_config_v4_t),
+    CONFIG_NUMBER(CONFIG_U16, "snapshot_every", node_config_v4_t, snapshot_every, 1, 1000),
+    CONFIG_ENERGY_FIELDS(node_config_v4_t),
+    CONFIG_DELIVERY_FIELDS(node_config_v4_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v4_t),
+    CONFIG_STRING("ntp_server", node_config_v4_t, ntp_server, false),
+};
+static const config_field_t config_fields_v5[] = {
+    CONFIG_TIMING_FIELDS(node_config_v5_t),
+    CONFIG_NUMBER(CONFIG_U16, "snapshot_every", node_config_v5_t, snapshot_every, 1, 1000),
+    CONFIG_NUMBER(CONFIG_U16, "mqtt_port", node_config_v5_t, mqtt_port, 1, 65535),
+    CONFIG_NUMBER(CONFIG_U16, "tls_fragment", node_config_v5_t, tls_fragment, 0, 4096),
+    CONFIG_ENERGY_FIELDS(node_config_v5_t),
+    CONFIG_DELIVERY_FIELDS(node_config_v5_t),
+    CONFIG_CREDENTIAL_FIELDS(node_config_v5_t),
+    CONFIG_STRING("mqtt_fingerprint", node_config_v5_t, mqtt_fingerprint, false),
+    CONFIG_STRING("ntp_server", node_config_v5_t, ntp_server, false),
+};
+
+static const config_layout_t config_layouts[] = {
+    CONFIG_LAYOUT(1, node_config_v1_t, config_fields_v1),
+    CONFIG_LAYOUT(2, node_config_v2_t, config_fields_v2),
+    CONFIG_LAYOUT(3, node_config_v3_t, config_fields_v3),
+    CONFIG_LAYOUT(4, node_config_v4_t, config_fields_v4),
+    CONFIG_LAYOUT(5, node_config_v5_t, config_fields_v5),
+};
+#define CONFIG_LAYOUTS_N (sizeof(config_layouts) / sizeof(config_layouts[0]))
+
+static void configDefaults(node_config_t &c)
+{
+    memset(&c, 0, sizeof(c));
+    c.log_delay = LOG_DELAY;
+    c.sample_delay = SAMPLE_DELAY;
+    c.mqtt_control_delay = MQTT_CONTROL_DELAY;
+    c.ac_control_delay = AC_CONTROL_DELAY;
+    c.photoresistor_threshold = PHOTORESISTOR_THRESHOLD;
+    c.snapshot_every = MQTT_SNAPSHOT_EVERY;
+    c.mqtt_port = MQTT_BROKERPORT;
+    c.tls_fragment = TLS_FRAGMENT;
+    energy_model_t energy; // the packed member can't be bound to a reference
+    energyModelDefaults(energy);
+    c.energy = energy;
+    mqttPolicyDefaults(c.delivery);
+    c.local_link = LOCAL_LINK;
+    strlcpy(c.device_name, DEVICE_NAME, sizeof(c.device_name));
+    strlcpy(c.wifi_ssid, SECRET_SSID, sizeof(c.wifi_ssid));
+    strlcpy(c.wifi_pass, SECRET_PASS, sizeof(c.wifi_pass));
+    strlcpy(c.mqtt_broker_ip, MQTT_BROKERIP, sizeof(c.mqtt_broker_ip));
+    strlcpy(c.mqtt_client_id, MQTT_CLIENTID, sizeof(c.mqtt_client_id));
+    strlcpy(c.mqtt_username, MQTT_USERNAME, sizeof(c.mqtt_username));
+    strlcpy(c.mqtt_password, MQTT_PASSWORD, sizeof(c.mqtt_password));
+    strlcpy(c.mqtt_fingerprint, MQTT_FINGERPRINT, sizeof(c.mqtt_fingerprint));
+    strlcpy(c.ntp_server, NTP_SERVER, sizeof(c.ntp_server));
+}
+
+void configBegin()
+{
+    bool mounted = configStoreBegin();
+    if (mounted && configStoreLoad(CONFIG_PATH, CONFIG_VERSION, &config, sizeof(config)))
+        return;
+
+    configDefaults(config);
+    // stored by an older firmware: keep its values, the new fields get their defaults
+    if (mounted && configStoreMigrate(CONFIG_PATH, config_layouts, CONFIG_LAYOUTS_N, &config, config_fields, CONFIG_FIELDS_N))
+        configStoreSave(CONFIG_PATH, CONFIG_VERSION, &config, sizeof(config));
+}
+
+bool configUpdate(const char *payload, size_t length)
+{
+    JsonScope<512> doc;
+    if (deserializeJson(doc, payload, length) || !doc.is<JsonObject>())
+        return false;
+
+    node_config_t candidate = config;
+    if (!configStorePatch(&candidate, sizeof(candidate), config_fields, CONFIG_FIELDS_N, doc.as<JsonObjectConst>()))
+        return false;
+
+    // retained updates are delivered again on every reconnect, don't wear the flash
+    if (memcmp((uint8_t *)&candidate + sizeof(candidate.revision),
+               (uint8_t *)&config + sizeof(config.revision),
+               sizeof(config) - sizeof(config.revision)) == 0)
+        return true;
+
+    candidate.revision = config.revision + 1;
+    if (!configStoreSave(CONFIG_PATH, CONFIG_VERSION, &candidate, sizeof(candidate)))
+        return false;
+    config = candidate;
+    return true;
+}
+
+void configReport(JsonObject out)
+{
+    out["revision"] = config.revision;
+    configStoreDump(&config, config_fields, CONFIG_FIELDS_N, out);
+}
@@ -0,0 +1,175 @@
+// Welford statistics of the publish windows against a two-pass reference
+// computed in long double:  pio test -e native -f test_aggregator
+
+#include <math.h>
+#include <stdint.h>
+#include <unity.h>
+
+#include <aggregator.h>
+
+#define LONG_RUN 1000000 // about 11 days of samples at 1 Hz in one window
+
+typedef struct reference
+{
+    long double mean;
+    long double variance; // population, like Aggregator::variance()
+} reference_t;
+
+static reference_t twoPass(const double *values, size_t n)
+{
+    reference_t ref;
+    long double sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += values[i];
+    ref.mean = sum / n;
+    long double m2 = 0;
+    for (size_t i = 0; i < n; i++)
+        m2 += (values[i] - ref.mean) * (values[i] - ref.mean);
+    ref.variance = m2 / n;
+    return ref;
+}
+
+// Deterministic noise in [-1, 1)
+static uint32_t lcg_state;
+static double noise()
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return (lcg_state >> 8) / (double)(1u << 23) - 1.0;
+}
+
+static double values[LONG_RUN];
+
+static void feed(Aggregator &window, size_t n)
+{
+    window.reset();
+    for (size_t i = 0; i < n; i++)
+        window.add(values[i]);
+}
+
+void setUp(void)
+{
+    lcg_state = 12345;
+}
+
+void tearDown(void) {}
+
+void test_empty_window_is_nan(void)
+{
+    Aggregator window;
+    TEST_ASSERT_EQUAL_UINT32(0, window.count());
+    TEST_ASSERT_DOUBLE_IS_NAN(window.mean());
+    TEST_ASSERT_DOUBLE_IS_NAN(window.variance());
+    TEST_ASSERT_DOUBLE_IS_NAN(window.min());
+    TEST_ASSERT_DOUBLE_IS_NAN(window.max());
+}
+
+void test_nan_samples_are_skipped(void)
+{
+    Aggregator window;
+    window.add(21.0);
+    window.add(NAN);
+    window.add(23.0);
+    TEST_ASSERT_EQUAL_UINT32(2, window.count());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 22.0, window.mean());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 1.0, window.variance());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 21.0, window.min());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 23.0, window.max());
+}
+
+void test_large_offset(void)
+{
+    // the classic case where sum of squares minus squared sum cancels out
+    const double offsets[] = {1e6, 1e9, 1e12};
+    for (double offset : offsets)
+    {
+        values[0] = offset + 4;
+        values[1] = offset + 7;
+        values[2] = offset + 13;
+        values[3] = offset + 16;
+        Aggregator window;
+        feed(window, 4);
+        TEST_ASSERT_DOUBLE_WITHIN(offset * 1e-15, (double)(offset + 10), window.mean());
+        TEST_ASSERT_DOUBLE_WITHIN(22.5 * 1e-9, 22.5, window.variance());
+        TEST_ASSERT_DOUBLE_WITHIN(0, offset + 4, window.min());
+        TEST_ASSERT_DOUBLE_WITHIN(0, offset + 16, window.max());
+    }
+}
+
+void test_large_offset_with_noise(void)
+{
+    const size_t n = 10000;
+    for (size_t i = 0; i < n; i++)
+        values[i] = 1e8 + noise();
+    Aggregator window;
+    feed(window, n);
+    reference_t ref = twoPass(values, n);
+    TEST_ASSERT_DOUBLE_WITHIN(1e8 * 1e-14, (double)ref.mean, window.mean());
+    TEST_ASSERT_DOUBLE_WITHIN(ref.variance * 1e-6, (double)ref.variance, window.variance());
+}
+
+void test_near_constant(void)
+{
+    // a steady reading: the variance must stay tiny and never go negative
+    const size_t n = 3600;
+    for (size_t i = 0; i < n; i++)
+        values[i] = 23.5 + 1e-9 * noise();
+    Aggregator window;
+    feed(window, n);
+    reference_t ref = twoPass(values, n);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-12, (double)ref.mean, window.mean());
+    TEST_ASSERT_TRUE(window.variance() >= 0);
+    TEST_ASSERT_DOUBLE_WITHIN(ref.variance * 1e-3, (double)ref.variance, window.variance());
+}
+
+void test_constant(void)
+{
+    const size_t n = 3600;
+    for (size_t i = 0; i < n; i++)
+        values[i] = 0.1; // not exactly representable
+    Aggregator window;
+    feed(window, n);
+    TEST_ASSERT_DOUBLE_WITHIN(0, 0.1, window.mean());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 0.0, window.variance());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 0.0, window.stddev());
+}
+
+void test_long_run(void)
+{
+    // slow drift plus noise, the running mean must not accumulate error
+    for (size_t i = 0; i < LONG_RUN; i++)
+        values[i] = 20.0 + 5.0 * sin(i * 1e-4) + 0.5 * noise();
+    Aggregator window;
+    feed(window, LONG_RUN);
+    reference_t ref = twoPass(values, LONG_RUN);
+    TEST_ASSERT_EQUAL_UINT32(LONG_RUN, window.count());
+    TEST_ASSERT_DOUBLE_WITHIN(1e-10, (double)ref.mean, window.mean());
+    TEST_ASSERT_DOUBLE_WITHIN(ref.variance * 1e-10, (double)ref.variance, window.variance());
+}
+
+void test_reset(void)
+{
+    Aggregator window;
+    window.add(1e9);
+    window.add(-1e9);
+    window.reset();
+    window.add(5.0);
+    TEST_ASSERT_EQUAL_UINT32(1, window.count());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 5.0, window.mean());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 0.0, window.variance());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 5.0, window.min());
+    TEST_ASSERT_DOUBLE_WITHIN(0, 5.0, window.max());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_window_is_nan);
+    RUN_TEST(test_nan_samples_are_skipped);
+    RUN_TEST(test_large_offset);
+    RUN_TEST(test_large_offset_with_noise);
+    RUN_TEST(test_near_constant);
+    RUN_TEST(test_constant);
+    RUN_TEST(test_long_run);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,425 @@
+// Sensor drivers against a mock line and a mock I2C bus replaying frames
+//   pio test -e native -f test_drivers
+
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+#include <bme280.h>
+#include <dht11.h>
+#include <sht3x.h>
+
+// DHT11 line
+// ----------
+// After the host releases the line the sensor answers with the waveform of
+// a frame: 80 us low, 80 us high, then for every bit 50 us low and 27 us
+// (0) or 70 us (1) high, and a final 50 us low. Idle (pulled up) otherwise.
+
+#define DHT_MAX_LEVELS (3 + 2 * 40 + 1)
+
+struct MockGpio
+{
+    static uint32_t clock_us;
+    static bool driven_low;
+    static uint32_t released_at;
+    static int locks;
+    static bool levels[DHT_MAX_LEVELS];
+    static uint32_t durations[DHT_MAX_LEVELS];
+    static int n_levels;
+
+    static void output(uint8_t) {}
+    static void input(uint8_t, bool)
+    {
+        if (driven_low)
+            released_at = clock_us;
+        driven_low = false;
+    }
+    static void write(uint8_t, bool high) { driven_low = !high; }
+    static bool read(uint8_t)
+    {
+        clock_us += 2; // polling loop
+        if (driven_low)
+            return false;
+        uint32_t t = clock_us - released_at;
+        for (int i = 0; i < n_levels; i++)
+        {
+            if (t < durations[i])
+                return levels[i];
+            t -= durations[i];
+        }
+        return true;
+    }
+    static int analog(uint8_t) { return 0; }
+    static uint32_t now_us() { return clock_us; }
+    static void wait_us(uint32_t us) { clock_us += us; }
+    static void lock() { locks++; }
+    static void unlock() { locks--; }
+
+    static void level(bool high, uint32_t us)
+    {
+        levels[n_levels] = high;
+        durations[n_levels++] = us;
+    }
+
+    // Waveform of the first bits of a frame
+    static void answer(const uint8_t *frame, uint8_t bits)
+    {
+        n_levels = 0;
+        level(true, 30);
+        level(false, 80);
+        level(true, 80);
+        for (uint8_t bit = 0; bit < bits; bit++)
+        {
+            level(false, 50);
+            level(true, frame[bit / 8] & (0x80 >> bit % 8) ? 70 : 27);
+        }
+        level(false, 50);
+    }
+};
+
+uint32_t MockGpio::clock_us;
+bool MockGpio::driven_low;
+uint32_t MockGpio::released_at;
+int MockGpio::locks;
+bool MockGpio::levels[DHT_MAX_LEVELS];
+uint32_t MockGpio::durations[DHT_MAX_LEVELS];
+int MockGpio::n_levels;
+
+static bool readDht(const uint8_t *frame, uint8_t bits, float *values)
+{
+    Dht11<MockGpio> dht(2);
+    dht.begin();
+    MockGpio::answer(frame, bits);
+    dht.start(0);
+    TEST_ASSERT_TRUE(MockGpio::driven_low); // start signal
+    TEST_ASSERT_TRUE(dht.ready(Dht11<MockGpio>::CONVERSION_MS));
+    bool ok = dht.finish(values);
+    TEST_ASSERT_EQUAL_INT(0, MockGpio::locks);
+    return ok;
+}
+
+// I2C bus
+// -------
+// Register file of one device: a write sets the register pointer (first
+// byte) and the registers after it, a read returns the registers from the
+// pointer on. A device without registers (SHT3x) replies with a frame.
+
+struct MockBus
+{
+    uint8_t address;  // of the device on the bus
+    uint8_t registers[256];
+    uint8_t pointer;
+    const uint8_t *reply;
+    uint8_t reply_length;
+    uint8_t command[2]; // first bytes of the last transmission
+    uint8_t sent;
+
+    uint8_t target;
+    uint8_t available;
+
+    explicit MockBus(uint8_t device) : address(device), pointer(0), reply(NULL), reply_length(0), sent(0), target(0), available(0)
+    {
+        memset(registers, 0, sizeof(registers));
+    }
+
+    void beginTransmission(uint8_t to)
+    {
+        target = to;
+        sent = 0;
+    }
+    size_t write(uint8_t value)
+    {
+        if (sent < sizeof(command))
+            command[sent] = value;
+        if (sent == 0)
+            pointer = value;
+        else
+            registers[pointer++] = value;
+        sent++;
+        return 1;
+    }
+    uint8_t endTransmission() { return target == address ? 0 : 2; } // 2: address NACK
+    uint8_t requestFrom(uint8_t from, uint8_t length)
+    {
+        if (from != address || (reply && length > reply_length))
+            return 0;
+        available = length;
+        return length;
+    }
+    int read()
+    {
+        if (!available)
+            return -1;
+        available--;
+        return reply ? *reply++ : registers[pointer++];
+    }
+};
+
+// SHT3x frames: temperature word, CRC, humidity word, CRC
+static const uint8_t SHT_25C_50RH[] = {0x66, 0x66, 0x93, 0x80, 0x00, 0xa2};
+static const uint8_t SHT_MINUS_10C_80RH[] = {0x33, 0x33, 0x88, 0xcc, 0xcc, 0xa5};
+
+// BME280 calibration of the datasheet example (0x88..0xA1, 0xE1..0xE7)
+static const uint8_t BME_CALIB[] = {0x70, 0x6b, 0x43, 0x67, 0x18, 0xfc, 0x7d, 0x8e, 0x43, 0xd6, 0xd0, 0x0b, 0x27,
+                                    0x0b, 0x8c, 0x00, 0xf9, 0xff, 0x8c, 0x3c, 0xf8, 0xc6, 0x70, 0x17, 0x00, 0x4b};
+static const uint8_t BME_HUM_CALIB[] = {0x6a, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1e};
+// Measurement registers 0xF7..0xFE: pressure, temperature, humidity ADC
+static const uint8_t BME_25C[] = {0x65, 0x5a, 0xc0, 0x7e, 0xed, 0x00, 0x75, 0x30};       // adc_T 519888
+static const uint8_t BME_BELOW_ZERO[] = {0x65, 0x5a, 0xc0, 0x61, 0xa8, 0x00, 0x75, 0x30}; // adc_T 400000
+static const uint8_t BME_SKIPPED[] = {0x65, 0x5a, 0xc0, 0x80, 0x00, 0x00, 0x75, 0x30};    // adc_T 0x80000
+
+// Floating point compensation of the datasheet, as the reference
+typedef struct bme_reference
+{
+    double temperature, pressure, humidity; // °C, hPa, %
+} bme_reference_t;
+
+static bme_reference_t bmeReference(const uint8_t *frame)
+{
+    const double T1 = 27504, T2 = 26435, T3 = -1000;
+    const double P1 = 36477, P2 = -10685, P3 = 3024, P4 = 2855, P5 = 140, P6 = -7, P7 = 15500, P8 = -14600, P9 = 6000;
+    const double H1 = 75, H2 = 362, H3 = 0, H4 = 313, H5 = 50, H6 = 30;
+    double adc_P = (frame[0] << 12) | (frame[1] << 4) | (frame[2] >> 4);
+    double adc_T = (frame[3] << 12) | (frame[4] << 4) | (frame[5] >> 4);
+    double adc_H = (frame[6] << 8) | frame[7];
+    bme_reference_t ref;
+
+    double var1 = (adc_T / 16384.0 - T1 / 1024.0) * T2;
+    double var2 = (adc_T / 131072.0 - T1 / 8192.0) * (adc_T / 131072.0 - T1 / 8192.0) * T3;
+    double t_fine = var1 + var2;
+    ref.temperature = t_fine / 5120.0;
+
+    var1 = t_fine / 2.0 - 64000.0;
+    var2 = var1 * var1 * P6 / 32768.0 + var1 * P5 * 2.0;
+    var2 = var2 / 4.0 + P4 * 65536.0;
+    var1 = (P3 * var1 * var1 / 524288.0 + P2 * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * P1;
+    double p = (1048576.0 - adc_P - var2 / 4096.0) * 6250.0 / var1;
+    p += (P9 * p * p / 2147483648.0 + p * P8 / 32768.0 + P7) / 16.0;
+    ref.pressure = p / 100.0;
+
+    double h = t_fine - 76800.0;
+    h = (adc_H - (H4 * 64.0 + H5 / 16384.0 * h)) * (H2 / 65536.0 * (1.0 + H6 / 67108864.0 * h * (1.0 + H3 / 67108864.0 * h)));
+    h = h * (1.0 - H1 * h / 524288.0);
+    ref.humidity = h < 0 ? 0 : h > 100 ? 100 : h;
+    return ref;
+}
+
+static MockBus bmeBus()
+{
+    MockBus bus(0x76);
+    bus.registers[0xD0] = 0x60; // chip id
+    memcpy(bus.registers + 0x88, BME_CALIB, sizeof(BME_CALIB));
+    memcpy(bus.registers + 0xE1, BME_HUM_CALIB, sizeof(BME_HUM_CALIB));
+    return bus;
+}
+
+static bool readBme(MockBus &bus, Bme280<MockBus> &bme, const uint8_t *frame, float *values)
+{
+    bme.start(0);
+    TEST_ASSERT_EQUAL_UINT8(0x25, bus.registers[0xF4]); // forced mode
+    memcpy(bus.registers + 0xF7, frame, 8);
+    TEST_ASSERT_TRUE(bme.ready(Bme280<MockBus>::CONVERSION_MS));
+    return bme.finish(values);
+}
+
+void setUp(void)
+{
+    MockGpio::clock_us = 1000;
+    MockGpio::driven_low = false;
+    MockGpio::released_at = 0;
+    MockGpio::locks = 0;
+    MockGpio::n_levels = 0;
+}
+
+void tearDown(void) {}
+
+// DHT11
+
+void test_dht11_frame(void)
+{
+    const uint8_t frame[] = {55, 0, 23, 4, 55 + 23 + 4};
+    float values[Dht11<MockGpio>::METRICS];
+    TEST_ASSERT_TRUE(readDht(frame, 40, values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 23.4, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 55.0, values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 13.9, values[3]); // dew point
+}
+
+void test_dht11_negative_temperature(void)
+{
+    // sign in bit 7 of the decimal byte; the integral byte is the one below
+    // the value, so 0x05 0x83 is -6 + 0.3
+    const uint8_t frame[] = {70, 0, 5, 0x83, (uint8_t)(70 + 5 + 0x83)};
+    float values[Dht11<MockGpio>::METRICS];
+    TEST_ASSERT_TRUE(readDht(frame, 40, values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -5.7, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 70.0, values[1]);
+
+    const uint8_t zero[] = {70, 0, 0, 0x81, (uint8_t)(70 + 0x81)};
+    TEST_ASSERT_TRUE(readDht(zero, 40, values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, -0.9, values[0]);
+}
+
+void test_dht11_checksum_failure(void)
+{
+    const uint8_t frame[] = {55, 0, 23, 4, 55 + 23 + 4 + 1};
+    float values[Dht11<MockGpio>::METRICS];
+    TEST_ASSERT_FALSE(readDht(frame, 40, values));
+
+    // a flipped bit in the data
+    const uint8_t flipped[] = {55, 0, 23 ^ 0x10, 4, 55 + 23 + 4};
+    TEST_ASSERT_FALSE(readDht(flipped, 40, values));
+}
+
+void test_dht11_no_answer(void)
+{
+    const uint8_t frame[] = {55, 0, 23, 4, 55 + 23 + 4};
+    float values[Dht11<MockGpio>::METRICS];
+    TEST_ASSERT_FALSE(readDht(frame, 20, values)); // stops after 20 bits
+    MockGpio::n_levels = 0; // the line stays idle
+    Dht11<MockGpio> dht(2);
+    dht.start(0);
+    TEST_ASSERT_FALSE(dht.finish(values));
+    TEST_ASSERT_EQUAL_INT(0, MockGpio::locks);
+}
+
+// SHT3x
+
+void test_sht3x_frame(void)
+{
+    MockBus bus(0x44);
+    Sht3x<MockBus> sht(bus);
+    TEST_ASSERT_TRUE(sht.begin());
+    TEST_ASSERT_TRUE(sht.start(0));
+    TEST_ASSERT_EQUAL_UINT8(0x24, bus.command[0]); // single shot, high repeatability
+    TEST_ASSERT_EQUAL_UINT8(0x00, bus.command[1]);
+
+    bus.reply = SHT_25C_50RH;
+    bus.reply_length = sizeof(SHT_25C_50RH);
+    float values[Sht3x<MockBus>::METRICS];
+    TEST_ASSERT_TRUE(sht.finish(values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 25.0, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 50.0, values[1]);
+}
+
+void test_sht3x_negative_temperature(void)
+{
+    MockBus bus(0x44);
+    Sht3x<MockBus> sht(bus);
+    sht.start(0);
+    bus.reply = SHT_MINUS_10C_80RH;
+    bus.reply_length = sizeof(SHT_MINUS_10C_80RH);
+    float values[Sht3x<MockBus>::METRICS];
+    TEST_ASSERT_TRUE(sht.finish(values));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, -10.0, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 80.0, values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, -12.8, values[3]); // dew point
+}
+
+void test_sht3x_checksum_failure(void)
+{
+    MockBus bus(0x44);
+    Sht3x<MockBus> sht(bus);
+    float values[Sht3x<MockBus>::METRICS];
+
+    uint8_t frame[6];
+    memcpy(frame, SHT_25C_50RH, sizeof(frame));
+    frame[1] ^= 0x01; // temperature word
+    sht.start(0);
+    bus.reply = frame;
+    bus.reply_length = sizeof(frame);
+    TEST_ASSERT_FALSE(sht.finish(values));
+
+    memcpy(frame, SHT_25C_50RH, sizeof(frame));
+    frame[5] ^= 0x80; // humidity CRC
+    sht.start(0);
+    bus.reply = frame;
+    bus.reply_length = sizeof(frame);
+    TEST_ASSERT_FALSE(sht.finish(values));
+}
+
+void test_sht3x_missing(void)
+{
+    MockBus bus(0x45); // nothing answers at 0x44
+    Sht3x<MockBus> sht(bus);
+    TEST_ASSERT_FALSE(sht.begin());
+    TEST_ASSERT_FALSE(sht.start(0));
+
+    MockBus short_bus(0x44);
+    Sht3x<MockBus> cut(short_bus);
+    cut.start(0);
+    short_bus.reply = SHT_25C_50RH;
+    short_bus.reply_length = 3; // a short read
+    float values[Sht3x<MockBus>::METRICS];
+    TEST_ASSERT_FALSE(cut.finish(values));
+}
+
+// BME280
+
+void test_bme280_frame(void)
+{
+    MockBus bus = bmeBus();
+    Bme280<MockBus> bme(bus);
+    TEST_ASSERT_TRUE(bme.begin());
+    TEST_ASSERT_EQUAL_UINT8(0x01, bus.registers[0xF2]); // humidity x1
+
+    float values[Bme280<MockBus>::METRICS];
+    TEST_ASSERT_TRUE(readBme(bus, bme, BME_25C, values));
+    bme_reference_t ref = bmeReference(BME_25C);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.08, values[0]); // datasheet example
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1006.53, values[2]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, ref.temperature, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.1, ref.humidity, values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, ref.pressure, values[2]);
+}
+
+void test_bme280_negative_temperature(void)
+{
+    MockBus bus = bmeBus();
+    Bme280<MockBus> bme(bus);
+    TEST_ASSERT_TRUE(bme.begin());
+
+    float values[Bme280<MockBus>::METRICS];
+    TEST_ASSERT_TRUE(readBme(bus, bme, BME_BELOW_ZERO, values));
+    bme_reference_t ref = bmeReference(BME_BELOW_ZERO);
+    TEST_ASSERT_TRUE(ref.temperature < -10);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, ref.temperature, values[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.1, ref.humidity, values[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, ref.pressure, values[2]);
+}
+
+void test_bme280_failures(void)
+{
+    MockBus bus = bmeBus();
+    Bme280<MockBus> bme(bus);
+    TEST_ASSERT_TRUE(bme.begin());
+    float values[Bme280<MockBus>::METRICS];
+    TEST_ASSERT_FALSE(readBme(bus, bme, BME_SKIPPED, values));
+
+    MockBus other = bmeBus();
+    other.registers[0xD0] = 0x58; // a BMP280, no humidity
+    Bme280<MockBus> bmp(other);
+    TEST_ASSERT_FALSE(bmp.begin());
+
+    MockBus empty(0x77);
+    Bme280<MockBus> missing(empty);
+    TEST_ASSERT_FALSE(missing.begin());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dht11_frame);
+    RUN_TEST(test_dht11_negative_temperature);
+    RUN_TEST(test_dht11_checksum_failure);
+    RUN_TEST(test_dht11_no_answer);
+    RUN_TEST(test_sht3x_frame);
+    RUN_TEST(test_sht3x_negative_temperature);
+    RUN_TEST(test_sht3x_checksum_failure);
+    RUN_TEST(test_sht3x_missing);
+    RUN_TEST(test_bme280_frame);
+    RUN_TEST(test_bme280_negative_temperature);
+    RUN_TEST(test_bme280_failures);
+    return UNITY_END();
+}
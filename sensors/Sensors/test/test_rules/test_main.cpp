@@ -0,0 +1,348 @@
+// Rules interpreter: programs of the backend compiler and malformed ones
+//   pio test -e native -f test_rules
+
+#include <math.h>
+#include <string.h>
+#include <unity.h>
+
+#include <rules_vm.h>
+
+// Output of api/components/rulesCompiler.js for
+//   [{"if": {"metric": "temperature", "above": 28, "hysteresis": 1},
+//     "then": {"ac": "on"}, "else": {"ac": "off"}}]
+static const char *HYSTERESIS_HEX =
+    "5201010b74656d70657261747572650100020000d841020000e0413000040103014007020000803f500103012240070200000000500100";
+//   [{"if": {"all": [{"metric": "light", "below": 300}, {"not": {"metric": "flame", "above": 0.5}}]},
+//     "then": {"light": "on"}, "else": {"light": "off"}}]
+static const char *ALL_HEX = "520102056c6967687405666c616d6501000200009643110101020000003f102220040003004007020000803f50"
+                             "0003002240070200000000500000";
+//   [{"if": {"metric": "temperature", "above": 30, "for": 60000}, "then": {"ac": "on"}}]
+static const char *HELD_HEX =
+    "5201010b74656d70657261747572650100020000f04110310060ea0000040003004007020000803f500100";
+
+#define LIGHT 0
+#define AC 1
+
+// Metric slots of the test node
+enum
+{
+    TEMPERATURE,
+    HUMIDITY,
+    LIGHT_LEVEL,
+    FLAME,
+    METRICS,
+};
+
+static int resolve(const char *metric)
+{
+    static const char *const names[METRICS] = {"temperature", "humidity", "light", "flame"};
+    for (int i = 0; i < METRICS; i++)
+    {
+        if (!strcmp(metric, names[i]))
+            return i;
+    }
+    return -1;
+}
+
+// Last state written to each actuator, -1 if never, and number of writes
+static int written[RULES_ACTUATORS];
+static int writes;
+
+static void record(uint8_t actuator, bool on)
+{
+    written[actuator] = on;
+    writes++;
+}
+
+static float metrics[METRICS];
+static RulesVm vm;
+
+static bool loadHex(const char *hex)
+{
+    uint8_t code[RULES_MAX_PROGRAM];
+    size_t length = rulesFromHex(hex, code, sizeof(code));
+    return length > 0 && vm.load(code, length, resolve);
+}
+
+static bool loadBytes(const uint8_t *code, size_t length)
+{
+    return vm.load(code, length, resolve);
+}
+
+static void run(uint32_t now)
+{
+    vm.run(metrics, now, record);
+}
+
+void setUp(void)
+{
+    vm.clear();
+    for (int i = 0; i < METRICS; i++)
+        metrics[i] = NAN;
+    for (int i = 0; i < RULES_ACTUATORS; i++)
+        written[i] = -1;
+    writes = 0;
+}
+
+void tearDown(void) {}
+
+// Compiled programs
+
+void test_hysteresis_program(void)
+{
+    TEST_ASSERT_TRUE(loadHex(HYSTERESIS_HEX));
+
+    metrics[TEMPERATURE] = 27.5;
+    run(0);
+    TEST_ASSERT_EQUAL_INT(0, written[AC]); // else branch on the first run
+    metrics[TEMPERATURE] = 28.5;
+    run(1000);
+    TEST_ASSERT_EQUAL_INT(1, written[AC]);
+    metrics[TEMPERATURE] = 27.2; // inside the band, stays on
+    run(2000);
+    TEST_ASSERT_EQUAL_INT(1, written[AC]);
+    metrics[TEMPERATURE] = 26.9;
+    run(3000);
+    TEST_ASSERT_EQUAL_INT(0, written[AC]);
+    TEST_ASSERT_EQUAL_INT(3, writes);
+    TEST_ASSERT_EQUAL_INT(-1, written[LIGHT]);
+}
+
+void test_all_not_program(void)
+{
+    TEST_ASSERT_TRUE(loadHex(ALL_HEX));
+
+    metrics[LIGHT_LEVEL] = 120;
+    metrics[FLAME] = 0;
+    run(0);
+    TEST_ASSERT_EQUAL_INT(1, written[LIGHT]);
+    metrics[FLAME] = 1;
+    run(100);
+    TEST_ASSERT_EQUAL_INT(0, written[LIGHT]);
+    metrics[FLAME] = 0;
+    metrics[LIGHT_LEVEL] = 800;
+    run(200);
+    TEST_ASSERT_EQUAL_INT(0, written[LIGHT]);
+    TEST_ASSERT_EQUAL_INT(2, writes); // only changes are written
+}
+
+void test_held_program(void)
+{
+    TEST_ASSERT_TRUE(loadHex(HELD_HEX));
+
+    metrics[TEMPERATURE] = 31;
+    run(1000);
+    run(60999);
+    TEST_ASSERT_EQUAL_INT(-1, written[AC]);
+    run(61000);
+    TEST_ASSERT_EQUAL_INT(1, written[AC]);
+
+    // the timer restarts once the condition drops
+    metrics[TEMPERATURE] = 25;
+    run(62000);
+    metrics[TEMPERATURE] = 31;
+    run(63000);
+    run(122999);
+    TEST_ASSERT_EQUAL_INT(1, writes);
+}
+
+void test_unsampled_metrics(void)
+{
+    // NaN until the first sample: comparisons are false, nothing trips
+    TEST_ASSERT_TRUE(loadHex(HELD_HEX));
+    run(0);
+    run(120000);
+    TEST_ASSERT_EQUAL_INT(0, writes);
+}
+
+void test_run_is_bounded(void)
+{
+    // forward jumps only: never more instructions than bytes of code
+    TEST_ASSERT_TRUE(loadHex(HYSTERESIS_HEX));
+    metrics[TEMPERATURE] = 30;
+    TEST_ASSERT_TRUE(vm.run(metrics, 0, record) <= vm.size());
+}
+
+void test_empty_program(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(4, vm.size());
+    TEST_ASSERT_TRUE(loadBytes(vm.program(), vm.size()));
+    TEST_ASSERT_EQUAL_UINT16(1, vm.run(metrics, 0, record));
+}
+
+// Malformed programs
+
+void test_unknown_metric(void)
+{
+    // same bytecode for a node without that metric
+    uint8_t code[RULES_MAX_PROGRAM];
+    size_t length = rulesFromHex(HELD_HEX, code, sizeof(code));
+    memcpy(code + 4, "pressure!!!", 11);
+    TEST_ASSERT_FALSE(loadBytes(code, length));
+}
+
+void test_bad_header(void)
+{
+    const uint8_t bad_magic[] = {'X', RULES_FORMAT, 0, RULES_END};
+    const uint8_t bad_format[] = {RULES_MAGIC, RULES_FORMAT + 1, 0, RULES_END};
+    const uint8_t too_many_metrics[] = {RULES_MAGIC, RULES_FORMAT, RULES_MAX_METRICS + 1, RULES_END};
+    const uint8_t truncated[] = {RULES_MAGIC, RULES_FORMAT, 0};
+    TEST_ASSERT_FALSE(loadBytes(bad_magic, sizeof(bad_magic)));
+    TEST_ASSERT_FALSE(loadBytes(bad_format, sizeof(bad_format)));
+    TEST_ASSERT_FALSE(loadBytes(too_many_metrics, sizeof(too_many_metrics)));
+    TEST_ASSERT_FALSE(loadBytes(truncated, sizeof(truncated)));
+
+    uint8_t too_long[RULES_MAX_PROGRAM + 1];
+    memset(too_long, RULES_END, sizeof(too_long));
+    too_long[0] = RULES_MAGIC;
+    too_long[1] = RULES_FORMAT;
+    too_long[2] = 0;
+    TEST_ASSERT_FALSE(loadBytes(too_long, sizeof(too_long)));
+}
+
+void test_bad_metric_names(void)
+{
+    const uint8_t empty_name[] = {RULES_MAGIC, RULES_FORMAT, 1, 0, RULES_END};
+    const uint8_t past_end[] = {RULES_MAGIC, RULES_FORMAT, 1, 20, 'l', 'i', 'g', 'h', 't', RULES_END};
+    const uint8_t missing[] = {RULES_MAGIC, RULES_FORMAT, 2, 5, 'l', 'i', 'g', 'h', 't'};
+    TEST_ASSERT_FALSE(loadBytes(empty_name, sizeof(empty_name)));
+    TEST_ASSERT_FALSE(loadBytes(past_end, sizeof(past_end)));
+    TEST_ASSERT_FALSE(loadBytes(missing, sizeof(missing)));
+}
+
+void test_bad_jumps(void)
+{
+    // CONST 1.0 = 02 00 00 80 3f
+    const uint8_t past_end[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00, 0x80, 0x3f, RULES_JZ, 10, RULES_END};
+    const uint8_t onto_end[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00, 0x80, 0x3f, RULES_JZ, 0, RULES_END};
+    // lands on the operand of the second CONST
+    const uint8_t into_operand[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00, 0x80, 0x3f, RULES_JZ, 1,
+                                    RULES_CONST, 0x00, 0x00, 0x00, 0x00, RULES_STORE, 0, RULES_END};
+    // skips a push: the paths meet with different stack depths
+    const uint8_t unbalanced[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00, 0x80, 0x3f, RULES_JZ, 5,
+                                  RULES_CONST, 0x00, 0x00, 0x00, 0x00, RULES_END};
+    TEST_ASSERT_FALSE(loadBytes(past_end, sizeof(past_end)));
+    TEST_ASSERT_TRUE(loadBytes(onto_end, sizeof(onto_end)));
+    TEST_ASSERT_FALSE(loadBytes(into_operand, sizeof(into_operand)));
+    TEST_ASSERT_FALSE(loadBytes(unbalanced, sizeof(unbalanced)));
+}
+
+void test_stack_underflow(void)
+{
+    const uint8_t binary[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00, 0x80, 0x3f, RULES_GT, RULES_END};
+    const uint8_t store[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_STORE, 0, RULES_END};
+    const uint8_t write_empty[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_WRITE, LIGHT, RULES_END};
+    const uint8_t hysteresis[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, 0, RULES_LOAD, 1, RULES_HYST, 2, RULES_END};
+    TEST_ASSERT_FALSE(loadBytes(binary, sizeof(binary)));
+    TEST_ASSERT_FALSE(loadBytes(store, sizeof(store)));
+    TEST_ASSERT_FALSE(loadBytes(write_empty, sizeof(write_empty)));
+    TEST_ASSERT_FALSE(loadBytes(hysteresis, sizeof(hysteresis)));
+}
+
+void test_stack_overflow(void)
+{
+    uint8_t code[3 + 2 * (RULES_STACK + 1) + 1] = {RULES_MAGIC, RULES_FORMAT, 0};
+    size_t length = 3;
+    for (int i = 0; i < RULES_STACK; i++)
+    {
+        code[length++] = RULES_LOAD;
+        code[length++] = 0;
+    }
+    code[length] = RULES_END;
+    TEST_ASSERT_TRUE(loadBytes(code, length + 1)); // exactly full
+
+    code[length++] = RULES_LOAD;
+    code[length++] = 0;
+    code[length++] = RULES_END;
+    TEST_ASSERT_FALSE(loadBytes(code, length));
+}
+
+void test_bad_indexes(void)
+{
+    const uint8_t metric_slot[] = {RULES_MAGIC, RULES_FORMAT, 1, 5, 'l', 'i', 'g', 'h', 't', RULES_METRIC, 1, RULES_STORE, 0, RULES_END};
+    const uint8_t load[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, RULES_REGISTERS, RULES_STORE, 0, RULES_END};
+    const uint8_t store[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, 0, RULES_STORE, RULES_REGISTERS, RULES_END};
+    const uint8_t timer[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, 0, RULES_HELD, RULES_TIMERS, 0, 0, 0, 0, RULES_STORE, 0, RULES_END};
+    const uint8_t actuator[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, 0, RULES_WRITE, RULES_ACTUATORS, RULES_END};
+    TEST_ASSERT_FALSE(loadBytes(metric_slot, sizeof(metric_slot)));
+    TEST_ASSERT_FALSE(loadBytes(load, sizeof(load)));
+    TEST_ASSERT_FALSE(loadBytes(store, sizeof(store)));
+    TEST_ASSERT_FALSE(loadBytes(timer, sizeof(timer)));
+    TEST_ASSERT_FALSE(loadBytes(actuator, sizeof(actuator)));
+}
+
+void test_bad_code(void)
+{
+    const uint8_t unknown_opcode[] = {RULES_MAGIC, RULES_FORMAT, 0, 0x7f, RULES_END};
+    const uint8_t missing_end[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_LOAD, 0, RULES_STORE, 0};
+    const uint8_t after_end[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_END, RULES_END};
+    const uint8_t cut_operand[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_CONST, 0x00, 0x00};
+    TEST_ASSERT_FALSE(loadBytes(unknown_opcode, sizeof(unknown_opcode)));
+    TEST_ASSERT_FALSE(loadBytes(missing_end, sizeof(missing_end)));
+    TEST_ASSERT_FALSE(loadBytes(after_end, sizeof(after_end)));
+    TEST_ASSERT_FALSE(loadBytes(cut_operand, sizeof(cut_operand)));
+}
+
+void test_failed_load_keeps_program(void)
+{
+    TEST_ASSERT_TRUE(loadHex(ALL_HEX));
+    uint16_t size = vm.size();
+    const uint8_t store[] = {RULES_MAGIC, RULES_FORMAT, 0, RULES_STORE, 0, RULES_END};
+    TEST_ASSERT_FALSE(loadBytes(store, sizeof(store)));
+    TEST_ASSERT_EQUAL_UINT16(size, vm.size());
+
+    metrics[LIGHT_LEVEL] = 120;
+    metrics[FLAME] = 0;
+    run(0);
+    TEST_ASSERT_EQUAL_INT(1, written[LIGHT]);
+}
+
+void test_bad_hex(void)
+{
+    uint8_t code[4];
+    TEST_ASSERT_EQUAL_UINT32(0, rulesFromHex("520", code, sizeof(code)));       // odd length
+    TEST_ASSERT_EQUAL_UINT32(0, rulesFromHex("52zz", code, sizeof(code)));      // not hex
+    TEST_ASSERT_EQUAL_UINT32(0, rulesFromHex("5201000000", code, sizeof(code))); // too long
+    TEST_ASSERT_EQUAL_UINT32(4, rulesFromHex("520100AA", code, sizeof(code)));
+    TEST_ASSERT_EQUAL_UINT8(0xaa, code[3]);
+}
+
+void test_update(void)
+{
+    RulesVm candidate;
+    rules_blob_t blob;
+    TEST_ASSERT_TRUE(rulesUpdate(ALL_HEX, resolve, candidate, blob));
+    TEST_ASSERT_EQUAL_UINT16(candidate.size(), blob.length);
+    TEST_ASSERT_EQUAL_MEMORY(candidate.program(), blob.code, blob.length);
+
+    // an empty program removes the rules, and is stored as one
+    TEST_ASSERT_TRUE(rulesUpdate("", resolve, candidate, blob));
+    TEST_ASSERT_EQUAL_UINT16(4, blob.length);
+    TEST_ASSERT_TRUE(loadBytes(blob.code, blob.length));
+
+    TEST_ASSERT_FALSE(rulesUpdate("52zz", resolve, candidate, blob));
+    TEST_ASSERT_FALSE(rulesUpdate("520100", resolve, candidate, blob)); // no END
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hysteresis_program);
+    RUN_TEST(test_all_not_program);
+    RUN_TEST(test_held_program);
+    RUN_TEST(test_unsampled_metrics);
+    RUN_TEST(test_run_is_bounded);
+    RUN_TEST(test_empty_program);
+    RUN_TEST(test_unknown_metric);
+    RUN_TEST(test_bad_header);
+    RUN_TEST(test_bad_metric_names);
+    RUN_TEST(test_bad_jumps);
+    RUN_TEST(test_stack_underflow);
+    RUN_TEST(test_stack_overflow);
+    RUN_TEST(test_bad_indexes);
+    RUN_TEST(test_bad_code);
+    RUN_TEST(test_failed_load_keeps_program);
+    RUN_TEST(test_bad_hex);
+    RUN_TEST(test_update);
+    return UNITY_END();
+}
@@ -0,0 +1,179 @@
+// Accuracy and speed of the fixed point comfort metrics.
+// Sweeps every reading the drivers can produce (0.1 °C from -40 to 60 °C,
+// 0.1 %RH from 0 to 100 %) through the Comfort library and compares it
+// with the formulas evaluated in double precision, then times both the
+// fixed point path and the float path it replaces. Exits with 1 when an
+// error bound is exceeded, so it can gate changes to the tables.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include <comfort.h>
+#include <sensor_driver.h>
+
+// Maximum absolute errors, in the units of the metrics
+#define BOUND_HEAT_INDEX 0.1         // °C
+#define BOUND_DEW_POINT 0.1          // °C
+#define BOUND_ABSOLUTE_HUMIDITY 0.03 // g/m3, up to 130 g/m3 at 60 °C
+#define BOUND_HUMIDEX 0.1            // °C
+
+static double saturation(double celsius)
+{
+    return 6.1094 * exp(17.625 * celsius / (celsius + 243.04)); // hPa
+}
+
+static double heatIndex(double celsius, double humidity)
+{
+    double t = celsius * 1.8 + 32.0;
+    double hi = 0.5 * (t + 61.0 + ((t - 68.0) * 1.2) + (humidity * 0.094));
+    if (hi > 79.0)
+    {
+        hi = -42.379 + 2.04901523 * t + 10.14333127 * humidity +
+             -0.22475541 * t * humidity +
+             -0.00683783 * t * t +
+             -0.05481717 * humidity * humidity +
+             0.00122874 * t * t * humidity +
+             0.00085282 * t * humidity * humidity +
+             -0.00000199 * t * t * humidity * humidity;
+
+        if ((humidity < 13.0) && (t >= 80.0) && (t <= 112.0))
+            hi -= ((13.0 - humidity) / 4) * sqrt((17.0 - fabs(t - 95.0)) / 17);
+        else if ((humidity > 85.0) && (t >= 80.0) && (t <= 87.0))
+            hi += ((humidity - 85.0) / 10) * ((87.0 - t) / 5);
+    }
+    return (hi - 32.0) * 5 / 9;
+}
+
+static double dewPoint(double celsius, double humidity)
+{
+    if (humidity <= 0)
+        return COMFORT_T_MIN / 10.0;
+    double b = log(humidity / 100) + 17.625 * celsius / (243.04 + celsius);
+    double dew = 243.04 * b / (17.625 - b);
+    return dew < COMFORT_T_MIN / 10.0 ? COMFORT_T_MIN / 10.0 : dew;
+}
+
+static double absoluteHumidity(double celsius, double humidity)
+{
+    return 216.7 * saturation(celsius) * humidity / 100 / (celsius + 273.15);
+}
+
+static double humidex(double celsius, double humidity)
+{
+    return celsius + 5.0 / 9 * (saturation(celsius) * humidity / 100 - 10);
+}
+
+// The float path the library replaces: what a node computed per reading
+// before, in single precision with libm
+static void floatPath(float celsius, float humidity, float *values)
+{
+    float e = 6.1094f * expf(17.625f * celsius / (celsius + 243.04f)) * humidity / 100;
+    float b = logf(e / 6.1094f);
+    values[0] = apparentTemperature(celsius, humidity);
+    values[1] = 243.04f * b / (17.625f - b);
+    values[2] = 216.7f * e / (celsius + 273.15f);
+    values[3] = celsius + 0.5555f * (e - 10);
+}
+
+typedef struct error
+{
+    const char *name;
+    double bound;
+    double max;
+    int16_t t_dc; // worst reading
+    uint16_t rh_dp;
+} error_t;
+
+static void track(error_t &e, double value, double reference, int16_t t_dc, uint16_t rh_dp)
+{
+    double error = fabs(value - reference);
+    if (error > e.max)
+    {
+        e.max = error;
+        e.t_dc = t_dc;
+        e.rh_dp = rh_dp;
+    }
+}
+
+static double nsPerCall(std::chrono::steady_clock::duration elapsed, uint32_t calls)
+{
+    return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 5;
+
+    error_t errors[] = {
+        {"heat index", BOUND_HEAT_INDEX, 0, 0, 0},
+        {"dew point", BOUND_DEW_POINT, 0, 0, 0},
+        {"absolute humidity", BOUND_ABSOLUTE_HUMIDITY, 0, 0, 0},
+        {"humidex", BOUND_HUMIDEX, 0, 0, 0},
+    };
+    uint32_t readings = 0;
+    for (int16_t t = COMFORT_T_MIN; t <= COMFORT_T_MAX; t++)
+    {
+        for (uint16_t rh = 0; rh <= 1000; rh++)
+        {
+            comfort_t c;
+            comfortCompute(t, rh, c);
+            track(errors[0], c.heat_index / 10.0, heatIndex(t / 10.0, rh / 10.0), t, rh);
+            track(errors[1], c.dew_point / 10.0, dewPoint(t / 10.0, rh / 10.0), t, rh);
+            track(errors[2], c.absolute_humidity / 100.0, absoluteHumidity(t / 10.0, rh / 10.0), t, rh);
+            track(errors[3], c.humidex / 10.0, humidex(t / 10.0, rh / 10.0), t, rh);
+            readings++;
+        }
+    }
+
+    bool ok = true;
+    printf("%u readings, max error against double precision:\n", readings);
+    for (const error_t &e : errors)
+    {
+        bool within = e.max <= e.bound + 1e-9;
+        ok = ok && within;
+        printf("  %-18s %.4f (bound %.2f) at %.1f C %.1f %%%s\n",
+               e.name, e.max, e.bound, e.t_dc / 10.0, e.rh_dp / 10.0, within ? "" : "  EXCEEDED");
+    }
+
+    // Host timings only rank the two paths, cycles on the ESP8266 (where
+    // floats are emulated) come from the COMFORT_BENCHMARK firmware flag
+    volatile float sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (int16_t t = COMFORT_T_MIN; t <= COMFORT_T_MAX; t += 3)
+        {
+            for (uint16_t rh = 0; rh <= 1000; rh += 3)
+            {
+                comfort_t c;
+                comfortCompute(t, rh, c);
+                sink = sink + c.heat_index + c.dew_point + c.absolute_humidity + c.humidex;
+            }
+        }
+    }
+    auto fixed = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++)
+    {
+        for (int16_t t = COMFORT_T_MIN; t <= COMFORT_T_MAX; t += 3)
+        {
+            for (uint16_t rh = 0; rh <= 1000; rh += 3)
+            {
+                float values[COMFORT_METRICS];
+                floatPath(t * 0.1f, rh * 0.1f, values);
+                sink = sink + values[0] + values[1] + values[2] + values[3];
+            }
+        }
+    }
+    auto floating = std::chrono::steady_clock::now() - start;
+
+    uint32_t calls = rounds * ((COMFORT_T_MAX - COMFORT_T_MIN) / 3 + 1) * (1000 / 3 + 1);
+    printf("\nhost, all four metrics: fixed point %.1f ns/call, float %.1f ns/call\n",
+           nsPerCall(fixed, calls), nsPerCall(floating, calls));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+// Energy simulation of the sensors node loop.
+// Replays one period of the main loop timeline (WiFi/MQTT connections,
+// samples, publishes, control polling) through the firmware EnergyProfiler
+// for auto modem sleep and FORCE_MODEM_SLEEP, so configurations can be
+// compared before flashing. Durations are typical figures measured on the
+// bench and can be overridden from the command line.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <energy_profiler.h>
+
+typedef struct sim_config
+{
+    uint32_t log_ms;      // log_delay
+    uint32_t sample_ms;   // sample_delay
+    uint32_t control_ms;  // mqtt_control_delay
+    uint32_t hours;       // simulated time
+    uint32_t battery_mah; // for the battery life estimate
+    uint32_t publishes;   // messages per log (rssi, energy, metrics)
+    uint32_t wifi_connect_us;
+    uint32_t mqtt_connect_us;
+    uint32_t publish_us;
+    uint32_t mqtt_loop_us;
+    uint32_t sample_us; // DHT11 bit transfer and ADC read
+} sim_config_t;
+
+static sim_config_t defaults()
+{
+    sim_config_t c;
+    c.log_ms = 60000;
+    c.sample_ms = 5000;
+    c.control_ms = 0;
+    c.hours = 1;
+    c.battery_mah = 2000;
+    c.publishes = 10;
+    c.wifi_connect_us = 1500000;
+    c.mqtt_connect_us = 150000;
+    c.publish_us = 3000;
+    c.mqtt_loop_us = 1000;
+    c.sample_us = 4600;
+    return c;
+}
+
+// Simulated node, time in us
+class Node
+{
+public:
+    Node(const sim_config_t &sim_config, bool forced_sleep)
+        : c(sim_config), forced(forced_sleep), now(0), connected(false)
+    {
+        profiler.begin(0);
+        profiler.radio(forced ? RADIO_OFF : RADIO_MODEM_SLEEP, 0);
+        connected = !forced;
+    }
+
+    void run(energy_report_t &report)
+    {
+        uint64_t end = (uint64_t)c.hours * 3600000000ULL;
+        uint64_t next_sample = 0, next_control = 0, next_log = (uint64_t)c.log_ms * 1000;
+        // the loop spins continuously; only the iterations doing work matter
+        const uint64_t loop_us = forced ? 100 : 1000; // delay(1) with auto modem sleep
+        while (now < end)
+        {
+            bool awake = false;
+            if (now >= next_sample)
+            {
+                busy(SUB_SENSORS, profiler.radioState(), c.sample_us);
+                next_sample = now + (uint64_t)c.sample_ms * 1000;
+            }
+            if (now >= next_control)
+            {
+                awake = wake();
+                busy(SUB_MQTT, RADIO_RX, c.mqtt_loop_us);
+                next_control = now + (uint64_t)c.control_ms * 1000 + loop_us;
+            }
+            if (now >= next_log)
+            {
+                awake = wake();
+                for (uint32_t i = 0; i < c.publishes; i++)
+                    busy(SUB_PUBLISH, RADIO_TX, c.publish_us);
+                next_log = now + (uint64_t)c.log_ms * 1000;
+            }
+            if (awake && forced)
+            {
+                profiler.radio(RADIO_OFF, (uint32_t)now);
+                connected = false;
+            }
+
+            // idle until the next event
+            uint64_t next = next_sample < next_control ? next_sample : next_control;
+            next = next < next_log ? next : next_log;
+            now = next > now ? next : now + loop_us;
+        }
+        profiler.report((uint32_t)now, report);
+    }
+
+private:
+    bool wake()
+    {
+        if (!connected)
+        {
+            connected = true;
+            busy(SUB_WIFI, RADIO_RX, c.wifi_connect_us);
+            busy(SUB_MQTT, RADIO_RX, c.mqtt_connect_us);
+        }
+        return true;
+    }
+
+    void busy(energy_subsystem_t subsystem, energy_radio_t radio, uint32_t duration_us)
+    {
+        energy_radio_t idle = connected ? RADIO_MODEM_SLEEP : RADIO_OFF;
+        energy_subsystem_t previous = profiler.enter(subsystem, (uint32_t)now);
+        profiler.radio(radio, (uint32_t)now);
+        now += duration_us;
+        profiler.radio(idle, (uint32_t)now);
+        profiler.enter(previous, (uint32_t)now);
+    }
+
+    sim_config_t c;
+    bool forced;
+    uint64_t now;
+    bool connected;
+    EnergyProfiler profiler;
+};
+
+static void print(const char *name, const sim_config_t &c, const energy_report_t &r)
+{
+    printf("%-18s %8.2f mA  %8.1f h", name, r.total_ma, r.total_ma > 0 ? c.battery_mah / r.total_ma : 0);
+    for (uint8_t i = 0; i < SUBSYSTEMS; i++)
+        printf("  %s %.2f", energySubsystemName(i), r.subsystem_ma[i]);
+    printf("\n%-18s radio:", "");
+    for (uint8_t i = 0; i < RADIO_STATES; i++)
+        printf("  %s %.1f%%", energyRadioName(i), r.radio_share[i] * 100);
+    printf("\n");
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--log ms] [--sample ms] [--control ms] [--hours h] [--battery mAh]\n"
+            "          [--publishes n] [--wifi-connect us] [--mqtt-connect us] [--publish us]\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    sim_config_t c = defaults();
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 == argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        uint32_t value = strtoul(argv[i + 1], NULL, 10);
+        if (!strcmp(argv[i], "--log"))
+            c.log_ms = value;
+        else if (!strcmp(argv[i], "--sample"))
+            c.sample_ms = value;
+        else if (!strcmp(argv[i], "--control"))
+            c.control_ms = value;
+        else if (!strcmp(argv[i], "--hours"))
+            c.hours = value;
+        else if (!strcmp(argv[i], "--battery"))
+            c.battery_mah = value;
+        else if (!strcmp(argv[i], "--publishes"))
+            c.publishes = value;
+        else if (!strcmp(argv[i], "--wifi-connect"))
+            c.wifi_connect_us = value;
+        else if (!strcmp(argv[i], "--mqtt-connect"))
+            c.mqtt_connect_us = value;
+        else if (!strcmp(argv[i], "--publish"))
+            c.publish_us = value;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    printf("log %u ms, sample %u ms, control %u ms, %u h, battery %u mAh\n\n",
+           c.log_ms, c.sample_ms, c.control_ms, c.hours, c.battery_mah);
+    printf("%-18s %11s  %10s  per subsystem (mA)\n", "configuration", "average", "battery");
+
+    energy_report_t report;
+    Node auto_sleep(c, false);
+    auto_sleep.run(report);
+    print("auto modem sleep", c, report);
+
+    Node forced_sleep(c, true);
+    forced_sleep.run(report);
+    print("FORCE_MODEM_SLEEP", c, report);
+    return 0;
+}
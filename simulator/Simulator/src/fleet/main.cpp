@@ -0,0 +1,395 @@
+// Fleet simulation: N virtual sensors nodes against a real broker.
+// Every node connects with its own MAC, will and subscriptions, registers
+// through the setup topic, then publishes readings, flame alarms and
+// interlock reports like the firmware does, and answers actuator commands.
+// A controller connection sends light commands at a fixed rate, the way the
+// API does, and times them until the node acknowledgement comes back, so
+// the whole pipeline downstream of the nodes (broker, daemon, API) can be
+// loaded reproducibly:
+//
+//   .pio/build/fleet/program --broker 127.0.0.1 --nodes 2000 --log 10000 --commands 50
+
+#include <math.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include "virtual_node.h"
+
+#define COMMAND_TIMEOUT 10000 // ms, commands not acknowledged by then are lost
+
+static volatile bool stop = false;
+
+static uint64_t nowMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t epochMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t nowUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Round trip of the actuator commands: API-like publisher and ack listener
+class Controller
+{
+public:
+    Controller(const fleet_config_t &config, float commands_per_s)
+        : c(config), subscribed(false), rate(commands_per_s), budget(0), last_tick(0), sequence(0), seq(0), sent(0),
+          acked(0), lost(0)
+    {
+        mqtt.onMessage([this](const std::string &topic, const char *payload, size_t length)
+                       { ackReceived(topic, payload, length); });
+    }
+
+    MqttSession &session() { return mqtt; }
+
+    void tick(uint64_t now_ms, std::vector<std::unique_ptr<VirtualNode>> &nodes, uint32_t started)
+    {
+        if (!mqtt.isOpen())
+        {
+            mqtt.open(c.broker, "fleet-controller", c.username, c.password, 60, true, nullptr, now_ms);
+            subscribed = false;
+            return;
+        }
+        if (!mqtt.connected())
+            return;
+        if (!subscribed)
+        {
+            mqtt.subscribe("unishare/acks/+/+", 1);
+            subscribed = true;
+            last_tick = now_ms;
+        }
+
+        budget += rate * (now_ms - last_tick) / 1000.0f;
+        last_tick = now_ms;
+        for (; budget >= 1 && started > 0; budget -= 1)
+        {
+            VirtualNode &node = *nodes[::random() % started];
+            if (!node.online())
+                continue;
+            // same payload as liveManagement.publishCommand()
+            char id[24];
+            snprintf(id, sizeof(id), "f%llx", (unsigned long long)++sequence);
+            seq = std::max(epochMs(), seq + 1);
+            char payload[80];
+            int n = snprintf(payload, sizeof(payload), "{\"control\":\"%s\",\"id\":\"%s\",\"seq\":%llu}",
+                             sequence % 2 ? "on" : "off", id, (unsigned long long)seq);
+            mqtt.publish("unishare/control/" + node.mac() + "/light", payload, n, 1, true);
+            pending[id] = nowUs();
+            sent++;
+        }
+
+        for (auto it = pending.begin(); it != pending.end();)
+        {
+            if (nowUs() - it->second > (uint64_t)COMMAND_TIMEOUT * 1000)
+            {
+                it = pending.erase(it);
+                lost++;
+            }
+            else
+                ++it;
+        }
+        mqtt.keepAlive(now_ms);
+    }
+
+    // Round trip times since the last call, in us
+    std::vector<uint32_t> takeWindow()
+    {
+        std::vector<uint32_t> window;
+        window.swap(rtt_window);
+        return window;
+    }
+
+    const std::vector<uint32_t> &all() const { return rtt_all; }
+    uint64_t sentCount() const { return sent; }
+    uint64_t ackedCount() const { return acked; }
+    uint64_t lostCount() const { return lost; }
+
+private:
+    void ackReceived(const std::string &topic, const char *payload, size_t length)
+    {
+        StaticJsonDocument<192> doc;
+        if (deserializeJson(doc, payload, length))
+            return;
+        auto it = pending.find(doc["id"] | "");
+        if (it == pending.end())
+            return; // retained ack of a previous run, or a command of the API
+        uint32_t rtt = nowUs() - it->second;
+        pending.erase(it);
+        rtt_window.push_back(rtt);
+        rtt_all.push_back(rtt);
+        acked++;
+    }
+
+    const fleet_config_t &c;
+    MqttSession mqtt;
+    bool subscribed;
+    float rate;
+    float budget;
+    uint64_t last_tick;
+    uint64_t sequence;
+    uint64_t seq; // of the last command, wall clock ms like the API
+    std::unordered_map<std::string, uint64_t> pending;
+    std::vector<uint32_t> rtt_window;
+    std::vector<uint32_t> rtt_all;
+    uint64_t sent, acked, lost;
+};
+
+static void printLatency(std::vector<uint32_t> rtt)
+{
+    if (rtt.empty())
+    {
+        printf("  rtt -");
+        return;
+    }
+    std::sort(rtt.begin(), rtt.end());
+    auto at = [&rtt](float q)
+    { return rtt[std::min(rtt.size() - 1, (size_t)(q * rtt.size()))] / 1000.0f; };
+    printf("  rtt p50 %.1f p90 %.1f p99 %.1f max %.1f ms", at(0.5f), at(0.9f), at(0.99f), rtt.back() / 1000.0f);
+}
+
+static mqtt_counters_t totals(std::vector<std::unique_ptr<VirtualNode>> &nodes, uint32_t *online)
+{
+    mqtt_counters_t sum;
+    memset(&sum, 0, sizeof(sum));
+    *online = 0;
+    for (auto &node : nodes)
+    {
+        const mqtt_counters_t &n = node->session().counters();
+        sum.published += n.published;
+        sum.acked += n.acked;
+        sum.received += n.received;
+        sum.bytes_out += n.bytes_out;
+        sum.bytes_in += n.bytes_in;
+        if (node->online())
+            (*online)++;
+    }
+    return sum;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--broker host] [--port n] [--username u] [--password p] [--nodes n]\n"
+            "          [--ramp nodes/s] [--log ms] [--sample ms] [--ac-control ms] [--flames n/h]\n"
+            "          [--flame-ms ms] [--ac-auto share] [--commands n/s] [--duration s] [--report s]\n"
+            "          [--no-setup]\n",
+            program);
+}
+
+static void onSignal(int)
+{
+    stop = true;
+}
+
+int main(int argc, char **argv)
+{
+    fleet_config_t c;
+    memset(&c, 0, sizeof(c));
+    const char *host = "127.0.0.1";
+    uint16_t port = 1883;
+    c.username = "";
+    c.password = "";
+    c.nodes = 100;
+    c.log_ms = 60000;
+    c.sample_ms = 5000;
+    c.ac_control_ms = 30000;
+    c.snapshot_every = MQTT_SNAPSHOT_EVERY;
+    c.photoresistor_threshold = 900;
+    c.flames_per_hour = 0.1f;
+    c.flame_ms = 20000;
+    c.ac_auto_share = 0.2f;
+    c.setup = true;
+    mqttPolicyDefaults(c.delivery);
+    uint32_t ramp = 200;
+    float commands = 1;
+    uint32_t duration_s = 60;
+    uint32_t report_s = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--no-setup"))
+        {
+            c.setup = false;
+            continue;
+        }
+        if (i + 1 == argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (!strcmp(argv[i - 1], "--broker"))
+            host = value;
+        else if (!strcmp(argv[i - 1], "--port"))
+            port = atoi(value);
+        else if (!strcmp(argv[i - 1], "--username"))
+            c.username = value;
+        else if (!strcmp(argv[i - 1], "--password"))
+            c.password = value;
+        else if (!strcmp(argv[i - 1], "--nodes"))
+            c.nodes = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--ramp"))
+            ramp = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--log"))
+            c.log_ms = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--sample"))
+            c.sample_ms = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--ac-control"))
+            c.ac_control_ms = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--flames"))
+            c.flames_per_hour = atof(value);
+        else if (!strcmp(argv[i - 1], "--flame-ms"))
+            c.flame_ms = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--ac-auto"))
+            c.ac_auto_share = atof(value);
+        else if (!strcmp(argv[i - 1], "--commands"))
+            commands = atof(value);
+        else if (!strcmp(argv[i - 1], "--duration"))
+            duration_s = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "--report"))
+            report_s = strtoul(value, NULL, 10);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (c.nodes == 0 || c.log_ms == 0 || c.sample_ms == 0 || ramp == 0 || report_s == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+    {
+        fprintf(stderr, "unknown broker host %s\n", host);
+        return 1;
+    }
+    c.broker = *(sockaddr_in *)result->ai_addr;
+    c.broker.sin_port = htons(port);
+    freeaddrinfo(result);
+
+    // one socket per node
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < c.nodes + 16)
+        fprintf(stderr, "warning: only %llu file descriptors available\n", (unsigned long long)limit.rlim_cur);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    std::vector<std::unique_ptr<VirtualNode>> nodes;
+    for (uint32_t i = 0; i < c.nodes; i++)
+        nodes.emplace_back(new VirtualNode(i, c));
+    Controller controller(c, commands);
+
+    printf("%u nodes on %s:%u, log %u ms, sample %u ms, %.1f commands/s, %u s\n",
+           c.nodes, host, port, c.log_ms, c.sample_ms, commands, duration_s);
+
+    std::vector<pollfd> fds;
+    std::vector<MqttSession *> sessions;
+    uint64_t start = nowMs();
+    uint64_t last_report = start;
+    uint32_t started = 0, online = 0;
+    mqtt_counters_t previous;
+    memset(&previous, 0, sizeof(previous));
+
+    while (!stop && nowMs() - start < (uint64_t)duration_s * 1000)
+    {
+        uint64_t now = nowMs();
+
+        // connect the fleet progressively, brokers throttle connection storms
+        uint64_t allowed = (now - start) * ramp / 1000 + 1;
+        while (started < c.nodes && started < allowed)
+            nodes[started++]->start(now);
+        for (uint32_t i = 0; i < started; i++)
+            nodes[i]->tick(now);
+        controller.tick(now, nodes, started);
+
+        fds.clear();
+        sessions.clear();
+        for (uint32_t i = 0; i <= started; i++)
+        {
+            MqttSession &session = i < started ? nodes[i]->session() : controller.session();
+            if (!session.isOpen())
+                continue;
+            fds.push_back({session.fd(), (short)(POLLIN | (session.wantsWrite() ? POLLOUT : 0)), 0});
+            sessions.push_back(&session);
+        }
+        if (poll(fds.data(), fds.size(), 5) > 0)
+        {
+            for (size_t i = 0; i < fds.size(); i++)
+            {
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !sessions[i]->readable(now))
+                    continue;
+                if (fds[i].revents & POLLOUT)
+                    sessions[i]->writable();
+            }
+        }
+
+        if (now - last_report >= (uint64_t)report_s * 1000)
+        {
+            float elapsed = (now - last_report) / 1000.0f;
+            mqtt_counters_t sum = totals(nodes, &online);
+            printf("%5llus  online %u/%u  publish %.0f/s  puback %.0f/s  out %.1f KB/s  commands %llu acked %llu lost %llu",
+                   (unsigned long long)(now - start) / 1000, online, c.nodes,
+                   (sum.published - previous.published) / elapsed, (sum.acked - previous.acked) / elapsed,
+                   (sum.bytes_out - previous.bytes_out) / elapsed / 1024,
+                   (unsigned long long)controller.sentCount(), (unsigned long long)controller.ackedCount(),
+                   (unsigned long long)controller.lostCount());
+            printLatency(controller.takeWindow());
+            printf("\n");
+            fflush(stdout);
+            previous = sum;
+            last_report = now;
+        }
+    }
+
+    // graceful disconnect: the wills are not published
+    for (auto &node : nodes)
+    {
+        node->session().disconnect();
+        node->session().writable();
+    }
+
+    float elapsed = (nowMs() - start) / 1000.0f;
+    mqtt_counters_t sum = totals(nodes, &online);
+    printf("\ntotal %.0f s: %llu publishes (%.0f/s), %llu pubacks, %.1f MB out, %llu commands, %llu acked, %llu lost\n",
+           elapsed, (unsigned long long)sum.published, sum.published / elapsed, (unsigned long long)sum.acked,
+           sum.bytes_out / 1048576.0f, (unsigned long long)controller.sentCount(),
+           (unsigned long long)controller.ackedCount(), (unsigned long long)controller.lostCount());
+    printLatency(controller.all());
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,301 @@
+#include "mqtt_session.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_PINGREQ 0xC0
+#define MQTT_DISCONNECT 0xE0
+
+static void putU16(std::string &s, uint16_t value)
+{
+    s.push_back((char)(value >> 8));
+    s.push_back((char)(value & 0xFF));
+}
+
+static void putString(std::string &s, const char *value, size_t length)
+{
+    putU16(s, (uint16_t)length);
+    s.append(value, length);
+}
+
+static void putString(std::string &s, const std::string &value)
+{
+    putString(s, value.data(), value.size());
+}
+
+MqttSession::MqttSession()
+    : sock(-1), connecting(false), accepted(false), closing(false), keep_alive_s(0), packet_id(0),
+      last_out_ms(0), out_pos(0), received_flags(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+MqttSession::~MqttSession()
+{
+    close();
+}
+
+bool MqttSession::open(const sockaddr_in &broker, const char *client_id, const char *username, const char *password,
+                       uint16_t keep_alive, bool clean_session, const mqtt_will_t *will, uint64_t now_ms)
+{
+    close();
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+        return false;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    if (connect(sock, (const sockaddr *)&broker, sizeof(broker)) < 0 && errno != EINPROGRESS)
+    {
+        close();
+        return false;
+    }
+    connecting = true;
+    keep_alive_s = keep_alive;
+    last_out_ms = now_ms;
+
+    uint8_t flags = clean_session ? 0x02 : 0x00;
+    if (username && username[0])
+        flags |= 0x80;
+    if (password && password[0])
+        flags |= 0x40;
+    if (will)
+        flags |= 0x04 | (will->qos << 3) | (will->retained ? 0x20 : 0x00);
+
+    std::string body;
+    putString(body, "MQTT", 4);
+    body.push_back(4); // protocol level 3.1.1
+    body.push_back((char)flags);
+    putU16(body, keep_alive);
+    putString(body, client_id, strlen(client_id));
+    if (will)
+    {
+        putString(body, will->topic);
+        putString(body, will->payload);
+    }
+    if (flags & 0x80)
+        putString(body, username, strlen(username));
+    if (flags & 0x40)
+        putString(body, password, strlen(password));
+    queue(MQTT_CONNECT, body);
+    return true;
+}
+
+void MqttSession::disconnect()
+{
+    if (sock < 0)
+        return;
+    queue(MQTT_DISCONNECT, std::string());
+    closing = true;
+}
+
+void MqttSession::close()
+{
+    if (sock >= 0)
+        ::close(sock);
+    sock = -1;
+    connecting = false;
+    accepted = false;
+    closing = false;
+    out.clear();
+    out_pos = 0;
+    in.clear();
+}
+
+void MqttSession::publish(const std::string &topic, const char *payload, size_t length, uint8_t qos, bool retained)
+{
+    if (sock < 0)
+        return;
+    std::string body;
+    putString(body, topic);
+    if (qos > 0)
+        putU16(body, nextPacketId());
+    body.append(payload, length);
+    queue(MQTT_PUBLISH | (qos > 0 ? 0x02 : 0x00) | (retained ? 0x01 : 0x00), body);
+    stats.published++;
+}
+
+void MqttSession::subscribe(const std::string &topic, uint8_t qos)
+{
+    if (sock < 0)
+        return;
+    std::string body;
+    putU16(body, nextPacketId());
+    putString(body, topic);
+    body.push_back((char)qos);
+    queue(MQTT_SUBSCRIBE, body);
+}
+
+void MqttSession::keepAlive(uint64_t now_ms)
+{
+    if (!accepted || keep_alive_s == 0 || now_ms - last_out_ms < (uint64_t)keep_alive_s * 500)
+        return;
+    queue(MQTT_PINGREQ, std::string());
+    last_out_ms = now_ms;
+}
+
+bool MqttSession::readable(uint64_t now_ms)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+        if (n > 0)
+        {
+            in.append(buffer, n);
+            stats.bytes_in += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        close(); // closed by the broker or error
+        return false;
+    }
+    if (!parse(now_ms))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool MqttSession::writable()
+{
+    if (connecting)
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+        {
+            close();
+            return false;
+        }
+        connecting = false;
+    }
+    while (out_pos < out.size())
+    {
+        ssize_t n = send(sock, out.data() + out_pos, out.size() - out_pos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            close();
+            return false;
+        }
+        out_pos += n;
+        stats.bytes_out += n;
+    }
+    out.clear();
+    out_pos = 0;
+    if (closing)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MqttSession::queue(uint8_t header, const std::string &body)
+{
+    // compact the buffer once the written part dominates
+    if (out_pos > 0 && out_pos >= out.size() / 2)
+    {
+        out.erase(0, out_pos);
+        out_pos = 0;
+    }
+    out.push_back((char)header);
+    size_t length = body.size();
+    do
+    {
+        uint8_t digit = length % 128;
+        length /= 128;
+        out.push_back((char)(length > 0 ? digit | 0x80 : digit));
+    } while (length > 0);
+    out.append(body);
+}
+
+bool MqttSession::parse(uint64_t now_ms)
+{
+    size_t pos = 0;
+    while (in.size() - pos >= 2)
+    {
+        // fixed header: type and flags, then the remaining length (1-4 bytes)
+        uint8_t header = (uint8_t)in[pos];
+        size_t length = 0, multiplier = 1, i = pos + 1;
+        bool complete = false;
+        for (; i < in.size() && i < pos + 5; i++)
+        {
+            uint8_t digit = (uint8_t)in[i];
+            length += (digit & 0x7F) * multiplier;
+            multiplier *= 128;
+            if (!(digit & 0x80))
+            {
+                complete = true;
+                i++;
+                break;
+            }
+        }
+        if (!complete)
+        {
+            if (i == pos + 5)
+                return false; // malformed length
+            break;
+        }
+        if (in.size() - i < length)
+            break; // wait for the rest of the packet
+        const char *body = in.data() + i;
+
+        switch (header & 0xF0)
+        {
+        case MQTT_CONNACK:
+            if (length < 2 || body[1] != 0)
+                return false; // refused
+            accepted = true;
+            last_out_ms = now_ms;
+            break;
+        case MQTT_PUBACK:
+            stats.acked++;
+            break;
+        case MQTT_PUBLISH:
+        {
+            uint8_t qos = (header >> 1) & 0x03;
+            if (length < 2)
+                return false;
+            size_t topic_length = ((uint8_t)body[0] << 8) | (uint8_t)body[1];
+            size_t offset = 2 + topic_length + (qos > 0 ? 2 : 0);
+            if (offset > length)
+                return false;
+            std::string topic(body + 2, topic_length);
+            if (qos > 0)
+            {
+                std::string ack(body + 2 + topic_length, 2);
+                queue(MQTT_PUBACK, ack);
+            }
+            stats.received++;
+            received_flags = header & 0x0F;
+            if (message_handler)
+                message_handler(topic, body + offset, length - offset);
+            if (sock < 0)
+                return true; // closed by the handler
+            break;
+        }
+        default:
+            break; // SUBACK, PINGRESP
+        }
+        pos = i + length;
+    }
+    in.erase(0, pos);
+    return true;
+}
+
+uint16_t MqttSession::nextPacketId()
+{
+    packet_id = packet_id == 0xFFFF ? 1 : packet_id + 1;
+    return packet_id;
+}
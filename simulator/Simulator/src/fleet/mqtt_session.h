@@ -0,0 +1,90 @@
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+
+#include <netinet/in.h>
+
+// Minimal non-blocking MQTT 3.1.1 client for the fleet simulator.
+// One session per socket, driven by the event loop: the loop polls fd()
+// for reading (and for writing while wantsWrite()), then calls
+// readable()/writable(). Packets are queued in an output buffer, so a
+// publish never blocks; QoS 1 is sent but not retransmitted, the
+// simulator only counts the PUBACKs.
+
+typedef struct mqtt_will
+{
+    std::string topic;
+    std::string payload;
+    uint8_t qos;
+    bool retained;
+} mqtt_will_t;
+
+typedef struct mqtt_counters
+{
+    uint64_t published; // PUBLISH packets queued
+    uint64_t acked;     // PUBACKs received for them
+    uint64_t received;  // PUBLISH packets received
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+} mqtt_counters_t;
+
+class MqttSession
+{
+public:
+    typedef std::function<void(const std::string &topic, const char *payload, size_t length)> handler_t;
+
+    MqttSession();
+    ~MqttSession();
+
+    void onMessage(handler_t handler) { message_handler = handler; }
+
+    // Start a non-blocking TCP connection and queue the CONNECT packet
+    bool open(const sockaddr_in &broker, const char *client_id, const char *username, const char *password,
+              uint16_t keep_alive, bool clean_session, const mqtt_will_t *will, uint64_t now_ms);
+    // Queue DISCONNECT and close once it is written
+    void disconnect();
+    void close();
+
+    void publish(const std::string &topic, const char *payload, size_t length, uint8_t qos, bool retained);
+    void subscribe(const std::string &topic, uint8_t qos);
+    // Send PINGREQ when the keep alive is half elapsed
+    void keepAlive(uint64_t now_ms);
+
+    // Event loop hooks, false once the connection is lost
+    bool readable(uint64_t now_ms);
+    bool writable();
+
+    int fd() const { return sock; }
+    bool isOpen() const { return sock >= 0; }
+    bool connected() const { return accepted; } // CONNACK received with return code 0
+    bool wantsWrite() const { return out_pos < out.size() || connecting; }
+    const mqtt_counters_t &counters() const { return stats; }
+    // Fixed header flags of the PUBLISH being handled (bit 0 retain, bits 1-2 QoS)
+    uint8_t receivedFlags() const { return received_flags; }
+
+private:
+    void queue(uint8_t header, const std::string &body);
+    bool parse(uint64_t now_ms);
+    uint16_t nextPacketId();
+
+    int sock;
+    bool connecting; // TCP handshake in progress
+    bool accepted;
+    bool closing;
+    uint16_t keep_alive_s;
+    uint16_t packet_id;
+    uint64_t last_out_ms;
+    std::string out;
+    size_t out_pos;
+    std::string in;
+    handler_t message_handler;
+    uint8_t received_flags;
+    mqtt_counters_t stats;
+};
+
+#endif
@@ -0,0 +1,450 @@
+#include "virtual_node.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <ArduinoJson.h>
+
+#define FIRMWARE_VERSION "sim"
+#define MQTT_TOPIC_SETUP "unishare/devices/setup"
+#define MQTT_TOPIC_OTA "unishare/ota/announce"
+#define MQTT_TOPIC_TIME "unishare/time"
+#define RECONNECT_DELAY 1000 // ms
+
+static const int metric_temperature = SimSensors::metricIndex("temperature");
+static const int metric_humidity = SimSensors::metricIndex("humidity");
+static const int metric_comfort = SimSensors::metricIndex("apparent_temperature");
+static const int metric_light = SimSensors::metricIndex("light");
+static const int metric_flame = SimSensors::metricIndex("flame");
+
+VirtualNode *VirtualNode::applying = nullptr;
+
+static uint64_t epochMs()
+{
+    // the simulated clocks are always synced
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t micros64()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+VirtualNode::VirtualNode(uint32_t index, const fleet_config_t &config)
+    : c(config), seed(index * 2654435761u + 1), running(false), retry_at(0), next_sample(0), next_log(0),
+      next_ac_control(0), flame_until(0), log_cycles(0), light_state("off"), ac_mode("off"), ac_temp(0),
+      temp_read(false), ack_queue_n(0)
+{
+    // locally administered MACs, formatted like clearMacAddress()
+    char mac[16];
+    snprintf(mac, sizeof(mac), "02%010X", index);
+    clean_mac_address = mac;
+    client_id = "sim-" + clean_mac_address;
+    sensors_topic = "unishare/sensors/" + clean_mac_address + "/";
+    light_control_topic = "unishare/control/" + clean_mac_address + "/light";
+    ac_control_topic = "unishare/control/" + clean_mac_address + "/ac";
+    status_topic = "unishare/devices/status/" + clean_mac_address;
+    ack_topic = "unishare/acks/" + clean_mac_address;
+    state_topic = "unishare/state/" + clean_mac_address;
+    interlock_topic = "unishare/interlock/" + clean_mac_address;
+
+    // every node in its own room
+    temperature = uniform(18, 30);
+    humidity = uniform(35, 65);
+    light = uniform(200, 1023);
+    memset(data_events, 0, sizeof(data_events));
+    if (uniform(0, 1) < c.ac_auto_share)
+    {
+        ac_mode = "auto";
+        ac_temp = 24;
+    }
+
+    interlock.begin(interlockApply, SimSensors::metricIndex);
+    interlock_table_t table;
+    interlockDefaults(table);
+    interlock.load(table);
+
+    mqtt.onMessage([this](const std::string &topic, const char *payload, size_t length)
+                   { messageReceived(topic, payload, length); });
+}
+
+void VirtualNode::start(uint64_t now_ms)
+{
+    if (mqtt.isOpen() || now_ms < retry_at)
+        return;
+    running = false;
+    retry_at = now_ms + RECONNECT_DELAY;
+
+    mqtt_will_t will;
+    will.topic = status_topic;
+    will.payload = "{\"connected\":false}";
+    will.qos = c.delivery[MSG_STATUS].qos;
+    will.retained = c.delivery[MSG_STATUS].retained;
+    mqtt.open(c.broker, client_id.c_str(), c.username, c.password, c.log_ms / 1000 + 2, false, &will, now_ms);
+}
+
+void VirtualNode::tick(uint64_t now_ms)
+{
+    if (!mqtt.isOpen())
+    {
+        running = false;
+        start(now_ms);
+        return;
+    }
+    if (!mqtt.connected())
+        return;
+    if (!running)
+        connected(now_ms);
+
+    if (now_ms >= next_sample)
+    {
+        next_sample = now_ms + c.sample_ms;
+        sample(now_ms);
+    }
+    if (interlock.pending())
+        sendInterlockEvents();
+
+    if (ac_mode == "auto" && temp_read && !interlock.locked(INTERLOCK_AC) && now_ms >= next_ac_control)
+    {
+        next_ac_control = now_ms + c.ac_control_ms;
+        acAutoControl();
+    }
+    if (now_ms >= next_log)
+    {
+        next_log = now_ms + c.log_ms;
+        log();
+    }
+
+    applyCommands();
+    sendCommandAcks();
+    mqtt.keepAlive(now_ms);
+}
+
+void VirtualNode::connected(uint64_t now_ms)
+{
+    running = true;
+    mqtt.subscribe(light_control_topic, 1);
+    mqtt.subscribe(ac_control_topic, 1);
+    mqtt.subscribe("unishare/control/" + clean_mac_address + "/ota", 1);
+    mqtt.subscribe(MQTT_TOPIC_OTA, 1);
+    mqtt.subscribe("unishare/config/" + clean_mac_address, 1);
+    mqtt.subscribe("unishare/control/" + clean_mac_address + "/interlock", 1);
+    mqtt.subscribe("unishare/control/" + clean_mac_address + "/rules", 1);
+    mqtt.subscribe(MQTT_TOPIC_TIME, 0);
+
+    if (c.setup)
+    {
+        StaticJsonDocument<256> doc;
+        doc["mac_address"] = clean_mac_address;
+        doc["type"] = "sensors";
+        doc["name"] = client_id;
+        char buffer[256];
+        size_t n = serializeJson(doc, buffer);
+        mqtt.publish(MQTT_TOPIC_SETUP, buffer, n, 1, false);
+    }
+    sendStatus();
+    sendStateDigest();
+
+    // spread the fleet over the sampling and log periods
+    next_sample = now_ms + random() % c.sample_ms;
+    if (next_log == 0)
+        next_log = now_ms + random() % c.log_ms;
+}
+
+void VirtualNode::messageReceived(const std::string &topic, const char *payload, size_t length)
+{
+    // Same handling as mqttMessageReceived() for the actuators, the other
+    // control topics are only subscribed
+    if (topic == light_control_topic)
+        offerCommand("light", light_commands, payload, length);
+    else if (topic == ac_control_topic)
+        offerCommand("ac", ac_commands, payload, length);
+}
+
+void VirtualNode::offerCommand(const char *actuator, CommandSlot &slot, const char *payload, size_t length)
+{
+    uint64_t received_at = micros64();
+    bool light = &slot == &light_commands;
+    const std::string &state = light ? light_state : ac_mode;
+    command_t command;
+    if (!commandParse(payload, length, command) || command.control == COMMAND_UNKNOWN ||
+        (light && command.control == COMMAND_AUTO))
+    {
+        queueCommandAck(actuator, command.id, state, false, NULL, received_at);
+        return;
+    }
+    command.received_at = received_at;
+
+    command_t replaced;
+    switch (slot.offer(command, replaced))
+    {
+    case COMMAND_STALE:
+        queueCommandAck(actuator, command.id, state, false, "stale", received_at);
+        break;
+    case COMMAND_SUPERSEDED:
+        queueCommandAck(actuator, replaced.id, state, false, "superseded", replaced.received_at);
+        break;
+    default:
+        break;
+    }
+}
+
+void VirtualNode::applyCommands()
+{
+    command_t command;
+    if (light_commands.take(command))
+    {
+        bool applied = !interlock.locked(INTERLOCK_LIGHT);
+        if (applied)
+            setLight(command.control == COMMAND_ON);
+        queueCommandAck("light", command.id, light_state, applied, NULL, command.received_at);
+    }
+    if (ac_commands.take(command))
+    {
+        bool applied = !interlock.locked(INTERLOCK_AC);
+        if (applied && command.control == COMMAND_AUTO)
+        {
+            ac_mode = "auto";
+            ac_temp = command.temp;
+            ac_previous_state = "";
+        }
+        else if (applied)
+            setAc(command.control == COMMAND_ON);
+        queueCommandAck("ac", command.id, ac_mode, applied, NULL, command.received_at);
+    }
+}
+
+void VirtualNode::sample(uint64_t now_ms)
+{
+    // slow random walks, the AC pulls the temperature down
+    temperature += uniform(-0.05f, 0.05f) + (ac_mode == "on" || ac_previous_state == "on" ? -0.05f : 0.02f);
+    humidity += uniform(-0.2f, 0.2f);
+    humidity = humidity < 20 ? 20 : humidity > 90 ? 90 : humidity;
+    light += uniform(-20, 20);
+    light = light < 0 ? 0 : light > 1023 ? 1023 : light;
+
+    // flames start as a Poisson process and last flame_ms
+    float p = c.flames_per_hour * c.sample_ms / 3600000.0f;
+    if (flame_until == 0 && uniform(0, 1) < p)
+        flame_until = now_ms + c.flame_ms;
+    else if (flame_until != 0 && now_ms >= flame_until)
+        flame_until = 0;
+
+    float values[SimSensors::METRICS];
+    values[metric_temperature] = temperature;
+    values[metric_humidity] = humidity;
+    comfortValues((int16_t)lroundf(temperature * 10), (uint16_t)lroundf(humidity * 10), values + metric_comfort);
+    values[metric_light] = light;
+    values[metric_flame] = flame_until != 0 ? 1 : 0;
+
+    for (uint8_t m = 0; m < SimSensors::METRICS; m++)
+    {
+        // local reaction first, reports go out afterwards
+        applying = this;
+        interlock.update(m, values[m]);
+        applying = nullptr;
+
+        metric_info_t info = SimSensors::metric(m);
+        if (m == metric_temperature)
+            temp_read = true;
+        if (info.kind != METRIC_EVENT)
+        {
+            windows[m].add(values[m]);
+            continue;
+        }
+        bool active = values[m] != 0;
+        if (active == data_events[m])
+            continue;
+        data_events[m] = active;
+        sendValue(info.name, active, MSG_ALARM);
+    }
+}
+
+void VirtualNode::log()
+{
+    // plain telemetry, except for a periodic retained snapshot
+    message_class_t telemetry = (log_cycles % c.snapshot_every == 0) ? MSG_SNAPSHOT : MSG_TELEMETRY;
+    log_cycles++;
+
+    sendValue("rssi", -50 - (int)(random() % 30), telemetry);
+    for (uint8_t m = 0; m < SimSensors::METRICS; m++)
+    {
+        metric_info_t info = SimSensors::metric(m);
+        if (info.kind == METRIC_EVENT || windows[m].count() == 0)
+            continue;
+        sendWindow(info.name, info.kind == METRIC_LEVEL, windows[m], telemetry);
+        windows[m].reset();
+    }
+}
+
+void VirtualNode::publish(const std::string &topic, const char *payload, size_t length, message_class_t message_class)
+{
+    const delivery_policy_t &policy = c.delivery[message_class];
+    mqtt.publish(topic, payload, length, policy.qos, policy.retained);
+}
+
+void VirtualNode::sendValue(const char *attribute, double value, message_class_t message_class)
+{
+    StaticJsonDocument<128> doc;
+    if (message_class == MSG_ALARM)
+        doc["value"] = value != 0; // events are booleans
+    else
+        doc["value"] = value;
+    doc["ts"] = epochMs();
+    char buffer[128];
+    size_t n = serializeJson(doc, buffer);
+    publish(sensors_topic + attribute, buffer, n, message_class);
+}
+
+void VirtualNode::sendWindow(const char *attribute, bool level, Aggregator &window, message_class_t message_class)
+{
+    StaticJsonDocument<256> doc;
+    if (level)
+        doc["value"] = window.mean() >= c.photoresistor_threshold;
+    else
+        doc["value"] = window.mean();
+    doc["min"] = window.min();
+    doc["max"] = window.max();
+    doc["mean"] = window.mean();
+    doc["stddev"] = window.stddev();
+    doc["count"] = window.count();
+    doc["ts"] = epochMs();
+    char buffer[256];
+    size_t n = serializeJson(doc, buffer);
+    publish(sensors_topic + attribute, buffer, n, message_class);
+}
+
+void VirtualNode::sendStatus()
+{
+    StaticJsonDocument<256> doc;
+    doc["connected"] = true;
+    doc["version"] = FIRMWARE_VERSION;
+    doc["clock"] = "sntp";
+    doc["clock_age"] = 0;
+    doc["tls"] = false;
+    doc["connect_ms"] = 0;
+    char buffer[256];
+    size_t n = serializeJson(doc, buffer);
+    publish(status_topic, buffer, n, MSG_STATUS);
+}
+
+void VirtualNode::sendStateDigest()
+{
+    StaticJsonDocument<256> doc;
+    doc["light"] = light_state;
+    doc["ac"] = ac_mode;
+    if (ac_mode == "auto")
+    {
+        doc["ac_temp"] = ac_temp;
+        doc["ac_state"] = ac_previous_state;
+    }
+    doc["light_locked"] = interlock.locked(INTERLOCK_LIGHT);
+    doc["ac_locked"] = interlock.locked(INTERLOCK_AC);
+    JsonObject commands = doc.createNestedObject("commands");
+    commands["superseded"] = light_commands.superseded() + ac_commands.superseded();
+    commands["stale"] = light_commands.stale() + ac_commands.stale();
+    char buffer[224];
+    size_t n = serializeJson(doc, buffer);
+    publish(state_topic, buffer, n, MSG_STATUS);
+}
+
+void VirtualNode::sendInterlockEvents()
+{
+    interlock_event_t event;
+    while (interlock.pollEvent(event))
+    {
+        const interlock_rule_t &rule = interlock.table().rules[event.rule];
+        StaticJsonDocument<256> doc;
+        doc["rule"] = event.rule;
+        doc["metric"] = rule.metric;
+        doc["value"] = event.value;
+        doc["active"] = event.active;
+        if (rule.action[INTERLOCK_LIGHT] != INTERLOCK_KEEP)
+            doc["light"] = interlockActionName(rule.action[INTERLOCK_LIGHT]);
+        if (rule.action[INTERLOCK_AC] != INTERLOCK_KEEP)
+            doc["ac"] = interlockActionName(rule.action[INTERLOCK_AC]);
+        doc["ts"] = epochMs();
+        char buffer[256];
+        size_t n = serializeJson(doc, buffer);
+        publish(interlock_topic, buffer, n, MSG_ALARM);
+    }
+    sendStateDigest();
+}
+
+void VirtualNode::queueCommandAck(const char *actuator, const char *id, const std::string &state, bool applied,
+                                  const char *dropped, uint64_t received_us)
+{
+    if (ack_queue_n >= SIM_ACK_QUEUE_SIZE - (dropped ? SIM_ACK_QUEUE_RESERVED : 0))
+        return; // as on the node, the state digest still reports the outcome
+    auto &ack = ack_queue[ack_queue_n++];
+    ack.actuator = actuator;
+    snprintf(ack.id, sizeof(ack.id), "%s", id);
+    snprintf(ack.state, sizeof(ack.state), "%s", state.c_str());
+    ack.applied = applied;
+    ack.dropped = dropped;
+    ack.latency_us = micros64() - received_us;
+}
+
+void VirtualNode::sendCommandAcks()
+{
+    for (int i = 0; i < ack_queue_n; i++)
+    {
+        auto &ack = ack_queue[i];
+        StaticJsonDocument<128> doc;
+        if (ack.id[0] != '\0')
+            doc["id"] = ack.id;
+        doc["state"] = ack.state;
+        doc["applied"] = ack.applied;
+        if (ack.dropped)
+            doc["dropped"] = ack.dropped;
+        doc["latency_us"] = ack.latency_us;
+        char buffer[128];
+        size_t n = serializeJson(doc, buffer);
+        publish(ack_topic + "/" + ack.actuator, buffer, n, MSG_ACK);
+    }
+    ack_queue_n = 0;
+}
+
+void VirtualNode::setLight(bool on)
+{
+    light_state = on ? "on" : "off";
+}
+
+void VirtualNode::setAc(bool on)
+{
+    ac_mode = on ? "on" : "off";
+}
+
+void VirtualNode::acAutoControl()
+{
+    ac_previous_state = temperature >= ac_temp ? "on" : "off";
+}
+
+void VirtualNode::interlockApply(interlock_actuator_t actuator, bool on)
+{
+    if (!applying)
+        return;
+    if (actuator == INTERLOCK_LIGHT)
+        applying->setLight(on);
+    else
+        applying->setAc(on);
+}
+
+uint32_t VirtualNode::random()
+{
+    // xorshift32, every node has its own reproducible sequence
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+float VirtualNode::uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (random() / 4294967296.0f);
+}
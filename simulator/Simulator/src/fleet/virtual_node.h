@@ -0,0 +1,139 @@
+#ifndef VIRTUAL_NODE_H
+#define VIRTUAL_NODE_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <aggregator.h>
+#include <command_slot.h>
+#include <interlock.h>
+#include <mqtt_policy.h>
+#include <sensor_set.h>
+#include <dht11.h>
+#include <photoresistor.h>
+#include <flame.h>
+
+#include "mqtt_session.h"
+
+// Readings are synthesized, the drivers only describe the metrics so that
+// topics and windows are the ones of the sensors firmware
+struct NoGpio
+{
+};
+typedef SensorSet<Dht11<NoGpio>, Photoresistor<NoGpio>, FlameDetector<NoGpio>> SimSensors;
+
+typedef struct fleet_config
+{
+    sockaddr_in broker;
+    const char *username;
+    const char *password;
+    uint32_t nodes;
+    uint32_t log_ms;        // log_delay
+    uint32_t sample_ms;     // sample_delay
+    uint32_t ac_control_ms; // ac_control_delay
+    uint16_t snapshot_every;
+    uint16_t photoresistor_threshold;
+    float flames_per_hour;  // per node
+    uint32_t flame_ms;      // duration of a flame
+    float ac_auto_share;    // share of the nodes starting with the AC in auto mode
+    bool setup;             // send the setup message (registers the node in the daemon)
+    delivery_policy_t delivery[MSG_CLASS_N];
+} fleet_config_t;
+
+// One simulated sensors node: same topics, payloads, delivery policy,
+// interlock and command handling as sensors/Sensors/src/main.cpp, driven
+// by the fleet event loop instead of loop()
+class VirtualNode
+{
+public:
+    VirtualNode(uint32_t index, const fleet_config_t &config);
+
+    const std::string &mac() const { return clean_mac_address; }
+    MqttSession &session() { return mqtt; }
+    bool online() const { return running; }
+
+    // Connect (or reconnect after a failure)
+    void start(uint64_t now_ms);
+    // Sampling, log windows, AC control and reports due at now
+    void tick(uint64_t now_ms);
+
+private:
+    void connected(uint64_t now_ms);
+    void messageReceived(const std::string &topic, const char *payload, size_t length);
+    void sample(uint64_t now_ms);
+    void log();
+    void publish(const std::string &topic, const char *payload, size_t length, message_class_t message_class);
+    void sendValue(const char *attribute, double value, message_class_t message_class);
+    void sendWindow(const char *attribute, bool level, Aggregator &window, message_class_t message_class);
+    void sendStatus();
+    void sendStateDigest();
+    void sendInterlockEvents();
+    void offerCommand(const char *actuator, CommandSlot &slot, const char *payload, size_t length);
+    void applyCommands();
+    void queueCommandAck(const char *actuator, const char *id, const std::string &state, bool applied,
+                         const char *dropped, uint64_t received_us);
+    void sendCommandAcks();
+    void setLight(bool on);
+    void setAc(bool on);
+    void acAutoControl();
+    uint32_t random();
+    float uniform(float lo, float hi);
+
+    static void interlockApply(interlock_actuator_t actuator, bool on);
+    static VirtualNode *applying; // node running its interlock (the callback has no context)
+
+    const fleet_config_t &c;
+    uint32_t seed;
+    MqttSession mqtt;
+    bool running;
+    uint64_t retry_at;
+
+    std::string clean_mac_address;
+    std::string client_id;
+    std::string sensors_topic;
+    std::string light_control_topic;
+    std::string ac_control_topic;
+    std::string status_topic;
+    std::string ack_topic;
+    std::string state_topic;
+    std::string interlock_topic;
+
+    uint64_t next_sample;
+    uint64_t next_log;
+    uint64_t next_ac_control;
+    uint64_t flame_until;
+    uint32_t log_cycles;
+
+    // simulated environment
+    float temperature;
+    float humidity;
+    float light;
+
+    Aggregator windows[SimSensors::METRICS];
+    bool data_events[SimSensors::METRICS];
+    Interlock interlock;
+
+    std::string light_state;
+    std::string ac_mode;
+    std::string ac_previous_state;
+    double ac_temp;
+    bool temp_read;
+    CommandSlot light_commands;
+    CommandSlot ac_commands;
+
+#define SIM_ACK_QUEUE_SIZE 4
+#define SIM_ACK_QUEUE_RESERVED 2
+    struct
+    {
+        const char *actuator;
+        char id[COMMAND_ID_LEN];
+        char state[8];
+        bool applied;
+        const char *dropped;
+        uint64_t latency_us;
+    } ack_queue[SIM_ACK_QUEUE_SIZE];
+    int ack_queue_n;
+};
+
+#endif
@@ -0,0 +1,207 @@
+// Sizing of the reading log of the sensors node.
+// Generates days of log windows (diurnal temperature and humidity with
+// sensor noise and 1 unit resolution, the comfort metrics derived from
+// them, light level), compresses them into segments like ReadingLog does,
+// decodes every segment again and reports the bytes per record and the
+// retention of the segment ring. Exits with 1 when a decoded record differs
+// from the original.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include <log_codec.h>
+
+// As in reading_log.h
+#define SEGMENT_HEADER 20
+
+typedef struct sim_config
+{
+    uint32_t log_ms;
+    uint32_t sample_ms;
+    uint32_t days;
+    uint32_t segment_size;
+    uint32_t segments;
+    uint32_t jitter_ms; // of the log timer
+} sim_config_t;
+
+static const char *const metric_names[] = {"temperature", "humidity", "apparent_temperature", "dew_point",
+                                           "absolute_humidity", "humidex", "light"};
+#define METRICS (sizeof(metric_names) / sizeof(metric_names[0]))
+
+typedef struct record
+{
+    uint32_t ts;
+    uint32_t mask;
+    float values[LOG_MAX_METRICS];
+} record_t;
+
+static float noise()
+{
+    return (rand() % 2001 - 1000) / 1000.0f;
+}
+
+static void window(const sim_config_t &c, uint32_t ts, record_t &r)
+{
+    // mean of the samples of the window, readings rounded like the DHT11's
+    uint32_t samples = c.log_ms / c.sample_ms;
+    if (samples == 0)
+        samples = 1;
+    float day = (ts % 86400) / 86400.0f * 2 * M_PI;
+    float temperature = 0, humidity = 0, light = 0;
+    for (uint32_t s = 0; s < samples; s++)
+    {
+        temperature += roundf(21 + 3 * sinf(day - 2) + 0.4f * noise());
+        humidity += roundf(50 - 10 * sinf(day - 2) + 1.5f * noise());
+        light += roundf(fmaxf(0, 900 * sinf(day - M_PI / 2)) + 8 * noise());
+    }
+    temperature /= samples;
+    humidity /= samples;
+    light /= samples;
+
+    float gamma = logf(humidity / 100) + 17.625f * temperature / (243.04f + temperature);
+    float dew_point = 243.04f * gamma / (17.625f - gamma);
+    float vapour = 6.112f * expf(17.67f * temperature / (temperature + 243.5f)) * humidity / 100;
+    r.ts = ts;
+    r.mask = (1UL << METRICS) - 1;
+    r.values[0] = temperature;
+    r.values[1] = humidity;
+    r.values[2] = temperature + 0.33f * vapour - 4;
+    r.values[3] = dew_point;
+    r.values[4] = vapour * 100 * 2.1674f / (273.15f + temperature);
+    r.values[5] = temperature + 0.5555f * (vapour - 10);
+    r.values[6] = light;
+}
+
+static bool verify(const std::vector<uint8_t> &segment, const record_t *records, size_t n)
+{
+    log_codec_state_t codec;
+    logCodecReset(codec, records[0].ts);
+    size_t offset = SEGMENT_HEADER;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t ts, mask;
+        float values[LOG_MAX_METRICS];
+        size_t used = logDecode(codec, segment.data() + offset, segment.size() - offset, METRICS, ts, mask, values);
+        if (used == 0 || ts != records[i].ts || mask != records[i].mask)
+            return false;
+        for (uint8_t m = 0; m < METRICS; m++)
+        {
+            if (fabsf(values[m] - roundf(records[i].values[m] * LOG_SCALE) / LOG_SCALE) > 0.5f / LOG_SCALE)
+                return false;
+        }
+        offset += used;
+    }
+    return offset == segment.size();
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--log ms] [--sample ms] [--days n] [--segment-size bytes] [--segments n]\n"
+            "          [--jitter ms]\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    sim_config_t c = {60000, 10000, 7, 4096, 64, 50};
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 == argc)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        uint32_t value = strtoul(argv[i + 1], NULL, 10);
+        if (!strcmp(argv[i], "--log"))
+            c.log_ms = value;
+        else if (!strcmp(argv[i], "--sample"))
+            c.sample_ms = value;
+        else if (!strcmp(argv[i], "--days"))
+            c.days = value;
+        else if (!strcmp(argv[i], "--segment-size"))
+            c.segment_size = value;
+        else if (!strcmp(argv[i], "--segments"))
+            c.segments = value;
+        else if (!strcmp(argv[i], "--jitter"))
+            c.jitter_ms = value;
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (c.log_ms < 1000 || c.sample_ms == 0 || c.segment_size < SEGMENT_HEADER + LOG_RECORD_MAX)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // log windows, timestamps in seconds like the node stores them
+    std::vector<record_t> records;
+    uint64_t now_ms = 1700000000000ULL;
+    uint64_t end_ms = now_ms + (uint64_t)c.days * 86400000ULL;
+    while (now_ms < end_ms)
+    {
+        record_t r;
+        window(c, now_ms / 1000, r);
+        records.push_back(r);
+        now_ms += c.log_ms + (c.jitter_ms ? rand() % (c.jitter_ms + 1) : 0);
+    }
+
+    // segments, a new one when the next record might not fit
+    size_t segments = 0, bytes = 0, first = 0;
+    bool ok = true;
+    std::vector<uint8_t> segment;
+    log_codec_state_t codec;
+    for (size_t i = 0; i <= records.size(); i++)
+    {
+        if (i == records.size() || segment.empty() || segment.size() + LOG_RECORD_MAX > c.segment_size)
+        {
+            if (!segment.empty())
+            {
+                ok = ok && verify(segment, &records[first], i - first);
+                bytes += segment.size();
+                segments++;
+            }
+            if (i == records.size())
+                break;
+            segment.assign(SEGMENT_HEADER, 0);
+            logCodecReset(codec, records[i].ts);
+            first = i;
+        }
+        uint8_t out[LOG_RECORD_MAX];
+        size_t n = logEncode(codec, records[i].ts, records[i].mask, records[i].values, out);
+        segment.insert(segment.end(), out, out + n);
+    }
+
+    // what the same windows cost as raw structs and as the published JSON values
+    size_t raw = records.size() * (4 + 4 * METRICS);
+    size_t json = 0;
+    for (const record_t &r : records)
+    {
+        char payload[64];
+        for (uint8_t m = 0; m < METRICS; m++)
+            json += snprintf(payload, sizeof(payload), "{\"value\":%.2f,\"ts\":%llu}", r.values[m],
+                             (unsigned long long)r.ts * 1000);
+    }
+
+    double per_record = (double)bytes / records.size();
+    double records_per_segment = (double)records.size() / segments;
+    double retention_days = records_per_segment * c.segments * c.log_ms / 86400000.0;
+    printf("%zu windows of %zu metrics over %u days, log %u ms, sample %u ms\n", records.size(), METRICS, c.days,
+           c.log_ms, c.sample_ms);
+    printf("compressed   %8zu bytes  %6.2f bytes/record  in %zu segments of %u bytes\n", bytes, per_record,
+           segments, c.segment_size);
+    printf("raw structs  %8zu bytes  %6.2f x\n", raw, (double)raw / bytes);
+    printf("JSON values  %8zu bytes  %6.2f x\n", json, (double)json / bytes);
+    printf("retention    %8.1f days in %u segments (%u KB of flash)\n", retention_days, c.segments,
+           c.segments * c.segment_size / 1024);
+    printf("%s\n", ok ? "decoded records match" : "DECODE MISMATCH");
+    return ok ? 0 : 1;
+}
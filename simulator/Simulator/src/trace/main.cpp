@@ -0,0 +1,520 @@
+// MQTT trace capture and deterministic replay through the firmware handlers.
+//
+//   record  subscribes to the broker and writes every message with its
+//           arrival time, retain flag and QoS to a compact trace file
+//   replay  feeds a trace through the handlers of the screen and sensors
+//           node firmwares (DeviceTable, Actuators, interlock and rules
+//           updates, dispatched by ScreenModel and SensorsModel) on the
+//           host, in real time, faster (--speed 10) or as fast as possible
+//           (--speed 0), and reports the handler time, stack and heap of
+//           every kind of message, and of the display refreshes they
+//           trigger. Actuator commands are applied at control ticks
+//           --control ms apart, like the node coalesces them between two
+//           MQTT polls. Budgets (--max-us, --max-stack, --max-heap, and the
+//           JSON arena) make it exit with 1 when exceeded, so recorded
+//           production bursts can run as regression tests.
+//   synth   writes the burst a screen gets when it connects: retained
+//           registry snapshot, statuses and readings of every device
+//
+//   .pio/build/trace/program record --broker 127.0.0.1 --out evening.trc --duration 3600
+//   .pio/build/trace/program replay evening.trc --speed 0 --max-us 2000
+
+#include <math.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <json_arena.h>
+
+#include "../fleet/mqtt_session.h"
+#include "probe.h"
+#include "screen_model.h"
+#include "sensors_model.h"
+#include "trace_file.h"
+
+#define BURST_WINDOW_MS 1000
+
+static volatile bool stop = false;
+
+static void onSignal(int)
+{
+    stop = true;
+}
+
+static uint64_t nowMs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t epochMs()
+{
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s record --out file [--broker host] [--port n] [--username u] [--password p]\n"
+            "                 [--topic filter] [--duration s]\n"
+            "       %s replay file [--speed x] [--node mac] [--history-slot ms] [--refresh ms]\n"
+            "                 [--control ms] [--max-us n] [--max-stack bytes] [--max-heap bytes]\n"
+            "       %s synth --out file [--devices n] [--minutes n] [--log ms]\n",
+            program, program, program);
+}
+
+// Options as --name value pairs after the command (and its positional argument)
+static const char *option(int argc, char **argv, int first, const char *name, const char *fallback)
+{
+    for (int i = first; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], name))
+            return argv[i + 1];
+    }
+    return fallback;
+}
+
+static int record(int argc, char **argv)
+{
+    const char *out = option(argc, argv, 2, "--out", NULL);
+    const char *host = option(argc, argv, 2, "--broker", "127.0.0.1");
+    uint16_t port = atoi(option(argc, argv, 2, "--port", "1883"));
+    const char *username = option(argc, argv, 2, "--username", "");
+    const char *password = option(argc, argv, 2, "--password", "");
+    const char *filter = option(argc, argv, 2, "--topic", "unishare/#");
+    uint32_t duration_s = strtoul(option(argc, argv, 2, "--duration", "0"), NULL, 10);
+    if (!out)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0)
+    {
+        fprintf(stderr, "unknown broker host %s\n", host);
+        return 1;
+    }
+    sockaddr_in broker = *(sockaddr_in *)result->ai_addr;
+    broker.sin_port = htons(port);
+    freeaddrinfo(result);
+
+    uint64_t start = nowMs();
+    TraceWriter writer;
+    if (!writer.open(out, epochMs()))
+    {
+        fprintf(stderr, "can't write %s\n", out);
+        return 1;
+    }
+
+    MqttSession mqtt;
+    mqtt.onMessage([&](const std::string &topic, const char *payload, size_t length)
+                   { writer.write(nowMs() - start, mqtt.receivedFlags(), topic, payload, length); });
+    char client_id[32];
+    snprintf(client_id, sizeof(client_id), "trace-%d", (int)getpid());
+    if (!mqtt.open(broker, client_id, username, password, 60, true, nullptr, start))
+    {
+        fprintf(stderr, "can't connect to %s:%u\n", host, port);
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    bool subscribed = false;
+    uint64_t last_report = start;
+    while (!stop && (duration_s == 0 || nowMs() - start < (uint64_t)duration_s * 1000))
+    {
+        uint64_t now = nowMs();
+        if (!mqtt.isOpen())
+        {
+            fprintf(stderr, "connection lost\n");
+            break;
+        }
+        if (mqtt.connected() && !subscribed)
+        {
+            mqtt.subscribe(filter, 1); // QoS 1 keeps the QoS of the publishers (up to 1)
+            subscribed = true;
+        }
+        mqtt.keepAlive(now);
+
+        pollfd fd = {mqtt.fd(), (short)(POLLIN | (mqtt.wantsWrite() ? POLLOUT : 0)), 0};
+        if (poll(&fd, 1, 100) > 0)
+        {
+            if ((fd.revents & (POLLIN | POLLHUP | POLLERR)) && !mqtt.readable(now))
+                continue;
+            if (fd.revents & POLLOUT)
+                mqtt.writable();
+        }
+        if (now - last_report >= 10000)
+        {
+            printf("%5llus  %llu messages, %llu KB\n", (unsigned long long)(now - start) / 1000,
+                   (unsigned long long)writer.messages(), (unsigned long long)writer.bytes() / 1024);
+            fflush(stdout);
+            last_report = now;
+        }
+    }
+    mqtt.disconnect();
+    mqtt.writable();
+    writer.close();
+    printf("%llu messages in %.0f s, %llu bytes\n", (unsigned long long)writer.messages(),
+           (nowMs() - start) / 1000.0f, (unsigned long long)writer.bytes());
+    return 0;
+}
+
+// Statistics of one kind of handler call
+struct HandlerStats
+{
+    std::vector<uint32_t> us;
+    size_t stack = 0;
+    size_t heap = 0;
+
+    void add(const probe_result_t &result)
+    {
+        us.push_back((uint32_t)((result.elapsed_ns + 500) / 1000));
+        stack = std::max(stack, result.stack);
+        heap = std::max(heap, result.heap);
+    }
+
+    uint32_t maxUs() const { return us.empty() ? 0 : *std::max_element(us.begin(), us.end()); }
+
+    void print(const char *side, const char *name) const
+    {
+        if (us.empty())
+            return;
+        std::vector<uint32_t> sorted(us);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (uint32_t v : sorted)
+            sum += v;
+        auto at = [&sorted](float q)
+        { return sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))]; };
+        printf("%-8s %-14s %8zu %8.1f %8u %8u %8u %8zu %8zu\n", side, name, sorted.size(), sum / sorted.size(),
+               at(0.5f), at(0.99f), sorted.back(), stack, heap);
+    }
+};
+
+struct ScreenCall
+{
+    ScreenModel *model;
+    const trace_message_t *message;
+};
+
+struct SensorsCall
+{
+    SensorsModel *model;
+    const trace_message_t *message;
+};
+
+static void screenHandle(void *context)
+{
+    ScreenCall *call = (ScreenCall *)context;
+    call->model->handle(call->message->topic, call->message->payload.data(), call->message->payload.size());
+}
+
+static void screenRender(void *context)
+{
+    ((ScreenModel *)context)->render();
+}
+
+static void sensorsHandle(void *context)
+{
+    SensorsCall *call = (SensorsCall *)context;
+    call->model->handle(call->message->topic, call->message->payload.data(), call->message->payload.size());
+}
+
+static void sensorsApply(void *context)
+{
+    ((SensorsModel *)context)->applyCommands();
+}
+
+// MAC of the first node that gets a command in the trace
+static std::string firstControlledNode(const char *path)
+{
+    TraceReader reader;
+    trace_message_t message;
+    const std::string prefix = "unishare/control/";
+    if (!reader.open(path))
+        return "";
+    while (reader.next(message))
+    {
+        if (message.topic.compare(0, prefix.size(), prefix) != 0)
+            continue;
+        size_t end = message.topic.find('/', prefix.size());
+        if (end != std::string::npos)
+            return message.topic.substr(prefix.size(), end - prefix.size());
+    }
+    return "";
+}
+
+static int replay(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[2];
+    float speed = atof(option(argc, argv, 3, "--speed", "1"));
+    // defaults of the screen runtime config (history_slot, display_refresh_rate)
+    uint32_t history_slot = strtoul(option(argc, argv, 3, "--history-slot", "900000"), NULL, 10);
+    uint32_t refresh = strtoul(option(argc, argv, 3, "--refresh", "5000"), NULL, 10);
+    // mqtt_control_delay of the node, and the time a modem sleep cycle adds to it
+    uint32_t control = strtoul(option(argc, argv, 3, "--control", "100"), NULL, 10);
+    uint32_t max_us = strtoul(option(argc, argv, 3, "--max-us", "0"), NULL, 10);
+    size_t max_stack = strtoul(option(argc, argv, 3, "--max-stack", "0"), NULL, 10);
+    size_t max_heap = strtoul(option(argc, argv, 3, "--max-heap", "0"), NULL, 10);
+    std::string node = option(argc, argv, 3, "--node", "");
+    if (node.empty())
+        node = firstControlledNode(path);
+    if (history_slot == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(path))
+    {
+        fprintf(stderr, "%s is not a trace\n", path);
+        return 1;
+    }
+
+    ScreenModel screen(history_slot);
+    SensorsModel sensors(node);
+    HandlerStats screen_stats[SCREEN_IGNORED];
+    HandlerStats display_stats;
+    HandlerStats sensors_stats[SENSORS_HANDLERS];
+    HandlerStats control_stats;
+
+    // busiest window: handler time the screen spends in BURST_WINDOW_MS
+    std::deque<std::pair<uint64_t, uint32_t>> window;
+    uint64_t window_us = 0, burst_us = 0, burst_at = 0;
+    size_t burst_messages = 0;
+
+    signal(SIGINT, onSignal);
+    uint64_t start = nowMs();
+    uint64_t last_refresh = 0, last_control = 0;
+    uint64_t messages = 0, ignored = 0, duration_ms = 0;
+    trace_message_t message;
+    while (!stop && reader.next(message))
+    {
+        if (speed > 0)
+        {
+            uint64_t due = start + (uint64_t)(message.at_ms / speed);
+            uint64_t now = nowMs();
+            if (due > now)
+                usleep((due - now) * 1000);
+        }
+        messages++;
+        duration_ms = message.at_ms;
+
+        probe_result_t result;
+        screen_handler_t kind = screen.classify(message.topic);
+        if (kind != SCREEN_IGNORED)
+        {
+            ScreenCall call = {&screen, &message};
+            probeRun(screenHandle, &call, result);
+            screen_stats[kind].add(result);
+
+            uint32_t us = screen_stats[kind].us.back();
+            window.push_back(std::make_pair(message.at_ms, us));
+            window_us += us;
+            while (window.front().first + BURST_WINDOW_MS <= message.at_ms)
+            {
+                window_us -= window.front().second;
+                window.pop_front();
+            }
+            if (window_us > burst_us)
+            {
+                burst_us = window_us;
+                burst_messages = window.size();
+                burst_at = window.front().first;
+            }
+        }
+        else
+            ignored++;
+
+        // refreshDisplay(): on a reading of the device on display, or periodically
+        if (screen.devices() > 0 && (screen.displayStale() || message.at_ms - last_refresh > refresh))
+        {
+            probeRun(screenRender, &screen, result);
+            display_stats.add(result);
+            last_refresh = message.at_ms;
+        }
+
+        // control tick of the node before the messages of the next poll
+        if (message.at_ms - last_control > control)
+        {
+            if (sensors.commandsPending())
+            {
+                probeRun(sensorsApply, &sensors, result);
+                control_stats.add(result);
+            }
+            last_control = message.at_ms;
+        }
+
+        sensors_handler_t sensors_kind = sensors.classify(message.topic);
+        if (sensors_kind != SENSORS_IGNORED)
+        {
+            SensorsCall call = {&sensors, &message};
+            probeRun(sensorsHandle, &call, result);
+            sensors_stats[sensors_kind].add(result);
+        }
+    }
+    if (sensors.commandsPending())
+    {
+        probe_result_t result;
+        probeRun(sensorsApply, &sensors, result);
+        control_stats.add(result);
+    }
+    if (reader.failed())
+        fprintf(stderr, "warning: trace truncated after %llu messages\n", (unsigned long long)messages);
+
+    printf("%llu messages over %.1f s, replayed in %.1f s, screen table %d devices%s, node %s\n\n",
+           (unsigned long long)messages, duration_ms / 1000.0f, (nowMs() - start) / 1000.0f, screen.devices(),
+           screen.resyncRequested() ? " (resync requested)" : "", node.empty() ? "-" : node.c_str());
+    printf("%-8s %-14s %8s %8s %8s %8s %8s %8s %8s\n", "side", "handler", "calls", "mean us", "p50 us", "p99 us",
+           "max us", "stack", "heap");
+    for (uint8_t h = 0; h < SCREEN_IGNORED; h++)
+        screen_stats[h].print("screen", ScreenModel::handlerName(h));
+    display_stats.print("screen", "display");
+    for (uint8_t h = 0; h < SENSORS_IGNORED; h++)
+        sensors_stats[h].print("sensors", SensorsModel::handlerName(h));
+    control_stats.print("sensors", "control tick");
+    printf("\nnode commands: %u applied, %u superseded, %u stale\n", sensors.applied(), sensors.superseded(),
+           sensors.stale());
+    printf("%llu messages not handled by the screen, busiest %u ms: %zu messages, %.1f ms of handlers at %.1f s\n",
+           (unsigned long long)ignored, BURST_WINDOW_MS, burst_messages, burst_us / 1000.0f,
+           burst_at / 1000.0f);
+    json_arena_stats_t arena;
+    jsonArenaStats(arena);
+    printf("JSON arena: %u of %u bytes at most, largest document %u bytes, %u scopes that did not fit\n",
+           arena.peak, arena.size, arena.largest, arena.failed);
+
+    // budgets
+    bool ok = arena.failed == 0;
+    std::vector<const HandlerStats *> all;
+    for (uint8_t h = 0; h < SCREEN_IGNORED; h++)
+        all.push_back(&screen_stats[h]);
+    all.push_back(&display_stats);
+    for (uint8_t h = 0; h < SENSORS_IGNORED; h++)
+        all.push_back(&sensors_stats[h]);
+    all.push_back(&control_stats);
+    for (const HandlerStats *stats : all)
+    {
+        ok = ok && (max_us == 0 || stats->maxUs() <= max_us);
+        ok = ok && (max_stack == 0 || stats->stack <= max_stack);
+        ok = ok && (max_heap == 0 || stats->heap <= max_heap);
+    }
+    if (!ok)
+        printf("OVER BUDGET\n");
+    return ok && !reader.failed() ? 0 : 1;
+}
+
+// Reading payload of the sensors firmware (publishWindow)
+static int windowPayload(char *out, size_t size, float value, uint64_t ts)
+{
+    return snprintf(out, size,
+                    "{\"value\":%.2f,\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,\"stddev\":0.12,\"count\":12,\"ts\":%llu}",
+                    value, value - 0.3f, value + 0.3f, value, (unsigned long long)ts);
+}
+
+static int synth(int argc, char **argv)
+{
+    const char *out = option(argc, argv, 2, "--out", NULL);
+    uint32_t devices = strtoul(option(argc, argv, 2, "--devices", "32"), NULL, 10);
+    uint32_t minutes = strtoul(option(argc, argv, 2, "--minutes", "10"), NULL, 10);
+    uint32_t log_ms = strtoul(option(argc, argv, 2, "--log", "60000"), NULL, 10);
+    if (!out || devices == 0 || log_ms == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint64_t epoch = epochMs();
+    TraceWriter writer;
+    if (!writer.open(out, epoch))
+    {
+        fprintf(stderr, "can't write %s\n", out);
+        return 1;
+    }
+    std::vector<std::string> macs;
+    for (uint32_t i = 0; i < devices; i++)
+    {
+        char mac[13];
+        snprintf(mac, sizeof(mac), "5CCF7F%06X", i & 0xFFFFFF);
+        macs.push_back(mac);
+    }
+    static const char *const metrics[] = {"temperature", "humidity", "apparent_temperature", "dew_point",
+                                          "absolute_humidity", "humidex", "light", "rssi"};
+    const uint8_t retained_qos1 = TRACE_RETAINED | (1 << TRACE_QOS_SHIFT);
+    char payload[256];
+
+    // the burst on subscribe: registry snapshot, then retained statuses and readings
+    std::string list = "{\"version\":1,\"devices\":[";
+    for (uint32_t i = 0; i < devices; i++)
+        list += (i ? "," : "") + std::string("{\"MAC_ADDRESS\":\"") + macs[i] + "\",\"NAME\":\"room " +
+                std::to_string(i) + "\",\"TYPE\":\"sensors\"}";
+    list += "]}";
+    writer.write(0, retained_qos1, "unishare/devices/all_sensors", list.data(), list.size());
+    for (uint32_t i = 0; i < devices; i++)
+    {
+        int n = snprintf(payload, sizeof(payload), "{\"connected\":true,\"version\":\"1.1.0\"}");
+        writer.write(0, retained_qos1, "unishare/devices/status/" + macs[i], payload, n);
+        for (const char *metric : metrics)
+        {
+            n = windowPayload(payload, sizeof(payload), 21.5f + i % 7, epoch - log_ms);
+            writer.write(0, retained_qos1, "unishare/sensors/" + macs[i] + "/" + metric, payload, n);
+        }
+    }
+
+    // then a light command and the live telemetry, spread over the log period
+    for (uint64_t at = 0; at < (uint64_t)minutes * 60000; at += log_ms)
+    {
+        int n = snprintf(payload, sizeof(payload), "{\"control\":\"%s\",\"id\":\"s%llu\",\"seq\":%llu}",
+                         (at / log_ms) % 2 ? "off" : "on", (unsigned long long)(at / log_ms),
+                         (unsigned long long)(epoch + at));
+        writer.write(at, retained_qos1, "unishare/control/" + macs[0] + "/light", payload, n);
+        for (uint32_t i = 0; i < devices; i++)
+        {
+            uint64_t t = at + (uint64_t)i * log_ms / devices;
+            for (const char *metric : metrics)
+            {
+                float value = 21.5f + 3 * sinf((t + i * 7919) / 600000.0f);
+                n = windowPayload(payload, sizeof(payload), value, epoch + t);
+                writer.write(t, 0, "unishare/sensors/" + macs[i] + "/" + metric, payload, n);
+            }
+        }
+    }
+    writer.close();
+    printf("%llu messages, %llu bytes\n", (unsigned long long)writer.messages(), (unsigned long long)writer.bytes());
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && !strcmp(argv[1], "record"))
+        return record(argc, argv);
+    if (argc >= 2 && !strcmp(argv[1], "replay"))
+        return replay(argc, argv);
+    if (argc >= 2 && !strcmp(argv[1], "synth"))
+        return synth(argc, argv);
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,115 @@
+#include "probe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <new>
+
+#define PROBE_PAINT 0xA5
+#define PROBE_HEADER 16 // keeps the blocks 16 byte aligned
+
+static size_t heap_live = 0;
+static size_t heap_peak = 0;
+
+alignas(16) static uint8_t probe_stack[PROBE_STACK_SIZE];
+static ucontext_t caller_context;
+static ucontext_t call_context;
+static probe_call_t pending_call;
+static void *pending_context;
+static uint64_t call_ns;
+
+static uint64_t nowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void trampoline()
+{
+    uint64_t start = nowNs();
+    pending_call(pending_context);
+    call_ns = nowNs() - start;
+}
+
+void probeRun(probe_call_t call, void *context, probe_result_t &result)
+{
+    memset(probe_stack, PROBE_PAINT, sizeof(probe_stack));
+    getcontext(&call_context);
+    call_context.uc_stack.ss_sp = probe_stack;
+    call_context.uc_stack.ss_size = sizeof(probe_stack);
+    call_context.uc_link = &caller_context;
+    makecontext(&call_context, trampoline, 0);
+    pending_call = call;
+    pending_context = context;
+
+    size_t heap_before = heap_live;
+    heap_peak = heap_live;
+    swapcontext(&caller_context, &call_context);
+
+    // the stack grows down from the end of the buffer
+    size_t untouched = 0;
+    while (untouched < sizeof(probe_stack) && probe_stack[untouched] == PROBE_PAINT)
+        untouched++;
+    result.elapsed_ns = call_ns;
+    result.stack = sizeof(probe_stack) - untouched;
+    result.heap = heap_peak - heap_before;
+}
+
+void *probeMalloc(size_t size)
+{
+    uint8_t *block = (uint8_t *)malloc(size + PROBE_HEADER);
+    if (!block)
+        return nullptr;
+    *(size_t *)block = size;
+    heap_live += size;
+    if (heap_live > heap_peak)
+        heap_peak = heap_live;
+    return block + PROBE_HEADER;
+}
+
+void probeFree(void *pointer)
+{
+    if (!pointer)
+        return;
+    uint8_t *block = (uint8_t *)pointer - PROBE_HEADER;
+    heap_live -= *(size_t *)block;
+    free(block);
+}
+
+// Every allocation of the process goes through the probe, the handlers'
+// std::string copies stand for the Arduino Strings of the firmware
+void *operator new(size_t size)
+{
+    void *pointer = probeMalloc(size);
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    probeFree(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    probeFree(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    probeFree(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    probeFree(pointer);
+}
@@ -0,0 +1,31 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Resource use of a replayed handler call.
+// The call runs on its own stack, painted with a pattern beforehand: the
+// deepest byte that changed is its stack high-water mark. Heap is the peak
+// of what it allocated on top of what was live before (String copies,
+// through the global operator new; JSON documents are in the arena).
+// Host frames are larger than the ESP8266 ones, compare the figures
+// between traces and builds rather than against the 4 KB of the device.
+
+#define PROBE_STACK_SIZE (64 * 1024)
+
+typedef struct probe_result
+{
+    uint64_t elapsed_ns;
+    size_t stack; // bytes
+    size_t heap;  // bytes
+} probe_result_t;
+
+typedef void (*probe_call_t)(void *context);
+
+void probeRun(probe_call_t call, void *context, probe_result_t &result);
+
+void *probeMalloc(size_t size);
+void probeFree(void *pointer);
+
+#endif
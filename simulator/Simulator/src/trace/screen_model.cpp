@@ -0,0 +1,121 @@
+#include "screen_model.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MQTT_TOPIC_DEVICES "unishare/devices/all_sensors"
+#define MQTT_TOPIC_DEVICES_DELTA "unishare/devices/all_sensors/delta"
+#define MQTT_TOPIC_STATUS "unishare/devices/status/"
+
+static const char *const handler_names[SCREEN_HANDLERS] = {"devices", "devices_delta", "reading", "status", "ignored"};
+
+ScreenModel::ScreenModel(uint32_t history_slot_ms)
+    : history_slot(history_slot_ms), device_index(0), display_mode(0), display_stale(false)
+{
+}
+
+const char *ScreenModel::handlerName(uint8_t handler)
+{
+    return handler < SCREEN_HANDLERS ? handler_names[handler] : "?";
+}
+
+screen_handler_t ScreenModel::classify(const std::string &topic) const
+{
+    if (topic == MQTT_TOPIC_DEVICES)
+        return SCREEN_DEVICES;
+    if (topic == MQTT_TOPIC_DEVICES_DELTA)
+        return SCREEN_DELTA;
+    if (topic.compare(0, strlen(MQTT_TOPIC_SENSORS), MQTT_TOPIC_SENSORS) == 0)
+        return SCREEN_READING;
+    if (topic.compare(0, strlen(MQTT_TOPIC_STATUS), MQTT_TOPIC_STATUS) == 0)
+        return SCREEN_STATUS;
+    return SCREEN_IGNORED;
+}
+
+void ScreenModel::handle(const std::string &topic, const char *payload, size_t length)
+{
+    switch (classify(topic))
+    {
+    case SCREEN_DEVICES:
+        table.snapshot(payload, length);
+        break;
+    case SCREEN_DELTA:
+        table.delta(payload, length);
+        break;
+    case SCREEN_READING:
+    {
+        int index = table.reading(topic.c_str(), payload, length, history_slot);
+        if (index >= 0 && index == device_index)
+            display_stale = true;
+        break;
+    }
+    case SCREEN_STATUS:
+        table.status(topic.c_str(), payload, length);
+        break;
+    default:
+        break;
+    }
+    if (device_index >= table.size())
+        device_index = 0;
+}
+
+void ScreenModel::render()
+{
+    // the firmware shows one mode at a time, the replay goes through all of them
+    const sensors_t &device = table.at(device_index);
+    uint8_t mode = display_mode;
+    display_mode = (display_mode + 1) % SCREEN_DISPLAY_MODES;
+    display_stale = false;
+
+    switch (mode)
+    {
+    case 0:
+        snprintf(lines[0], sizeof(lines[0]), "Humidity:");
+        snprintf(lines[1], sizeof(lines[1]), "%2.2f %%", device.humidity);
+        return;
+    case 1:
+        snprintf(lines[0], sizeof(lines[0]), "Temp:");
+        snprintf(lines[1], sizeof(lines[1]), "%2.2f C", device.temperature);
+        return;
+    case 2:
+        snprintf(lines[0], sizeof(lines[0]), "Apparent temp:");
+        snprintf(lines[1], sizeof(lines[1]), "%2.2f C", device.apparent_temperature);
+        return;
+    case 3:
+        snprintf(lines[0], sizeof(lines[0]), "Light:");
+        snprintf(lines[1], sizeof(lines[1]), "%s", device.light ? "ON" : "OFF");
+        return;
+    case 4:
+        snprintf(lines[0], sizeof(lines[0]), "Fire:");
+        snprintf(lines[1], sizeof(lines[1]), "%s", device.flame ? "YES" : "NO");
+        return;
+    case 5:
+        snprintf(lines[0], sizeof(lines[0]), "WiFi Signal:");
+        snprintf(lines[1], sizeof(lines[1]), "%ld dB", device.rssi);
+        return;
+    default:
+        break;
+    }
+
+    // printTrend()
+    uint8_t metric = mode - (SCREEN_DISPLAY_MODES - HISTORY_METRICS);
+    uint8_t points[HISTORY_POINTS];
+    if (!historyPoints(device.history[metric], points))
+    {
+        snprintf(lines[0], sizeof(lines[0]), "%s trend:", history_labels[metric]);
+        snprintf(lines[1], sizeof(lines[1]), "No history");
+        return;
+    }
+    uint8_t lowest, highest;
+    historyBounds(points, lowest, highest);
+    snprintf(lines[0], sizeof(lines[0]), "%s %.1f-%.1f", history_labels[metric],
+             historyValue(lowest, history_ranges[metric]), historyValue(highest, history_ranges[metric]));
+    historySparkline(points, glyphs);
+    for (uint8_t g = 0; g < HISTORY_GLYPHS; g++)
+        lines[1][g] = (char)(g + 1); // custom characters
+    unsigned long span_min = HISTORY_POINTS * (history_slot / 60000);
+    if (span_min >= 120)
+        snprintf(lines[1] + HISTORY_GLYPHS, sizeof(lines[1]) - HISTORY_GLYPHS, " %luh", span_min / 60);
+    else
+        snprintf(lines[1] + HISTORY_GLYPHS, sizeof(lines[1]) - HISTORY_GLYPHS, " %lumin", span_min);
+}
@@ -0,0 +1,51 @@
+#ifndef SCREEN_MODEL_H
+#define SCREEN_MODEL_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <device_table.h>
+
+#define SCREEN_DISPLAY_MODES (6 + HISTORY_METRICS)
+
+typedef enum screen_handler
+{
+    SCREEN_DEVICES, // registry snapshot
+    SCREEN_DELTA,   // registry change
+    SCREEN_READING,
+    SCREEN_STATUS,
+    SCREEN_IGNORED, // not subscribed, or handled by the firmware libraries (config, OTA)
+    SCREEN_HANDLERS,
+} screen_handler_t;
+
+// Screen side of a replay: messageReceived() of screen/Screen/src/main.cpp
+// on the host, dispatching to the same DeviceTable handlers as the firmware,
+// and its display rendering into a text buffer.
+class ScreenModel
+{
+public:
+    explicit ScreenModel(uint32_t history_slot_ms);
+
+    static const char *handlerName(uint8_t handler);
+    screen_handler_t classify(const std::string &topic) const;
+    // messageReceived() of the firmware
+    void handle(const std::string &topic, const char *payload, size_t length);
+    // printDisplayInfo() into a 16x2 text buffer, display modes in turn
+    void render();
+
+    bool displayStale() const { return display_stale; }
+    int devices() const { return table.size(); }
+    bool resyncRequested() const { return table.resyncPending(); }
+
+private:
+    uint32_t history_slot;
+    DeviceTable table;
+    int device_index;
+    uint8_t display_mode;
+    bool display_stale;
+    char lines[2][17];
+    uint8_t glyphs[HISTORY_GLYPHS][8];
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "sensors_model.h"
+
+#include <time.h>
+
+#include <ArduinoJson.h>
+#include <json_arena.h>
+#include <sensor_set.h>
+#include <dht11.h>
+#include <photoresistor.h>
+#include <flame.h>
+
+#define MQTT_TOPIC_TIME "unishare/time"
+
+// Metric names of the node, for the interlock and rules updates
+struct NoGpio
+{
+};
+typedef SensorSet<Dht11<NoGpio>, Photoresistor<NoGpio>, FlameDetector<NoGpio>> ModelSensors;
+
+static const char *const handler_names[SENSORS_HANDLERS] = {"light", "ac", "interlock", "rules", "time", "ignored"};
+
+SensorsModel::SensorsModel(const std::string &mac) : clean_mac_address(mac), broker_time(0), acks_queued(0)
+{
+    std::string control_topic = "unishare/control/" + mac;
+    light_control_topic = control_topic + "/light";
+    ac_control_topic = control_topic + "/ac";
+    interlock_control_topic = control_topic + "/interlock";
+    rules_control_topic = control_topic + "/rules";
+
+    actuators.begin(interlock, writeActuator, clockUs);
+    interlock.begin(interlockApply, metricIndex);
+    interlock_table_t table;
+    interlockDefaults(table);
+    interlock.load(table);
+}
+
+const char *SensorsModel::handlerName(uint8_t handler)
+{
+    return handler < SENSORS_HANDLERS ? handler_names[handler] : "?";
+}
+
+sensors_handler_t SensorsModel::classify(const std::string &topic) const
+{
+    if (topic == light_control_topic)
+        return SENSORS_LIGHT;
+    if (topic == ac_control_topic)
+        return SENSORS_AC;
+    if (topic == interlock_control_topic)
+        return SENSORS_INTERLOCK;
+    if (topic == rules_control_topic)
+        return SENSORS_RULES;
+    if (topic == MQTT_TOPIC_TIME)
+        return SENSORS_TIME;
+    return SENSORS_IGNORED;
+}
+
+void SensorsModel::handle(const std::string &topic_in, const char *payload_in, size_t length)
+{
+    // String copies of the firmware callback
+    std::string topic = topic_in;
+    std::string payload(payload_in, length);
+    unsigned long received_at = clockUs();
+
+    if (topic == light_control_topic)
+    {
+        actuators.offer(INTERLOCK_LIGHT, payload.c_str(), payload.length(), received_at);
+        return;
+    }
+    if (topic == ac_control_topic)
+    {
+        actuators.offer(INTERLOCK_AC, payload.c_str(), payload.length(), received_at);
+        return;
+    }
+    if (topic == interlock_control_topic)
+    {
+        // the firmware stores the table in flash before loading it
+        JsonScope<1024> doc;
+        interlock_table_t table;
+        if (!deserializeJson(doc, payload) && interlockParse(doc.as<JsonObjectConst>(), metricIndex, table))
+            interlock.load(table);
+        return;
+    }
+    if (topic == rules_control_topic)
+    {
+        // the firmware stores the blob in flash before the swap
+        JsonScope<1024> doc;
+        rules_blob_t blob;
+        RulesVm candidate;
+        if (!deserializeJson(doc, payload) && doc["program"].is<const char *>() &&
+            rulesUpdate(doc["program"].as<const char *>(), metricIndex, candidate, blob))
+            rules = candidate;
+        return;
+    }
+    if (topic == MQTT_TOPIC_TIME)
+    {
+        // timeSyncBroker() runs on millis(), the replay keeps the value
+        JsonScope<64> doc;
+        if (!deserializeJson(doc, payload) && doc["epoch_ms"].is<uint64_t>())
+            broker_time = doc["epoch_ms"].as<uint64_t>();
+    }
+}
+
+void SensorsModel::applyCommands()
+{
+    actuators.apply();
+    // published by sendCommandAcks() of the firmware, the replay counts them
+    acks_queued += actuators.acks();
+    actuators.clearAcks();
+}
+
+void SensorsModel::writeActuator(interlock_actuator_t actuator, bool on)
+{
+    // pins are not replayed
+    (void)actuator;
+    (void)on;
+}
+
+void SensorsModel::interlockApply(interlock_actuator_t actuator, bool on)
+{
+    // only samples trip the interlock, none are replayed
+    (void)actuator;
+    (void)on;
+}
+
+unsigned long SensorsModel::clockUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int SensorsModel::metricIndex(const char *name)
+{
+    return ModelSensors::metricIndex(name);
+}
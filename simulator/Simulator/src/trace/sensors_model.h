@@ -0,0 +1,66 @@
+#ifndef SENSORS_MODEL_H
+#define SENSORS_MODEL_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <actuators.h>
+#include <interlock.h>
+#include <rules_vm.h>
+
+typedef enum sensors_handler
+{
+    SENSORS_LIGHT,
+    SENSORS_AC,
+    SENSORS_INTERLOCK,
+    SENSORS_RULES,
+    SENSORS_TIME,
+    SENSORS_IGNORED, // other nodes, or handled by the firmware libraries (config, OTA)
+    SENSORS_HANDLERS,
+} sensors_handler_t;
+
+// Sensors node side of a replay: the control path of mqttMessageReceived()
+// in sensors/Sensors/src/main.cpp for one node (actuator commands,
+// interlock and rules updates, broker time) with the same String copies,
+// documents and handlers (Actuators, interlockParse, rulesUpdate), and the
+// control tick applying the commands. Pins and flash are not replayed.
+class SensorsModel
+{
+public:
+    explicit SensorsModel(const std::string &mac);
+
+    static const char *handlerName(uint8_t handler);
+    sensors_handler_t classify(const std::string &topic) const;
+    void handle(const std::string &topic, const char *payload, size_t length);
+    // Control tick: the newest command of every actuator, then the
+    // acknowledgements queued since the last tick
+    bool commandsPending() const { return actuators.pending() || actuators.acks() > 0; }
+    void applyCommands();
+
+    const std::string &mac() const { return clean_mac_address; }
+    uint32_t acks() const { return acks_queued; }
+    uint32_t applied() const { return actuators.applied(); }
+    uint32_t superseded() const { return actuators.superseded(); }
+    uint32_t stale() const { return actuators.stale(); }
+
+private:
+    static void writeActuator(interlock_actuator_t actuator, bool on);
+    static void interlockApply(interlock_actuator_t actuator, bool on);
+    static unsigned long clockUs();
+    static int metricIndex(const char *name);
+
+    std::string clean_mac_address;
+    std::string light_control_topic;
+    std::string ac_control_topic;
+    std::string interlock_control_topic;
+    std::string rules_control_topic;
+
+    Interlock interlock;
+    RulesVm rules;
+    Actuators actuators;
+    uint64_t broker_time;
+    uint32_t acks_queued;
+};
+
+#endif
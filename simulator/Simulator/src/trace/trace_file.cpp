@@ -0,0 +1,170 @@
+#include "trace_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+static const char trace_magic[4] = {'U', 'T', 'R', 'C'};
+
+#define TRACE_MAX_FIELD (1u << 20) // no topic or payload is that long, the file is corrupted
+
+TraceWriter::TraceWriter() : file(nullptr), last_ms(0), count(0), size(0) {}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+bool TraceWriter::open(const char *path, uint64_t start_epoch_ms)
+{
+    close();
+    file = fopen(path, "wb");
+    if (!file)
+        return false;
+    put(trace_magic, sizeof(trace_magic));
+    uint8_t header[9];
+    header[0] = TRACE_FORMAT;
+    for (int i = 0; i < 8; i++)
+        header[1 + i] = (uint8_t)(start_epoch_ms >> (8 * i));
+    put(header, sizeof(header));
+    return !ferror(file);
+}
+
+bool TraceWriter::write(uint64_t at_ms, uint8_t flags, const std::string &topic, const char *payload, size_t length)
+{
+    if (!file)
+        return false;
+    putVarint(at_ms > last_ms ? at_ms - last_ms : 0);
+    last_ms = std::max(last_ms, at_ms);
+
+    auto known = topics.find(topic);
+    flags &= TRACE_RETAINED | (0x03 << TRACE_QOS_SHIFT);
+    if (known == topics.end())
+    {
+        uint8_t record_flags = flags | TRACE_NEW_TOPIC;
+        put(&record_flags, 1);
+        putVarint(topic.size());
+        put(topic.data(), topic.size());
+        uint64_t index = topics.size();
+        topics[topic] = index;
+    }
+    else
+    {
+        put(&flags, 1);
+        putVarint(known->second);
+    }
+    putVarint(length);
+    put(payload, length);
+    count++;
+    return !ferror(file);
+}
+
+void TraceWriter::close()
+{
+    if (file)
+        fclose(file);
+    file = nullptr;
+}
+
+void TraceWriter::putVarint(uint64_t value)
+{
+    uint8_t bytes[10];
+    size_t n = 0;
+    do
+    {
+        bytes[n] = value & 0x7F;
+        value >>= 7;
+        if (value)
+            bytes[n] |= 0x80;
+        n++;
+    } while (value);
+    put(bytes, n);
+}
+
+void TraceWriter::put(const void *data, size_t length)
+{
+    fwrite(data, 1, length, file);
+    size += length;
+}
+
+TraceReader::TraceReader() : file(nullptr), start_epoch(0), at_ms(0), corrupted(false) {}
+
+TraceReader::~TraceReader()
+{
+    if (file)
+        fclose(file);
+}
+
+bool TraceReader::open(const char *path)
+{
+    file = fopen(path, "rb");
+    if (!file)
+        return false;
+    uint8_t header[sizeof(trace_magic) + 9];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, trace_magic, sizeof(trace_magic)) != 0 || header[4] != TRACE_FORMAT)
+        return false;
+    for (int i = 0; i < 8; i++)
+        start_epoch |= (uint64_t)header[5 + i] << (8 * i);
+    return true;
+}
+
+bool TraceReader::next(trace_message_t &message)
+{
+    if (!file || corrupted)
+        return false;
+    uint64_t delta;
+    int first = fgetc(file);
+    if (first == EOF)
+        return false; // clean end
+    ungetc(first, file);
+
+    int flags = EOF;
+    uint64_t index = 0;
+    bool ok = getVarint(delta) && (flags = fgetc(file)) != EOF;
+    if (ok && (flags & TRACE_NEW_TOPIC))
+    {
+        ok = getString(message.topic);
+        topics.push_back(message.topic);
+    }
+    else if (ok)
+    {
+        ok = getVarint(index) && index < topics.size();
+        if (ok)
+            message.topic = topics[index];
+    }
+    ok = ok && getString(message.payload);
+    if (!ok)
+    {
+        corrupted = true; // truncated recording (killed recorder) or not a trace
+        return false;
+    }
+    at_ms += delta;
+    message.at_ms = at_ms;
+    message.flags = flags & ~TRACE_NEW_TOPIC;
+    return true;
+}
+
+bool TraceReader::getVarint(uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(file);
+        if (c == EOF)
+            return false;
+        value |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool TraceReader::getString(std::string &value)
+{
+    uint64_t length;
+    if (!getVarint(length) || length > TRACE_MAX_FIELD)
+        return false;
+    value.resize(length);
+    return length == 0 || fread(&value[0], 1, length, file) == length;
+}
@@ -0,0 +1,79 @@
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compact MQTT trace file.
+// Header: "UTRC", format, start time (ms since the epoch, 8 bytes LE).
+// Then one record per message:
+//   varint  ms since the previous message
+//   u8      flags (bit 0 retained, bits 1-2 QoS, bit 3 new topic)
+//   varint  topic index, or for a new topic: length + bytes, which gets
+//           the next index (topics repeat a lot, most records refer back)
+//   varint  payload length + bytes
+// Integers are LEB128 varints, so a typical reading costs ~4 bytes over
+// its payload.
+
+#define TRACE_FORMAT 1
+#define TRACE_RETAINED 0x01
+#define TRACE_QOS_SHIFT 1
+#define TRACE_NEW_TOPIC 0x08
+
+typedef struct trace_message
+{
+    uint64_t at_ms; // since the start of the trace
+    uint8_t flags;
+    std::string topic;
+    std::string payload;
+} trace_message_t;
+
+class TraceWriter
+{
+public:
+    TraceWriter();
+    ~TraceWriter();
+    bool open(const char *path, uint64_t start_epoch_ms);
+    bool write(uint64_t at_ms, uint8_t flags, const std::string &topic, const char *payload, size_t length);
+    void close();
+    uint64_t messages() const { return count; }
+    uint64_t bytes() const { return size; }
+
+private:
+    void putVarint(uint64_t value);
+    void put(const void *data, size_t length);
+
+    FILE *file;
+    uint64_t last_ms;
+    uint64_t count;
+    uint64_t size;
+    std::unordered_map<std::string, uint64_t> topics; // index of each topic written so far
+};
+
+class TraceReader
+{
+public:
+    TraceReader();
+    ~TraceReader();
+    bool open(const char *path);
+    // False at the end of the trace or on a corrupted record (see failed())
+    bool next(trace_message_t &message);
+    bool failed() const { return corrupted; }
+    uint64_t startEpochMs() const { return start_epoch; }
+
+private:
+    bool getVarint(uint64_t &value);
+    bool getString(std::string &value);
+
+    FILE *file;
+    uint64_t start_epoch;
+    uint64_t at_ms;
+    bool corrupted;
+    std::vector<std::string> topics;
+};
+
+#endif
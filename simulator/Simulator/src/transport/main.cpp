@@ -0,0 +1,94 @@
+// Local link check of the sensors -> screen path on the host.
+// Publishes the largest readings the sensors firmware can produce (window
+// statistics of every metric of every driver, 12 digit MAC, timestamp)
+// through a LoopbackTransport pair, which uses the ESP-NOW frame format,
+// and verifies that each one arrives intact and in order on the other end.
+// Exits with 1 if a reading doesn't fit in a frame, so payload changes
+// that would silently stop reaching the screens are caught.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <loopback_transport.h>
+#include <sensor_set.h>
+#include <dht11.h>
+#include <sht3x.h>
+#include <bme280.h>
+#include <photoresistor.h>
+#include <flame.h>
+
+#define SENSORS_TOPIC "unishare/sensors/"
+#define WORST_MAC "AABBCCDDEEFF"
+
+struct NoGpio
+{
+};
+struct NoBus
+{
+};
+// Every metric name a node can publish
+typedef SensorSet<Dht11<NoGpio>, Sht3x<NoBus>, Bme280<NoBus>, Photoresistor<NoGpio>, FlameDetector<NoGpio>> AllSensors;
+
+static char expected_topic[TRANSPORT_FRAME_MAX];
+static char expected_payload[TRANSPORT_FRAME_MAX];
+static size_t expected_length;
+static uint32_t received;
+static uint32_t mismatched;
+
+static void screenReceived(const char *topic, const char *payload, size_t length)
+{
+    received++;
+    if (strcmp(topic, expected_topic) != 0 || length != expected_length || memcmp(payload, expected_payload, length) != 0)
+        mismatched++;
+}
+
+// Same shape as publishWindow() in the sensors firmware, with the longest
+// values ArduinoJson prints (9 significant digits, negative)
+static size_t windowPayload(char *out, size_t size)
+{
+    return snprintf(out, size,
+                    "{\"value\":-123.456789,\"min\":-123.456789,\"max\":-123.456789,\"mean\":-123.456789,"
+                    "\"stddev\":123.456789,\"count\":65535,\"ts\":1893456000000}");
+}
+
+int main()
+{
+    LoopbackTransport sensors_end;
+    LoopbackTransport screen_end;
+    sensors_end.link(screen_end);
+    screen_end.onMessage(screenReceived);
+
+    bool ok = true;
+    size_t largest = 0;
+    printf("%-22s %5s %5s\n", "metric", "frame", "free");
+    for (uint8_t m = 0; m < AllSensors::METRICS; m++)
+    {
+        const char *name = AllSensors::metric(m).name;
+        if (AllSensors::metricIndex(name) != m)
+            continue; // same metric of another driver
+        snprintf(expected_topic, sizeof(expected_topic), "%s%s/%s", SENSORS_TOPIC, WORST_MAC, name);
+        expected_length = windowPayload(expected_payload, sizeof(expected_payload));
+
+        size_t frame = TRANSPORT_FRAME_HEADER + strlen(expected_topic) + expected_length;
+        uint32_t before = received;
+        bool sent = sensors_end.publish(expected_topic, expected_payload, expected_length, false, 0);
+        screen_end.poll();
+        bool delivered = sent && received == before + 1;
+        ok = ok && delivered;
+        largest = frame > largest ? frame : largest;
+        printf("%-22s %5zu %5d%s\n", name, frame, (int)TRANSPORT_FRAME_MAX - (int)frame, delivered ? "" : "  NOT DELIVERED");
+    }
+
+    // A burst larger than the queue loses the excess, like missed broadcasts
+    for (uint8_t i = 0; i < LOOPBACK_QUEUE + 2; i++)
+        sensors_end.publish(expected_topic, expected_payload, expected_length, false, 0);
+    uint32_t before = received;
+    screen_end.poll();
+    bool burst = received - before == LOOPBACK_QUEUE && screen_end.dropped() == 2;
+    ok = ok && burst && mismatched == 0;
+
+    printf("\nlargest frame %zu of %d bytes, %u corrupted, burst of %d: %u delivered, %u dropped%s\n",
+           largest, TRANSPORT_FRAME_MAX, mismatched, LOOPBACK_QUEUE + 2, received - before, screen_end.dropped(),
+           burst ? "" : "  UNEXPECTED");
+    return ok ? 0 : 1;
+}